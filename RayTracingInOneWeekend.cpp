@@ -6,226 +6,20 @@
 #include <string>
 
 #include "util.h"
-#include "sphere.h"
-#include "moving_sphere.h"
 #include "hittable_list.h"
 #include "camera.h"
 #include "material.h"
-#include "bvh_node.h"
-#include "axis_rectangle.h"
-#include "box.h"
+#include "scenes.h"
+#include "renderer.h"
+#include "bdpt.h"
+#include "photon_map.h"
+#include "denoiser.h"
+#include "preview_server.h"
+#include "distributed.h"
 
 using std::shared_ptr;
 using std::make_shared;
 
-HittableList initial_scene()
-{
-    HittableList world;
-
-    auto checker = make_shared<CheckeredTexture>(Color(0.1, 0.1, 0.1), Color(0.9, 0.9, 0.9));
-    auto material_ground = make_shared<Lambertian>(Color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<Lambertian>(Color(0.1, 0.2, 0.5));
-    auto material_left = make_shared<Dielectric>(1.5);
-    auto material_right = make_shared<Metal>(Color(0.8, 0.6, 0.2), 0.0);
-
-    //world.add(make_shared<Sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<Sphere>(Point3(0.0, -100.5, -1.0), 100.0, make_shared<Lambertian>(checker)));
-    world.add(make_shared<Sphere>(Point3(0.0, 0.0, -1.0), 0.5, material_center));
-    world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), 0.5, material_left));
-    world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), -0.45, material_left));
-    world.add(make_shared<Sphere>(Point3(1.0, 0.0, -1.0), 0.5, material_right));
-
-    return world;
-}
-HittableList rt_one_weekend_scene() {
-    HittableList world;
-
-    auto ground_material = make_shared<Lambertian>(COLOR_GREY);
-
-    HittableList smallSpheres;
-    for (int a = -11; a < 11; a++) 
-    {
-        for (int b = -11; b < 11; b++) 
-        {
-            auto choose_mat = random_double();
-            Point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-
-            if ((center - Point3(4, 0.2, 0)).length() > 0.9) 
-            {
-                shared_ptr<Material> sphere_material;
-
-                if (choose_mat < 0.8) 
-                {
-                    // diffuse
-                    auto albedo = Color::random() * Color::random();
-                    sphere_material = make_shared<Lambertian>(albedo);
-
-                    auto center2 = center + Vec3(0, random_double(0, .5), 0);
-                    smallSpheres.add(make_shared<MovingSphere>(0.0, 1.0,
-                        center, center2,  0.2, sphere_material));
-                }
-                else if (choose_mat < 0.95) 
-                {
-                    // metal
-                    auto albedo = Color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<Metal>(albedo, fuzz);
-                    smallSpheres.add(make_shared<Sphere>(center, 0.2, sphere_material));
-                }
-                else 
-                {
-                    // glass
-                    sphere_material = make_shared<Dielectric>(1.5);
-                    smallSpheres.add(make_shared<Sphere>(center, 0.2, sphere_material));
-                }
-            }
-        }
-    }
-
-
-    HittableList largeSpheres;
-
-    auto material1 = make_shared<Dielectric>(1.5);
-    auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-
-    largeSpheres.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
-    largeSpheres.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
-    largeSpheres.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
-
-    world.add(make_shared<BvhNode>(smallSpheres, 0, 1));
-    world.add(make_shared<BvhNode>(largeSpheres, 0, 1));
-    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
-    return world;
-}
-HittableList earth_scene()
-{
-    shared_ptr<Texture> earthTexture = make_shared<ImageTexture>("textures\\earthmap.jpg");
-    shared_ptr<Material> earthMaterial = make_shared<Lambertian>(earthTexture);
-    
-    HittableList world;
-    world.add(make_shared<Sphere>(Point3(), 2, earthMaterial));
-    return world;
-}
-HittableList simple_light() 
-{
-    HittableList world;
-
-    auto checker = make_shared<CheckeredTexture>(Color(0.1, 0.1, 0.1), Color(0.9, 0.9, 0.9));
-    auto material_ground = make_shared<Lambertian>(Color(0.8, 0.8, 0.0));
-    world.add(make_shared<Sphere>(Point3(0.0, -100.5, -1.0), 100.0, make_shared<Lambertian>(checker)));
-
-    auto light_material = make_shared<Light>(COLOR_WHITE, 7);
-    auto lambertian_material = make_shared<Lambertian>(COLOR_WHITE);
-
-    world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), 0.5, lambertian_material));
-    world.add(make_shared<Sphere>(Point3(0.0, 100.0, -1.0), 50, light_material));
-    world.add(make_shared<Sphere>(Point3(1.0, 0.0, -1.0), 0.5, lambertian_material));
-
-
-    world.add(make_shared<Box>(lambertian_material, Point3(-0.2, 0, -1.4), Point3(0.2, 0.4, -1)));
-    
-    return world;
-}
-HittableList cornell_box()
-{
-    HittableList world;
-
-    auto red_material = make_shared<Lambertian>(Color(.65, .05, .05));
-    auto green_material = make_shared<Lambertian>(Color(.12, .45, .15));
-    auto white_material = make_shared<Lambertian>(Color(.73, .73, .73));
-    auto light_material = make_shared<Light>(COLOR_WHITE, 15);
-
-    //add walls
-    world.add(make_shared<Rect_xz>(light_material, 213, 343, 227, 332, 554));
-    world.add(make_shared<Rect_yz>(red_material,   0, 555, 0, 555, 555));
-    world.add(make_shared<Rect_yz>(green_material, 0, 555, 0, 555, 0));
-    world.add(make_shared<Rect_xz>(white_material, 0, 555, 0, 555, 0));
-    world.add(make_shared<Rect_xz>(white_material, 0, 555, 0, 555, 555));
-    world.add(make_shared<Rect_xy>(white_material, 0, 555, 0, 555, 555));
-
-    //Add boxes
-    world.add(make_shared<Box>(white_material, Point3(130, 0, 65), Point3(295, 165, 230)));
-    world.add(make_shared<Box>(white_material, Point3(265, 0, 295), Point3(430, 330, 460)));
-
-    return world;
-}
-HittableList rt_next_week_scene()
-{
-    HittableList boxes1;
-    auto ground = make_shared<Lambertian>(Color(0.48, 0.83, 0.53));
-
-    const int boxes_per_side = 20;
-    for (int i = 0; i < boxes_per_side; i++) {
-        for (int j = 0; j < boxes_per_side; j++) {
-            auto w = 100.0;
-            auto x0 = -1000.0 + i * w;
-            auto z0 = -1000.0 + j * w;
-            auto y0 = 0.0;
-            auto x1 = x0 + w;
-            auto y1 = random_double(1, 101);
-            auto z1 = z0 + w;
-
-            boxes1.add(make_shared<Box>(ground, Point3(x0, y0, z0), Point3(x1, y1, z1)));
-        }
-    }
-
-    HittableList objects;
-
-    objects.add(make_shared<BvhNode>(boxes1, 0, 1));
-
-    auto light = make_shared<Light>(COLOR_WHITE, 7);
-    objects.add(make_shared<Rect_xz>(light, 123, 423, 147, 412, 554));
-
-   /* auto center1 = Point3(400, 400, 200);
-    auto center2 = center1 + Vec3(30, 0, 0);
-    auto moving_sphere_material = make_shared<Lambertian>(Color(0.7, 0.3, 0.1));
-    objects.add(make_shared<MovingSphere>( 0, 1, center1, center2, 50, moving_sphere_material));
-
-    objects.add(make_shared<Sphere>(Point3(260, 150, 45), 50, make_shared<Dielectric>(1.5)));
-    objects.add(make_shared<Sphere>(Point3(0, 150, 145), 50, make_shared<Metal>(Color(0.8, 0.8, 0.9), 1.0)));
-
-    auto boundary = make_shared<Sphere>(Point3(360, 150, 145), 70, make_shared<Dielectric>(1.5));
-    objects.add(boundary);
-    //objects.add(make_shared<constant_medium>(boundary, 0.2, Color(0.2, 0.4, 0.9)));
-    boundary = make_shared<Sphere>(Point3(0, 0, 0), 5000, make_shared<Dielectric>(1.5));
-    //objects.add(make_shared<constant_medium>(boundary, .0001, Color(1, 1, 1)));
-
-    auto emat = make_shared<Lambertian>(make_shared<ImageTexture>("earthmap.jpg"));
-    objects.add(make_shared<Sphere>(Point3(400, 200, 400), 100, emat));
-    //auto pertext = make_shared<noise_texture>(0.1);
-    //objects.add(make_shared<Sphere>(Point3(220, 280, 300), 80, make_shared<Lambertian>(pertext)));
-    objects.add(make_shared<Sphere>(Point3(220, 280, 300), 80, make_shared<Lambertian>(COLOR_TEAL)));
-
-    HittableList boxes2;
-    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
-    //int ns = 1000;
-    int ns = 50;
-    for (int j = 0; j < ns; j++) 
-    {
-        boxes2.add(make_shared<Sphere>(Point3::random(0, 165), 10, white));
-    }
-
-    //objects.add(make_shared<translate>( make_shared<rotate_y>( make_shared<bvh_node>(boxes2, 0.0, 1.0), 15), vec3(-100, 270, 395) ) );
-    objects.add(make_shared<BvhNode>(boxes2, 0.0, 1.0));*/
-    return objects;
-}
-
-Color calculate_color(Color pixel_color, int samples_per_pixel)
-{
-    double avg = 1. / samples_per_pixel;
-    double r = clamp(pixel_color.x() * avg, 0., 0.999);
-    double g = clamp(pixel_color.y() * avg, 0., 0.999);
-    double b = clamp(pixel_color.z() * avg, 0., 0.999);
-
-    //gamma corrected:
-    r = std::sqrt(r);
-    g = std::sqrt(g);
-    b = std::sqrt(b);
-
-    return Color((255.999 * r),(255.999 * g), (255.999 * b));
-}
-
 void write_color(std::ofstream& out, Color pixel_color, int samples_per_pixel)
 {
     Color c = calculate_color(pixel_color, samples_per_pixel);
@@ -264,163 +58,323 @@ bool createGradientPPM(std::string filename)
     return true;
 } 
 
-Color get_ray_color(const Ray& r, const Hittable &world, int depth, const Color &backgroundColor)
+//command line options, the scene menu is skipped when --scene is given
+struct Options
+{
+    int scene = 0;
+    int samples_per_pixel = 100;
+    SampleSequence sequence = SampleSequence::Sobol;
+
+    //animation: frames first..last at fps, the camera shutter is open for a fraction of each frame
+    bool animate = false;
+    int firstFrame = 0;
+    int lastFrame = 0;
+    double fps = 24.;
+    double shutter = 0.5;
+
+    //subtrees are rebuilt when refitting makes their SAH cost this many times worse
+    double rebuildThreshold = 1.5;
+
+    //next event estimation with the emitters picked by a light BVH or uniformly, or none
+    bool sampleLights = true;
+    LightSelection lightSelection = LightSelection::Bvh;
+    //equirectangular HDR image lighting the scene instead of its background color
+    std::string environment;
+    //path guiding learned over passes of doubling sample counts
+    bool guiding = false;
+    //bidirectional path tracing, light subpaths from the emitters joined to every camera subpath
+    bool bidirectional = false;
+    //progressive photon mapping with this many photons per pass, one pass per sample
+    int photons = 0;
+
+    bool denoise = false; //filter the image guided by the first hit features
+    bool aovs = false;    //also write the albedo, normal and depth images
+
+    //progressive preview served over http instead of writing an image
+    bool preview = false;
+    int port = 8080;
+
+    //tiles rendered by this many local worker processes
+    int distributedWorkers = 0;
+    //worker process of a distributed render, failAfter tiles makes it exit early for testing
+    bool worker = false;
+    std::string coordinatorHost;
+    int coordinatorPort = 0;
+    int failAfter = -1;
+};
+
+Options parseOptions(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--scene" && i + 1 < argc)
+            options.scene = atoi(argv[++i]);
+        else if (arg == "--spp" && i + 1 < argc)
+            options.samples_per_pixel = atoi(argv[++i]);
+        else if (arg == "--sampler" && i + 1 < argc)
+        {
+            if (!parseSampleSequence(argv[++i], options.sequence))
+                std::cerr << "Unknown sampler " << argv[i] << "\n";
+        }
+        else if (arg == "--scatter-sampling" && i + 1 < argc)
+        {
+            std::string method = argv[++i];
+            scatterSampling = (method == "rejection") ? ScatterSampling::Rejection : ScatterSampling::Analytic;
+        }
+        else if (arg == "--frames" && i + 2 < argc)
+        {
+            options.animate = true;
+            options.firstFrame = atoi(argv[++i]);
+            options.lastFrame = atoi(argv[++i]);
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+            options.fps = atof(argv[++i]);
+        else if (arg == "--shutter" && i + 1 < argc)
+            options.shutter = atof(argv[++i]);
+        else if (arg == "--rebuild-threshold" && i + 1 < argc)
+            options.rebuildThreshold = atof(argv[++i]);
+        else if (arg == "--lights" && i + 1 < argc)
+        {
+            std::string lights = argv[++i];
+            options.sampleLights = lights != "none";
+            options.lightSelection = lights == "uniform" ? LightSelection::Uniform : LightSelection::Bvh;
+        }
+        else if (arg == "--environment" && i + 1 < argc)
+            options.environment = argv[++i];
+        else if (arg == "--guiding")
+            options.guiding = true;
+        else if (arg == "--bdpt")
+            options.bidirectional = true;
+        else if (arg == "--photons" && i + 1 < argc)
+            options.photons = atoi(argv[++i]);
+        else if (arg == "--denoise")
+            options.denoise = true;
+        else if (arg == "--aovs")
+            options.aovs = true;
+        else if (arg == "--preview")
+            options.preview = true;
+        else if (arg == "--port" && i + 1 < argc)
+            options.port = atoi(argv[++i]);
+        else if (arg == "--distributed" && i + 1 < argc)
+            options.distributedWorkers = atoi(argv[++i]);
+        else if (arg == "--worker" && i + 2 < argc)
+        {
+            options.worker = true;
+            options.coordinatorHost = argv[++i];
+            options.coordinatorPort = atoi(argv[++i]);
+        }
+        else if (arg == "--fail-after" && i + 1 < argc)
+            options.failAfter = atoi(argv[++i]);
+        else
+            std::cerr << "Unknown option " << arg << "\n";
+    }
+    return options;
+}
+
+//Renders the frame range keeping one BVH over the whole scene: every frame its boxes are refit for the frame's
+//shutter interval instead of building it again.
+void renderAnimation(const SceneDescription& scene, const Options& options, const RenderSettings& settings, unsigned char* image)
 {
-    HitRecord rec;
+    double frameTime = 1. / options.fps;
+    double time0 = options.firstFrame * frameTime;
+    BvhNode sceneBvh(scene.world, time0, time0 + options.shutter * frameTime);
+
+    for (int frame = options.firstFrame; frame <= options.lastFrame; frame++)
+    {
+        time0 = frame * frameTime;
+        double time1 = time0 + options.shutter * frameTime;
+        int rebuilt = sceneBvh.refit(time0, time1, options.rebuildThreshold);
+        std::cerr << "\nFrame " << frame << ": refit, " << rebuilt << " subtrees rebuilt\n";
 
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0)
-        return Color();
+        renderImage(sceneBvh, scene.camera(time0, time1), scene.background, settings, image);
 
+        char filename[64];
+        snprintf(filename, sizeof(filename), "result_images\\frame_%04d.png", frame);
+        writeImage(image, filename, settings.image_height, settings.image_width, 3);
+    }
+}
 
-    //Setting t_min = 0.001 instead of 0 gets rid of the shadow acne problem
-    if (!world.hit(r, 0.001, infinity, rec))
+//albedo, normal (mapped from [-1,1] to [0,1]) and depth (scaled by the farthest hit) images next to the result
+void writeFeatureImages(const std::vector<PixelFeatures>& features, int samples_per_pixel, const RenderSettings& settings, const std::string& baseName)
+{
+    std::vector<Color> albedo(features.size()), normal(features.size()), depth(features.size());
+    double maxDepth = 0;
+    for (const auto& f : features)
+        maxDepth = std::max(maxDepth, f.depth / samples_per_pixel);
+    for (size_t i = 0; i < features.size(); i++)
     {
-        //nothing hit, return background color
-        return backgroundColor;
+        albedo[i] = features[i].albedo / samples_per_pixel;
+        normal[i] = 0.5 * (features[i].normal / samples_per_pixel + Vec3(1, 1, 1));
+        double d = maxDepth > 0 ? features[i].depth / samples_per_pixel / maxDepth : 0.;
+        depth[i] = Color(d, d, d);
     }
 
-    Ray scattered;
-    Color attenuation; //value of obsorbed color 
-    Color emitted = rec.material_ptr->color_emitted(rec.u, rec.v, rec.p); //if Material is light emitting
-    if (rec.material_ptr->scatter(r, rec, attenuation, scattered))
+    std::vector<unsigned char> image(features.size() * 3);
+    const std::pair<const char*, const std::vector<Color>*> outputs[] = { { "_albedo.png", &albedo }, { "_normal.png", &normal }, { "_depth.png", &depth } };
+    for (const auto& output : outputs)
     {
-        return emitted + attenuation * get_ray_color(scattered, world, depth - 1, backgroundColor);
+        toImage(*output.second, 1, image.data());
+        writeImage(image.data(), (baseName + output.first).c_str(), settings.image_height, settings.image_width, 3);
     }
-    else
-        return emitted;
 }
 
-void writeImage(const unsigned char* image, const char* filename, int h, int w, int color_channels) 
+int main(int argc, char** argv)
 {
-    int result = stbi_write_png(filename, w, h, color_channels, image, 3 * w);
-    if (result == 0)
-        std::cerr << "Failed to write image.";
-}
-int main()
-{
-    // World
-    HittableList world;
-    Color background(0, 0, 0);
-
-    // Camera
-    Point3 cameraPosition(0, 0, 7);
-    Point3 cameraLookAt(0, 0, 0);
-    Vec3 cameraUp(0, 1, 0);
-    auto dist_to_focus = 10.0;
-    auto aperture = 0.1;
-    double fieldOfView_deg = 20.;
-
-    int choice = 5;
-    std::cout << "Choose scene: \n"
-        "1 - Random Scene (Book 1 cover) \n"
-        "2 - Initial Scene (3 Spheres) \n"
-        "3 - Simple light scene \n"
-        "4 - Earth Scene (with JPG Texture)\n"
-        "5 - Cornell Box \n"
-        "6 - Random Scene (Book 2 cover) \n";
-
-    std::cin >> choice;
+    Options options = parseOptions(argc, argv);
+    if (options.worker)
+        return runRenderWorker(options.coordinatorHost.c_str(), options.coordinatorPort, options.failAfter);
+    //workers only get the scene number and the render settings of the job, not the environment or the other integrators,
+    //and the coordinator only gathers the image sums, without the features or the frames of an animation
+    if (options.distributedWorkers > 0 && (!options.environment.empty() || options.guiding || options.bidirectional || options.photons > 0
+        || options.denoise || options.aovs || options.animate || options.preview))
+    {
+        std::cerr << "--distributed can't be combined with --environment, --guiding, --bdpt, --photons, --denoise, --aovs, --frames or --preview\n";
+        return 1;
+    }
+
+    int choice = options.scene;
+    if (choice == 0)
+    {
+        std::cout << "Choose scene: \n"
+            "1 - Random Scene (Book 1 cover) \n"
+            "2 - Initial Scene (3 Spheres) \n"
+            "3 - Simple light scene \n"
+            "4 - Earth Scene (with JPG Texture)\n"
+            "5 - Cornell Box \n"
+            "6 - Random Scene (Book 2 cover) \n"
+            "7 - Perlin Noise Spheres \n";
+
+        std::cin >> choice;
+    }
+
+    // World and camera
+    SceneDescription scene = load_scene(choice);
 
     //Image
     const char* imagepng = "result_images\\book1cover1.png";
-    auto aspect_ratio = 1.0;// 3.0 / 2.0;
-    int image_width = 1000;
-    int image_height = static_cast<int>(image_width / aspect_ratio);
-    size_t size = image_width * image_height * 3;
+    RenderSettings settings;
+    settings.image_width = 1000;
+    settings.image_height = static_cast<int>(settings.image_width / scene.aspect_ratio);
+    size_t size = settings.image_width * settings.image_height * 3;
     unsigned char* image = new unsigned char[size];
 
     //Rendering Parameters
-    int samples_per_pixel = 100;
-    int max_depth = 50;
-
-    switch (choice) 
+    settings.samples_per_pixel = options.samples_per_pixel;
+    settings.sequence = options.sequence;
+    settings.max_depth = 50;
+    if (!options.environment.empty())
     {
-    case 1:
-        world = rt_one_weekend_scene();
-        background = Color(0.70, 0.80, 1.00);
-        cameraPosition = Point3(13, 2, 3);
-        cameraLookAt = Point3(0, 0, 0);
-        fieldOfView_deg = 20.0;
-        aperture = 0.1;
-        break;
-
-    case 2:
-        world = initial_scene();
-        background = Color(0.70, 0.80, 1.00);
-        cameraPosition = Point3(0, 0, 7);
-        cameraLookAt = Point3(0, 0, 0);
-        fieldOfView_deg = 20.0;
-        aperture = 0.1;
-        break;
-
-    case 3:
-        world = simple_light();
-        background = Color(0.0, 0.0, 0.0);    
-        cameraLookAt = Point3(0, 0, 0);
-        fieldOfView_deg = 20.0;
-        aperture = 0.1;
-        break;
-
-    case 4:
-        world = earth_scene();
-        background = Color(0.70, 0.80, 1.00);
-        cameraPosition = Point3(13, 2, 3);
-        cameraLookAt = Point3(0, 0, 0);
-        fieldOfView_deg = 20.0;
-        break;
-
-    case 5:
-        world = cornell_box();
-        background = Color(0.1, 0.1, 0.1); //to add some light 
-        cameraPosition = Point3(278, 278, -800);
-        cameraLookAt = Point3(278, 278, 0);
-        fieldOfView_deg = 40.0;
-        break;
-    case 6:
-        world = rt_next_week_scene();
-        aspect_ratio = 1.0;
-        cameraPosition = Point3(478, 278, -600);
-        cameraLookAt = Point3(278, 278, 0);
-        fieldOfView_deg = 40.0;
-        break;
-
-    default:
-        background = Color(0.0, 0.0, 0.0);
-        break;
+        //the map is sampled next to the emitters, with --lights none it is only looked up by rays leaving the scene
+        if (auto environment = EnvironmentMap::load(options.environment.c_str()))
+        {
+            if (!scene.lights)
+                scene.lights = make_shared<LightSampler>(scene.world);
+            scene.lights->setEnvironment(environment, options.sampleLights);
+            if (!options.sampleLights)
+                scene.lights->setSelection(LightSelection::None);
+            settings.lights = scene.lights.get();
+        }
     }
+    if (scene.lights && options.sampleLights)
+    {
+        scene.lights->setSelection(options.lightSelection);
+        settings.lights = scene.lights.get();
+    }
+    if (options.photons > 0 && !(scene.lights && scene.lights->totalPower() > 0))
+        std::cerr << "The scene has no emitters to shoot photons from, it is path traced\n";
 
-
-    Camera cam(cameraPosition, cameraLookAt, cameraUp, fieldOfView_deg, aspect_ratio, dist_to_focus, aperture);
-
-    //render
-
-    for (int row = 0; row < image_height; row++)
+    if (options.preview)
+    {
+        PreviewSession session(scene, settings);
+        session.start();
+        PreviewServer server(session, options.port);
+        if (!server.run())
+            std::cerr << "Couldn't listen on port " << options.port << "\n";
+        session.stop();
+    }
+    else if (options.distributedWorkers > 0)
     {
-        std::cerr << "\rScanlines remaining: " << image_height-row << ' ' << std::flush;
-        #pragma omp parallel for
-        for (int col = 0; col < image_width; col++)
+        unsigned int threads = std::max(1u, std::thread::hardware_concurrency() / options.distributedWorkers);
+        RenderCoordinator coordinator(choice, settings.seed, settings, 64, static_cast<int>(threads));
+        std::vector<Color> sums;
+        //workers that can't be spawned may still be started by hand before the coordinator gives up waiting
+        if (coordinator.listening() && !coordinator.spawnLocalWorkers(argv[0], { "--worker" }, options.distributedWorkers))
+            std::cerr << "Couldn't start the workers, start them with: " << argv[0] << " --worker 127.0.0.1 " << coordinator.port() << "\n";
+        if (coordinator.render(sums))
         {
-            Color pixel_color(0, 0, 0);
-            #pragma omp parallel for
-            for (int s = 0; s < samples_per_pixel; s++) 
-            {
-                auto u = double(col + random_double()) / (image_width - 1);
-                auto v = double(image_height-1-row + random_double()) / (image_height - 1);
-                Ray r = cam.get_ray(u, v);
-                pixel_color += get_ray_color(r, world, max_depth, background);
-            }
-
-            Color c = calculate_color(pixel_color, samples_per_pixel);
-            
-            int x = 3 * row * image_width + 3*col;
-            image[x] = static_cast<unsigned char>(c.x());
-            image[x+1] = static_cast<unsigned char>(c.y());
-            image[x+2] = static_cast<unsigned char>(c.z());
+            toImage(sums, settings.samples_per_pixel, image);
+            writeImage(image, imagepng, settings.image_height, settings.image_width, 3);
+            const auto& stats = coordinator.getStats();
+            std::cerr << "\n" << stats.workersConnected << " workers, " << stats.workersFailed << " failed, "
+                << stats.tilesReassigned << " tiles reassigned\n";
         }
+        else
+            std::cerr << "Distributed render failed\n";
+    }
+    else if (options.animate)
+    {
+        renderAnimation(scene, options, settings, image);
     }
+    else if (options.denoise || options.aovs)
+    {
+        std::vector<Color> sums;
+        std::vector<PixelFeatures> features;
+        renderSamples(scene.world, scene.camera(), scene.background, settings, 0, settings.samples_per_pixel, sums, true, &features);
+        if (options.aovs)
+            writeFeatureImages(features, settings.samples_per_pixel, settings, "result_images\\book1cover1");
 
-    writeImage(image, imagepng, image_height, image_width, 3);
+        if (options.denoise)
+        {
+            std::vector<Color> denoised;
+            Denoiser denoiser(settings.image_width, settings.image_height);
+            denoiser.denoise(sums, features, settings.samples_per_pixel, denoised);
+            toImage(denoised, 1, image);
+        }
+        else
+            toImage(sums, settings.samples_per_pixel, image);
+        writeImage(image, imagepng, settings.image_height, settings.image_width, 3);
+    }
+    else if (options.guiding)
+    {
+        aabb bounds;
+        scene.world.boundingBox(0, 1, bounds);
+        GuidingField guiding(bounds);
+        settings.guiding = &guiding;
+        std::vector<Color> sums;
+        renderGuided(scene.world, scene.camera(), scene.background, settings, sums);
+        toImage(sums, settings.samples_per_pixel, image);
+        writeImage(image, imagepng, settings.image_height, settings.image_width, 3);
+    }
+    else if (options.bidirectional)
+    {
+        //light subpaths start on the indexed emitters even when they aren't sampled for next event estimation
+        if (scene.lights)
+            settings.lights = scene.lights.get();
+        Camera cam = scene.camera();
+        BidirectionalTracer tracer(scene.world, cam, scene.background, settings);
+        std::vector<Color> sums;
+        tracer.render(0, settings.samples_per_pixel, sums);
+        toImage(sums, settings.samples_per_pixel, image);
+        writeImage(image, imagepng, settings.image_height, settings.image_width, 3);
+    }
+    else if (options.photons > 0 && scene.lights && scene.lights->totalPower() > 0)
+    {
+        settings.lights = scene.lights.get();
+        Camera cam = scene.camera();
+        PhotonMapper mapper(scene.world, cam, scene.background, settings, options.photons);
+        mapper.render();
+        std::vector<Color> colors;
+        mapper.image(colors);
+        toImage(colors, 1, image);
+        writeImage(image, imagepng, settings.image_height, settings.image_width, 3);
+    }
+    else
+    {
+        renderImage(scene.world, scene.camera(), scene.background, settings, image);
+        writeImage(image, imagepng, settings.image_height, settings.image_width, 3);
+    }
 
     delete[] image;
 
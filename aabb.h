@@ -8,10 +8,11 @@
 class aabb
 {
 public:
+    //default box is empty (inverted), so surrounding it with another box yields that box
     aabb()
     {
-        minPoint = Point3(0, 0, 0);
-        maxPoint = Point3(0, 0, 0);
+        minPoint = Point3(infinity, infinity, infinity);
+        maxPoint = Point3(-infinity, -infinity, -infinity);
     }
 
     aabb(const Point3 &min_, const Point3 &max_) : minPoint(min_), maxPoint(max_){}
@@ -29,18 +30,18 @@ public:
         /*
         t0=min( (x0−Ax)/bx, (x1−Ax) /bx)
         t1=max((x0−Ax)/ bx, (x1−Ax) / bx)
+        the slab intervals of the three axes must overlap for the ray to hit the box
         */
         for (int i = 0; i < 3; i++)
-        {   
-            auto x0_Ax = minPoint[i] - ray.origin()[i];
-            auto x1_Ax = maxPoint[i] - ray.origin()[i];
-            auto bx = ray.direction()[i];
-            double t0 = std::min( x0_Ax / bx, x1_Ax / bx );
-            double t1 = std::max(x0_Ax / bx, x1_Ax / bx);
-
-            //if(t0 < t_min || t1 > t_max)
-            t_min = std::min(t_min, t0);
-            t_max = std::max(t_max, t1);
+        {
+            auto inv_bx = 1. / ray.direction()[i];
+            double t0 = (minPoint[i] - ray.origin()[i]) * inv_bx;
+            double t1 = (maxPoint[i] - ray.origin()[i]) * inv_bx;
+            if (inv_bx < 0.)
+                std::swap(t0, t1);
+
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
             if (t_max <= t_min)
                 return false;
         }
@@ -50,12 +51,60 @@ public:
     {
         for(int i = 0; i<3; i++)
         {
-            maxPoint[i] = std::min(minPoint[i], other.maximum()[i]);
-            maxPoint[i] = std::max(maxPoint[i], other.maximum()[i]); 
+            minPoint[i] = std::min(minPoint[i], other.minimum()[i]);
+            maxPoint[i] = std::max(maxPoint[i], other.maximum()[i]);
+        }
+    }
+    void surround(const Point3& p)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            minPoint[i] = std::min(minPoint[i], p[i]);
+            maxPoint[i] = std::max(maxPoint[i], p[i]);
         }
     }
 
+    bool empty() const
+    {
+        return minPoint.x() > maxPoint.x() || minPoint.y() > maxPoint.y() || minPoint.z() > maxPoint.z();
+    }
+
+    Point3 centroid() const
+    {
+        return 0.5 * (minPoint + maxPoint);
+    }
+
+    Vec3 extent() const
+    {
+        return maxPoint - minPoint;
+    }
+
+    //axis (0,1,2) along which the box is widest
+    int longestAxis() const
+    {
+        Vec3 e = extent();
+        if (e.x() > e.y() && e.x() > e.z())
+            return 0;
+        return e.y() > e.z() ? 1 : 2;
+    }
+
+    //used by the surface area heuristic, empty boxes have no area
+    double surfaceArea() const
+    {
+        if (empty())
+            return 0.;
+        Vec3 e = extent();
+        return 2. * (e.x() * e.y() + e.y() * e.z() + e.z() * e.x());
+    }
+
 private:
     Point3 minPoint, maxPoint;
 
-};
\ No newline at end of file
+};
+
+inline aabb surrounding_box(const aabb& box0, const aabb& box1)
+{
+    aabb box = box0;
+    box.surround(box1);
+    return box;
+}
@@ -28,6 +28,8 @@ public:
 private:
     double x0, x1, y0, y1, k;
     shared_ptr<Material> material;
+
+    friend class LightSampler;
 };
 
 bool Rect_xy::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
@@ -48,7 +50,7 @@ bool Rect_xy::hit(const Ray& r, const double& min_t, const double& max_t, HitRec
     hitrecord.t = t;
     auto outward_normal = Vec3(0, 0, 1);
     hitrecord.set_face_normal(r, outward_normal);
-    hitrecord.material_ptr = material;
+    hitrecord.material_ptr = material.get();
     hitrecord.p = r.at(t);
     return true;
 }
@@ -82,6 +84,8 @@ public:
 private:
     double x0, x1, z0, z1, k;
     shared_ptr<Material> material;
+
+    friend class LightSampler;
 };
 
 bool Rect_xz::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
@@ -102,7 +106,7 @@ bool Rect_xz::hit(const Ray& r, const double& min_t, const double& max_t, HitRec
     hitrecord.t = t;
     auto outward_normal = Vec3(0, 1, 0);
     hitrecord.set_face_normal(r, outward_normal);
-    hitrecord.material_ptr = material;
+    hitrecord.material_ptr = material.get();
     hitrecord.p = r.at(t);
     return true;
 }
@@ -136,6 +140,8 @@ public:
 private:
     double y0, y1, z0, z1, k;
     shared_ptr<Material> material;
+
+    friend class LightSampler;
 };
 
 bool Rect_yz::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
@@ -156,7 +162,7 @@ bool Rect_yz::hit(const Ray& r, const double& min_t, const double& max_t, HitRec
     hitrecord.t = t;
     auto outward_normal = Vec3(1, 0, 0);
     hitrecord.set_face_normal(r, outward_normal);
-    hitrecord.material_ptr = material;
+    hitrecord.material_ptr = material.get();
     hitrecord.p = r.at(t);
     return true;
 }
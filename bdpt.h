@@ -0,0 +1,497 @@
+#pragma once
+
+#include "renderer.h"
+#include "light_sampler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+//Image the light paths of a bidirectional render add to, at whatever pixel they reach the camera through, from all
+//render threads at once. Splats land on random pixels, two threads rarely add to the same one, so every channel is
+//an atomic float updated without locks instead of a copy of the image per thread.
+class SplatBuffer
+{
+public:
+    SplatBuffer(int width_, int height_) : width(width_), channels(size_t(3) * width_ * height_)
+    {
+        for (auto& channel : channels)
+            channel.store(0.f, std::memory_order_relaxed);
+    }
+
+    void add(int col, int row, const Color& c)
+    {
+        size_t index = 3 * (size_t(row) * width + col);
+        atomicAdd(channels[index], static_cast<float>(c.x()));
+        atomicAdd(channels[index + 1], static_cast<float>(c.y()));
+        atomicAdd(channels[index + 2], static_cast<float>(c.z()));
+    }
+
+    //adds the splats to sums, image_width * image_height colors with row 0 at the top
+    void resolve(std::vector<Color>& sums) const
+    {
+        for (size_t i = 0; i < sums.size(); i++)
+        {
+            sums[i] += Color(channels[3 * i].load(std::memory_order_relaxed), channels[3 * i + 1].load(std::memory_order_relaxed),
+                channels[3 * i + 2].load(std::memory_order_relaxed));
+        }
+    }
+
+private:
+    int width;
+    std::vector<std::atomic<float>> channels;
+};
+
+//Vertex of a camera or light subpath
+struct PathVertex
+{
+    enum class Kind
+    {
+        Camera,  //on the lens
+        Light,   //on an emitter, where a light subpath starts
+        Surface,
+        Medium
+    };
+
+    Kind kind = Kind::Surface;
+    Point3 p;
+    Vec3 n; //facing the side the path arrived from; the view direction on the lens
+    const Material* material = nullptr;
+    Color beta;    //throughput of the subpath up to the vertex
+    Color albedo;  //of a Lambertian surface
+    Color emitted; //of a light source
+    int emitter = -1; //in the LightSampler, of light vertices and surfaces on an indexed emitter
+    bool delta = false; //mirror, glass and media: their scattering can't be evaluated for a connection
+    double pdfFwd = 0; //area density of the vertex sampled from its subpath
+    double pdfRev = 0; //area density of sampling it from the other end
+
+    bool onSurface() const { return kind == Kind::Surface || kind == Kind::Light; }
+    bool connectable() const
+    {
+        return kind == Kind::Camera || kind == Kind::Light || (kind == Kind::Surface && material->type == MaterialType::Lambertian);
+    }
+};
+
+//Bidirectional path tracer (Veach 1997, as in pbrt): for every pixel sample a camera subpath and a light subpath,
+//starting on an emitter picked by its power, are traced and every prefix of one is connected to every prefix of the
+//other with a shadow ray. Paths of the same length made by different strategies are combined with the power
+//heuristic, so each light path takes the strategy that samples it best: caustics on diffuse surfaces come from
+//light subpaths through the glass connected to the camera (t = 1), whose contributions are splatted to the pixel
+//they reach. Only Lambertian vertices are connected, mirrors, glass and media only continue their subpath; fuzzy
+//metal and media are weighted as if they were specular too, which is exact for glass and polished metal only.
+//Light from the background and emitters the LightSampler doesn't index are found by camera subpaths only.
+class BidirectionalTracer
+{
+public:
+    BidirectionalTracer(const Hittable& world_, const Camera& cam_, const Color& background_, const RenderSettings& settings_)
+        : world(world_), cam(cam_), background(background_), settings(settings_), lights(settings_.lights),
+        lightPaths(settings_.lights && settings_.lights->totalPower() > 0)
+    {
+    }
+
+    //Adds samples [firstSample, firstSample + sampleCount) of every pixel to sums like renderSamples, with the
+    //contributions of light paths splatted to the pixels they reach
+    void render(int firstSample, int sampleCount, std::vector<Color>& sums, bool showProgress = true) const;
+
+private:
+    //pixel color of a camera ray, light subpath contributions to other pixels go to splats
+    Color trace(const Ray& cameraRay, SplatBuffer& splats) const;
+    void randomWalk(Ray ray, Color beta, double pdfDir, int maxVertices, std::vector<PathVertex>& path, Color* escaped) const;
+    bool sampleLightPoint(PathVertex& vertex, double time, EmissionSample& emission) const;
+    Color connect(std::vector<PathVertex>& cameraPath, std::vector<PathVertex>& lightPath, int s, int t, double time,
+        SplatBuffer& splats) const;
+    double misWeight(std::vector<PathVertex>& cameraPath, std::vector<PathVertex>& lightPath, const PathVertex& sampled, int s, int t) const;
+
+    //area density with which from samples the direction to to, a vertex on either side of it
+    double pdf(const PathVertex& from, const PathVertex* previous, const PathVertex& to) const;
+    double pdfLight(const PathVertex& light, const PathVertex& to) const;
+    double pdfLightOrigin(const PathVertex& light) const;
+    Color f(const PathVertex& vertex, const PathVertex& previous, const PathVertex& next) const;
+    double convertDensity(double pdfSolidAngle, const PathVertex& from, const PathVertex& to) const;
+    bool visible(const Point3& a, const Point3& b, double time) const;
+
+    const Hittable& world;
+    const Camera& cam;
+    Color background;
+    const RenderSettings& settings;
+    const LightSampler* lights;
+    bool lightPaths; //false without emitters to start them from
+};
+
+double BidirectionalTracer::convertDensity(double pdfSolidAngle, const PathVertex& from, const PathVertex& to) const
+{
+    Vec3 w = to.p - from.p;
+    double distanceSquared = w.length_squared();
+    if (distanceSquared == 0)
+        return 0;
+    double pdf = pdfSolidAngle / distanceSquared;
+    if (to.onSurface())
+        pdf *= std::abs(dot(to.n, w)) / std::sqrt(distanceSquared);
+    return pdf;
+}
+
+double BidirectionalTracer::pdfLight(const PathVertex& light, const PathVertex& to) const
+{
+    Vec3 w = unit_vector(to.p - light.p);
+    double pdfPosition, pdfDirection;
+    lights->emissionPdf(light.emitter, light.n, w, pdfPosition, pdfDirection);
+    return convertDensity(pdfDirection, light, to);
+}
+
+double BidirectionalTracer::pdfLightOrigin(const PathVertex& light) const
+{
+    if (!lightPaths || light.emitter < 0)
+        return 0;
+    double pdfPosition, pdfDirection;
+    lights->emissionPdf(light.emitter, light.n, light.n, pdfPosition, pdfDirection);
+    return pdfPosition;
+}
+
+double BidirectionalTracer::pdf(const PathVertex& from, const PathVertex* previous, const PathVertex& to) const
+{
+    if (from.kind == PathVertex::Kind::Light)
+        return pdfLight(from, to);
+    Vec3 w = unit_vector(to.p - from.p);
+    if (from.kind == PathVertex::Kind::Camera)
+        return convertDensity(cam.directionPdf(w, settings.image_width, settings.image_height), from, to);
+    //Lambertian, cosine weighted on the side of the other vertex
+    Vec3 back = previous->p - from.p;
+    if (dot(from.n, back) * dot(from.n, w) <= 0)
+        return 0;
+    return convertDensity(std::abs(dot(from.n, w)) / pi, from, to);
+}
+
+Color BidirectionalTracer::f(const PathVertex& vertex, const PathVertex& previous, const PathVertex& next) const
+{
+    if (dot(vertex.n, previous.p - vertex.p) <= 0 || dot(vertex.n, next.p - vertex.p) <= 0)
+        return Color(0, 0, 0);
+    return vertex.albedo / pi;
+}
+
+bool BidirectionalTracer::visible(const Point3& a, const Point3& b, double time) const
+{
+    Vec3 w = b - a;
+    double distance = w.length();
+    HitRecord blocker;
+    return !world.hit(Ray(a, w / distance, time), 0.001, distance - 0.001, blocker);
+}
+
+//Extends path from its last vertex along ray until maxVertices or a surface that doesn't scatter, pbrt's
+//RandomWalk. escaped, when given, gets the background light of a ray leaving the scene times its throughput.
+void BidirectionalTracer::randomWalk(Ray ray, Color beta, double pdfDir, int maxVertices, std::vector<PathVertex>& path,
+    Color* escaped) const
+{
+    while (static_cast<int>(path.size()) < maxVertices)
+    {
+        HitRecord rec;
+        if (!world.hit(ray, 0.001, infinity, rec))
+        {
+            if (escaped)
+                *escaped += beta * escaped_color(ray, lights, background);
+            return;
+        }
+        PathVertex vertex;
+        vertex.kind = rec.material_ptr->type == MaterialType::Isotropic ? PathVertex::Kind::Medium : PathVertex::Kind::Surface;
+        vertex.p = rec.p;
+        vertex.n = rec.normal;
+        vertex.material = rec.material_ptr;
+        vertex.beta = beta;
+        if (rec.material_ptr->type == MaterialType::Light)
+        {
+            vertex.emitted = emitted_material(rec.material_ptr, rec.u, rec.v, rec.p);
+            vertex.emitter = lights ? lights->findEmitter(rec) : -1;
+        }
+        vertex.pdfFwd = convertDensity(pdfDir, path.back(), vertex);
+        path.push_back(vertex);
+
+        //the last vertex is scattered too, for the albedo of its connections
+        Color attenuation;
+        Ray scattered;
+        if (!scatter_material(rec.material_ptr, ray, rec, attenuation, scattered))
+            return;
+        PathVertex& current = path.back();
+        if (rec.material_ptr->type == MaterialType::Lambertian)
+            current.albedo = attenuation;
+        if (static_cast<int>(path.size()) >= maxVertices)
+            return;
+        PathVertex& previous = path[path.size() - 2];
+        Vec3 wi = unit_vector(scattered.direction());
+        double pdfRev = 0;
+        if (rec.material_ptr->type == MaterialType::Lambertian)
+        {
+            pdfDir = std::max(0., dot(rec.normal, wi)) / pi;
+            pdfRev = std::max(0., dot(rec.normal, -unit_vector(ray.direction()))) / pi;
+            if (pdfDir == 0)
+                return;
+        }
+        else
+        {
+            //the placeholder 0 densities around delta vertices cancel in misWeight
+            current.delta = true;
+            pdfDir = 0;
+        }
+        beta = beta * attenuation;
+        previous.pdfRev = convertDensity(pdfRev, current, previous);
+        ray = scattered;
+    }
+}
+
+//Point of an emitter picked by power as the first vertex of a light subpath, with the direction it continues in
+bool BidirectionalTracer::sampleLightPoint(PathVertex& vertex, double time, EmissionSample& emission) const
+{
+    if (!lights->sampleEmission(time, emission))
+        return false;
+    vertex = PathVertex();
+    vertex.kind = PathVertex::Kind::Light;
+    vertex.p = emission.p;
+    vertex.n = emission.normal;
+    vertex.material = lights->emitter(emission.emitter).material;
+    vertex.emitter = static_cast<int>(emission.emitter);
+    vertex.emitted = emission.emitted;
+    vertex.pdfFwd = emission.pdfPosition;
+    vertex.beta = vertex.emitted / vertex.pdfFwd;
+    return true;
+}
+
+//Weight of strategy (s, t) by the power heuristic over all strategies that make the same path, from the ratios of
+//the densities of each strategy to its neighbour's along the path (pbrt's MISWeight). The densities at the
+//connection change with it, they are set for the call and restored after.
+double BidirectionalTracer::misWeight(std::vector<PathVertex>& cameraPath, std::vector<PathVertex>& lightPath,
+    const PathVertex& sampled, int s, int t) const
+{
+    if (s + t == 2)
+        return 1;
+
+    PathVertex savedCamera[2], savedLight[2];
+    for (int i = 0; i < 2; i++)
+    {
+        if (t - 1 - i >= 0)
+            savedCamera[i] = cameraPath[t - 1 - i];
+        if (s - 1 - i >= 0)
+            savedLight[i] = lightPath[s - 1 - i];
+    }
+    if (s == 1)
+        lightPath[0] = sampled;
+    if (t == 1)
+        cameraPath[0] = sampled;
+
+    PathVertex* pt = &cameraPath[t - 1];
+    PathVertex* ptMinus = t > 1 ? &cameraPath[t - 2] : nullptr;
+    PathVertex* qs = s > 0 ? &lightPath[s - 1] : nullptr;
+    PathVertex* qsMinus = s > 1 ? &lightPath[s - 2] : nullptr;
+
+    pt->delta = false;
+    if (qs)
+        qs->delta = false;
+    double ptRev = s > 0 ? pdf(*qs, qsMinus, *pt) : pdfLightOrigin(*pt);
+    double ptMinusRev = 0;
+    if (ptMinus)
+    {
+        if (s > 0)
+            ptMinusRev = pdf(*pt, qs, *ptMinus);
+        else
+        {
+            PathVertex light = *pt;
+            light.kind = PathVertex::Kind::Light;
+            ptMinusRev = pdfLight(light, *ptMinus);
+        }
+    }
+    double qsRev = qs ? pdf(*pt, ptMinus, *qs) : 0;
+    double qsMinusRev = qsMinus ? pdf(*qs, pt, *qsMinus) : 0;
+    pt->pdfRev = ptRev;
+    if (ptMinus)
+        ptMinus->pdfRev = ptMinusRev;
+    if (qs)
+        qs->pdfRev = qsRev;
+    if (qsMinus)
+        qsMinus->pdfRev = qsMinusRev;
+
+    auto remap0 = [](double pdf) { return pdf != 0 ? pdf : 1.; };
+    double sum = 0;
+    double ratio = 1;
+    for (int i = t - 1; i > 0; i--)
+    {
+        ratio *= remap0(cameraPath[i].pdfRev) / remap0(cameraPath[i].pdfFwd);
+        if (!cameraPath[i].delta && !cameraPath[i - 1].delta)
+            sum += ratio * ratio;
+    }
+    ratio = 1;
+    for (int i = s - 1; i >= 0; i--)
+    {
+        ratio *= remap0(lightPath[i].pdfRev) / remap0(lightPath[i].pdfFwd);
+        bool deltaBefore = i > 0 && lightPath[i - 1].delta;
+        if (!lightPath[i].delta && !deltaBefore)
+            sum += ratio * ratio;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (t - 1 - i >= 0)
+            cameraPath[t - 1 - i] = savedCamera[i];
+        if (s - 1 - i >= 0)
+            lightPath[s - 1 - i] = savedLight[i];
+    }
+    return 1. / (1. + sum);
+}
+
+//Contribution of the path made of the first s light and first t camera vertices, pbrt's ConnectBDPT. s = 1 samples
+//a new point on a light, t = 1 a new point on the lens and splats the contribution to the pixel it reaches.
+Color BidirectionalTracer::connect(std::vector<PathVertex>& cameraPath, std::vector<PathVertex>& lightPath, int s, int t,
+    double time, SplatBuffer& splats) const
+{
+    PathVertex sampled;
+    Color contribution(0, 0, 0);
+    if (s == 0)
+    {
+        //the camera subpath ends on a light
+        const PathVertex& pt = cameraPath[t - 1];
+        if (pt.kind != PathVertex::Kind::Surface || pt.material->type != MaterialType::Light)
+            return Color(0, 0, 0);
+        contribution = pt.beta * pt.emitted;
+        //emitters light subpaths can't start on
+        if (pdfLightOrigin(pt) == 0)
+            return contribution;
+    }
+    else if (t == 1)
+    {
+        const PathVertex& qs = lightPath[s - 1];
+        if (!qs.connectable())
+            return Color(0, 0, 0);
+        sampled.kind = PathVertex::Kind::Camera;
+        sampled.p = cam.sampleLens();
+        sampled.n = cam.forward();
+        sampled.beta = Color(1, 1, 1);
+        int col, row;
+        if (!cam.pixelOf(sampled.p, qs.p, settings.image_width, settings.image_height, col, row))
+            return Color(0, 0, 0);
+        Vec3 toLens = sampled.p - qs.p;
+        double distanceSquared = toLens.length_squared();
+        Vec3 w = toLens / std::sqrt(distanceSquared);
+        Color fs = s == 1 ? Color(1, 1, 1) : f(qs, lightPath[s - 2], sampled);
+        double importance = cam.directionPdf(-w, settings.image_width, settings.image_height);
+        contribution = qs.beta * fs * (std::abs(dot(qs.n, w)) / distanceSquared * importance);
+        if (contribution.near_zero() || !visible(qs.p, sampled.p, time))
+            return Color(0, 0, 0);
+        splats.add(col, row, contribution * misWeight(cameraPath, lightPath, sampled, s, t));
+        return Color(0, 0, 0);
+    }
+    else if (s == 1)
+    {
+        const PathVertex& pt = cameraPath[t - 1];
+        EmissionSample emission;
+        if (!pt.connectable() || !sampleLightPoint(sampled, time, emission))
+            return Color(0, 0, 0);
+        Vec3 w = sampled.p - pt.p;
+        double distanceSquared = w.length_squared();
+        w = w / std::sqrt(distanceSquared);
+        double g = std::abs(dot(pt.n, w)) * std::abs(dot(sampled.n, w)) / distanceSquared;
+        contribution = pt.beta * f(pt, cameraPath[t - 2], sampled) * sampled.beta * g;
+        if (contribution.near_zero() || !visible(pt.p, sampled.p, time))
+            return Color(0, 0, 0);
+    }
+    else
+    {
+        const PathVertex& qs = lightPath[s - 1];
+        const PathVertex& pt = cameraPath[t - 1];
+        if (!qs.connectable() || !pt.connectable())
+            return Color(0, 0, 0);
+        Vec3 w = qs.p - pt.p;
+        double distanceSquared = w.length_squared();
+        w = w / std::sqrt(distanceSquared);
+        double g = std::abs(dot(pt.n, w)) * std::abs(dot(qs.n, w)) / distanceSquared;
+        contribution = pt.beta * f(pt, cameraPath[t - 2], qs) * f(qs, lightPath[s - 2], pt) * qs.beta * g;
+        if (contribution.near_zero() || !visible(pt.p, qs.p, time))
+            return Color(0, 0, 0);
+    }
+    return contribution * misWeight(cameraPath, lightPath, sampled, s, t);
+}
+
+Color BidirectionalTracer::trace(const Ray& cameraRay, SplatBuffer& splats) const
+{
+    static thread_local std::vector<PathVertex> cameraPath, lightPath;
+    int maxDepth = settings.max_depth;
+    double time = cameraRay.time();
+    Color color(0, 0, 0);
+
+    //a path of n segments has n + 1 vertices, the light subpath needs one less as t >= 1
+    cameraPath.clear();
+    PathVertex lens;
+    lens.kind = PathVertex::Kind::Camera;
+    lens.p = cameraRay.origin();
+    lens.n = cam.forward();
+    lens.beta = Color(1, 1, 1);
+    cameraPath.push_back(lens);
+    Vec3 direction = unit_vector(cameraRay.direction());
+    randomWalk(Ray(cameraRay.origin(), direction, time), Color(1, 1, 1),
+        cam.directionPdf(direction, settings.image_width, settings.image_height), maxDepth + 1, cameraPath, &color);
+
+    lightPath.clear();
+    PathVertex origin;
+    EmissionSample emission;
+    if (lightPaths && sampleLightPoint(origin, time, emission))
+    {
+        lightPath.push_back(origin);
+        randomWalk(Ray(origin.p, emission.direction, time),
+            origin.beta * (std::abs(dot(origin.n, emission.direction)) / emission.pdfDirection), emission.pdfDirection, maxDepth,
+            lightPath, nullptr);
+    }
+
+    for (int t = 1; t <= static_cast<int>(cameraPath.size()); t++)
+    {
+        for (int s = 0; s <= static_cast<int>(lightPath.size()); s++)
+        {
+            //emitters seen directly are left to the camera subpath (s = 0, t = 2), as the weight of s + t = 2 is 1
+            int segments = s + t - 1;
+            if (segments < 1 || segments > maxDepth || (s == 1 && !lightPaths) || (s == 0 && t == 1) ||
+                (s == 1 && t == 1))
+                continue;
+            color += connect(cameraPath, lightPath, s, t, time, splats);
+        }
+    }
+    return color;
+}
+
+void BidirectionalTracer::render(int firstSample, int sampleCount, std::vector<Color>& sums, bool showProgress) const
+{
+    sums.resize(size_t(settings.image_width) * settings.image_height);
+    SplatBuffer splats(settings.image_width, settings.image_height);
+    PixelSampler sampler(settings.sequence, settings.samples_per_pixel, settings.seed);
+
+    const int tile_size = settings.tile_size;
+    int tilesX = (settings.image_width + tile_size - 1) / tile_size;
+    int tilesY = (settings.image_height + tile_size - 1) / tile_size;
+    int tileCount = tilesX * tilesY;
+    std::atomic<int> tilesDone(0);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int tile = 0; tile < tileCount; tile++)
+    {
+        int x0 = (tile % tilesX) * tile_size;
+        int y0 = (tile / tilesX) * tile_size;
+        int x1 = std::min(x0 + tile_size, settings.image_width);
+        int y1 = std::min(y0 + tile_size, settings.image_height);
+        static thread_local std::vector<Ray> rays;
+        cam.generateTile(x0, y0, x1, y1, settings.image_width, settings.image_height, firstSample, sampleCount, sampler, rays);
+
+        size_t ray = 0;
+        for (int row = y0; row < y1; row++)
+        {
+            for (int col = x0; col < x1; col++)
+            {
+                seed_random((uint64_t(settings.seed) << 48) ^ (uint64_t(firstSample) << 32) ^ (uint64_t(row) << 16) ^ uint64_t(col));
+                Color pixel_color(0, 0, 0);
+                for (int s = 0; s < sampleCount; s++)
+                    pixel_color += trace(rays[ray++], splats);
+                sums[size_t(row) * settings.image_width + col] += pixel_color;
+            }
+        }
+
+        int done = ++tilesDone;
+        if (showProgress)
+        {
+            #pragma omp critical
+            std::cerr << "\rTiles remaining: " << tileCount - done << ' ' << std::flush;
+        }
+    }
+    splats.resolve(sums);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "bench_util.h"
+#include "renderer.h"
+#include "bdpt.h"
+#include "scenes.h"
+
+//Glass and mirror spheres on a diffuse floor in front of a wall, lit by one small sphere light: the floor under the
+//glass sphere and the wall behind it are lit almost only through caustics
+HittableList makeCausticScene()
+{
+    HittableList objects;
+    auto white = make_shared<Lambertian>(Color(0.73, 0.73, 0.73));
+    objects.add(make_shared<Rect_xz>(white, -10, 10, -4, 10, 0));
+    objects.add(make_shared<Rect_xy>(white, -10, 10, 0, 10, -4));
+    objects.add(make_shared<Sphere>(Point3(-0.6, 1, 0), 1, make_shared<Dielectric>(1.5)));
+    objects.add(make_shared<Sphere>(Point3(1.7, 0.7, -1), 0.7, make_shared<Metal>(Color(0.9, 0.9, 0.9), 0.0)));
+    objects.add(make_shared<Sphere>(Point3(-2.5, 5, 1.5), 0.1, make_shared<Light>(COLOR_WHITE, 900)));
+    return objects;
+}
+
+//The Cornell box of scene 5 with a glass sphere on the short box
+HittableList makeCausticCornellBox()
+{
+    HittableList objects = cornell_box();
+    objects.add(make_shared<Sphere>(Point3(212, 245, 147), 80, make_shared<Dielectric>(1.5)));
+    return objects;
+}
+
+//The caustic scenes of the bdpt and photons benchmarks, lit by their emitters only
+struct CausticScene
+{
+    const char* name;
+    HittableList objects;
+    Camera cam;
+    double aspectRatio;
+};
+
+std::vector<CausticScene> makeCausticScenes()
+{
+    return {
+        { "spheres", makeCausticScene(), Camera(Point3(0, 3, 9), Point3(0, 0.8, 0), Vec3(0, 1, 0), 35, 3. / 2., 9., 0.), 3. / 2. },
+        { "cornell", makeCausticCornellBox(), Camera(Point3(278, 278, -800), Point3(278, 278, 0), Vec3(0, 1, 0), 40, 1., 10., 0.), 1. },
+    };
+}
+
+//Noise at equal render time of path tracing with next event estimation and bidirectional path tracing on two
+//caustic scenes: glass and mirror spheres lit by a small light, and the Cornell box with a glass sphere. Path
+//tracing renders the samples its measured time per sample fits in --budget-ms, so does bidirectional path tracing.
+//RMSE is against a --reference-spp bidirectional render with another seed; the mean luminance of both methods at
+//equal time shows they converge to the same image. Scenes 1 and 2 (caustics of the sky through the glass spheres of
+//the Book 1 scenes) have no emitters to start light subpaths from, bidirectional tracing can't help them.
+void benchBdpt(const BenchOptions& options)
+{
+    int width = static_cast<int>(options.get("width", 120));
+    int depth = static_cast<int>(options.get("depth", 8));
+    double budgetMs = options.get("budget-ms", 3000);
+    int referenceSpp = static_cast<int>(options.get("reference-spp", 1024));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    printf("bdpt: %d px wide, depth %d, %.0f ms per render, %d threads\n", width, depth, budgetMs, benchThreadCount());
+    printf("%-10s %-10s %8s %10s %12s %16s\n", "scene", "method", "spp", "ms", "RMSE", "mean luminance");
+
+    auto meanLuminance = [](const std::vector<Color>& sums, int spp)
+    {
+        double sum = 0;
+        for (const Color& c : sums)
+            sum += luminance(c) / spp;
+        return sum / sums.size();
+    };
+
+    const Color background(0, 0, 0);
+    std::vector<CausticScene> scenes = makeCausticScenes();
+    for (CausticScene& scene : scenes)
+    {
+        LightSampler lights(scene.objects);
+        HittableList world(make_shared<BvhNode>(scene.objects, 0, 1));
+
+        RenderSettings settings;
+        settings.image_width = width;
+        settings.image_height = static_cast<int>(width / scene.aspectRatio);
+        settings.max_depth = depth;
+        settings.seed = seed;
+        settings.lights = &lights;
+        settings.samples_per_pixel = referenceSpp;
+        BidirectionalTracer tracer(world, scene.cam, background, settings);
+        std::vector<Color> reference;
+        Timer referenceTimer;
+        tracer.render(0, referenceSpp, reference, false);
+        printf("%-10s %-10s %8d %10.0f %12s %16.5f\n", scene.name, "reference", referenceSpp, referenceTimer.elapsedMs(), "",
+            meanLuminance(reference, referenceSpp));
+
+        for (bool bidirectional : { false, true })
+        {
+            settings.seed = seed + 1;
+            //the samples that fit in the budget at the time per sample of a short probe
+            const int probeSpp = 2;
+            settings.samples_per_pixel = probeSpp;
+            std::vector<Color> probe;
+            Timer probeTimer;
+            if (bidirectional)
+                tracer.render(0, probeSpp, probe, false);
+            else
+                renderSamples(world, scene.cam, background, settings, 0, probeSpp, probe, false);
+            int spp = std::max(1, static_cast<int>(budgetMs / (probeTimer.elapsedMs() / probeSpp)));
+
+            settings.samples_per_pixel = spp;
+            std::vector<Color> sums;
+            Timer timer;
+            if (bidirectional)
+                tracer.render(0, spp, sums, false);
+            else
+                renderSamples(world, scene.cam, background, settings, 0, spp, sums, false);
+            double ms = timer.elapsedMs();
+            printf("%-10s %-10s %8d %10.0f %12.5f %16.5f\n", scene.name, bidirectional ? "bdpt" : "path", spp, ms,
+                imageRmse(sums, spp, reference, referenceSpp), meanLuminance(sums, spp));
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "bench_util.h"
+#include "bvh_node.h"
+
+//Build time of each builder from 10k up to --max-prims primitives (10M by default), and the quality of
+//the resulting trees as SAH cost and closest hit rays/sec.
+void benchBvhBuild(const BenchOptions& options)
+{
+    size_t maxPrims = options.getSize("max-prims", 10000000);
+    size_t maxMedianPrims = options.getSize("max-median-prims", 1000000);
+    size_t rayCount = options.getSize("rays", 200000);
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    struct Method
+    {
+        const char* name;
+        BvhBuildMethod method;
+    };
+    const Method methods[] = {
+        { "median", BvhBuildMethod::RandomAxisMedian },
+        { "sah", BvhBuildMethod::BinnedSAH },
+        { "lbvh", BvhBuildMethod::LBVH },
+    };
+
+    printf("bvh_build: %d threads\n", benchThreadCount());
+    printf("%-8s %10s %12s %12s %10s %14s\n", "builder", "prims", "build ms", "1 thread ms", "sah cost", "rays/sec");
+
+    for (size_t count = 10000; count <= maxPrims; count *= 10)
+    {
+        HittableList spheres = makeRandomSpheres(count, seed);
+        aabb bounds;
+        spheres.boundingBox(0, 1, bounds);
+        std::vector<Ray> rays = makeRandomRays(bounds, rayCount, seed + 1);
+
+        for (const auto& method : methods)
+        {
+            if (method.method == BvhBuildMethod::RandomAxisMedian && count > maxMedianPrims)
+                continue;
+
+            double singleThreadMs = 0;
+#ifdef _OPENMP
+            if (method.method != BvhBuildMethod::RandomAxisMedian && benchThreadCount() > 1)
+            {
+                int threads = benchThreadCount();
+                omp_set_num_threads(1);
+                Timer timer;
+                BvhNode serialTree(spheres, 0, 1, method.method);
+                singleThreadMs = timer.elapsedMs();
+                omp_set_num_threads(threads);
+            }
+#endif
+            seed_random(seed);
+            Timer timer;
+            BvhNode tree(spheres, 0, 1, method.method);
+            double buildMs = timer.elapsedMs();
+
+            double sah = tree.sahCost();
+            double raysPerSecond = measureRaysPerSecond(tree, rays);
+            printf("%-8s %10zu %12.1f %12.1f %10.2f %14.0f\n", method.name, count, buildMs, singleThreadMs, sah, raysPerSecond);
+        }
+    }
+}
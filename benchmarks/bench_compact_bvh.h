@@ -0,0 +1,90 @@
+#pragma once
+
+#include "bench_util.h"
+#include "bvh_node.h"
+#include "compact_bvh.h"
+
+//Node memory and closest hit rays/sec of BvhNode against the 8 and 16 bit quantized CompactBvh on uniformly
+//scattered spheres, from 10k to --max-prims. BvhNode memory counts the node and its shared_ptr control block,
+//CompactBvh memory its node lines; the primitives are the same for both. The mismatch column counts rays whose
+//closest hit distance differs from BvhNode's, which must be 0. Nodes/ray (RT_BVH_STATS) counts the BvhNode boxes
+//tested and the CompactBvh nodes popped, each of which tests two child boxes.
+void benchCompactBvh(const BenchOptions& options)
+{
+    size_t maxPrims = options.getSize("max-prims", 1000000);
+    size_t rayCount = options.getSize("rays", 500000);
+    int repeats = static_cast<int>(options.get("repeats", 3));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    printf("compact_bvh: %zu rays, best of %d runs, %d threads\n", rayCount, repeats, benchThreadCount());
+    printf("%-10s %-10s %10s %10s %12s %12s %14s %12s %10s\n", "spheres", "layout", "build ms", "bytes/node", "node MB", "nodes/ray", "rays/sec", "speedup", "mismatch");
+
+    for (size_t count = 10000; count <= maxPrims; count *= 10)
+    {
+        HittableList world = makeRandomSpheres(count, seed);
+        aabb bounds;
+        world.boundingBox(0, 1, bounds);
+        std::vector<Ray> rays = makeRandomRays(bounds, rayCount, seed + 1);
+
+        //closest hit distances, nodes visited per ray and best rays/sec
+        auto trace = [&](const Hittable& tree, std::vector<double>& distances, double& nodesPerRay)
+        {
+            distances.resize(rays.size());
+            long long nodes = 0;
+            #pragma omp parallel for reduction(+:nodes) schedule(dynamic, 1024)
+            for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(rays.size()); i++)
+            {
+#ifdef RT_BVH_STATS
+                long long before = bvhNodesVisited;
+#endif
+                HitRecord rec;
+                distances[i] = tree.hit(rays[i], 0.001, infinity, rec) ? rec.t : infinity;
+#ifdef RT_BVH_STATS
+                nodes += bvhNodesVisited - before;
+#endif
+            }
+            nodesPerRay = static_cast<double>(nodes) / rays.size();
+            double raysPerSecond = 0;
+            for (int r = 0; r < repeats; r++)
+                raysPerSecond = std::max(raysPerSecond, measureRaysPerSecond(tree, rays));
+            return raysPerSecond;
+        };
+
+        std::vector<double> reference, distances;
+        double nodesPerRay = 0;
+        size_t nodeCount = 0;
+        double baseRaysPerSecond = 0;
+        {
+            Timer timer;
+            BvhNode tree(world, 0, 1);
+            double buildMs = timer.elapsedMs();
+            baseRaysPerSecond = trace(tree, reference, nodesPerRay);
+            //inner nodes, the same count the compact trees end up with
+            nodeCount = count - 1;
+            size_t bytes = sizeof(BvhNode) + 16;
+            printf("%-10zu %-10s %10.1f %10zu %12.1f %12.2f %14.0f %11.2fx %10d\n", count, "BvhNode", buildMs, bytes,
+                nodeCount * bytes / (1024. * 1024.), nodesPerRay, baseRaysPerSecond, 1., 0);
+        }
+
+        auto compare = [&](const char* name, auto* tag)
+        {
+            using Tree = typename std::remove_pointer<decltype(tag)>::type;
+            Timer timer;
+            Tree tree(world, 0, 1);
+            double buildMs = timer.elapsedMs();
+            double raysPerSecond = trace(tree, distances, nodesPerRay);
+            size_t mismatches = 0;
+            for (size_t i = 0; i < rays.size(); i++)
+                mismatches += distances[i] != reference[i];
+            benchFailures += mismatches != 0;
+            printf("%-10zu %-10s %10.1f %10.1f %12.1f %12.2f %14.0f %11.2fx %10zu\n", count, name, buildMs,
+                static_cast<double>(tree.nodeBytes()) / tree.nodeCount(), tree.nodeBytes() / (1024. * 1024.), nodesPerRay,
+                raysPerSecond, raysPerSecond / baseRaysPerSecond, mismatches);
+            if (tree.nodeCount() != nodeCount)
+                printf("  node count %zu, expected %zu\n", tree.nodeCount(), nodeCount);
+        };
+        compare("compact16", static_cast<CompactBvh<uint16_t>*>(nullptr));
+        compare("compact8", static_cast<CompactBvh<uint8_t>*>(nullptr));
+    }
+    printf("build ms includes the BvhNode the compact trees are flattened from\n");
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "bench_util.h"
+#include "scenes.h"
+#include "renderer.h"
+
+//RMSE against a high sample count reference for every sample sequence at increasing samples per pixel.
+//The reference uses independent random samples so it doesn't share structure with any of the sequences.
+void benchConvergence(const BenchOptions& options)
+{
+    int sceneChoice = static_cast<int>(options.get("scene", 2));
+    int width = static_cast<int>(options.get("width", 64));
+    int referenceSpp = static_cast<int>(options.get("reference-spp", 4096));
+    int maxSpp = static_cast<int>(options.get("max-spp", 256));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    seed_random(seed);
+    SceneDescription scene = load_scene(sceneChoice);
+    Camera cam = scene.camera();
+
+    RenderSettings settings;
+    settings.image_width = width;
+    settings.image_height = static_cast<int>(width / scene.aspect_ratio);
+    settings.max_depth = 50;
+    settings.seed = seed;
+
+    settings.sequence = SampleSequence::Random;
+    settings.samples_per_pixel = referenceSpp;
+    std::vector<Color> reference;
+    renderSamples(scene.world, cam, scene.background, settings, 0, referenceSpp, reference, false);
+
+    printf("convergence: scene %d, %dx%d, reference %d spp, RMSE per sample sequence\n", sceneChoice, settings.image_width, settings.image_height, referenceSpp);
+    printf("%6s", "spp");
+    const SampleSequence sequences[] = { SampleSequence::Random, SampleSequence::Stratified, SampleSequence::Halton, SampleSequence::Sobol, SampleSequence::BlueNoise };
+    for (auto sequence : sequences)
+        printf(" %12s", sampleSequenceName(sequence));
+    printf("\n");
+
+    for (int spp = 1; spp <= maxSpp; spp *= 4)
+    {
+        printf("%6d", spp);
+        for (auto sequence : sequences)
+        {
+            settings.sequence = sequence;
+            settings.samples_per_pixel = spp;
+            settings.seed = seed + 1;
+            std::vector<Color> sums;
+            renderSamples(scene.world, cam, scene.background, settings, 0, spp, sums, false);
+            printf(" %12.5f", imageRmse(sums, spp, reference, referenceSpp));
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "bench_util.h"
+#include "scenes.h"
+#include "renderer.h"
+#include "denoiser.h"
+
+//Low sample count renders with and without the denoiser against a 100 spp render of each scene: RMSE of the
+//display colors (clamped to [0,1]) and time. The 100 spp reference is noisy itself, so a denoised image can't
+//reach 0: the last column is the RMSE of a second, independent 100 spp render, the error of a render that is as
+//good as the reference.
+void benchDenoise(const BenchOptions& options)
+{
+    int width = static_cast<int>(options.get("width", 160));
+    int referenceSpp = static_cast<int>(options.get("reference-spp", 100));
+    int lastScene = static_cast<int>(options.get("scenes", 6));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+    const int sampleCounts[] = { 8, 16 };
+
+    printf("denoise: %d px wide, RMSE against %d spp\n", width, referenceSpp);
+    printf("%-6s %5s %10s %10s %12s %10s %12s %12s\n", "scene", "spp", "raw RMSE", "denoised", "render ms", "denoise ms", "ref ms", "ref vs ref");
+
+    for (int sceneChoice = 1; sceneChoice <= lastScene; sceneChoice++)
+    {
+        seed_random(seed);
+        SceneDescription scene = load_scene(sceneChoice);
+        Camera cam = scene.camera();
+
+        RenderSettings settings;
+        settings.image_width = width;
+        settings.image_height = static_cast<int>(width / scene.aspect_ratio);
+        settings.max_depth = 50;
+        settings.seed = seed;
+
+        settings.samples_per_pixel = referenceSpp;
+        std::vector<Color> reference;
+        Timer referenceTimer;
+        renderSamples(scene.world, cam, scene.background, settings, 0, referenceSpp, reference, false);
+        double referenceMs = referenceTimer.elapsedMs();
+
+        settings.seed = seed + 2;
+        std::vector<Color> secondReference;
+        renderSamples(scene.world, cam, scene.background, settings, 0, referenceSpp, secondReference, false);
+        double referenceRmse = imageRmse(secondReference, referenceSpp, reference, referenceSpp);
+
+        for (int spp : sampleCounts)
+        {
+            settings.samples_per_pixel = spp;
+            settings.seed = seed + 1;
+            std::vector<Color> sums;
+            std::vector<PixelFeatures> features;
+            Timer renderTimer;
+            renderSamples(scene.world, cam, scene.background, settings, 0, spp, sums, false, &features);
+            double renderMs = renderTimer.elapsedMs();
+
+            std::vector<Color> denoised;
+            Timer denoiseTimer;
+            Denoiser denoiser(settings.image_width, settings.image_height);
+            denoiser.denoise(sums, features, spp, denoised);
+            double denoiseMs = denoiseTimer.elapsedMs();
+
+            printf("%-6d %5d %10.5f %10.5f %12.1f %10.1f %12.1f %12.5f\n", sceneChoice, spp, imageRmse(sums, spp, reference, referenceSpp),
+                imageRmse(denoised, 1, reference, referenceSpp), renderMs, denoiseMs, referenceMs, referenceRmse);
+        }
+    }
+}
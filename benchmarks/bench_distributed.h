@@ -0,0 +1,74 @@
+#pragma once
+
+#include "bench_util.h"
+#include "scenes.h"
+#include "renderer.h"
+#include "distributed.h"
+
+#include <algorithm>
+
+//Distributed render scaling: the same image rendered by 1..--max-workers local worker processes (this benchmark
+//binary started as "worker"), each with its share of the hardware threads, against an in-process render. The
+//workers trace the same paths, so the RMSE column only shows the float rounding of the transfer. The last run
+//has one worker exit after --fail-after tiles, its tiles are reassigned and the image must not change.
+void benchDistributed(const BenchOptions& options)
+{
+    int sceneChoice = static_cast<int>(options.get("scene", 1));
+    int width = static_cast<int>(options.get("width", 400));
+    int spp = static_cast<int>(options.get("spp", 16));
+    int maxWorkers = static_cast<int>(options.get("max-workers", 4));
+    int tileSize = static_cast<int>(options.get("tile", 32));
+    int failAfter = static_cast<int>(options.get("fail-after", 2));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    seed_random(seed);
+    SceneDescription scene = load_scene(sceneChoice);
+    RenderSettings settings;
+    settings.image_width = width;
+    settings.image_height = static_cast<int>(width / scene.aspect_ratio);
+    settings.samples_per_pixel = spp;
+    settings.max_depth = 50;
+    settings.seed = seed;
+
+    std::vector<Color> reference;
+    Timer referenceTimer;
+    renderSamples(scene.world, scene.camera(), scene.background, settings, 0, spp, reference, false);
+    double referenceMs = referenceTimer.elapsedMs();
+
+    int threads = benchThreadCount();
+    printf("distributed: scene %d, %dx%d, %d spp, %d px tiles, %d hardware threads\n", sceneChoice, settings.image_width,
+        settings.image_height, spp, tileSize, threads);
+    printf("in process: %.1f ms\n", referenceMs);
+    printf("%8s %8s %12s %9s %12s %10s %10s\n", "workers", "threads", "time ms", "speedup", "RMSE", "failed", "reassigned");
+
+    double oneWorkerMs = 0;
+    auto run = [&](int workers, bool withFailure)
+    {
+        int threadsPerWorker = std::max(1, threads / workers);
+        RenderCoordinator coordinator(sceneChoice, seed, settings, tileSize, threadsPerWorker);
+        std::vector<Color> sums;
+        Timer timer;
+        bool ok = coordinator.spawnLocalWorkers(options.program(), { "worker" }, withFailure ? workers - 1 : workers);
+        if (ok && withFailure)
+            ok = coordinator.spawnLocalWorkers(options.program(), { "worker", "--fail-after", std::to_string(failAfter) }, 1);
+        ok = ok && coordinator.render(sums, 10000.);
+        double ms = timer.elapsedMs();
+        coordinator.reapWorkers();
+        if (!ok)
+        {
+            printf("%8d render failed\n", workers);
+            return;
+        }
+        if (workers == 1)
+            oneWorkerMs = ms;
+
+        const auto& stats = coordinator.getStats();
+        printf("%8d %8d %12.1f %8.2fx %12.2e %10d %10d\n", workers, threadsPerWorker, ms, oneWorkerMs > 0 ? oneWorkerMs / ms : 0.,
+            imageRmse(sums, spp, reference, spp), stats.workersFailed, stats.tilesReassigned);
+    };
+
+    for (int workers = 1; workers <= maxWorkers; workers++)
+        run(workers, false);
+    printf("with one worker exiting after %d tiles:\n", failAfter);
+    run(std::max(2, maxWorkers), true);
+}
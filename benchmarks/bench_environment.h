@@ -0,0 +1,118 @@
+#pragma once
+
+#include "bench_util.h"
+#include "renderer.h"
+#include "light_sampler.h"
+#include "environment.h"
+#include "bench_lights.h"
+
+//Equirectangular sky of width x 2 width pixels: a gradient from a bright horizon to a blue zenith, a dim ground
+//below the horizon and a sun of sunDegrees angular radius at 40 degrees elevation carrying most of the light
+std::shared_ptr<EnvironmentMap> makeSkyMap(int width, double sunDegrees, double sunRadiance)
+{
+    int height = width / 2;
+    Vec3 sun = unit_vector(Vec3(std::cos(degreeToRadians(40.)) * std::cos(1.), std::sin(degreeToRadians(40.)),
+        std::cos(degreeToRadians(40.)) * std::sin(1.)));
+    double cosSun = std::cos(degreeToRadians(sunDegrees));
+    std::vector<Color> pixels(size_t(width) * height);
+    for (int row = 0; row < height; row++)
+    {
+        double theta = pi * (row + 0.5) / height;
+        for (int column = 0; column < width; column++)
+        {
+            double phi = 2. * pi * (column + 0.5) / width - pi;
+            Vec3 d(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            Color c;
+            if (d.y() < 0)
+                c = Color(0.2, 0.18, 0.15);
+            else
+                c = (1. - d.y()) * Color(1.0, 0.95, 0.9) + d.y() * Color(0.3, 0.5, 1.0);
+            if (dot(d, sun) >= cosSun)
+                c += Color(sunRadiance, 0.9 * sunRadiance, 0.8 * sunRadiance);
+            pixels[size_t(row) * width + column] = c;
+        }
+    }
+    return std::make_shared<EnvironmentMap>(width, height, std::move(pixels));
+}
+
+//Noise at equal samples per pixel of the diffuse Book 1 layout lit only by an environment map, either looked up
+//when a path leaves the scene (escape) or also importance sampled from its luminance CDF at every diffuse hit and
+//weighed against the escaping rays (sampled). The map is a procedural sky with a small sun (--map-width,
+//--sun-degrees, --sun) or the HDR image of --hdr. RMSE is against a --reference-spp sampled render.
+void benchEnvironment(const BenchOptions& options)
+{
+    int width = static_cast<int>(options.get("width", 120));
+    int depth = static_cast<int>(options.get("depth", 5));
+    int spp = static_cast<int>(options.get("spp", 16));
+    int referenceSpp = static_cast<int>(options.get("reference-spp", 512));
+    int mapWidth = static_cast<int>(options.get("map-width", 1024));
+    double sunDegrees = options.get("sun-degrees", 1.);
+    double sunRadiance = options.get("sun", 5000.);
+    std::string hdr = options.getString("hdr", "");
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    Timer buildTimer;
+    std::shared_ptr<EnvironmentMap> environment = hdr.empty() ? makeSkyMap(mapWidth, sunDegrees, sunRadiance)
+        : EnvironmentMap::load(hdr.c_str());
+    if (!environment)
+    {
+        benchFailures++;
+        return;
+    }
+    double buildMs = buildTimer.elapsedMs();
+
+    HittableList objects = makeManyLightsScene(0, seed);
+    LightSampler lights(objects);
+    HittableList world(make_shared<BvhNode>(objects, 0, 1));
+    Camera cam(Point3(13, 2, 3), Point3(0, 0, 0), Vec3(0, 1, 0), 20, 3. / 2., 10., 0.);
+    const Color background(0, 0, 0);
+
+    RenderSettings settings;
+    settings.image_width = width;
+    settings.image_height = width * 2 / 3;
+    settings.max_depth = depth;
+    settings.seed = seed;
+    settings.lights = &lights;
+
+    auto meanLuminance = [](const std::vector<Color>& sums, int spp)
+    {
+        double sum = 0;
+        for (const Color& c : sums)
+            sum += luminance(c) / spp;
+        return sum / sums.size();
+    };
+
+    std::vector<Color> reference;
+    lights.setEnvironment(environment, true);
+    settings.samples_per_pixel = referenceSpp;
+    Timer referenceTimer;
+    renderSamples(world, cam, background, settings, 0, referenceSpp, reference, false);
+    printf("environment: %s %dx%d map with its CDFs built in %.1f ms, %dx%d image, depth %d, %d threads\n",
+        hdr.empty() ? "procedural sky" : hdr.c_str(), environment->getWidth(), environment->getHeight(), buildMs,
+        settings.image_width, settings.image_height, depth, benchThreadCount());
+    printf("environment: reference %d spp sampled in %.0f ms, mean luminance %.5f\n", referenceSpp, referenceTimer.elapsedMs(),
+        meanLuminance(reference, referenceSpp));
+    printf("%-10s %8s %10s %12s %16s\n", "method", "spp", "ms", "RMSE", "mean luminance");
+
+    struct Method
+    {
+        const char* name;
+        bool importanceSample;
+    };
+    const Method methods[] = {
+        { "escape", false },
+        { "sampled", true },
+    };
+    for (const Method& method : methods)
+    {
+        lights.setEnvironment(environment, method.importanceSample);
+        settings.seed = seed + 1;
+        settings.samples_per_pixel = spp;
+        std::vector<Color> sums;
+        Timer timer;
+        renderSamples(world, cam, background, settings, 0, spp, sums, false);
+        double ms = timer.elapsedMs();
+        printf("%-10s %8d %10.0f %12.5f %16.5f\n", method.name, spp, ms, imageRmse(sums, spp, reference, referenceSpp),
+            meanLuminance(sums, spp));
+    }
+}
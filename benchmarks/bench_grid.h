@@ -0,0 +1,115 @@
+#pragma once
+
+#include "bench_util.h"
+#include "scenes.h"
+#include "bvh_node.h"
+#include "uniform_grid.h"
+
+//the primitives of a scene with its lists and BVHs taken apart, without the media (their hits are random)
+void flattenScene(const shared_ptr<Hittable>& object, HittableList& primitives)
+{
+    if (auto list = std::dynamic_pointer_cast<HittableList>(object))
+    {
+        for (const auto& child : list->list)
+            flattenScene(child, primitives);
+    }
+    else if (auto node = std::dynamic_pointer_cast<BvhNode>(object))
+    {
+        vector<shared_ptr<Hittable>> leaves;
+        node->collectPrimitives(leaves);
+        for (const auto& leaf : leaves)
+            flattenScene(leaf, primitives);
+    }
+    else if (!object->hitUsesRandom())
+    {
+        primitives.add(object);
+    }
+}
+
+//The same primitives in a UniformGrid and a BvhNode: the Book 1 sphere lattice and the Book 2 scene with its box
+//ground (camera rays over the image), and uniformly scattered spheres from 10k to --max-prims (random rays inside
+//the bounds). Build times are the best of --repeats, the mismatch column counts rays whose closest hit distance
+//differs between the two, which must be 0.
+void benchGrid(const BenchOptions& options)
+{
+    size_t maxPrims = options.getSize("max-prims", 100000);
+    size_t rayCount = options.getSize("rays", 500000);
+    double density = options.get("density", 4);
+    int repeats = static_cast<int>(options.get("repeats", 3));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    printf("grid: %zu rays, %.1f cells per primitive, best of %d runs, %d threads\n", rayCount, density, repeats, benchThreadCount());
+    printf("%-16s %10s %12s %12s %16s %10s %14s %14s %9s %10s\n", "scene", "prims", "bvh build ms", "grid build ms", "resolution",
+        "refs/prim", "bvh rays/sec", "grid rays/sec", "speedup", "mismatch");
+
+    auto run = [&](const std::string& name, const HittableList& primitives, const std::vector<Ray>& rays)
+    {
+        shared_ptr<BvhNode> bvh;
+        shared_ptr<UniformGrid> grid;
+        double bvhMs = infinity, gridMs = infinity;
+        for (int r = 0; r < repeats; r++)
+        {
+            bvh.reset();
+            Timer timer;
+            bvh = make_shared<BvhNode>(primitives, 0, 1);
+            bvhMs = std::min(bvhMs, timer.elapsedMs());
+        }
+        for (int r = 0; r < repeats; r++)
+        {
+            grid.reset();
+            Timer timer;
+            grid = make_shared<UniformGrid>(primitives, 0, 1, density);
+            gridMs = std::min(gridMs, timer.elapsedMs());
+        }
+
+        size_t mismatches = 0;
+        #pragma omp parallel for reduction(+:mismatches) schedule(dynamic, 1024)
+        for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(rays.size()); i++)
+        {
+            HitRecord bvhRec, gridRec;
+            double bvhT = bvh->hit(rays[i], 0.001, infinity, bvhRec) ? bvhRec.t : infinity;
+            double gridT = grid->hit(rays[i], 0.001, infinity, gridRec) ? gridRec.t : infinity;
+            mismatches += bvhT != gridT;
+        }
+        benchFailures += mismatches != 0;
+
+        double bvhRaysPerSecond = 0, gridRaysPerSecond = 0;
+        for (int r = 0; r < repeats; r++)
+        {
+            bvhRaysPerSecond = std::max(bvhRaysPerSecond, measureRaysPerSecond(*bvh, rays));
+            gridRaysPerSecond = std::max(gridRaysPerSecond, measureRaysPerSecond(*grid, rays));
+        }
+        const int* cells = grid->resolution();
+        std::string resolution = std::to_string(cells[0]) + "x" + std::to_string(cells[1]) + "x" + std::to_string(cells[2]);
+        size_t binned = primitives.list.size() - grid->unbinnedCount();
+        printf("%-16s %10zu %12.2f %12.2f %16s %10.2f %14.0f %14.0f %8.2fx %10zu\n", name.c_str(), primitives.list.size(), bvhMs, gridMs,
+            resolution.c_str(), binned ? static_cast<double>(grid->referenceCount()) / binned : 0., bvhRaysPerSecond, gridRaysPerSecond,
+            gridRaysPerSecond / bvhRaysPerSecond, mismatches);
+    };
+
+    const std::pair<const char*, int> scenes[] = { { "book1_lattice", 1 }, { "book2_boxes", 6 } };
+    for (const auto& entry : scenes)
+    {
+        seed_random(seed);
+        SceneDescription scene = load_scene(entry.second);
+        HittableList primitives;
+        flattenScene(make_shared<HittableList>(scene.world), primitives);
+
+        Camera cam = scene.camera();
+        std::vector<Ray> rays;
+        rays.reserve(rayCount);
+        seed_random(seed + 1);
+        for (size_t i = 0; i < rayCount; i++)
+            rays.push_back(cam.get_ray(random_double(), random_double()));
+        run(entry.first, primitives, rays);
+    }
+
+    for (size_t count = 10000; count <= maxPrims; count *= 10)
+    {
+        HittableList spheres = makeRandomSpheres(count, seed);
+        aabb bounds;
+        spheres.boundingBox(0, 1, bounds);
+        run("spheres_" + std::to_string(count), spheres, makeRandomRays(bounds, rayCount, seed + 1));
+    }
+    printf("refs/prim: cell references per primitive in the grid, primitives much larger than the median are tested by every ray\n");
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "bench_util.h"
+#include "renderer.h"
+#include "guiding.h"
+#include "scenes.h"
+
+//Noise at equal render time of scenes 3 (simple light) and 5 (Cornell box) path traced with and without path
+//guiding, both with next event estimation (nee) and without it (bsdf). Plain path tracing renders the samples its
+//measured time per sample fits in --budget-ms, guided rendering runs passes of doubling sample counts, refining
+//the guiding field after each, until the budget is used. RMSE is against a --reference-spp render with next event
+//estimation.
+void benchGuiding(const BenchOptions& options)
+{
+    int width = static_cast<int>(options.get("width", 100));
+    int depth = static_cast<int>(options.get("depth", 8));
+    double budgetMs = options.get("budget-ms", 3000);
+    int referenceSpp = static_cast<int>(options.get("reference-spp", 1024));
+    double spatialThreshold = options.get("spatial-threshold", 1000);
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    printf("guiding: %d px wide, depth %d, %.0f ms per render, %d threads\n", width, depth, budgetMs, benchThreadCount());
+    printf("%-6s %-12s %8s %10s %10s %12s %16s\n", "scene", "method", "spp", "ms", "leaves", "RMSE", "mean luminance");
+
+    auto meanLuminance = [](const std::vector<Color>& sums, int spp)
+    {
+        double sum = 0;
+        for (const Color& c : sums)
+            sum += luminance(c) / spp;
+        return sum / sums.size();
+    };
+
+    for (int choice : { 3, 5 })
+    {
+        SceneDescription scene = load_scene(choice);
+        HittableList world(make_shared<BvhNode>(scene.world, 0, 1));
+        Camera cam = scene.camera();
+        aabb bounds;
+        world.boundingBox(0, 1, bounds);
+
+        RenderSettings settings;
+        settings.image_width = width;
+        settings.image_height = static_cast<int>(width / scene.aspect_ratio);
+        settings.max_depth = depth;
+        settings.seed = seed;
+        settings.lights = scene.lights.get();
+        settings.samples_per_pixel = referenceSpp;
+        std::vector<Color> reference;
+        renderSamples(world, cam, scene.background, settings, 0, referenceSpp, reference, false);
+        printf("%-6d %-12s %8d %10s %10s %12s %16.5f\n", choice, "reference", referenceSpp, "", "", "", meanLuminance(reference, referenceSpp));
+
+        for (bool sampleLights : { true, false })
+        {
+            settings.lights = sampleLights ? scene.lights.get() : nullptr;
+            settings.seed = seed + 1;
+
+            //plain: the samples that fit in the budget at the time per sample of a short probe
+            const int probeSpp = 2;
+            settings.guiding = nullptr;
+            settings.samples_per_pixel = probeSpp;
+            std::vector<Color> probe;
+            Timer probeTimer;
+            renderSamples(world, cam, scene.background, settings, 0, probeSpp, probe, false);
+            int spp = std::max(1, static_cast<int>(budgetMs / (probeTimer.elapsedMs() / probeSpp)));
+            settings.samples_per_pixel = spp;
+            std::vector<Color> sums;
+            Timer timer;
+            renderSamples(world, cam, scene.background, settings, 0, spp, sums, false);
+            double ms = timer.elapsedMs();
+            printf("%-6d %-12s %8d %10.0f %10s %12.5f %16.5f\n", choice, sampleLights ? "nee" : "bsdf", spp, ms, "",
+                imageRmse(sums, spp, reference, referenceSpp), meanLuminance(sums, spp));
+
+            //guided: passes of doubling samples, the last one cut to the time left at the previous pass's speed
+            GuidingField guiding(bounds, spatialThreshold);
+            settings.guiding = &guiding;
+            //samples_per_pixel stays the plain count, only the strata of the stratified sequence depend on it
+            sums.assign(size_t(settings.image_width) * settings.image_height, Color(0, 0, 0));
+            int samples = 0;
+            int passSamples = 1;
+            Timer guidedTimer;
+            while (guidedTimer.elapsedMs() < budgetMs)
+            {
+                Timer passTimer;
+                renderSamples(world, cam, scene.background, settings, samples, passSamples, sums, false);
+                guiding.refine();
+                samples += passSamples;
+                double msPerSample = passTimer.elapsedMs() / passSamples;
+                int remaining = static_cast<int>((budgetMs - guidedTimer.elapsedMs()) / msPerSample);
+                passSamples = std::min(2 * passSamples, remaining);
+                if (passSamples <= 0)
+                    break;
+            }
+            ms = guidedTimer.elapsedMs();
+            printf("%-6d %-12s %8d %10.0f %10zu %12.5f %16.5f\n", choice, sampleLights ? "nee+guided" : "bsdf+guided", samples, ms,
+                guiding.leafCount(), imageRmse(sums, samples, reference, referenceSpp), meanLuminance(sums, samples));
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "bench_util.h"
+#include "bvh_node.h"
+#include "instance.h"
+
+//Two level scene: one bottom level BVH over a sphere cluster referenced by many transformed instances in a top
+//level BVH, against flattening every instance into world space spheres under a single BVH. Flattening is only
+//built up to --max-flat spheres and extrapolated linearly beyond that.
+void benchInstancing(const BenchOptions& options)
+{
+    size_t clusterSize = options.getSize("cluster", 10000);
+    size_t instanceCount = options.getSize("instances", 10000);
+    size_t maxFlat = options.getSize("max-flat", 2000000);
+    size_t rayCount = options.getSize("rays", 200000);
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    //instances on a jittered grid with random orientation, far enough apart not to overlap
+    seed_random(seed);
+    HittableList cluster = makeRandomSpheres(clusterSize, seed);
+    aabb clusterBox;
+    cluster.boundingBox(0, 1, clusterBox);
+    double spacing = 1.5 * clusterBox.extent().length();
+    int perSide = static_cast<int>(std::ceil(std::cbrt(static_cast<double>(instanceCount))));
+
+    std::vector<Transform> transforms;
+    for (size_t i = 0; i < instanceCount; i++)
+    {
+        Vec3 cell(double(i % perSide), double((i / perSide) % perSide), double(i / (perSide * perSide)));
+        transforms.push_back(Transform::translate(spacing * cell) * Transform::rotateY(random_double(0, 360)) * Transform::rotateX(random_double(0, 360)));
+    }
+
+    printf("instancing: %zu instances of a %zu sphere cluster, %d threads\n", instanceCount, clusterSize, benchThreadCount());
+    printf("%-12s %14s %12s %12s %14s\n", "layout", "spheres", "build ms", "memory MB", "rays/sec");
+
+    size_t rssBefore = currentRssBytes();
+    Timer timer;
+    auto bottomLevel = make_shared<BvhNode>(cluster, 0, 1);
+    HittableList instances;
+    for (const auto& transform : transforms)
+        instances.add(make_shared<Instance>(bottomLevel, transform));
+    BvhNode topLevel(instances, 0, 1);
+    double instancedMs = timer.elapsedMs();
+    double instancedMb = (currentRssBytes() - rssBefore) / (1024. * 1024.);
+
+    aabb sceneBox;
+    topLevel.boundingBox(0, 1, sceneBox);
+    std::vector<Ray> rays = makeRandomRays(sceneBox, rayCount, seed + 1);
+    printf("%-12s %14zu %12.1f %12.1f %14.0f\n", "instanced", clusterSize * instanceCount, instancedMs, instancedMb, measureRaysPerSecond(topLevel, rays));
+
+    //flatten as many whole instances as fit under max-flat
+    size_t flatInstances = std::min(instanceCount, std::max<size_t>(1, maxFlat / std::max<size_t>(1, clusterSize)));
+    rssBefore = currentRssBytes();
+    timer = Timer();
+    HittableList flattened;
+    flattened.list.reserve(flatInstances * clusterSize);
+    auto material = make_shared<Lambertian>(COLOR_GREY);
+    for (size_t i = 0; i < flatInstances; i++)
+    {
+        for (const auto& object : cluster.list)
+        {
+            aabb box;
+            object->boundingBox(0, 1, box);
+            double radius = 0.5 * box.extent().x();
+            flattened.add(make_shared<Sphere>(transforms[i].point(box.centroid()), radius, material));
+        }
+    }
+    BvhNode flatTree(flattened, 0, 1);
+    double flatMs = timer.elapsedMs();
+    double flatMb = (currentRssBytes() - rssBefore) / (1024. * 1024.);
+
+    flatTree.boundingBox(0, 1, sceneBox);
+    std::vector<Ray> flatRays = makeRandomRays(sceneBox, rayCount, seed + 1);
+    printf("%-12s %14zu %12.1f %12.1f %14.0f\n", "flattened", flatInstances * clusterSize, flatMs, flatMb, measureRaysPerSecond(flatTree, flatRays));
+
+    if (flatInstances < instanceCount)
+    {
+        double factor = double(instanceCount) / flatInstances;
+        printf("%-12s %14zu %12.1f %12.1f %14s  (extrapolated)\n", "flattened", instanceCount * clusterSize, flatMs * factor, flatMb * factor, "-");
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "bench_util.h"
+#include "renderer.h"
+#include "bvh_node.h"
+#include "lazy_bvh.h"
+
+//field of spheres on the ground, count of them over a square with about one per 4 square units
+HittableList makeSphereField(size_t count, unsigned int seed)
+{
+    seed_random(seed);
+    HittableList spheres;
+    spheres.list.reserve(count);
+    double side = 2. * std::sqrt(static_cast<double>(count));
+    auto material = make_shared<Lambertian>(COLOR_GREY);
+    for (size_t i = 0; i < count; i++)
+    {
+        double radius = random_double(0.2, 1.);
+        spheres.add(make_shared<Sphere>(Point3(random_double(0, side), radius, random_double(0, side)), radius, material));
+    }
+    return spheres;
+}
+
+//Time to the first pixels and to the whole image of a field of --prims spheres with a BvhNode built up front and
+//with a LazyBvh, for a camera looking down at a small part of the field and one looking at all of it. First tile
+//is the build plus the 16x16 tile in the middle of the image, total the build plus the whole image. The images of
+//the two trees must be the same, the last column counts differing pixels.
+void benchLazyBvh(const BenchOptions& options)
+{
+    size_t primCount = options.getSize("prims", 1000000);
+    size_t subtreeSize = options.getSize("subtree", 4096);
+    int width = static_cast<int>(options.get("width", 160));
+    int spp = static_cast<int>(options.get("spp", 4));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    HittableList spheres = makeSphereField(primCount, seed);
+    aabb bounds;
+    spheres.boundingBox(0, 1, bounds);
+    Point3 center = bounds.centroid();
+    double side = bounds.extent().x();
+    const Color background(0.70, 0.80, 1.00);
+
+    printf("lazy_bvh: %zu spheres, subtrees of %zu, %d px wide, %d spp, %d threads\n", primCount, subtreeSize, width, spp, benchThreadCount());
+    printf("%-10s %-8s %12s %14s %12s %16s %10s\n", "camera", "tree", "build ms", "first tile ms", "total ms", "subtrees built", "mismatch");
+
+    struct View
+    {
+        const char* name;
+        Point3 from, at;
+        double fov;
+    };
+    const View views[] = {
+        { "closeup", center + Vec3(0, 10, -20), center, 30 },
+        { "overview", center + Vec3(0, 1.2 * side, -0.6 * side), center, 50 },
+    };
+    for (const View& view : views)
+    {
+        Camera cam(view.from, view.at, Vec3(0, 1, 0), view.fov, 1.0, 10.0, 0.0, 0, 1);
+        RenderSettings settings;
+        settings.image_width = width;
+        settings.image_height = width;
+        settings.samples_per_pixel = spp;
+        settings.max_depth = 8;
+        settings.seed = seed;
+        PixelSampler sampler(settings.sequence, spp, seed);
+        int tileX = width / 2 - 8, tileY = width / 2 - 8;
+
+        std::vector<Color> images[2];
+        for (int lazy = 0; lazy < 2; lazy++)
+        {
+            Timer timer;
+            shared_ptr<Hittable> world;
+            shared_ptr<LazyBvh> lazyTree;
+            if (lazy)
+                world = lazyTree = make_shared<LazyBvh>(spheres, 0, 1, subtreeSize);
+            else
+                world = make_shared<BvhNode>(spheres, 0, 1);
+            double buildMs = timer.elapsedMs();
+
+            std::vector<Color> tile(size_t(width) * width);
+            renderTile(*world, cam, background, settings, sampler, tileX, tileY, tileX + 16, tileY + 16, 0, spp, tile.data());
+            double firstMs = timer.elapsedMs();
+
+            renderSamples(*world, cam, background, settings, 0, spp, images[lazy], false);
+            double totalMs = timer.elapsedMs();
+
+            std::string built = lazyTree ? std::to_string(lazyTree->builtCount()) + "/" + std::to_string(lazyTree->subtreeCount()) : "-";
+            size_t mismatches = 0;
+            if (lazy)
+            {
+                for (size_t i = 0; i < images[0].size(); i++)
+                    mismatches += (images[0][i] - images[1][i]).length_squared() != 0;
+            }
+            benchFailures += mismatches != 0;
+            printf("%-10s %-8s %12.1f %14.1f %12.1f %16s %10zu\n", view.name, lazy ? "lazy" : "eager", buildMs, firstMs, totalMs, built.c_str(), mismatches);
+        }
+    }
+}
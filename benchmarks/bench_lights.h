@@ -0,0 +1,121 @@
+#pragma once
+
+#include "bench_util.h"
+#include "renderer.h"
+#include "light_sampler.h"
+
+//Book 1 layout at night, all diffuse: a ground, the three big spheres and small ones around them, lit by lightCount
+//tiny emissive spheres scattered over a square of about one per square unit above the view, most of them dim and
+//a few bright. The mirror and glass spheres are left out, their reflections of the lights would be as noisy with
+//any light selection.
+HittableList makeManyLightsScene(size_t lightCount, unsigned int seed)
+{
+    seed_random(seed);
+    HittableList world;
+    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+    for (int a = -11; a < 11; a += 2)
+    {
+        for (int b = -11; b < 11; b += 2)
+        {
+            Point3 center(a + 1.6 * random_double(), 0.2, b + 1.6 * random_double());
+            world.add(make_shared<Sphere>(center, 0.2, make_shared<Lambertian>(Color::random() * Color::random())));
+        }
+    }
+    world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, make_shared<Lambertian>(Color(0.8, 0.8, 0.8))));
+    world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, make_shared<Lambertian>(Color(0.4, 0.2, 0.1))));
+    world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, make_shared<Lambertian>(Color(0.7, 0.6, 0.5))));
+
+    double side = std::sqrt(static_cast<double>(lightCount));
+    for (size_t i = 0; i < lightCount; i++)
+    {
+        double radius = random_double(0.01, 0.03);
+        Point3 center(random_double(-side / 2, side / 2), random_double(4., 6.), random_double(-side / 2, side / 2));
+        //the same power as spheres of radius 0.05, the smaller the lights the harder for scattered rays to find
+        double intensity = (5. + 500. * std::pow(random_double(), 16.)) * (0.05 * 0.05) / (radius * radius);
+        Color color = 0.5 * (Color(1, 1, 1) + Color::random());
+        world.add(make_shared<Sphere>(center, radius, make_shared<Light>(intensity * color)));
+    }
+    return world;
+}
+
+//Noise at equal render time of paths finding lights only by scattering (none) and with next event estimation
+//picking one of --lights emissive spheres uniformly or with the light BVH. The time per sample of every method
+//is measured first, then each renders the samples that fit in --budget-ms. RMSE is against a --reference-spp
+//render with the light BVH, the mean luminance of all should agree with it.
+void benchLights(const BenchOptions& options)
+{
+    size_t lightCount = options.getSize("lights", 10000);
+    int width = static_cast<int>(options.get("width", 120));
+    int depth = static_cast<int>(options.get("depth", 5));
+    double budgetMs = options.get("budget-ms", 2000);
+    int referenceSpp = static_cast<int>(options.get("reference-spp", 256));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    HittableList objects = makeManyLightsScene(lightCount, seed);
+    Timer buildTimer;
+    LightSampler lights(objects);
+    double lightBuildMs = buildTimer.elapsedMs();
+    HittableList world(make_shared<BvhNode>(objects, 0, 1));
+    Camera cam(Point3(13, 2, 3), Point3(0, 0, 0), Vec3(0, 1, 0), 20, 3. / 2., 10., 0.);
+    const Color background(0, 0, 0);
+
+    RenderSettings settings;
+    settings.image_width = width;
+    settings.image_height = width * 2 / 3;
+    settings.max_depth = depth;
+    settings.seed = seed;
+
+    auto meanLuminance = [](const std::vector<Color>& sums, int spp)
+    {
+        double sum = 0;
+        for (const Color& c : sums)
+            sum += luminance(c) / spp;
+        return sum / sums.size();
+    };
+
+    std::vector<Color> reference;
+    lights.setSelection(LightSelection::Bvh);
+    settings.lights = &lights;
+    settings.samples_per_pixel = referenceSpp;
+    Timer referenceTimer;
+    renderSamples(world, cam, background, settings, 0, referenceSpp, reference, false);
+    printf("lights: %zu emissive spheres, light BVH of %zu nodes built in %.1f ms, %dx%d, depth %d, %d threads\n",
+        lights.emitterCount(), lights.nodeCount(), lightBuildMs, settings.image_width, settings.image_height, depth, benchThreadCount());
+    printf("lights: reference %d spp with the light BVH in %.0f ms, mean luminance %.5f\n", referenceSpp, referenceTimer.elapsedMs(),
+        meanLuminance(reference, referenceSpp));
+    printf("%-10s %12s %8s %10s %12s %16s\n", "selection", "ms/spp", "spp", "ms", "RMSE", "mean luminance");
+
+    struct Method
+    {
+        const char* name;
+        bool sampleLights;
+        LightSelection selection;
+    };
+    const Method methods[] = {
+        { "none", false, LightSelection::Uniform },
+        { "uniform", true, LightSelection::Uniform },
+        { "bvh", true, LightSelection::Bvh },
+    };
+    for (const Method& method : methods)
+    {
+        lights.setSelection(method.selection);
+        settings.lights = method.sampleLights ? &lights : nullptr;
+        settings.seed = seed + 1;
+
+        const int probeSpp = 2;
+        settings.samples_per_pixel = probeSpp;
+        std::vector<Color> probe;
+        Timer probeTimer;
+        renderSamples(world, cam, background, settings, 0, probeSpp, probe, false);
+        double msPerSample = probeTimer.elapsedMs() / probeSpp;
+
+        int spp = std::max(1, static_cast<int>(budgetMs / msPerSample));
+        settings.samples_per_pixel = spp;
+        std::vector<Color> sums;
+        Timer timer;
+        renderSamples(world, cam, background, settings, 0, spp, sums, false);
+        double ms = timer.elapsedMs();
+        printf("%-10s %12.1f %8d %10.0f %12.5f %16.5f\n", method.name, msPerSample, spp, ms, imageRmse(sums, spp, reference, referenceSpp),
+            meanLuminance(sums, spp));
+    }
+}
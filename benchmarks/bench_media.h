@@ -0,0 +1,156 @@
+#pragma once
+
+#include "bench_util.h"
+#include "constant_medium.h"
+#include "grid_medium.h"
+#include "perlin.h"
+
+//Transmittance estimates along rays crossing a medium: rays/sec, the average error of the per ray mean against the
+//exact value and the average variance of a single estimate. A scattering event from hit() counts as 0, no event as 1.
+struct MediumRun
+{
+    double raysPerSecond;
+    double meanError;
+    double variance;
+};
+
+template <typename Estimator>
+MediumRun runTransmittance(const std::vector<Ray>& rays, const std::vector<double>& reference, int estimatesPerRay, Estimator estimate)
+{
+    double errorSum = 0, varianceSum = 0;
+    Timer timer;
+    #pragma omp parallel for reduction(+:errorSum, varianceSum) schedule(dynamic, 64)
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(rays.size()); i++)
+    {
+        double sum = 0, sumSquares = 0;
+        for (int k = 0; k < estimatesPerRay; k++)
+        {
+            double value = estimate(rays[i]);
+            sum += value;
+            sumSquares += value * value;
+        }
+        double mean = sum / estimatesPerRay;
+        errorSum += fabs(mean - reference[i]);
+        varianceSum += (sumSquares - sum * mean) / (estimatesPerRay - 1);
+    }
+    double seconds = timer.elapsedMs() / 1000.;
+    return { rays.size() * estimatesPerRay / seconds, errorSum / rays.size(), varianceSum / rays.size() };
+}
+
+//sparse smoke: turbulent noise thresholded inside a ball, most of the box is empty
+std::vector<float> makeSmokeGrid(int resolution, unsigned int seed)
+{
+    seed_random(seed);
+    Perlin noise;
+    std::vector<float> density(static_cast<size_t>(resolution) * resolution * resolution);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int z = 0; z < resolution; z++)
+    {
+        for (int y = 0; y < resolution; y++)
+        {
+            for (int x = 0; x < resolution; x++)
+            {
+                Point3 p = (Point3(x, y, z) + Vec3(0.5, 0.5, 0.5)) / resolution - Vec3(0.5, 0.5, 0.5);
+                double ball = 1. - p.length() / 0.45;
+                double value = ball > 0. ? std::max(0., noise.turbulence(6. * p, 4) - 0.25) * std::min(1., 4. * ball) : 0.;
+                density[(static_cast<size_t>(z) * resolution + y) * resolution + x] = static_cast<float>(value);
+            }
+        }
+    }
+    return density;
+}
+
+void benchMedia(const BenchOptions& options)
+{
+    size_t rayCount = options.getSize("rays", 20000);
+    int estimates = static_cast<int>(options.get("estimates", 16));
+    int resolution = static_cast<int>(options.get("grid", 256));
+    double densityScale = options.get("density", 20.);
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    //fog sphere of the Book 2 final scene, rays from its camera to random points of the sphere
+    {
+        Point3 center(360, 150, 145);
+        double radius = 70, density = 0.2;
+        auto boundary = make_shared<Sphere>(center, radius, make_shared<Dielectric>(1.5));
+        ConstantMedium fog(boundary, density, Color(0.2, 0.4, 0.9));
+
+        seed_random(seed);
+        Point3 eye(478, 278, -600);
+        std::vector<Ray> rays;
+        std::vector<double> reference;
+        while (rays.size() < rayCount)
+        {
+            Point3 target = center + radius * random_in_unit_sphere_analytic();
+            Ray r(eye, target - eye);
+            HitRecord rec1, rec2;
+            if (!boundary->hit(r, 0, infinity, rec1) || !boundary->hit(r, rec1.t + 0.0001, infinity, rec2))
+                continue;
+            rays.push_back(r);
+            reference.push_back(exp(-density * (rec2.t - rec1.t) * r.direction().length()));
+        }
+
+        MediumRun run = runTransmittance(rays, reference, estimates, [&](const Ray& r)
+            {
+                HitRecord rec;
+                return fog.hit(r, 0.001, infinity, rec) ? 0. : 1.;
+            });
+        printf("media: Book 2 fog sphere, %zu rays x %d estimates\n", rays.size(), estimates);
+        printf("%-28s %12s %12s %12s\n", "method", "Mrays/s", "mean error", "variance");
+        printf("%-28s %12.2f %12.5f %12.5f\n", "constant medium", run.raysPerSecond * 1e-6, run.meanError, run.variance);
+    }
+
+    //smoke in a density grid, exact transmittance integrated at a quarter voxel step
+    Timer buildTimer;
+    std::vector<float> smoke = makeSmokeGrid(resolution, seed);
+    aabb bounds(Point3(-1, -1, -1), Point3(1, 1, 1));
+    double gridMs = buildTimer.elapsedMs();
+
+    seed_random(seed + 1);
+    std::vector<Ray> rays;
+    for (size_t i = 0; i < rayCount; i++)
+    {
+        Point3 origin = 3. * random_unit_vector_analytic();
+        Point3 target = 0.6 * random_in_unit_sphere_analytic();
+        rays.push_back(Ray(origin, target - origin));
+    }
+
+    GridMedium reference(bounds, resolution, resolution, resolution, smoke, densityScale, Color(0.8, 0.8, 0.8));
+    std::vector<double> exact(rays.size());
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(rays.size()); i++)
+    {
+        const Ray& r = rays[i];
+        double length = r.direction().length();
+        double dt = 0.25 * (2. / resolution) / length;
+        double opticalDepth = 0;
+        for (double t = 0.5 * dt; t < 10.; t += dt)
+            opticalDepth += reference.density(r.at(t)) * dt * length;
+        exact[i] = exp(-opticalDepth);
+    }
+
+    printf("media: %d^3 smoke grid (%.0f ms to generate), %zu rays x %d estimates\n", resolution, gridMs, rays.size(), estimates);
+    printf("%-28s %12s %12s %12s\n", "method", "Mrays/s", "mean error", "variance");
+    for (int block : { resolution, 32, 16, 8, 4 })
+    {
+        Timer timer;
+        GridMedium medium(bounds, resolution, resolution, resolution, smoke, densityScale, Color(0.8, 0.8, 0.8), block);
+        double buildMs = timer.elapsedMs();
+
+        char name[64];
+        MediumRun delta = runTransmittance(rays, exact, estimates, [&](const Ray& r)
+            {
+                HitRecord rec;
+                return medium.hit(r, 0.001, infinity, rec) ? 0. : 1.;
+            });
+        snprintf(name, sizeof(name), "delta, majorant block %d", block);
+        printf("%-28s %12.2f %12.5f %12.5f   (majorants built in %.0f ms)\n", name, delta.raysPerSecond * 1e-6, delta.meanError, delta.variance, buildMs);
+
+        MediumRun ratio = runTransmittance(rays, exact, estimates, [&](const Ray& r)
+            {
+                return medium.transmittance(r, 0.001, infinity);
+            });
+        snprintf(name, sizeof(name), "ratio, majorant block %d", block);
+        printf("%-28s %12.2f %12.5f %12.5f\n", name, ratio.raysPerSecond * 1e-6, ratio.meanError, ratio.variance);
+    }
+}
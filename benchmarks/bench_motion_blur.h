@@ -0,0 +1,46 @@
+#pragma once
+
+#include "bench_util.h"
+#include "scenes.h"
+
+//Camera rays through the Book 1 scene with the shutter open over the whole motion, small spheres in a BvhNode of
+//swept boxes against a MotionBvhNode interpolating its boxes to the ray time, at increasing motion magnitudes.
+void benchMotionBlur(const BenchOptions& options)
+{
+    int width = static_cast<int>(options.get("width", 400));
+    int height = width;
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    printf("motion_blur: Book 1 scene, %dx%d camera rays, %d threads\n", width, height, benchThreadCount());
+    printf("%8s %-8s %14s %14s\n", "motion", "bvh", "nodes/ray", "rays/sec");
+
+    for (double motionScale : { 0., 1., 2., 4., 8. })
+    {
+        for (bool motionBvh : { false, true })
+        {
+            seed_random(seed);
+            SceneDescription scene = load_scene(1);
+            seed_random(seed);
+            scene.world = rt_one_weekend_scene(motionScale, motionBvh);
+            Camera cam = scene.camera(0, 1);
+
+            seed_random(seed + 1);
+            std::vector<Ray> rays;
+            rays.reserve(size_t(width) * height);
+            for (int row = 0; row < height; row++)
+                for (int col = 0; col < width; col++)
+                    rays.push_back(cam.get_ray((col + random_double()) / (width - 1), (row + random_double()) / (height - 1)));
+
+            //visits are counted per thread, so count them on this one
+            bvhNodesVisited = 0;
+            for (const auto& ray : rays)
+            {
+                HitRecord rec;
+                scene.world.hit(ray, 0.001, infinity, rec);
+            }
+            double nodesPerRay = double(bvhNodesVisited) / rays.size();
+
+            printf("%8.1f %-8s %14.2f %14.0f\n", motionScale, motionBvh ? "motion" : "swept", nodesPerRay, measureRaysPerSecond(scene.world, rays));
+        }
+    }
+}
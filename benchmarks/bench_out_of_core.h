@@ -0,0 +1,199 @@
+#pragma once
+
+#include "bench_util.h"
+#include "renderer.h"
+#include "bvh_node.h"
+#include "paged_scene.h"
+
+#include <cstdio>
+
+//Procedural field of spheres in tiles x tiles square tiles of perTile spheres each, one page per tile. A tile is
+//generated from its own seed, so the field can be written page by page without ever being in memory.
+struct SphereField
+{
+    int tiles;
+    size_t perTile;
+    unsigned int seed;
+
+    double tileSide() const { return 2. * std::sqrt(static_cast<double>(perTile)); }
+    double side() const { return tiles * tileSide(); }
+
+    //ground, eight diffuse colors, two metals and glass
+    static std::vector<shared_ptr<Material>> palette()
+    {
+        std::vector<shared_ptr<Material>> materials;
+        materials.push_back(make_shared<Lambertian>(Color(0.5, 0.5, 0.5)));
+        seed_random(1);
+        for (int i = 0; i < 8; i++)
+            materials.push_back(make_shared<Lambertian>(Color::random() * Color::random()));
+        materials.push_back(make_shared<Metal>(Color(0.8, 0.8, 0.9), 0.05));
+        materials.push_back(make_shared<Metal>(Color(0.8, 0.6, 0.2), 0.3));
+        materials.push_back(make_shared<Dielectric>(1.5));
+        return materials;
+    }
+
+    void tile(int x, int z, std::vector<PagedSphere>& spheres) const
+    {
+        seed_random(uint64_t(seed) * 1000003u + uint64_t(z) * tiles + x);
+        spheres.resize(perTile);
+        for (PagedSphere& sphere : spheres)
+        {
+            sphere.radius = random_double(0.3, 1.2);
+            sphere.center[0] = (x + random_double()) * tileSide();
+            sphere.center[1] = sphere.radius;
+            sphere.center[2] = (z + random_double()) * tileSide();
+            double choice = random_double();
+            sphere.material = choice < 0.85 ? 1 + static_cast<uint32_t>(random_double() * 8) : choice < 0.97 ? 9 + (choice < 0.91) : 11;
+            sphere.padding = 0;
+        }
+    }
+
+    shared_ptr<Hittable> ground(const std::vector<shared_ptr<Material>>& materials) const
+    {
+        return make_shared<Sphere>(Point3(side() / 2, -1e5, side() / 2), 1e5, materials[0]);
+    }
+
+    bool write(const std::string& filename) const
+    {
+        PagedSceneWriter writer;
+        if (!writer.open(filename))
+            return false;
+        std::vector<PagedSphere> spheres;
+        for (int z = 0; z < tiles; z++)
+        {
+            for (int x = 0; x < tiles; x++)
+            {
+                tile(x, z, spheres);
+                if (!writer.addPage(spheres))
+                    return false;
+            }
+        }
+        return writer.close();
+    }
+
+    //the same spheres as Sphere objects, for an in memory render to compare with
+    HittableList inMemory(const std::vector<shared_ptr<Material>>& materials) const
+    {
+        HittableList world;
+        std::vector<PagedSphere> spheres;
+        for (int z = 0; z < tiles; z++)
+        {
+            for (int x = 0; x < tiles; x++)
+            {
+                tile(x, z, spheres);
+                for (const PagedSphere& s : spheres)
+                    world.add(make_shared<Sphere>(Point3(s.center[0], s.center[1], s.center[2]), s.radius, materials[s.material]));
+            }
+        }
+        return world;
+    }
+};
+
+//Renders a sphere field of --tiles^2 pages of --per-page spheres, written to --file, through a page cache of
+//--memory-mb, with the rays of every bounce of a --block x --block pixel block queued on the pages (intersect)
+//and with single rays loading the pages they need (hit). A smaller field of --verify-tiles^2 pages is also
+//rendered from memory to check both images.
+void benchOutOfCore(const BenchOptions& options)
+{
+    int tiles = static_cast<int>(options.get("tiles", 32));
+    size_t perPage = options.getSize("per-page", 4096);
+    size_t memoryLimit = options.getSize("memory-mb", 32) << 20;
+    int width = static_cast<int>(options.get("width", 160));
+    int spp = static_cast<int>(options.get("spp", 1));
+    int depth = static_cast<int>(options.get("depth", 4));
+    int block = static_cast<int>(options.get("block", 16));
+    int verifyTiles = static_cast<int>(options.get("verify-tiles", 4));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+    std::string filename = options.getString("file", "paged_scene.bin");
+    bool keep = options.get("keep", 0) != 0;
+
+    auto materials = SphereField::palette();
+    const Color background(0.70, 0.80, 1.00);
+    auto camera = [](const SphereField& field)
+    {
+        //low over one edge of the field looking across it, the camera rays cross many pages
+        double side = field.side();
+        return Camera(Point3(side / 2, 40, -30), Point3(side / 2, 0, side / 3), Vec3(0, 1, 0), 60, 16. / 9., 10., 0.);
+    };
+    RenderSettings settings;
+    settings.image_width = width;
+    settings.image_height = width * 9 / 16;
+    settings.samples_per_pixel = spp;
+    settings.max_depth = depth;
+    settings.seed = seed;
+    settings.packets = false;
+
+    //both renders of the small field against the in memory one
+    {
+        SphereField field = { verifyTiles, perPage, seed };
+        std::string verifyFile = filename + ".verify";
+        if (!field.write(verifyFile))
+            return;
+        HittableList world = field.inMemory(materials);
+        HittableList inMemory;
+        inMemory.add(make_shared<BvhNode>(world, 0, 1));
+        inMemory.add(field.ground(materials));
+        PagedScene scene(materials, HittableList(field.ground(materials)));
+        if (!scene.open(verifyFile, memoryLimit))
+            return;
+        Camera cam = camera(field);
+        std::vector<Color> reference, queued, single;
+        renderSamples(inMemory, cam, background, settings, 0, spp, reference, false);
+        renderPagedSamples(scene, cam, background, settings, queued, block);
+        renderSamples(scene, cam, background, settings, 0, spp, single, false);
+        double queuedDiff = 0, singleDiff = 0;
+        for (size_t i = 0; i < reference.size(); i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                queuedDiff = std::max(queuedDiff, std::abs(queued[i][c] - reference[i][c]));
+                singleDiff = std::max(singleDiff, std::abs(single[i][c] - reference[i][c]));
+            }
+        }
+        printf("out_of_core: check on %zu spheres against the in memory render: max difference %.3g queued, %.3g single rays\n",
+            world.list.size(), queuedDiff, singleDiff);
+        if (queuedDiff > 1e-9 || singleDiff > 0)
+        {
+            printf("FAILED: paged render differs from the in memory one\n");
+            benchFailures++;
+        }
+        remove(verifyFile.c_str());
+    }
+
+    SphereField field = { tiles, perPage, seed };
+    Timer timer;
+    if (!field.write(filename))
+        return;
+    double writeMs = timer.elapsedMs();
+    PagedScene scene(materials, HittableList(field.ground(materials)));
+    if (!scene.open(filename, memoryLimit))
+        return;
+
+    //what the spheres would take as Sphere objects under a BvhNode (one node per sphere), with control blocks
+    double inMemoryMb = scene.sphereCount() * (sizeof(Sphere) + sizeof(BvhNode) + 32.) / (1024. * 1024.);
+    printf("out_of_core: %llu spheres in %zu pages, file %.1f MB written in %.0f ms, %.1f MB in memory, cache limit %.1f MB, %d threads\n",
+        static_cast<unsigned long long>(scene.sphereCount()), scene.pageCount(), scene.fileBytes() / (1024. * 1024.), writeMs,
+        inMemoryMb, memoryLimit / (1024. * 1024.), benchThreadCount());
+    printf("%-8s %10s %12s %12s %10s %10s %10s %12s %10s\n", "mode", "ms", "rays", "Mrays/s", "requests", "faults", "hit rate", "MB read", "batches");
+
+    Camera cam = camera(field);
+    for (int queued = 1; queued >= 0; queued--)
+    {
+        scene.clearCache();
+        scene.resetStats();
+        std::vector<Color> sums;
+        Timer renderTimer;
+        if (queued)
+            renderPagedSamples(scene, cam, background, settings, sums, block);
+        else
+            renderSamples(scene, cam, background, settings, 0, spp, sums, false);
+        double ms = renderTimer.elapsedMs();
+        PagedSceneStats stats = scene.getStats();
+        printf("%-8s %10.0f %12lld %12.2f %10lld %10lld %9.1f%% %12.1f %10lld\n", queued ? "queued" : "single", ms, stats.rays,
+            stats.rays / (ms * 1e3), stats.cache.requests, stats.cache.faults,
+            stats.cache.requests ? 100. * (stats.cache.requests - stats.cache.faults) / stats.cache.requests : 0.,
+            stats.cache.bytesRead / (1024. * 1024.), stats.pageBatches);
+    }
+    if (!keep)
+        remove(filename.c_str());
+}
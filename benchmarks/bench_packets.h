@@ -0,0 +1,111 @@
+#pragma once
+
+#include "bench_util.h"
+#include "scenes.h"
+#include "renderer.h"
+#include "bvh_node.h"
+
+//Primary ray throughput of single rays against 8x8 pixel packets, on the Book 1 and Cornell box scenes with a BVH
+//over the whole scene. The camera rays of --spp samples per pixel are generated up front, packets hold the rays
+//of one sample of an 8x8 block. The mismatch column counts rays whose closest hit differs, which must be 0.
+void benchPackets(const BenchOptions& options)
+{
+    int width = static_cast<int>(options.get("width", 400));
+    int spp = static_cast<int>(options.get("spp", 4));
+    int repeats = static_cast<int>(options.get("repeats", 3));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+    const int blockSize = 8;
+
+    printf("packets: %d px wide, %d spp, best of %d runs, %d threads\n", width, spp, repeats, benchThreadCount());
+    printf("%-8s %14s %14s %9s %14s %14s %10s\n", "scene", "single Mrays/s", "packet Mrays/s", "speedup", "single nodes", "packet nodes", "mismatch");
+
+    for (int sceneChoice : { 1, 5 })
+    {
+        seed_random(seed);
+        SceneDescription scene = load_scene(sceneChoice);
+        BvhNode bvh(scene.world, 0, 1);
+        Camera cam = scene.camera();
+        RenderSettings settings;
+        settings.image_width = width;
+        settings.image_height = static_cast<int>(width / scene.aspect_ratio);
+        settings.samples_per_pixel = spp;
+        settings.seed = seed;
+        PixelSampler sampler(settings.sequence, spp, seed);
+
+        //rays of the whole image, pixel by pixel, spp rays per pixel
+        std::vector<Ray> rays;
+        cam.generateTile(0, 0, settings.image_width, settings.image_height, settings.image_width, settings.image_height, 0, spp, sampler, rays);
+        size_t rayCount = rays.size();
+        int blocksX = (settings.image_width + blockSize - 1) / blockSize;
+        int blocksY = (settings.image_height + blockSize - 1) / blockSize;
+        int packetCount = blocksX * blocksY * spp;
+
+        std::vector<double> singleT(rayCount), packetT(rayCount);
+        long long singleNodes = 0, packetNodes = 0;
+        double singleMs = infinity, packetMs = infinity;
+        for (int r = 0; r < repeats; r++)
+        {
+            long long nodes = 0;
+            Timer timer;
+            #pragma omp parallel for schedule(dynamic, 64) reduction(+:nodes)
+            for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(rayCount); i++)
+            {
+#ifdef RT_BVH_STATS
+                long long before = bvhNodesVisited;
+#endif
+                HitRecord rec;
+                singleT[i] = bvh.hit(rays[i], 0.001, infinity, rec) ? rec.t : infinity;
+#ifdef RT_BVH_STATS
+                nodes += bvhNodesVisited - before;
+#endif
+            }
+            singleMs = std::min(singleMs, timer.elapsedMs());
+            singleNodes = nodes;
+        }
+
+        for (int r = 0; r < repeats; r++)
+        {
+            long long nodes = 0;
+            Timer timer;
+            #pragma omp parallel for schedule(dynamic, 4) reduction(+:nodes)
+            for (int p = 0; p < packetCount; p++)
+            {
+                static thread_local std::unique_ptr<RayPacket> packet(new RayPacket());
+                size_t index[RayPacket::maxSize];
+                int s = p % spp;
+                int bx = (p / spp) % blocksX * blockSize;
+                int by = (p / spp) / blocksX * blockSize;
+                packet->count = 0;
+                for (int row = by; row < std::min(by + blockSize, settings.image_height); row++)
+                {
+                    for (int col = bx; col < std::min(bx + blockSize, settings.image_width); col++)
+                    {
+                        index[packet->count] = (size_t(row) * settings.image_width + col) * spp + s;
+                        packet->rays[packet->count] = rays[index[packet->count]];
+                        packet->count++;
+                    }
+                }
+#ifdef RT_BVH_STATS
+                long long before = bvhNodesVisited;
+#endif
+                packet->init();
+                bvh.hitPacket(*packet, 0.001, packet->allActive());
+#ifdef RT_BVH_STATS
+                nodes += bvhNodesVisited - before;
+#endif
+                for (int i = 0; i < packet->count; i++)
+                    packetT[index[i]] = packet->hit[i] ? packet->tMax[i] : infinity;
+            }
+            packetMs = std::min(packetMs, timer.elapsedMs());
+            packetNodes = nodes;
+        }
+
+        size_t mismatches = 0;
+        for (size_t i = 0; i < rayCount; i++)
+            mismatches += singleT[i] != packetT[i];
+        benchFailures += mismatches != 0;
+        printf("%-8d %14.2f %14.2f %8.2fx %14.2f %14.2f %10zu\n", sceneChoice, rayCount / (singleMs * 1e3), rayCount / (packetMs * 1e3),
+            singleMs / packetMs, static_cast<double>(singleNodes) / rayCount, static_cast<double>(packetNodes) / packetCount, mismatches);
+    }
+    printf("nodes: visited per ray (single) and per packet\n");
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "bench_util.h"
+#include "renderer.h"
+#include "photon_map.h"
+#include "bench_bdpt.h"
+
+//Stochastic progressive photon mapping against path tracing with next event estimation on the caustic scenes of
+//the bdpt benchmark. For each scene the photon passes are timed step by step: photons shot and stored per second,
+//the hash grid build, and radius lookups per second with the photons each gathers. Then both methods run for
+//--budget-ms, path tracing in batches of 1, 1, 2, 4... samples per pixel and photon mapping in passes of --photons
+//photons, and the RMSE against a --reference-spp bidirectional render is printed after every batch and after
+//passes 1, 2, 4, 8..., the image quality against time.
+void benchPhotons(const BenchOptions& options)
+{
+    int width = static_cast<int>(options.get("width", 120));
+    int depth = static_cast<int>(options.get("depth", 8));
+    double budgetMs = options.get("budget-ms", 4000);
+    int referenceSpp = static_cast<int>(options.get("reference-spp", 1024));
+    int photonsPerPass = static_cast<int>(options.get("photons", 100000));
+    double radiusPixels = options.get("radius", 4.);
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    printf("photons: %d px wide, depth %d, %d photons per pass, %.0f ms per render, %d threads\n", width, depth, photonsPerPass,
+        budgetMs, benchThreadCount());
+
+    auto meanLuminance = [](const std::vector<Color>& sums, int spp)
+    {
+        double sum = 0;
+        for (const Color& c : sums)
+            sum += luminance(c) / spp;
+        return sum / sums.size();
+    };
+
+    const Color background(0, 0, 0);
+    std::vector<CausticScene> scenes = makeCausticScenes();
+    for (CausticScene& scene : scenes)
+    {
+        LightSampler lights(scene.objects);
+        HittableList world(make_shared<BvhNode>(scene.objects, 0, 1));
+
+        RenderSettings settings;
+        settings.image_width = width;
+        settings.image_height = static_cast<int>(width / scene.aspectRatio);
+        settings.max_depth = depth;
+        settings.seed = seed;
+        settings.lights = &lights;
+        settings.samples_per_pixel = referenceSpp;
+        std::vector<Color> reference;
+        BidirectionalTracer tracer(world, scene.cam, background, settings);
+        tracer.render(0, referenceSpp, reference, false);
+        printf("%s: reference %d spp bidirectional, mean luminance %.5f\n", scene.name, referenceSpp, meanLuminance(reference, referenceSpp));
+
+        //the steps of a few passes
+        {
+            settings.seed = seed + 1;
+            settings.samples_per_pixel = 4;
+            PhotonMapper mapper(world, scene.cam, background, settings, photonsPerPass, radiusPixels);
+            double cameraMs = 0, shootMs = 0, buildMs = 0, gatherMs = 0;
+            size_t gridBytes = 0;
+            for (int pass = 0; pass < settings.samples_per_pixel; pass++)
+            {
+                Timer cameraTimer;
+                mapper.traceVisiblePoints(pass);
+                cameraMs += cameraTimer.elapsedMs();
+                Timer shootTimer;
+                mapper.shootPhotons(pass);
+                shootMs += shootTimer.elapsedMs();
+                Timer buildTimer;
+                mapper.buildGrid();
+                buildMs += buildTimer.elapsedMs();
+                gridBytes = std::max(gridBytes, mapper.getGrid().bytes());
+                Timer gatherTimer;
+                mapper.gather();
+                gatherMs += gatherTimer.elapsedMs();
+            }
+            const PhotonMapper::Stats& stats = mapper.getStats();
+            printf("%s: %d passes, visible points %.1f ms/pass, shooting %.2f M photons/s (%.2f M stored/s, %.1f per photon), "
+                "grid %.1f ms/pass (%.1f MB), lookups %.2f M/s with %.1f photons each\n",
+                scene.name, settings.samples_per_pixel, cameraMs / settings.samples_per_pixel, stats.photonsShot / shootMs / 1000.,
+                stats.photonsStored / shootMs / 1000., double(stats.photonsStored) / stats.photonsShot,
+                buildMs / settings.samples_per_pixel, gridBytes / (1024. * 1024.), stats.lookups / gatherMs / 1000.,
+                double(stats.photonsGathered) / stats.lookups);
+        }
+
+        printf("%-10s %-8s %10s %8s %12s %16s\n", "scene", "method", "ms", "spp", "RMSE", "mean luminance");
+        //path tracing, batches of doubling sample counts until the budget is used
+        {
+            settings.seed = seed + 1;
+            settings.samples_per_pixel = 1 << 16;
+            std::vector<Color> sums;
+            int samples = 0;
+            int batch = 1;
+            Timer timer;
+            while (timer.elapsedMs() < budgetMs)
+            {
+                renderSamples(world, scene.cam, background, settings, samples, batch, sums, false);
+                samples += batch;
+                batch = samples;
+                printf("%-10s %-8s %10.0f %8d %12.5f %16.5f\n", scene.name, "path", timer.elapsedMs(), samples,
+                    imageRmse(sums, samples, reference, referenceSpp), meanLuminance(sums, samples));
+            }
+        }
+        //photon mapping, reported after passes 1, 2, 4...
+        {
+            settings.seed = seed + 1;
+            settings.samples_per_pixel = 1 << 16;
+            PhotonMapper mapper(world, scene.cam, background, settings, photonsPerPass, radiusPixels);
+            std::vector<Color> colors;
+            int nextReport = 1;
+            Timer timer;
+            for (int pass = 0; timer.elapsedMs() < budgetMs; pass++)
+            {
+                mapper.renderPass(pass);
+                if (pass + 1 == nextReport || timer.elapsedMs() >= budgetMs)
+                {
+                    double ms = timer.elapsedMs();
+                    mapper.image(colors);
+                    printf("%-10s %-8s %10.0f %8d %12.5f %16.5f\n", scene.name, "sppm", ms, pass + 1,
+                        imageRmse(colors, 1, reference, referenceSpp), meanLuminance(colors, 1));
+                    nextReport *= 2;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "bench_util.h"
+#include "preview.h"
+
+#include <algorithm>
+
+//Progressive preview latency: time to the first image after start, then for camera updates orbiting the look at
+//point the time from the update to the first image with the new camera and to --spp accumulated samples.
+void benchPreview(const BenchOptions& options)
+{
+    int sceneChoice = static_cast<int>(options.get("scene", 1));
+    int width = static_cast<int>(options.get("width", 400));
+    int spp = static_cast<int>(options.get("spp", 16));
+    int updates = static_cast<int>(options.get("updates", 10));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    seed_random(seed);
+    Timer loadTimer;
+    SceneDescription scene = load_scene(sceneChoice);
+    double loadMs = loadTimer.elapsedMs();
+
+    RenderSettings settings;
+    settings.image_width = width;
+    settings.image_height = static_cast<int>(width / scene.aspect_ratio);
+    settings.samples_per_pixel = spp;
+    settings.max_depth = 50;
+    settings.seed = seed;
+
+    PreviewSession session(scene, settings, 1000.);
+    session.start();
+    session.waitForFrame(0, 1, 600000.);
+    PreviewSession::Stats first = session.stats();
+
+    printf("preview: scene %d, %dx%d, %d threads\n", sceneChoice, settings.image_width, settings.image_height, benchThreadCount());
+    printf("scene load %.1f ms, BVH build %.1f ms, first image %.1f ms after start\n", loadMs, first.bvhBuildMs, first.firstImageMs);
+
+    std::vector<double> firstImage, converged;
+    PreviewCamera camera = session.getCamera();
+    Vec3 offset = camera.position - camera.lookAt;
+    for (int update = 1; update <= updates; update++)
+    {
+        //orbit around the vertical axis
+        double angle = degreeToRadians(5. * update);
+        camera.position = camera.lookAt + Vec3(cos(angle) * offset.x() - sin(angle) * offset.z(), offset.y(), sin(angle) * offset.x() + cos(angle) * offset.z());
+
+        Timer timer;
+        uint64_t version = session.setCamera(camera);
+        session.waitForFrame(version, 1, 600000.);
+        firstImage.push_back(session.stats().lastUpdateMs);
+        session.waitForFrame(version, spp, 600000.);
+        converged.push_back(timer.elapsedMs());
+    }
+    session.stop();
+
+    auto report = [](const char* name, std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        double mean = 0;
+        for (double v : values)
+            mean += v / values.size();
+        printf("%-36s mean %8.1f ms, median %8.1f ms, max %8.1f ms\n", name, mean, values[values.size() / 2], values.back());
+    };
+    report("camera update to first image", firstImage);
+    char name[64];
+    snprintf(name, sizeof(name), "camera update to %d spp", spp);
+    report(name, converged);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "bench_util.h"
+#include "bvh_node.h"
+#include "moving_sphere.h"
+
+//Per frame cost of keeping an animated BVH up to date: refitting the topology built for the first frame
+//(rebuilding subtrees past --rebuild-threshold) against building the whole tree again every frame.
+void benchRefit(const BenchOptions& options)
+{
+    size_t count = options.getSize("prims", 100000);
+    int frames = static_cast<int>(options.get("frames", 48));
+    double fps = options.get("fps", 24);
+    double shutter = options.get("shutter", 0.5);
+    double threshold = options.get("rebuild-threshold", 1.5);
+    double speed = options.get("speed", 20);
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    //spheres moving in random directions, speed is in cube sides per second
+    HittableList spheres = makeRandomSpheres(count, seed);
+    aabb bounds;
+    spheres.boundingBox(0, 1, bounds);
+    double side = bounds.extent().x();
+    HittableList moving;
+    auto material = make_shared<Lambertian>(COLOR_GREY);
+    for (const auto& object : spheres.list)
+    {
+        aabb box;
+        object->boundingBox(0, 1, box);
+        Point3 center = box.centroid();
+        Vec3 velocity = random_unit_vector() * random_double(0, speed * side / 100.);
+        moving.add(make_shared<MovingSphere>(0., 1., center, center + velocity, 0.5 * box.extent().x(), material));
+    }
+
+    double frameTime = 1. / fps;
+    BvhNode animated(moving, 0, shutter * frameTime);
+
+    printf("refit: %zu moving spheres, %d frames, rebuild threshold %.2f, %d threads\n", count, frames, threshold, benchThreadCount());
+    printf("%6s %10s %10s %10s %12s %12s\n", "frame", "refit ms", "rebuilt", "refit sah", "rebuild ms", "rebuild sah");
+
+    double totalRefitMs = 0, totalRebuildMs = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        double time0 = frame * frameTime;
+        double time1 = time0 + shutter * frameTime;
+
+        Timer refitTimer;
+        int rebuilt = animated.refit(time0, time1, threshold);
+        double refitMs = refitTimer.elapsedMs();
+
+        Timer rebuildTimer;
+        BvhNode rebuiltTree(moving, time0, time1);
+        double rebuildMs = rebuildTimer.elapsedMs();
+
+        totalRefitMs += refitMs;
+        totalRebuildMs += rebuildMs;
+        printf("%6d %10.2f %10d %10.2f %12.2f %12.2f\n", frame, refitMs, rebuilt,
+            animated.sahCost(time0, time1), rebuildMs, rebuiltTree.sahCost(time0, time1));
+    }
+    printf("average per frame: refit %.2f ms, rebuild %.2f ms\n", totalRefitMs / frames, totalRebuildMs / frames);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "bench_util.h"
+#include "scenes.h"
+#include "renderer.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+
+//goldens committed with the sources, CMake passes their absolute path
+#ifndef RT_REGRESSION_DIR
+#define RT_REGRESSION_DIR "benchmarks/regression"
+#endif
+
+//Regression renders: each scene at --width pixels is compared against its golden image in --golden-dir, written
+//with --update 1 (at --golden-spp samples) from a build known to be right. The renders are deterministic for a
+//seed, so an unchanged renderer reproduces the golden of the same sample count exactly. Changes that trace other
+//paths (samplers, seeds, sample counts) only change the noise and are accepted by a statistical test:
+//  - a pixel is an outlier when its luminance differs by more than --max-z standard errors of the two estimates,
+//    from the per pixel sample variance; at most --max-outliers of the pixels may be outliers
+//  - the mean luminance of the image may not differ by more than --max-mean-error relative and --max-z standard
+//    errors of the mean at the same time, which catches an image that is brighter or darker overall
+//The scenes are always generated with --scene-seed, --seed only changes the paths traced. --skip takes a comma
+//separated list of scenes to leave out. The goldens of all seven scenes are committed in benchmarks/regression and
+//ctest runs the comparison.
+//Failures make the benchmark binary exit with 1.
+void benchRegression(const BenchOptions& options)
+{
+    int width = static_cast<int>(options.get("width", 64));
+    int spp = static_cast<int>(options.get("spp", 64));
+    int goldenSpp = static_cast<int>(options.get("golden-spp", 256));
+    int lastScene = static_cast<int>(options.get("scenes", 7));
+    bool update = options.get("update", 0) != 0;
+    double maxZ = options.get("max-z", 5.);
+    double maxOutliers = options.get("max-outliers", 0.01);
+    double maxMeanError = options.get("max-mean-error", 0.005);
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+    unsigned int sceneSeed = static_cast<unsigned int>(options.get("scene-seed", 7));
+    std::string goldenDir = options.getString("golden-dir", RT_REGRESSION_DIR);
+    std::vector<int> skipped;
+    std::stringstream skip(options.getString("skip", ""));
+    for (std::string choice; std::getline(skip, choice, ',');)
+        skipped.push_back(atoi(choice.c_str()));
+
+    if (update)
+    {
+        spp = goldenSpp;
+        std::error_code error;
+        std::filesystem::create_directories(goldenDir, error);
+    }
+    printf("regression: %d px wide, %d spp, seed %u, goldens in %s%s\n", width, spp, seed, goldenDir.c_str(), update ? " (updating)" : "");
+    if (!update)
+        printf("%-6s %10s %12s %12s %10s %8s\n", "scene", "ms", "max diff", "mean error", "outliers", "result");
+
+    for (int sceneChoice = 1; sceneChoice <= lastScene; sceneChoice++)
+    {
+        if (std::find(skipped.begin(), skipped.end(), sceneChoice) != skipped.end())
+            continue;
+        seed_random(sceneSeed);
+        SceneDescription scene = load_scene(sceneChoice);
+        RenderSettings settings;
+        settings.image_width = width;
+        settings.image_height = static_cast<int>(width / scene.aspect_ratio);
+        settings.samples_per_pixel = spp;
+        settings.max_depth = 50;
+        settings.seed = seed;
+
+        std::vector<Color> sums;
+        std::vector<PixelFeatures> features;
+        Timer timer;
+        renderSamples(scene.world, scene.camera(), scene.background, settings, 0, spp, sums, false, &features);
+        double ms = timer.elapsedMs();
+
+        //average color and standard error of the luminance of every pixel
+        std::vector<Color> mean(sums.size()), standardError(sums.size());
+        for (size_t i = 0; i < sums.size(); i++)
+        {
+            mean[i] = sums[i] / spp;
+            double l = luminance(mean[i]);
+            double e = std::sqrt(std::max(0., features[i].luminanceSquared / spp - l * l) / spp);
+            standardError[i] = Color(e, e, e);
+        }
+
+        std::string base = goldenDir + "/scene_" + std::to_string(sceneChoice);
+        if (update)
+        {
+            bool written = writePfm(mean, settings.image_width, settings.image_height, (base + ".pfm").c_str())
+                && writePfm(standardError, settings.image_width, settings.image_height, (base + "_stderr.pfm").c_str());
+            printf("scene %d: %s %s.pfm\n", sceneChoice, written ? "wrote" : "couldn't write", base.c_str());
+            if (!written)
+                benchFailures++;
+            continue;
+        }
+
+        std::vector<Color> golden, goldenError;
+        int goldenWidth = 0, goldenHeight = 0, errorWidth = 0, errorHeight = 0;
+        if (!readPfm((base + ".pfm").c_str(), golden, goldenWidth, goldenHeight)
+            || !readPfm((base + "_stderr.pfm").c_str(), goldenError, errorWidth, errorHeight)
+            || goldenWidth != settings.image_width || goldenHeight != settings.image_height
+            || errorWidth != goldenWidth || errorHeight != goldenHeight)
+        {
+            printf("%-6d %10.1f %12s %12s %10s %8s\n", sceneChoice, ms, "-", "-", "-", "NO GOLDEN");
+            benchFailures++;
+            continue;
+        }
+
+        double maxDiff = 0;
+        double sum = 0, goldenSum = 0, sumVariance = 0;
+        size_t outliers = 0;
+        for (size_t i = 0; i < mean.size(); i++)
+        {
+            for (int c = 0; c < 3; c++)
+                maxDiff = std::max(maxDiff, std::fabs(mean[i][c] - golden[i][c]));
+            sum += luminance(mean[i]);
+            goldenSum += luminance(golden[i]);
+            double variance = standardError[i].x() * standardError[i].x() + goldenError[i].x() * goldenError[i].x();
+            sumVariance += variance;
+
+            //the floor keeps pixels without noise (background, lights) from failing on float rounding
+            if (std::fabs(luminance(mean[i]) - luminance(golden[i])) > maxZ * std::sqrt(variance + 1e-6))
+                outliers++;
+        }
+        double meanError = std::fabs(sum - goldenSum) / std::max(goldenSum, 1e-9);
+        bool meanShifted = meanError > maxMeanError && std::fabs(sum - goldenSum) > maxZ * std::sqrt(sumVariance);
+        double outlierFraction = static_cast<double>(outliers) / mean.size();
+
+        bool pass = outlierFraction <= maxOutliers && !meanShifted;
+        if (!pass)
+            benchFailures++;
+        printf("%-6d %10.1f %12.2e %12.2e %9.2f%% %8s\n", sceneChoice, ms, maxDiff, meanError, 100. * outlierFraction,
+            !pass ? "FAIL" : maxDiff < 1e-5 ? "same" : "pass");
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "bench_util.h"
+#include "onb.h"
+
+//Rejection against closed form samplers from vec3.h: time per sample, plus a check that both produce the
+//intended distribution. Each sample is reduced to a statistic that is uniform on [0,1) for a correct sampler
+//(e.g. r^3 for points in the unit sphere) and binned for a chi-square test, next to a second moment.
+struct SamplerCheck
+{
+    const char* name;
+    Vec3 (*sample)();
+    double (*uniformStatistic)(const Vec3& p); //uniform in [0,1) when the distribution is right
+    double (*moment)(const Vec3& p);
+    double expectedMoment;
+};
+
+inline Vec3 lambertianRejection()
+{
+    //what the Lambertian material used to do around the normal +z
+    Vec3 direction = Vec3(0, 0, 1) + random_unit_vector();
+    return unit_vector(direction.near_zero() ? Vec3(0, 0, 1) : direction);
+}
+
+inline Vec3 lambertianAnalytic()
+{
+    return Onb(Vec3(0, 0, 1)).local(random_cosine_direction());
+}
+
+void benchSampling(const BenchOptions& options)
+{
+    size_t count = options.getSize("samples", 4000000);
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+    const int bins = 16;
+    const double chiSquareLimit = 37.7; //15 degrees of freedom at p = 0.001
+
+    auto sphereRadius = [](const Vec3& p) { return p.length_squared() * p.length(); };
+    auto azimuth = [](const Vec3& p) { return (atan2(p.y(), p.x()) + pi) / (2. * pi); };
+    const SamplerCheck checks[] = {
+        { "unit_vector rejection", random_unit_vector, [](const Vec3& p) { return 0.5 * (p.z() + 1.); }, [](const Vec3& p) { return p.x() * p.x(); }, 1. / 3. },
+        { "unit_vector analytic", random_unit_vector_analytic, [](const Vec3& p) { return 0.5 * (p.z() + 1.); }, [](const Vec3& p) { return p.x() * p.x(); }, 1. / 3. },
+        { "unit_sphere rejection", random_in_unit_sphere, sphereRadius, [](const Vec3& p) { return p.length_squared(); }, 3. / 5. },
+        { "unit_sphere analytic", random_in_unit_sphere_analytic, sphereRadius, [](const Vec3& p) { return p.length_squared(); }, 3. / 5. },
+        { "unit_disk rejection", random_in_unit_disk, [](const Vec3& p) { return p.length_squared(); }, [](const Vec3& p) { return p.x() * p.x(); }, 1. / 4. },
+        { "unit_disk analytic", random_in_unit_disk_analytic, [](const Vec3& p) { return p.length_squared(); }, [](const Vec3& p) { return p.x() * p.x(); }, 1. / 4. },
+        { "lambertian rejection", lambertianRejection, [](const Vec3& p) { return 1. - p.z() * p.z(); }, [](const Vec3& p) { return p.z(); }, 2. / 3. },
+        { "lambertian analytic", lambertianAnalytic, [](const Vec3& p) { return 1. - p.z() * p.z(); }, [](const Vec3& p) { return p.z(); }, 2. / 3. },
+    };
+
+    printf("sampling: %zu samples per sampler\n", count);
+    printf("%-24s %10s %10s %10s %10s %10s %6s\n", "sampler", "ns/sample", "moment", "expected", "chi2", "chi2 az", "ok");
+
+    for (const auto& check : checks)
+    {
+        //timing pass on its own, the checks below cost more than the samplers
+        seed_random(seed);
+        Vec3 sink;
+        Timer timer;
+        for (size_t i = 0; i < count; i++)
+            sink += check.sample();
+        double nsPerSample = timer.elapsedMs() * 1e6 / count;
+
+        seed_random(seed);
+        double histogram[bins] = {};
+        double azimuthHistogram[bins] = {};
+        double moment = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            Vec3 p = check.sample();
+            histogram[std::min(bins - 1, static_cast<int>(check.uniformStatistic(p) * bins))]++;
+            azimuthHistogram[std::min(bins - 1, static_cast<int>(azimuth(p) * bins))]++;
+            moment += check.moment(p);
+        }
+        moment /= count;
+
+        double expectedPerBin = double(count) / bins;
+        double chiSquare = 0, chiSquareAzimuth = 0;
+        for (int b = 0; b < bins; b++)
+        {
+            chiSquare += (histogram[b] - expectedPerBin) * (histogram[b] - expectedPerBin) / expectedPerBin;
+            chiSquareAzimuth += (azimuthHistogram[b] - expectedPerBin) * (azimuthHistogram[b] - expectedPerBin) / expectedPerBin;
+        }
+        bool ok = chiSquare < chiSquareLimit && chiSquareAzimuth < chiSquareLimit && fabs(moment - check.expectedMoment) < 0.005;
+        printf("%-24s %10.2f %10.4f %10.4f %10.1f %10.1f %6s%s\n", check.name, nsPerSample, moment, check.expectedMoment,
+            chiSquare, chiSquareAzimuth, ok ? "yes" : "NO", sink.x() == 12345. ? " " : "");
+    }
+}
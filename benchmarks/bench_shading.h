@@ -0,0 +1,89 @@
+#pragma once
+
+#include "bench_util.h"
+#include "scenes.h"
+#include "bvh_node.h"
+#include "material.h"
+
+//Material evaluation cost per hit for virtual calls, the switch over MaterialType and the material sorted batch.
+//The hits are those of camera rays and their first bounce in the Book 1 scene, so all material types are mixed.
+void benchShading(const BenchOptions& options)
+{
+    size_t rayCount = options.getSize("rays", 500000);
+    int repeats = static_cast<int>(options.get("repeats", 5));
+    size_t batchSize = options.getSize("batch", 2048);
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    seed_random(seed);
+    SceneDescription scene = load_scene(1);
+    Camera cam = scene.camera();
+    BvhNode bvh(scene.world, 0, 0);
+
+    std::vector<ShadingRequest> requests;
+    requests.reserve(2 * rayCount);
+    for (size_t i = 0; i < rayCount; i++)
+    {
+        ShadingRequest request;
+        request.ray_in = cam.get_ray(random_double(), random_double());
+        if (!bvh.hit(request.ray_in, 0.001, infinity, request.rec))
+            continue;
+        requests.push_back(request);
+
+        Color attenuation;
+        ShadingRequest bounce;
+        if (scatter_material(request.rec.material_ptr, request.ray_in, request.rec, attenuation, bounce.ray_in)
+            && bvh.hit(bounce.ray_in, 0.001, infinity, bounce.rec))
+            requests.push_back(bounce);
+    }
+
+    size_t counts[static_cast<int>(MaterialType::Other) + 1] = {};
+    for (const auto& request : requests)
+        counts[static_cast<int>(request.rec.material_ptr->type)]++;
+    printf("shading: %zu hits (lambertian %zu, metal %zu, dielectric %zu), best of %d runs, batches of %zu\n", requests.size(),
+        counts[static_cast<int>(MaterialType::Lambertian)], counts[static_cast<int>(MaterialType::Metal)],
+        counts[static_cast<int>(MaterialType::Dielectric)], repeats, batchSize);
+    printf("%-12s %10s %12s\n", "dispatch", "ns/hit", "checksum");
+
+    auto report = [&](const char* name, auto&& shadeAll)
+    {
+        double best = infinity;
+        double checksum = 0;
+        for (int r = 0; r < repeats; r++)
+        {
+            seed_random(seed);
+            Timer timer;
+            shadeAll();
+            best = std::min(best, timer.elapsedMs());
+        }
+        for (const auto& request : requests)
+            checksum += request.did_scatter ? request.attenuation.x() + request.scattered.direction().y() : 0.;
+        printf("%-12s %10.2f %12.3f\n", name, best * 1e6 / requests.size(), checksum);
+    };
+
+    report("virtual", [&]
+        {
+            for (auto& request : requests)
+            {
+                const Material* material = request.rec.material_ptr;
+                request.emitted = material->color_emitted(request.rec.u, request.rec.v, request.rec.p);
+                request.did_scatter = material->scatter(request.ray_in, request.rec, request.attenuation, request.scattered);
+            }
+        });
+
+    report("switch", [&]
+        {
+            for (auto& request : requests)
+            {
+                const Material* material = request.rec.material_ptr;
+                request.emitted = emitted_material(material, request.rec.u, request.rec.v, request.rec.p);
+                request.did_scatter = scatter_material(material, request.ray_in, request.rec, request.attenuation, request.scattered);
+            }
+        });
+
+    std::vector<uint32_t> order;
+    report("sorted batch", [&]
+        {
+            for (size_t first = 0; first < requests.size(); first += batchSize)
+                scatter_batch(requests.data() + first, std::min(batchSize, requests.size() - first), order);
+        });
+}
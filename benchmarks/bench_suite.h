@@ -0,0 +1,266 @@
+#pragma once
+
+#include "bench_util.h"
+#include "scenes.h"
+#include "renderer.h"
+#include "bvh_node.h"
+#include "axis_rectangle.h"
+#include "texture.h"
+
+#include <algorithm>
+#include <bitset>
+
+//one measurement of the suite, ops are rays, primitives or lookups depending on the workload
+struct SuiteResult
+{
+    std::string name;
+    double ops;
+    double ms;
+};
+
+//Counts the rays traced through it, one counter per thread so the count doesn't serialize the render. Packets go on
+//to the packet traversal of the wrapped world, so the suite renders the way the renderer does.
+class CountingHittable : public Hittable
+{
+    public:
+        CountingHittable(const Hittable& inner_) : inner(inner_), counters(benchThreadCount()) {}
+
+        virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override
+        {
+#ifdef _OPENMP
+            counters[omp_get_thread_num()].rays++;
+#else
+            counters[0].rays++;
+#endif
+            return inner.hit(r, min_t, max_t, hitrecord);
+        }
+
+        virtual void hitPacket(RayPacket& packet, double min_t, uint64_t active) const override
+        {
+            long long count = static_cast<long long>(std::bitset<64>(active).count());
+#ifdef _OPENMP
+            counters[omp_get_thread_num()].rays += count;
+#else
+            counters[0].rays += count;
+#endif
+            inner.hitPacket(packet, min_t, active);
+        }
+
+        virtual bool hitUsesRandom() const override { return inner.hitUsesRandom(); }
+
+        virtual bool boundingBox(double time0, double time1, aabb& output_box) const override
+        {
+            return inner.boundingBox(time0, time1, output_box);
+        }
+
+        long long rays() const
+        {
+            long long total = 0;
+            for (const auto& counter : counters)
+                total += counter.rays;
+            return total;
+        }
+
+    private:
+        struct alignas(64) Counter
+        {
+            long long rays = 0;
+        };
+
+        const Hittable& inner;
+        mutable std::vector<Counter> counters;
+};
+
+//Fixed seed workloads of the renderer core for tracking performance across commits: single threaded intersection,
+//material and texture kernels (ns/op, textures per point and batched), BVH build and traversal of 10k spheres up
+//to --max-prims on all threads, and end to end renders of the six scenes at --width pixels and --spp samples
+//(rays/sec counts every ray traced).
+//Every measurement is the best of --repeats runs. --json file writes the results with --label (e.g. the commit).
+void benchSuite(const BenchOptions& options)
+{
+    size_t kernelOps = options.getSize("ops", 1 << 20);
+    size_t maxPrims = options.getSize("max-prims", 1000000);
+    int width = static_cast<int>(options.get("width", 64));
+    int spp = static_cast<int>(options.get("spp", 4));
+    int repeats = static_cast<int>(options.get("repeats", 3));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+    std::string jsonPath = options.getString("json", "");
+    std::string label = options.getString("label", "");
+
+    std::vector<SuiteResult> results;
+    auto best = [&](auto&& run)
+    {
+        double bestMs = infinity;
+        for (int r = 0; r < repeats; r++)
+        {
+            seed_random(seed);
+            Timer timer;
+            run();
+            bestMs = std::min(bestMs, timer.elapsedMs());
+        }
+        return bestMs;
+    };
+
+    printf("suite: best of %d runs, %d threads, seed %u, build %s, cpu %s\n", repeats, benchThreadCount(), seed, RT_BUILD_DESCRIPTION, cpuIsaName());
+    printf("%-24s %14s %12s %12s %14s\n", "workload", "ops", "ms", "ns/op", "Mops/s");
+    auto report = [&](const std::string& name, double ops, double ms)
+    {
+        results.push_back({ name, ops, ms });
+        printf("%-24s %14.0f %12.2f %12.2f %14.2f\n", name.c_str(), ops, ms, ms * 1e6 / ops, ops / (ms * 1e3));
+    };
+
+    //intersection kernels: the rays start inside the cube holding the shapes, ray i against shape i % shapes
+    const size_t shapes = 1024;
+    aabb cube(Point3(-10, -10, -10), Point3(10, 10, 10));
+    std::vector<Ray> rays = makeRandomRays(cube, kernelOps, seed);
+    auto material = make_shared<Lambertian>(COLOR_GREY);
+    std::vector<aabb> boxes;
+    std::vector<Sphere> spheres;
+    std::vector<Rect_xy> rects;
+    seed_random(seed + 1);
+    for (size_t i = 0; i < shapes; i++)
+    {
+        Point3 corner = Vec3::random(-10, 8);
+        Vec3 size = Vec3::random(0.5, 2);
+        boxes.push_back(aabb(corner, corner + size));
+        spheres.push_back(Sphere(corner, size.x(), material));
+        rects.push_back(Rect_xy(material, corner.x(), corner.x() + size.x(), corner.y(), corner.y() + size.y(), corner.z()));
+    }
+
+    size_t hits = 0; //printed so the loops can't be optimized away
+    auto kernel = [&](const char* name, auto&& intersect)
+    {
+        report(name, static_cast<double>(kernelOps), best([&]
+            {
+                for (size_t i = 0; i < rays.size(); i++)
+                    hits += intersect(rays[i], i % shapes);
+            }));
+    };
+    kernel("ray_box", [&](const Ray& r, size_t shape) { return boxes[shape].hit(r, 0.001, infinity); });
+    kernel("ray_sphere", [&](const Ray& r, size_t shape) { HitRecord rec; return spheres[shape].hit(r, 0.001, infinity, rec); });
+    kernel("ray_rect", [&](const Ray& r, size_t shape) { HitRecord rec; return rects[shape].hit(r, 0.001, infinity, rec); });
+
+    //BVH build (ops = primitives) and closest hit traversal (ops = rays) of uniformly scattered spheres
+    for (size_t count = 10000; count <= maxPrims; count *= 10)
+    {
+        HittableList world = makeRandomSpheres(count, seed);
+        shared_ptr<BvhNode> tree;
+        double buildMs = best([&] { tree = make_shared<BvhNode>(world, 0, 0); });
+        report("bvh_build_" + std::to_string(count), static_cast<double>(count), buildMs);
+
+        aabb bounds;
+        tree->boundingBox(0, 0, bounds);
+        std::vector<Ray> traversalRays = makeRandomRays(bounds, kernelOps, seed);
+        double raysPerSecond = 0;
+        for (int r = 0; r < repeats; r++)
+            raysPerSecond = std::max(raysPerSecond, measureRaysPerSecond(*tree, traversalRays));
+        report("bvh_traverse_" + std::to_string(count), static_cast<double>(kernelOps), kernelOps / raysPerSecond * 1e3);
+    }
+
+    //material scatter on the first hits of camera rays in the Book 1 scene, all material types mixed
+    {
+        seed_random(seed);
+        SceneDescription scene = load_scene(1);
+        Camera cam = scene.camera();
+        std::vector<Ray> cameraRays;
+        std::vector<HitRecord> records;
+        for (size_t i = 0; i < kernelOps / 4; i++)
+        {
+            HitRecord rec;
+            Ray r = cam.get_ray(random_double(), random_double());
+            if (scene.world.hit(r, 0.001, infinity, rec))
+            {
+                cameraRays.push_back(r);
+                records.push_back(rec);
+            }
+        }
+        report("material_scatter", static_cast<double>(records.size()), best([&]
+            {
+                Color attenuation;
+                Ray scattered;
+                for (size_t i = 0; i < records.size(); i++)
+                    hits += scatter_material(records[i].material_ptr, cameraRays[i], records[i], attenuation, scattered);
+            }));
+    }
+
+    //texture lookups at random points, one call per point and batched
+    {
+        seed_random(seed);
+        std::vector<Point3> points(kernelOps);
+        std::vector<double> u(kernelOps, 0.5), v(kernelOps, 0.5), x(kernelOps), y(kernelOps), z(kernelOps);
+        std::vector<Color> colors(kernelOps);
+        for (size_t i = 0; i < kernelOps; i++)
+        {
+            points[i] = Vec3::random(-5, 5);
+            x[i] = points[i].x();
+            y[i] = points[i].y();
+            z[i] = points[i].z();
+        }
+        const std::pair<const char*, shared_ptr<Texture>> textures[] = {
+            { "texture_checker", make_shared<CheckeredTexture>(Color(0.1, 0.1, 0.1), Color(0.9, 0.9, 0.9)) },
+            { "texture_noise", make_shared<NoiseTexture>(4, NoisePattern::Noise) },
+            { "texture_marble", make_shared<NoiseTexture>(4, NoisePattern::Marble) },
+        };
+        for (const auto& texture : textures)
+        {
+            double sum = 0;
+            report(texture.first, static_cast<double>(kernelOps), best([&]
+                {
+                    for (const auto& p : points)
+                        sum += texture.second->colorValue(0.5, 0.5, p).x();
+                }));
+            report(std::string(texture.first) + "_batch", static_cast<double>(kernelOps), best([&]
+                {
+                    texture.second->colorValues(kernelOps, u.data(), v.data(), x.data(), y.data(), z.data(), colors.data());
+                    sum += colors[kernelOps / 2].x();
+                }));
+            hits += sum > 0;
+        }
+    }
+
+    //end to end renders, ops = rays traced
+    for (int sceneChoice = 1; sceneChoice <= 6; sceneChoice++)
+    {
+        seed_random(seed);
+        SceneDescription scene = load_scene(sceneChoice);
+        RenderSettings settings;
+        settings.image_width = width;
+        settings.image_height = static_cast<int>(width / scene.aspect_ratio);
+        settings.samples_per_pixel = spp;
+        settings.max_depth = 50;
+        settings.seed = seed;
+
+        std::vector<Color> sums;
+        long long traced = 0;
+        double ms = best([&]
+            {
+                CountingHittable world(scene.world);
+                sums.clear();
+                renderSamples(world, scene.camera(), scene.background, settings, 0, spp, sums, false);
+                traced = world.rays();
+            });
+        report("render_scene_" + std::to_string(sceneChoice), static_cast<double>(traced), ms);
+    }
+    printf("(%zu hits)\n", hits);
+
+    if (jsonPath.empty())
+        return;
+    FILE* json = fopen(jsonPath.c_str(), "w");
+    if (!json)
+    {
+        printf("Couldn't write %s\n", jsonPath.c_str());
+        return;
+    }
+    fprintf(json, "{\n  \"label\": \"%s\",\n  \"build\": \"%s\",\n  \"cpu\": \"%s\",\n  \"threads\": %d,\n  \"seed\": %u,\n  \"repeats\": %d,\n  \"results\": [\n",
+        label.c_str(), RT_BUILD_DESCRIPTION, cpuIsaName(), benchThreadCount(), seed, repeats);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const SuiteResult& result = results[i];
+        fprintf(json, "    {\"name\": \"%s\", \"ops\": %.0f, \"ms\": %.4f, \"ns_per_op\": %.4f, \"ops_per_sec\": %.1f}%s\n",
+            result.name.c_str(), result.ops, result.ms, result.ms * 1e6 / result.ops, result.ops / (result.ms * 1e-3),
+            i + 1 < results.size() ? "," : "");
+    }
+    fprintf(json, "  ]\n}\n");
+    fclose(json);
+    printf("results written to %s\n", jsonPath.c_str());
+}
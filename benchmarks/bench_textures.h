@@ -0,0 +1,94 @@
+#pragma once
+
+#include "bench_util.h"
+#include "texture.h"
+
+//the checker test of the original CheckeredTexture, to compare against the floor parity
+inline Color checkerSines(const Point3& p)
+{
+    auto sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
+    return sines < 0 ? Color(0.9, 0.9, 0.9) : Color(0.1, 0.1, 0.1);
+}
+
+//Procedural texture lookups per second at random points, one colorValue call per point against the batch
+//colorValues. The difference column is the largest difference between the two, which should be rounding only.
+void benchTextures(const BenchOptions& options)
+{
+    size_t count = options.getSize("lookups", 1 << 20);
+    int repeats = static_cast<int>(options.get("repeats", 5));
+    unsigned int seed = static_cast<unsigned int>(options.get("seed", 7));
+
+    seed_random(seed);
+    std::vector<double> u(count), v(count), x(count), y(count), z(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        u[i] = random_double();
+        v[i] = random_double();
+        x[i] = random_double(-5, 5);
+        y[i] = random_double(-5, 5);
+        z[i] = random_double(-5, 5);
+    }
+
+    auto best = [&](auto&& run)
+    {
+        double bestMs = infinity;
+        for (int r = 0; r < repeats; r++)
+        {
+            Timer timer;
+            run();
+            bestMs = std::min(bestMs, timer.elapsedMs());
+        }
+        return count / (bestMs * 1e3); //million lookups per second
+    };
+
+    std::vector<Color> scalar(count), batch(count);
+
+    printf("textures: %zu lookups, best of %d runs\n", count, repeats);
+    printf("%-12s %14s %14s %12s\n", "texture", "scalar Ml/s", "batch Ml/s", "difference");
+
+    double sinesRate = best([&]
+        {
+            for (size_t i = 0; i < count; i++)
+                scalar[i] = checkerSines(Point3(x[i], y[i], z[i]));
+        });
+    printf("%-12s %14.1f %14s %12s\n", "checker sin", sinesRate, "-", "-");
+    std::vector<Color> sines = scalar;
+
+    struct Entry
+    {
+        const char* name;
+        shared_ptr<Texture> texture;
+    };
+    const Entry textures[] = {
+        { "checker", make_shared<CheckeredTexture>(Color(0.1, 0.1, 0.1), Color(0.9, 0.9, 0.9)) },
+        { "noise", make_shared<NoiseTexture>(4, NoisePattern::Noise) },
+        { "turbulence", make_shared<NoiseTexture>(4, NoisePattern::Turbulence) },
+        { "marble", make_shared<NoiseTexture>(4, NoisePattern::Marble) },
+    };
+
+    for (const auto& entry : textures)
+    {
+        const Texture& texture = *entry.texture;
+        double scalarRate = best([&]
+            {
+                for (size_t i = 0; i < count; i++)
+                    scalar[i] = texture.colorValue(u[i], v[i], Point3(x[i], y[i], z[i]));
+            });
+        double batchRate = best([&]
+            {
+                texture.colorValues(count, u.data(), v.data(), x.data(), y.data(), z.data(), batch.data());
+            });
+
+        double difference = 0;
+        for (size_t i = 0; i < count; i++)
+            difference = std::max(difference, (scalar[i] - batch[i]).length());
+        printf("%-12s %14.1f %14.1f %12.2e\n", entry.name, scalarRate, batchRate, difference);
+    }
+
+    //the parity test and the sines disagree only where a sine is within rounding of zero
+    size_t mismatches = 0;
+    CheckeredTexture checker(Color(0.1, 0.1, 0.1), Color(0.9, 0.9, 0.9));
+    for (size_t i = 0; i < count; i++)
+        mismatches += (checker.colorValue(u[i], v[i], Point3(x[i], y[i], z[i])) - sines[i]).length() > 0.;
+    printf("checker parity against sines: %zu mismatches\n", mismatches);
+}
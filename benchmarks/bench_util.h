@@ -0,0 +1,197 @@
+#pragma once
+
+#include "util.h"
+#include "vec3.h"
+#include "ray.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include "material.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using std::shared_ptr;
+using std::make_shared;
+
+//checks failed by the benchmarks that verify results, the benchmark binary exits with 1 when there are any
+int benchFailures = 0;
+
+//command line of a benchmark: RaytracingBenchmark <name> [--option value]...
+class BenchOptions
+{
+    public:
+        BenchOptions(int argc, char** argv) : programPath(argv[0])
+        {
+            for (int i = 2; i + 1 < argc; i += 2)
+            {
+                if (strncmp(argv[i], "--", 2) == 0)
+                {
+                    names.push_back(argv[i] + 2);
+                    values.push_back(argv[i + 1]);
+                }
+            }
+        }
+
+        double get(const char* name, double defaultValue) const
+        {
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                if (names[i] == name)
+                    return atof(values[i].c_str());
+            }
+            return defaultValue;
+        }
+
+        std::string getString(const char* name, const std::string& defaultValue) const
+        {
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                if (names[i] == name)
+                    return values[i];
+            }
+            return defaultValue;
+        }
+
+        size_t getSize(const char* name, size_t defaultValue) const
+        {
+            return static_cast<size_t>(get(name, static_cast<double>(defaultValue)));
+        }
+
+        //path of the benchmark binary, for benchmarks starting worker processes
+        const std::string& program() const { return programPath; }
+
+    private:
+        std::string programPath;
+        std::vector<std::string> names;
+        std::vector<std::string> values;
+};
+
+class Timer
+{
+    public:
+        Timer() : start(std::chrono::steady_clock::now()) {}
+
+        double elapsedMs() const
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+    private:
+        std::chrono::steady_clock::time_point start;
+};
+
+//resident memory of the process, 0 where it can't be queried
+size_t currentRssBytes()
+{
+#ifdef __linux__
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    long pages = 0, residentPages = 0;
+    int read = fscanf(statm, "%ld %ld", &pages, &residentPages);
+    fclose(statm);
+    return read == 2 ? static_cast<size_t>(residentPages) * 4096 : 0;
+#else
+    return 0;
+#endif
+}
+
+#ifndef RT_BUILD_DESCRIPTION
+#define RT_BUILD_DESCRIPTION "unknown"
+#endif
+
+//widest vector instruction set of the CPU, the one the RT_ISA_KERNEL functions run with
+inline const char* cpuIsaName()
+{
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    if (__builtin_cpu_supports("avx512f"))
+        return "avx512";
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+    if (__builtin_cpu_supports("sse4.2"))
+        return "sse4.2";
+#endif
+    return "generic";
+}
+
+inline int benchThreadCount()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+//spheres scattered uniformly in a cube, sized so the density stays the same for any count
+HittableList makeRandomSpheres(size_t count, unsigned int seed)
+{
+    seed_random(seed);
+    HittableList spheres;
+    spheres.list.reserve(count);
+
+    double side = 100. * std::cbrt(static_cast<double>(count) / 10000.);
+    auto material = make_shared<Lambertian>(COLOR_GREY);
+    for (size_t i = 0; i < count; i++)
+    {
+        Point3 center = Vec3::random(0, side);
+        spheres.add(make_shared<Sphere>(center, random_double(0.2, 1.), material));
+    }
+    return spheres;
+}
+
+//rays from random points inside the bounds in random directions, generated up front so only tracing is timed
+std::vector<Ray> makeRandomRays(const aabb& bounds, size_t count, unsigned int seed)
+{
+    seed_random(seed);
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    Vec3 extent = bounds.extent();
+    for (size_t i = 0; i < count; i++)
+    {
+        Point3 origin = bounds.minimum() + Vec3::random() * extent;
+        rays.push_back(Ray(origin, random_unit_vector(), random_double()));
+    }
+    return rays;
+}
+
+//closest hit throughput over all threads
+double measureRaysPerSecond(const Hittable& world, const std::vector<Ray>& rays)
+{
+    Timer timer;
+    long long hits = 0;
+    #pragma omp parallel for reduction(+:hits) schedule(dynamic, 1024)
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(rays.size()); i++)
+    {
+        HitRecord rec;
+        if (world.hit(rays[i], 0.001, infinity, rec))
+            hits++;
+    }
+    double seconds = timer.elapsedMs() / 1000.;
+    return seconds > 0 ? rays.size() / seconds : 0;
+}
+
+//root mean square error of the average colors of two sample sums, channels clamped to [0,1]
+double imageRmse(const std::vector<Color>& sums, int samples, const std::vector<Color>& referenceSums, int referenceSamples)
+{
+    double squaredError = 0;
+    for (size_t i = 0; i < sums.size(); i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            double value = clamp(sums[i][c] / samples, 0., 1.);
+            double reference = clamp(referenceSums[i][c] / referenceSamples, 0., 1.);
+            squaredError += (value - reference) * (value - reference);
+        }
+    }
+    return std::sqrt(squaredError / (3. * sums.size()));
+}
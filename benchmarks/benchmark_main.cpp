@@ -0,0 +1,104 @@
+// benchmark_main.cpp : Renderer benchmarks. Run with the name of a benchmark followed by its options,
+// e.g. RaytracingBenchmark bvh_build --max-prims 1000000
+//
+
+#include <cstdio>
+#include <cstring>
+
+//count BVH node visits for the benchmarks reporting nodes per ray
+#define RT_BVH_STATS
+
+#include "bench_util.h"
+#include "bench_bvh_build.h"
+#include "bench_instancing.h"
+#include "bench_refit.h"
+#include "bench_motion_blur.h"
+#include "bench_convergence.h"
+#include "bench_sampling.h"
+#include "bench_shading.h"
+#include "bench_textures.h"
+#include "bench_media.h"
+#include "bench_denoise.h"
+#include "bench_preview.h"
+#include "bench_distributed.h"
+#include "bench_suite.h"
+#include "bench_regression.h"
+#include "bench_packets.h"
+#include "bench_compact_bvh.h"
+#include "bench_grid.h"
+#include "bench_lazy_bvh.h"
+#include "bench_out_of_core.h"
+#include "bench_lights.h"
+#include "bench_environment.h"
+#include "bench_guiding.h"
+#include "bench_bdpt.h"
+#include "bench_photons.h"
+
+struct Benchmark
+{
+    const char* name;
+    void (*run)(const BenchOptions& options);
+};
+
+const Benchmark benchmarks[] = {
+    { "bvh_build", benchBvhBuild },
+    { "instancing", benchInstancing },
+    { "refit", benchRefit },
+    { "motion_blur", benchMotionBlur },
+    { "convergence", benchConvergence },
+    { "sampling", benchSampling },
+    { "shading", benchShading },
+    { "textures", benchTextures },
+    { "media", benchMedia },
+    { "denoise", benchDenoise },
+    { "preview", benchPreview },
+    { "distributed", benchDistributed },
+    { "suite", benchSuite },
+    { "regression", benchRegression },
+    { "packets", benchPackets },
+    { "compact_bvh", benchCompactBvh },
+    { "grid", benchGrid },
+    { "lazy_bvh", benchLazyBvh },
+    { "out_of_core", benchOutOfCore },
+    { "lights", benchLights },
+    { "environment", benchEnvironment },
+    { "guiding", benchGuiding },
+    { "bdpt", benchBdpt },
+    { "photons", benchPhotons },
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <benchmark|all> [--option value]...\nBenchmarks:\n", argv[0]);
+        for (const auto& benchmark : benchmarks)
+            printf("  %s\n", benchmark.name);
+        return 1;
+    }
+
+    //worker process of the distributed benchmark: worker [--fail-after K] host port
+    if (strcmp(argv[1], "worker") == 0 && argc >= 4)
+    {
+        int failAfter = (argc >= 6 && strcmp(argv[2], "--fail-after") == 0) ? atoi(argv[3]) : -1;
+        return runRenderWorker(argv[argc - 2], atoi(argv[argc - 1]), failAfter);
+    }
+
+    BenchOptions options(argc, argv);
+    bool found = false;
+    for (const auto& benchmark : benchmarks)
+    {
+        if (strcmp(argv[1], "all") == 0 || strcmp(argv[1], benchmark.name) == 0)
+        {
+            benchmark.run(options);
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        printf("Unknown benchmark %s\n", argv[1]);
+        return 1;
+    }
+    return benchFailures > 0 ? 1 : 0;
+}
@@ -33,6 +33,8 @@ private:
     Point3 minimum;
     Point3 maximum;
     HittableList sides;
+
+    friend class LightSampler;
 };
 
 
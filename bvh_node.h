@@ -7,33 +7,70 @@
 #include "util.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using std::shared_ptr;
 using std::make_shared;
 using std::vector;
 
+#ifdef RT_BVH_STATS
+//nodes visited by the rays traced on this thread, only counted when RT_BVH_STATS is defined (benchmarks)
+inline thread_local long long bvhNodesVisited = 0;
+#define BVH_COUNT_VISIT() (bvhNodesVisited++)
+#else
+#define BVH_COUNT_VISIT()
+#endif
+
+enum class BvhBuildMethod
+{
+    RandomAxisMedian, //book builder: sort on a random axis and split in the middle
+    BinnedSAH,        //binned surface area heuristic, high quality trees
+    LBVH              //linear bvh: split on the morton codes of the centroids, very fast but approximate
+};
+
 class BvhNode : public Hittable
 {
 public:
 
     BvhNode(){}
-    BvhNode(const HittableList &hittableList, double time_0, double time_1) 
-        : BvhNode(hittableList.list, 0, hittableList.list.size(), time_0, time_1)
-    {
-
-    }
+    BvhNode(const HittableList &hittableList, double time_0, double time_1, BvhBuildMethod method = BvhBuildMethod::BinnedSAH);
     BvhNode(const vector<shared_ptr<Hittable>>& objectsList, size_t start, size_t end, double time_0, double time_1);
+    BvhNode(shared_ptr<Hittable> left, shared_ptr<Hittable> right, const aabb& box) : leftNode(left), rightNode(right), bBox(box) {}
 
     virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
     virtual bool boundingBox(double time0, double time1, aabb& output_box) const override;
+    virtual void hitPacket(RayPacket& packet, double min_t, uint64_t active) const override;
+    virtual bool hitUsesRandom() const override;
+
+    //expected cost of a random ray by the surface area heuristic, normalized by the root area (lower is better)
+    double sahCost(double time0 = 0, double time1 = 1) const;
+
+    //Refits the boxes bottom up for a new time window, keeping the topology. The first refit records the SAH
+    //cost of every node, later refits rebuild the subtrees whose cost grew beyond rebuildThreshold times that.
+    //Returns the number of rebuilt subtrees.
+    int refit(double time0, double time1, double rebuildThreshold = infinity);
+
+    //the leaves of the tree, left to right
+    void collectPrimitives(vector<shared_ptr<Hittable>>& objects) const;
 
 private:
+    friend class BvhBuilder;
+    template <typename Quantized> friend class CompactBvh;
+
+    void buildMedian(vector<shared_ptr<Hittable>>& objects, size_t start, size_t end, double time_0, double time_1);
+    double sahCostSum(double time0, double time1) const;
+    double refitNode(double time0, double time1, double rebuildThreshold, int& rebuilt);
 
     shared_ptr<Hittable> leftNode;
     shared_ptr<Hittable> rightNode;
 
     aabb bBox;
+    double referenceCost = 0; //normalized SAH cost of the subtree on the first refit
 };
 
 inline bool compareObjects(const shared_ptr<Hittable>& a, const shared_ptr<Hittable>& b, int axis)
@@ -63,10 +100,452 @@ bool box_z_compare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b)
 {
     return compareObjects(a, b, 2);
 }
+
+//Builds the SAH and LBVH trees over flat primitive references instead of copying the object list per node.
+//The top of the tree is split with all threads working on the same range (parallel binning/partition),
+//below that every remaining range is an independent subtree job built by one thread.
+class BvhBuilder
+{
+public:
+    struct Primitive
+    {
+        aabb box;
+        Point3 centroid;
+        uint32_t mortonCode = 0;
+        shared_ptr<Hittable> object;
+    };
+
+    BvhBuilder(double time_0, double time_1, BvhBuildMethod method_) : time0(time_0), time1(time_1), method(method_) {}
+
+    void build(const vector<shared_ptr<Hittable>>& objects, BvhNode& root);
+
+    //ranges smaller than this are built by a single thread
+    static const size_t parallelThreshold = 1 << 15;
+    static const int binCount = 16;
+
+private:
+    struct Bin
+    {
+        aabb box;
+        size_t count = 0;
+    };
+
+    struct Job
+    {
+        size_t start, end;
+        shared_ptr<Hittable>* slot;
+    };
+
+    void splitTop(size_t start, size_t end, BvhNode& node);
+    shared_ptr<Hittable> buildSubtree(size_t start, size_t end);
+    size_t findSplit(size_t start, size_t end, bool parallel);
+    size_t findSplitSAH(size_t start, size_t end, bool parallel);
+    size_t findSplitLBVH(size_t start, size_t end) const;
+    size_t partition(size_t start, size_t end, int axis, double minCentroid, double scale, int splitBin, bool parallel);
+    void rangeBounds(size_t start, size_t end, aabb& bounds, aabb& centroidBounds, bool parallel) const;
+    void computeMortonCodes();
+
+    static uint32_t expandBits(uint32_t v);
+    static int binIndex(double centroid, double minCentroid, double scale);
+
+    double time0, time1;
+    BvhBuildMethod method;
+    vector<Primitive> prims;
+    vector<Job> jobs;
+    vector<BvhNode*> topNodes; //nodes created by splitTop in pre-order
+};
+
+void BvhBuilder::build(const vector<shared_ptr<Hittable>>& objects, BvhNode& root)
+{
+    prims.resize(objects.size());
+
+    #pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(objects.size()); i++)
+    {
+        Primitive& prim = prims[i];
+        if (!objects[i]->boundingBox(time0, time1, prim.box))
+            std::cerr << "No bounding box in bvh_node constructor.\n";
+        prim.centroid = prim.box.centroid();
+        prim.object = objects[i];
+    }
+
+    if (prims.empty())
+        return;
+    if (prims.size() == 1)
+    {
+        root.leftNode = root.rightNode = prims[0].object;
+        root.bBox = prims[0].box;
+        return;
+    }
+
+    if (method == BvhBuildMethod::LBVH)
+        computeMortonCodes();
+
+    splitTop(0, prims.size(), root);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(jobs.size()); i++)
+    {
+        *jobs[i].slot = buildSubtree(jobs[i].start, jobs[i].end);
+    }
+
+    //the top nodes were created before their subtrees existed, fit their boxes bottom up
+    for (auto node = topNodes.rbegin(); node != topNodes.rend(); ++node)
+    {
+        aabb leftBox, rightBox;
+        (*node)->leftNode->boundingBox(time0, time1, leftBox);
+        (*node)->rightNode->boundingBox(time0, time1, rightBox);
+        (*node)->bBox = surrounding_box(leftBox, rightBox);
+    }
+
+    prims.clear();
+    jobs.clear();
+    topNodes.clear();
+}
+
+void BvhBuilder::splitTop(size_t start, size_t end, BvhNode& node)
+{
+    topNodes.push_back(&node);
+
+    size_t mid = findSplit(start, end, true);
+    shared_ptr<Hittable>* slots[2] = { &node.leftNode, &node.rightNode };
+    size_t ranges[3] = { start, mid, end };
+
+    for (int side = 0; side < 2; side++)
+    {
+        size_t childStart = ranges[side];
+        size_t childEnd = ranges[side + 1];
+        if (childEnd - childStart >= parallelThreshold)
+        {
+            auto child = make_shared<BvhNode>();
+            *slots[side] = child;
+            splitTop(childStart, childEnd, *child);
+        }
+        else
+        {
+            jobs.push_back({ childStart, childEnd, slots[side] });
+        }
+    }
+}
+
+shared_ptr<Hittable> BvhBuilder::buildSubtree(size_t start, size_t end)
+{
+    if (end - start == 1)
+        return prims[start].object;
+
+    size_t mid = findSplit(start, end, false);
+    auto left = buildSubtree(start, mid);
+    auto right = buildSubtree(mid, end);
+
+    aabb leftBox, rightBox;
+    left->boundingBox(time0, time1, leftBox);
+    right->boundingBox(time0, time1, rightBox);
+    return make_shared<BvhNode>(left, right, surrounding_box(leftBox, rightBox));
+}
+
+size_t BvhBuilder::findSplit(size_t start, size_t end, bool parallel)
+{
+    if (end - start == 2)
+        return start + 1;
+
+    size_t mid = (method == BvhBuildMethod::LBVH) ? findSplitLBVH(start, end) : findSplitSAH(start, end, parallel);
+
+    if (mid <= start || mid >= end)
+        mid = start + (end - start) / 2;
+    return mid;
+}
+
+size_t BvhBuilder::findSplitSAH(size_t start, size_t end, bool parallel)
+{
+    aabb bounds, centroidBounds;
+    rangeBounds(start, end, bounds, centroidBounds, parallel);
+
+    //all centroids in the same spot, any split is as good as the other
+    if (centroidBounds.extent().length_squared() <= 0)
+        return start + (end - start) / 2;
+
+    Bin bins[3][binCount];
+    Vec3 scale;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double extent = centroidBounds.extent()[axis];
+        scale[axis] = extent > 0 ? binCount / extent : 0;
+    }
+
+    auto binPrimitives = [&](size_t from, size_t to, Bin(&localBins)[3][binCount])
+    {
+        for (size_t i = from; i < to; i++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                int b = binIndex(prims[i].centroid[axis], centroidBounds.minimum()[axis], scale[axis]);
+                localBins[axis][b].count++;
+                localBins[axis][b].box.surround(prims[i].box);
+            }
+        }
+    };
+
+    if (parallel)
+    {
+        #pragma omp parallel
+        {
+            Bin localBins[3][binCount];
+            #pragma omp for nowait
+            for (std::ptrdiff_t i = start; i < static_cast<std::ptrdiff_t>(end); i++)
+                binPrimitives(i, i + 1, localBins);
+
+            #pragma omp critical
+            for (int axis = 0; axis < 3; axis++)
+            {
+                for (int b = 0; b < binCount; b++)
+                {
+                    bins[axis][b].count += localBins[axis][b].count;
+                    bins[axis][b].box.surround(localBins[axis][b].box);
+                }
+            }
+        }
+    }
+    else
+    {
+        binPrimitives(start, end, bins);
+    }
+
+    //sweep the bins from both sides, cost of a split is area weighted primitive count of the two halves
+    double bestCost = infinity;
+    int bestAxis = -1;
+    int bestBin = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (scale[axis] == 0)
+            continue;
+
+        double rightArea[binCount];
+        size_t rightCount[binCount];
+        aabb accumulated;
+        size_t count = 0;
+        for (int b = binCount - 1; b > 0; b--)
+        {
+            accumulated.surround(bins[axis][b].box);
+            count += bins[axis][b].count;
+            rightArea[b] = accumulated.surfaceArea();
+            rightCount[b] = count;
+        }
+
+        accumulated = aabb();
+        count = 0;
+        for (int b = 1; b < binCount; b++)
+        {
+            accumulated.surround(bins[axis][b - 1].box);
+            count += bins[axis][b - 1].count;
+            if (count == 0 || rightCount[b] == 0)
+                continue;
+            double cost = count * accumulated.surfaceArea() + rightCount[b] * rightArea[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    if (bestAxis < 0)
+        return start + (end - start) / 2;
+
+    return partition(start, end, bestAxis, centroidBounds.minimum()[bestAxis], scale[bestAxis], bestBin, parallel);
+}
+
+size_t BvhBuilder::partition(size_t start, size_t end, int axis, double minCentroid, double scale, int splitBin, bool parallel)
+{
+    auto goesLeft = [&](const Primitive& prim)
+    {
+        return binIndex(prim.centroid[axis], minCentroid, scale) < splitBin;
+    };
+
+#ifdef _OPENMP
+    //not when built from inside a parallel region (e.g. by a render thread), the nested team has a single thread
+    if (parallel && omp_get_max_threads() > 1 && !omp_in_parallel())
+    {
+        //every thread counts its chunk, then scatters it to the prefix summed offsets of both sides. The chunks are
+        //cut for the team the runtime actually gives, which can be smaller than omp_get_max_threads()
+        int threadCount = 0;
+        vector<size_t> leftCounts, rightCounts;
+        vector<Primitive> scattered(end - start);
+        size_t span = end - start;
+
+        #pragma omp parallel
+        {
+            #pragma omp single
+            {
+                threadCount = omp_get_num_threads();
+                leftCounts.assign(threadCount + 1, 0);
+                rightCounts.assign(threadCount + 1, 0);
+            }
+
+            int thread = omp_get_thread_num();
+            size_t chunkStart = start + span * thread / threadCount;
+            size_t chunkEnd = start + span * (thread + 1) / threadCount;
+
+            size_t left = 0;
+            for (size_t i = chunkStart; i < chunkEnd; i++)
+                left += goesLeft(prims[i]) ? 1 : 0;
+            leftCounts[thread + 1] = left;
+            rightCounts[thread + 1] = (chunkEnd - chunkStart) - left;
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                for (int t = 0; t < threadCount; t++)
+                {
+                    leftCounts[t + 1] += leftCounts[t];
+                    rightCounts[t + 1] += rightCounts[t];
+                }
+            }
+
+            size_t leftOut = leftCounts[thread];
+            size_t rightOut = leftCounts[threadCount] + rightCounts[thread];
+            for (size_t i = chunkStart; i < chunkEnd; i++)
+            {
+                if (goesLeft(prims[i]))
+                    scattered[leftOut++] = std::move(prims[i]);
+                else
+                    scattered[rightOut++] = std::move(prims[i]);
+            }
+
+            #pragma omp barrier
+            #pragma omp for
+            for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(span); i++)
+                prims[start + i] = std::move(scattered[i]);
+        }
+        return start + leftCounts[threadCount];
+    }
+#endif
+
+    auto mid = std::partition(prims.begin() + start, prims.begin() + end, goesLeft);
+    return mid - prims.begin();
+}
+
+void BvhBuilder::rangeBounds(size_t start, size_t end, aabb& bounds, aabb& centroidBounds, bool parallel) const
+{
+    bounds = aabb();
+    centroidBounds = aabb();
+    if (!parallel)
+    {
+        for (size_t i = start; i < end; i++)
+        {
+            bounds.surround(prims[i].box);
+            centroidBounds.surround(prims[i].centroid);
+        }
+        return;
+    }
+
+    #pragma omp parallel
+    {
+        aabb localBounds, localCentroidBounds;
+        #pragma omp for nowait
+        for (std::ptrdiff_t i = start; i < static_cast<std::ptrdiff_t>(end); i++)
+        {
+            localBounds.surround(prims[i].box);
+            localCentroidBounds.surround(prims[i].centroid);
+        }
+        #pragma omp critical
+        {
+            bounds.surround(localBounds);
+            centroidBounds.surround(localCentroidBounds);
+        }
+    }
+}
+
+void BvhBuilder::computeMortonCodes()
+{
+    aabb bounds, centroidBounds;
+    rangeBounds(0, prims.size(), bounds, centroidBounds, true);
+
+    Vec3 extent = centroidBounds.extent();
+    #pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(prims.size()); i++)
+    {
+        uint32_t code = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            double offset = extent[axis] > 0 ? (prims[i].centroid[axis] - centroidBounds.minimum()[axis]) / extent[axis] : 0.;
+            uint32_t cell = static_cast<uint32_t>(clamp(offset * 1024., 0., 1023.));
+            code |= expandBits(cell) << (2 - axis);
+        }
+        prims[i].mortonCode = code;
+    }
+
+    //two 15 bit radix passes over the 30 bit codes
+    vector<Primitive> sorted(prims.size());
+    for (int shift = 0; shift < 30; shift += 15)
+    {
+        vector<size_t> offsets((1 << 15) + 1, 0);
+        for (const auto& prim : prims)
+            offsets[((prim.mortonCode >> shift) & 0x7fff) + 1]++;
+        for (size_t b = 1; b < offsets.size(); b++)
+            offsets[b] += offsets[b - 1];
+        for (auto& prim : prims)
+            sorted[offsets[(prim.mortonCode >> shift) & 0x7fff]++] = std::move(prim);
+        prims.swap(sorted);
+    }
+}
+
+size_t BvhBuilder::findSplitLBVH(size_t start, size_t end) const
+{
+    //split where the highest bit that differs within the sorted range flips from 0 to 1
+    uint32_t first = prims[start].mortonCode;
+    uint32_t last = prims[end - 1].mortonCode;
+    if (first == last)
+        return start + (end - start) / 2;
+
+    uint32_t highestBit = 1u << 29;
+    while (((first ^ last) & highestBit) == 0)
+        highestBit >>= 1;
+
+    auto mid = std::partition_point(prims.begin() + start, prims.begin() + end,
+        [highestBit](const Primitive& prim) { return (prim.mortonCode & highestBit) == 0; });
+    return mid - prims.begin();
+}
+
+uint32_t BvhBuilder::expandBits(uint32_t v)
+{
+    //spread the lower 10 bits so that two zeros separate every bit
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+int BvhBuilder::binIndex(double centroid, double minCentroid, double scale)
+{
+    int b = static_cast<int>((centroid - minCentroid) * scale);
+    return std::max(0, std::min(b, binCount - 1));
+}
+
+BvhNode::BvhNode(const HittableList& hittableList, double time_0, double time_1, BvhBuildMethod method)
+{
+    if (method == BvhBuildMethod::RandomAxisMedian)
+    {
+        vector<shared_ptr<Hittable>> objects = hittableList.list;
+        if (!objects.empty())
+            buildMedian(objects, 0, objects.size(), time_0, time_1);
+        return;
+    }
+
+    BvhBuilder builder(time_0, time_1, method);
+    builder.build(hittableList.list, *this);
+}
+
 BvhNode::BvhNode(const vector<shared_ptr<Hittable>>& objectsList, size_t start, size_t end, double time_0, double time_1)
 {
+    //sorted in place by the children, copy once instead of once per node
     vector<shared_ptr<Hittable>> objects = objectsList;
+    buildMedian(objects, start, end, time_0, time_1);
+}
 
+void BvhNode::buildMedian(vector<shared_ptr<Hittable>>& objects, size_t start, size_t end, double time_0, double time_1)
+{
     //choose compare function for a random axis
     int axis = random_int(0, 2);
     auto comparator = (axis == 0) ? box_x_compare : (axis == 1) ? box_y_compare : box_z_compare;
@@ -79,7 +558,7 @@ BvhNode::BvhNode(const vector<shared_ptr<Hittable>>& objectsList, size_t start,
     }
     else if (span == 2)
     {
-        if (objects[start] > objects[end - 1])
+        if (comparator(objects[end - 1], objects[start]))
             swap(objects[start], objects[end - 1]);
         leftNode = objects[start];
         rightNode = objects[end - 1];
@@ -88,8 +567,12 @@ BvhNode::BvhNode(const vector<shared_ptr<Hittable>>& objectsList, size_t start,
     {
         sort(objects.begin() + start, objects.begin() + end, comparator);
         size_t mid = start + span / 2;
-        leftNode = make_shared<BvhNode>(objects, start, mid, time_0, time_1);
-        rightNode = make_shared<BvhNode>(objects, mid, end, time_0, time_1);
+        auto left = make_shared<BvhNode>();
+        auto right = make_shared<BvhNode>();
+        left->buildMedian(objects, start, mid, time_0, time_1);
+        right->buildMedian(objects, mid, end, time_0, time_1);
+        leftNode = left;
+        rightNode = right;
     }
 
     aabb bboxA;
@@ -105,6 +588,7 @@ BvhNode::BvhNode(const vector<shared_ptr<Hittable>>& objectsList, size_t start,
 }
 bool BvhNode::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
 {
+    BVH_COUNT_VISIT();
     if (!bBox.hit(r, min_t, max_t))
         return false;
 
@@ -115,8 +599,138 @@ bool BvhNode::hit(const Ray& r, const double& min_t, const double& max_t, HitRec
     return hitleft || hitright;
 }
 
+//The packet descends into the children with the rays that hit the box, unless the packet test rejects the box
+//for all of them first. Every ray visits the nodes it would visit alone, in the same order.
+void BvhNode::hitPacket(RayPacket& packet, double min_t, uint64_t active) const
+{
+    BVH_COUNT_VISIT();
+    if (packet.missesBox(bBox, min_t))
+        return;
+    active = packet.boxMask(bBox, min_t, active);
+    if (!active)
+        return;
+
+    leftNode->hitPacket(packet, min_t, active);
+    rightNode->hitPacket(packet, min_t, active);
+}
+
+bool BvhNode::hitUsesRandom() const
+{
+    return (leftNode && leftNode->hitUsesRandom()) || (rightNode && rightNode->hitUsesRandom());
+}
+
 bool BvhNode::boundingBox(double time0, double time1, aabb& output_box) const
 {
     output_box = bBox;
     return true;
-}
\ No newline at end of file
+}
+
+double BvhNode::sahCost(double time0, double time1) const
+{
+    double rootArea = bBox.surfaceArea();
+    if (rootArea <= 0)
+        return 0;
+    return sahCostSum(time0, time1) / rootArea;
+}
+
+double BvhNode::sahCostSum(double time0, double time1) const
+{
+    //one traversal step for this node plus the cost of its children, weighted by area
+    const double traversalCost = 1.;
+    const double intersectionCost = 1.;
+
+    double cost = traversalCost * bBox.surfaceArea();
+    for (const auto& child : { leftNode, rightNode })
+    {
+        if (!child)
+            continue;
+        if (auto childNode = dynamic_cast<const BvhNode*>(child.get()))
+        {
+            cost += childNode->sahCostSum(time0, time1);
+        }
+        else
+        {
+            aabb box;
+            child->boundingBox(time0, time1, box);
+            cost += intersectionCost * box.surfaceArea();
+        }
+        if (leftNode == rightNode)
+            break;
+    }
+    return cost;
+}
+
+int BvhNode::refit(double time0, double time1, double rebuildThreshold)
+{
+    int rebuilt = 0;
+    refitNode(time0, time1, rebuildThreshold, rebuilt);
+    return rebuilt;
+}
+
+double BvhNode::refitNode(double time0, double time1, double rebuildThreshold, int& rebuilt)
+{
+    const double traversalCost = 1.;
+    const double intersectionCost = 1.;
+
+    if (!leftNode)
+        return 0;
+
+    //returns the unnormalized SAH cost of the subtree, like sahCostSum
+    double childCost = 0;
+    aabb box;
+    for (const auto& child : { leftNode, rightNode })
+    {
+        aabb childBox;
+        if (auto childNode = dynamic_cast<BvhNode*>(child.get()))
+        {
+            childCost += childNode->refitNode(time0, time1, rebuildThreshold, rebuilt);
+            childBox = childNode->bBox;
+        }
+        else
+        {
+            child->boundingBox(time0, time1, childBox);
+            childCost += intersectionCost * childBox.surfaceArea();
+        }
+        box.surround(childBox);
+        if (leftNode == rightNode)
+            break;
+    }
+    bBox = box;
+
+    double area = bBox.surfaceArea();
+    double cost = traversalCost * area + childCost;
+    if (area <= 0)
+        return cost;
+
+    if (referenceCost <= 0)
+    {
+        referenceCost = cost / area;
+    }
+    else if (cost / area > rebuildThreshold * referenceCost)
+    {
+        vector<shared_ptr<Hittable>> objects;
+        collectPrimitives(objects);
+        if (objects.size() > 2)
+        {
+            BvhBuilder builder(time0, time1, BvhBuildMethod::BinnedSAH);
+            builder.build(objects, *this);
+            cost = sahCostSum(time0, time1);
+            referenceCost = cost / bBox.surfaceArea();
+            rebuilt++;
+        }
+    }
+    return cost;
+}
+
+void BvhNode::collectPrimitives(vector<shared_ptr<Hittable>>& objects) const
+{
+    for (const auto& child : { leftNode, rightNode })
+    {
+        if (auto childNode = dynamic_cast<const BvhNode*>(child.get()))
+            childNode->collectPrimitives(objects);
+        else if (child)
+            objects.push_back(child);
+        if (leftNode == rightNode)
+            break;
+    }
+}
@@ -2,6 +2,9 @@
 
 #include "vec3.h"
 #include "ray.h"
+#include "sampler.h"
+
+#include <vector>
 class Camera {
 
     public:
@@ -29,13 +32,97 @@ class Camera {
 
         Ray get_ray(double s, double t) const
         {
-            Vec3 lens_disk = lens_radius * random_in_unit_disk();
+            Vec3 lens_disk = lens_radius * ((scatterSampling == ScatterSampling::Analytic) ? random_in_unit_disk_analytic() : random_in_unit_disk());
             Vec3 offset = u * lens_disk.x() + v * lens_disk.y();
             return Ray( origin+offset, 
                         lower_left_corner + s * horizontal + t * vertical - origin - offset, 
                         random_double(time0, time1));
         }
+
+        //Rays of samples [firstSample, firstSample + sampleCount) for every pixel of the tile [x0, x1) x [y0, y1),
+        //pixel by pixel with row 0 at the top of the image. The pixel corner is computed once per pixel and the
+        //aperture is sampled with the concentric disk mapping so stratified sequences stay stratified on the lens.
+        void generateTile(int x0, int y0, int x1, int y1, int imageWidth, int imageHeight, int firstSample, int sampleCount,
+            const PixelSampler& sampler, std::vector<Ray>& rays) const
+        {
+            rays.clear();
+            rays.reserve(size_t(x1 - x0) * (y1 - y0) * sampleCount);
+
+            Vec3 pixelU = horizontal / (imageWidth - 1);
+            Vec3 pixelV = vertical / (imageHeight - 1);
+            for (int row = y0; row < y1; row++)
+            {
+                Vec3 rowCorner = lower_left_corner + (imageHeight - 1 - row) * pixelV - origin;
+                for (int col = x0; col < x1; col++)
+                {
+                    Vec3 pixelCorner = rowCorner + col * pixelU;
+                    for (int s = firstSample; s < firstSample + sampleCount; s++)
+                    {
+                        double jitterU, jitterV;
+                        sampler.sample2D(col, row, s, PixelSampler::PixelJitter, jitterU, jitterV);
+                        Vec3 direction = pixelCorner + jitterU * pixelU + jitterV * pixelV;
+
+                        Vec3 offset;
+                        if (lens_radius > 0)
+                        {
+                            double lensU, lensV;
+                            sampler.sample2D(col, row, s, PixelSampler::Lens, lensU, lensV);
+                            Vec3 lens_disk = lens_radius * concentric_sample_disk(lensU, lensV);
+                            offset = u * lens_disk.x() + v * lens_disk.y();
+                        }
+
+                        double time = time0 + sampler.sample1D(col, row, s, PixelSampler::Time) * (time1 - time0);
+                        rays.push_back(Ray(origin + offset, direction - offset, time));
+                    }
+                }
+            }
+        }
+        //Uniform point of the lens, where paths traced from the lights reach the camera
+        Point3 sampleLens() const
+        {
+            Vec3 lens_disk = lens_radius * random_in_unit_disk_analytic();
+            return origin + u * lens_disk.x() + v * lens_disk.y();
+        }
+
+        //view direction, the normal of the lens
+        Vec3 forward() const { return -w; }
+
+        //Pixel whose camera rays from lensPoint pass through p (they cross the focal plane at the same point), false
+        //when p is behind the camera or outside the image
+        bool pixelOf(const Point3& lensPoint, const Point3& p, int imageWidth, int imageHeight, int& col, int& row) const
+        {
+            Vec3 direction = p - lensPoint;
+            double along = dot(direction, -w);
+            if (along <= 0)
+                return false;
+            Point3 onFocalPlane = lensPoint + (dot(origin - lensPoint, -w) + focalDistance()) / along * direction;
+            Vec3 local = onFocalPlane - lower_left_corner;
+            double x = dot(local, u) / horizontal.length() * (imageWidth - 1);
+            double y = dot(local, v) / vertical.length() * (imageHeight - 1);
+            if (x < 0 || y < 0 || x >= imageWidth || y >= imageHeight)
+                return false;
+            col = static_cast<int>(x);
+            row = imageHeight - 1 - static_cast<int>(y);
+            return true;
+        }
+
+        //Density per solid angle of the camera rays of all the pixels of an imageWidth x imageHeight image (spread
+        //uniformly over the film in the focal plane) leaving any lens point in direction (unit). It is also the
+        //importance of the direction, the weight of light arriving from it in the image.
+        double directionPdf(const Vec3& direction, int imageWidth, int imageHeight) const
+        {
+            double cosine = dot(direction, -w);
+            if (cosine <= 0)
+                return 0;
+            double pixelArea = horizontal.length() / (imageWidth - 1) * vertical.length() / (imageHeight - 1);
+            double filmArea = pixelArea * imageWidth * imageHeight;
+            double distance = focalDistance();
+            return distance * distance / (filmArea * cosine * cosine * cosine);
+        }
+
     private:
+            double focalDistance() const { return dot(origin - lower_left_corner, w); }
+
             Point3 origin;
             Vec3 horizontal;
             Vec3 vertical;
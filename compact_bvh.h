@@ -0,0 +1,252 @@
+#pragma once
+
+#include "bvh_node.h"
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+//Flat BVH with quantized child boxes, to cut the memory traffic of traversal on large scenes. A node stores the
+//boxes of its two children as Quantized (uint8_t or uint16_t) fractions of its own box and the children's indices,
+//only the root box is kept in full. The fractions are rounded outwards so a decoded box always contains the real
+//one: rays visit a few more nodes but find the same closest hits as with the BvhNode it's built from.
+//Nodes are packed into 64 byte lines, three 20 byte nodes (8 bit) or two 32 byte nodes (16 bit) per line, so no
+//node straddles two cache lines. A BvhNode costs 96 bytes plus its shared_ptr control block.
+template <typename Quantized>
+class CompactBvh : public Hittable
+{
+    static_assert(std::is_same<Quantized, uint8_t>::value || std::is_same<Quantized, uint16_t>::value, "8 or 16 bit quantization");
+
+public:
+    CompactBvh(const HittableList& hittableList, double time_0, double time_1, BvhBuildMethod method = BvhBuildMethod::BinnedSAH);
+
+    virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
+    virtual bool boundingBox(double time0, double time1, aabb& output_box) const override;
+    virtual bool hitUsesRandom() const override { return usesRandom; }
+
+    struct Node
+    {
+        Quantized lower[2][3];
+        Quantized upper[2][3];
+        uint32_t child[2]; //node index, or primitive index with leafBit set
+    };
+    static const int nodesPerLine = 64 / sizeof(Node);
+    struct alignas(64) Line
+    {
+        Node nodes[nodesPerLine];
+    };
+
+    size_t nodeCount() const { return count; }
+    size_t nodeBytes() const { return lines.size() * sizeof(Line); }
+
+private:
+    static constexpr uint32_t leafBit = 0x80000000u;
+    static constexpr int levels = std::numeric_limits<Quantized>::max();
+
+    const Node& node(uint32_t index) const { return lines[index / nodesPerLine].nodes[index % nodesPerLine]; }
+    Node& node(uint32_t index) { return lines[index / nodesPerLine].nodes[index % nodesPerLine]; }
+
+    //bounds of a child on one axis from its quantized fractions of the parent's [parentMin, parentMax]. The top
+    //fraction decodes to parentMax itself, so rounding can't cut off the end of the parent box.
+    static double decodeLower(double parentMin, double parentMax, int q)
+    {
+        return parentMin + q * ((parentMax - parentMin) * (1. / levels));
+    }
+    static double decodeUpper(double parentMin, double parentMax, int q)
+    {
+        return q == levels ? parentMax : parentMin + q * ((parentMax - parentMin) * (1. / levels));
+    }
+
+    uint32_t flatten(const BvhNode& source, const double* boxMin, const double* boxMax, int depth);
+    uint32_t addChild(const shared_ptr<Hittable>& child, const double* boxMin, const double* boxMax, int depth);
+
+    std::vector<Line> lines;
+    size_t count = 0;
+    std::vector<shared_ptr<Hittable>> primitives;
+    aabb bBox;
+    double time0 = 0, time1 = 0;
+    int maxDepth = 0;
+    bool usesRandom = false;
+};
+
+template <typename Quantized>
+CompactBvh<Quantized>::CompactBvh(const HittableList& hittableList, double time_0, double time_1, BvhBuildMethod method)
+    : time0(time_0), time1(time_1)
+{
+    if (hittableList.list.empty())
+        return;
+
+    //the topology comes from a BvhNode, which is dropped once flattened
+    BvhNode source(hittableList, time_0, time_1, method);
+    source.boundingBox(time_0, time_1, bBox);
+    lines.reserve(hittableList.list.size() / nodesPerLine + 1);
+    primitives.reserve(hittableList.list.size());
+
+    double rootMin[3] = { bBox.minimum().x(), bBox.minimum().y(), bBox.minimum().z() };
+    double rootMax[3] = { bBox.maximum().x(), bBox.maximum().y(), bBox.maximum().z() };
+    flatten(source, rootMin, rootMax, 1);
+    lines.shrink_to_fit();
+}
+
+template <typename Quantized>
+uint32_t CompactBvh<Quantized>::flatten(const BvhNode& source, const double* boxMin, const double* boxMax, int depth)
+{
+    uint32_t index = static_cast<uint32_t>(count++);
+    if (index % nodesPerLine == 0)
+        lines.push_back(Line());
+    maxDepth = std::max(maxDepth, depth);
+
+    const shared_ptr<Hittable>* children[2] = { &source.leftNode, &source.rightNode };
+    double childMin[2][3], childMax[2][3];
+    for (int side = 0; side < 2; side++)
+    {
+        aabb box;
+        (*children[side])->boundingBox(time0, time1, box);
+        for (int a = 0; a < 3; a++)
+        {
+            //largest lower and smallest upper fraction whose decoded bound still contains the box, with a few ulps
+            //of slack in case the decode is contracted differently where it's inlined in traversal
+            double extent = boxMax[a] - boxMin[a];
+            double slack = 4 * std::numeric_limits<double>::epsilon() * (std::abs(boxMin[a]) + std::abs(boxMax[a]));
+            int lower = 0, upper = levels;
+            if (extent > 0)
+            {
+                lower = static_cast<int>(std::max(0., std::min(double(levels), std::floor((box.minimum()[a] - boxMin[a]) / extent * levels))));
+                upper = static_cast<int>(std::max(0., std::min(double(levels), std::ceil((box.maximum()[a] - boxMin[a]) / extent * levels))));
+                while (lower > 0 && decodeLower(boxMin[a], boxMax[a], lower) > box.minimum()[a] - slack)
+                    lower--;
+                while (upper < levels && decodeUpper(boxMin[a], boxMax[a], upper) < box.maximum()[a] + slack)
+                    upper++;
+            }
+            node(index).lower[side][a] = static_cast<Quantized>(lower);
+            node(index).upper[side][a] = static_cast<Quantized>(upper);
+            childMin[side][a] = decodeLower(boxMin[a], boxMax[a], lower);
+            childMax[side][a] = decodeUpper(boxMin[a], boxMax[a], upper);
+        }
+    }
+
+    //children are quantized against the decoded box, the only one traversal knows
+    for (int side = 0; side < 2; side++)
+    {
+        uint32_t child = addChild(*children[side], childMin[side], childMax[side], depth + 1);
+        node(index).child[side] = child;
+    }
+    return index;
+}
+
+template <typename Quantized>
+uint32_t CompactBvh<Quantized>::addChild(const shared_ptr<Hittable>& child, const double* boxMin, const double* boxMax, int depth)
+{
+    if (auto childNode = dynamic_cast<const BvhNode*>(child.get()))
+        return flatten(*childNode, boxMin, boxMax, depth);
+
+    usesRandom = usesRandom || child->hitUsesRandom();
+    primitives.push_back(child);
+    return static_cast<uint32_t>(primitives.size() - 1) | leafBit;
+}
+
+//Depth first with a stack of the nodes still to visit and their decoded boxes. Both children are tested at once,
+//hit leaves are intersected right away and the nearer of two hit inner children is visited first.
+template <typename Quantized>
+bool CompactBvh<Quantized>::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
+{
+    if (!count || !bBox.hit(r, min_t, max_t))
+        return false;
+
+    struct Entry
+    {
+        uint32_t index;
+        double boxMin[3], boxMax[3];
+    };
+    const int localSize = 64;
+    Entry local[localSize];
+    std::vector<Entry> deep;
+    Entry* stack = local;
+    if (maxDepth >= localSize)
+    {
+        deep.resize(maxDepth + 1);
+        stack = deep.data();
+    }
+
+    double origin[3] = { r.origin().x(), r.origin().y(), r.origin().z() };
+    double invDirection[3] = { 1. / r.direction().x(), 1. / r.direction().y(), 1. / r.direction().z() };
+    double closest = max_t;
+    bool hitAnything = false;
+
+    int size = 1;
+    stack[0].index = 0;
+    for (int a = 0; a < 3; a++)
+    {
+        stack[0].boxMin[a] = bBox.minimum()[a];
+        stack[0].boxMax[a] = bBox.maximum()[a];
+    }
+
+    while (size > 0)
+    {
+        Entry entry = stack[--size];
+        const Node& current = node(entry.index);
+        BVH_COUNT_VISIT();
+
+        double childMin[2][3], childMax[2][3], entryT[2];
+        bool childHit[2];
+        for (int side = 0; side < 2; side++)
+        {
+            //same slab test as aabb::hit, on the decoded box
+            double t_min = min_t, t_max = closest;
+            for (int a = 0; a < 3; a++)
+            {
+                childMin[side][a] = decodeLower(entry.boxMin[a], entry.boxMax[a], current.lower[side][a]);
+                childMax[side][a] = decodeUpper(entry.boxMin[a], entry.boxMax[a], current.upper[side][a]);
+                double t0 = (childMin[side][a] - origin[a]) * invDirection[a];
+                double t1 = (childMax[side][a] - origin[a]) * invDirection[a];
+                if (invDirection[a] < 0.)
+                    std::swap(t0, t1);
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+            }
+            childHit[side] = t_max > t_min;
+            entryT[side] = t_min;
+        }
+
+        int near = (childHit[0] && childHit[1] && entryT[1] < entryT[0]) ? 1 : 0;
+        int order[2] = { near, 1 - near };
+        int inner[2], innerCount = 0;
+        for (int side : order)
+        {
+            if (!childHit[side])
+                continue;
+            uint32_t child = current.child[side];
+            if (!(child & leafBit))
+            {
+                inner[innerCount++] = side;
+            }
+            else if (primitives[child & ~leafBit]->hit(r, min_t, closest, hitrecord))
+            {
+                hitAnything = true;
+                closest = hitrecord.t;
+            }
+        }
+        //push the far child first so the near one is popped next
+        while (innerCount > 0)
+        {
+            int side = inner[--innerCount];
+            uint32_t child = current.child[side];
+            Entry& next = stack[size++];
+            next.index = child;
+            for (int a = 0; a < 3; a++)
+            {
+                next.boxMin[a] = childMin[side][a];
+                next.boxMax[a] = childMax[side][a];
+            }
+        }
+    }
+    return hitAnything;
+}
+
+template <typename Quantized>
+bool CompactBvh<Quantized>::boundingBox(double time0, double time1, aabb& output_box) const
+{
+    output_box = bBox;
+    return true;
+}
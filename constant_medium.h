@@ -0,0 +1,61 @@
+#pragma once
+
+#include "hittable.h"
+#include "material.h"
+
+using std::shared_ptr;
+using std::make_shared;
+
+//Homogeneous participating medium (fog, smoke) filling a convex boundary. Inside the medium the distance to the
+//next scattering event is exponentially distributed, so it is sampled in closed form from a single random number.
+class ConstantMedium : public Hittable
+{
+    public:
+        ConstantMedium(shared_ptr<Hittable> boundary_, double density, shared_ptr<Texture> albedo)
+            : boundary(boundary_), negInvDensity(-1. / density), phaseFunction(make_shared<Isotropic>(albedo)) {}
+
+        ConstantMedium(shared_ptr<Hittable> boundary_, double density, Color albedo)
+            : boundary(boundary_), negInvDensity(-1. / density), phaseFunction(make_shared<Isotropic>(albedo)) {}
+
+        virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
+        virtual bool boundingBox(double time0, double time1, aabb& output_box) const override
+        {
+            return boundary->boundingBox(time0, time1, output_box);
+        }
+        virtual bool hitUsesRandom() const override { return true; }
+
+    private:
+        shared_ptr<Hittable> boundary;
+        double negInvDensity;
+        shared_ptr<Material> phaseFunction;
+};
+
+bool ConstantMedium::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
+{
+    //entry and exit of the whole line, the ray may start inside the medium
+    HitRecord rec1, rec2;
+    if (!boundary->hit(r, -infinity, infinity, rec1))
+        return false;
+    if (!boundary->hit(r, rec1.t + 0.0001, infinity, rec2))
+        return false;
+
+    double t1 = std::max(rec1.t, min_t);
+    double t2 = std::min(rec2.t, max_t);
+    if (t1 >= t2)
+        return false;
+    t1 = std::max(t1, 0.);
+
+    double rayLength = r.direction().length();
+    double distanceInside = (t2 - t1) * rayLength;
+    double hitDistance = negInvDensity * log(1. - random_double());
+    if (hitDistance > distanceInside)
+        return false;
+
+    hitrecord.t = t1 + hitDistance / rayLength;
+    hitrecord.p = r.at(hitrecord.t);
+    hitrecord.u = hitrecord.v = 0.;
+    hitrecord.normal = Vec3(1, 0, 0); //arbitrary, the phase function doesn't use it
+    hitrecord.front_face = true;
+    hitrecord.material_ptr = phaseFunction.get();
+    return true;
+}
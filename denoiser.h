@@ -0,0 +1,155 @@
+#pragma once
+
+#include "renderer.h"
+
+#include <cmath>
+#include <vector>
+
+struct DenoiseSettings
+{
+    int iterations = 5;        //filter radius doubles every iteration, 5 iterations reach 62 pixels
+    double sigmaColor = 16.;   //in standard deviations of the pixel noise
+    double sigmaNormal = 0.3;
+    double sigmaDepth = 0.05;  //relative to the depth
+    double sigmaAlbedo = 0.1;
+};
+
+//Edge avoiding a-trous wavelet filter (Dammertz et al.) guided by the first hit features, with the color weight
+//scaled by the estimated noise of every pixel as in SVGF. The color is divided by the albedo before filtering and
+//multiplied back afterwards, so textures stay sharp and only the lighting is smoothed.
+//sums and features are the per pixel sums of samples_per_pixel samples from renderSamples, out gets averaged
+//linear colors (toImage with 1 sample per pixel).
+class Denoiser
+{
+    public:
+        Denoiser(int width_, int height_, const DenoiseSettings& settings_ = DenoiseSettings())
+            : width(width_), height(height_), settings(settings_) {}
+
+        void denoise(const std::vector<Color>& sums, const std::vector<PixelFeatures>& features, int samples_per_pixel, std::vector<Color>& out);
+
+    private:
+        void filterIteration(int step);
+
+        int width, height;
+        DenoiseSettings settings;
+
+        std::vector<Color> albedo;
+        std::vector<Vec3> normal;
+        std::vector<double> depth;
+        std::vector<Color> irradiance, filtered;
+        std::vector<double> variance, filteredVariance;
+};
+
+void Denoiser::denoise(const std::vector<Color>& sums, const std::vector<PixelFeatures>& features, int samples_per_pixel, std::vector<Color>& out)
+{
+    size_t pixels = size_t(width) * height;
+    double invSamples = 1. / samples_per_pixel;
+    albedo.resize(pixels);
+    normal.resize(pixels);
+    depth.resize(pixels);
+    irradiance.resize(pixels);
+    variance.resize(pixels);
+    filtered.resize(pixels);
+    filteredVariance.resize(pixels);
+
+    const double minAlbedo = 0.01;
+    #pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(pixels); i++)
+    {
+        Color color = sums[i] * invSamples;
+        albedo[i] = features[i].albedo * invSamples;
+        normal[i] = features[i].normal * invSamples;
+        depth[i] = features[i].depth * invSamples;
+
+        //channels without albedo (lights are demodulated by their own color) are filtered as they are
+        Color demodulate;
+        for (int c = 0; c < 3; c++)
+            demodulate[c] = albedo[i][c] > minAlbedo ? 1. / albedo[i][c] : 1.;
+        irradiance[i] = color * demodulate;
+
+        //variance of the mean of the samples, in demodulated units
+        double mean = luminance(color);
+        double sampleVariance = std::max(0., features[i].luminanceSquared * invSamples - mean * mean);
+        double scale = luminance(demodulate);
+        variance[i] = sampleVariance * invSamples * scale * scale;
+    }
+
+    for (int iteration = 0; iteration < settings.iterations; iteration++)
+    {
+        filterIteration(1 << iteration);
+        std::swap(irradiance, filtered);
+        std::swap(variance, filteredVariance);
+    }
+
+    out.resize(pixels);
+    #pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(pixels); i++)
+    {
+        Color remodulate;
+        for (int c = 0; c < 3; c++)
+            remodulate[c] = albedo[i][c] > minAlbedo ? albedo[i][c] : 1.;
+        out[i] = irradiance[i] * remodulate;
+    }
+}
+
+void Denoiser::filterIteration(int step)
+{
+    //B3 spline, the 5x5 kernel is its outer product spread step pixels apart
+    static const double kernel[5] = { 1. / 16., 1. / 4., 3. / 8., 1. / 4., 1. / 16. };
+
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            size_t p = size_t(y) * width + x;
+
+            //noise of the pixel from its variance blurred over 3x3 pixels, single pixel estimates are too noisy
+            double localVariance = 0, localWeight = 0;
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    int qx = x + dx, qy = y + dy;
+                    if (qx < 0 || qx >= width || qy < 0 || qy >= height)
+                        continue;
+                    double w = (dx == 0 ? 2. : 1.) * (dy == 0 ? 2. : 1.);
+                    localVariance += w * variance[size_t(qy) * width + qx];
+                    localWeight += w;
+                }
+            }
+            double colorScale = 1. / (settings.sigmaColor * std::sqrt(localVariance / localWeight) + 1e-4);
+
+            double lp = luminance(irradiance[p]);
+            Color sum;
+            double sumWeights = 0, sumVariance = 0;
+            for (int j = 0; j < 5; j++)
+            {
+                int qy = y + (j - 2) * step;
+                if (qy < 0 || qy >= height)
+                    continue;
+                for (int i = 0; i < 5; i++)
+                {
+                    int qx = x + (i - 2) * step;
+                    if (qx < 0 || qx >= width)
+                        continue;
+                    size_t q = size_t(qy) * width + qx;
+
+                    double colorDistance = std::fabs(lp - luminance(irradiance[q])) * colorScale;
+                    double normalDistance = (normal[p] - normal[q]).length_squared() / (settings.sigmaNormal * settings.sigmaNormal);
+                    double depthDistance = std::fabs(depth[p] - depth[q]) / (settings.sigmaDepth * std::max(depth[p], depth[q]) + 1e-6);
+                    double albedoDistance = (albedo[p] - albedo[q]).length_squared() / (settings.sigmaAlbedo * settings.sigmaAlbedo);
+                    double w = kernel[i] * kernel[j] * std::exp(-colorDistance - normalDistance - depthDistance - albedoDistance);
+
+                    sum += w * irradiance[q];
+                    sumWeights += w;
+                    sumVariance += w * w * variance[q];
+                }
+            }
+
+            //the center tap always has weight kernel[2]^2, so sumWeights > 0
+            filtered[p] = sum / sumWeights;
+            filteredVariance[p] = sumVariance / (sumWeights * sumWeights);
+        }
+    }
+}
@@ -0,0 +1,430 @@
+#pragma once
+
+#include "scenes.h"
+#include "renderer.h"
+#include "socket_util.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+//Distributed rendering over local sockets. The coordinator hands tiles to worker processes and adds the float
+//sums they send back to the image. Workers regenerate the scene from its number and seed, and every pixel's paths
+//depend only on the seed, the pixel and the sample index, so the image matches a single process render up to the
+//rounding of the sums to float. Only plain path tracing is distributed, with or without sampled lights.
+//Messages are raw structs; coordinator and workers run the same binary on the same kind of machine.
+
+const int32_t distributedMagic = 0x52545733; //"RTW3"
+
+//sent once to every worker when it connects
+struct DistributedJob
+{
+    int32_t magic;
+    int32_t scene;
+    int32_t seed;
+    int32_t width, height;
+    int32_t samplesPerPixel;
+    int32_t maxDepth;
+    int32_t sequence;
+    int32_t lights; //LightSelection of the sampled lights plus 1, 0 when lights aren't sampled
+    int32_t threads; //0 keeps the OpenMP default
+    int32_t scatterSampling; //ScatterSampling of the coordinator, the process wide choice of --scatter-sampling
+};
+
+//index < 0 tells the worker to quit
+struct TileAssignment
+{
+    int32_t index;
+    int32_t x0, y0, x1, y1;
+    int32_t firstSample, sampleCount;
+};
+
+//followed by 3 * pixelCount floats, the tile's rgb sums row by row
+struct TileResultHeader
+{
+    int32_t index;
+    int32_t pixelCount;
+};
+
+class RenderCoordinator
+{
+    public:
+        struct Stats
+        {
+            int workersConnected = 0;
+            int workersFailed = 0;
+            int tilesReassigned = 0;
+        };
+
+        //tiles of tileSize^2 pixels with all samples of their pixels, threadsPerWorker is passed on to the workers
+        RenderCoordinator(int scene, unsigned int seed, const RenderSettings& settings, int tileSize = 64, int threadsPerWorker = 0);
+        ~RenderCoordinator();
+
+        bool listening() const { return listener != INVALID_SOCKET; }
+        int port() const { return listenPort; }
+
+        //starts count processes "program args... 127.0.0.1 port" on this machine
+        bool spawnLocalWorkers(const std::string& program, const std::vector<std::string>& args, int count);
+        //waits for the spawned processes to exit
+        void reapWorkers();
+
+        //renders every tile into sums (image_width * image_height colors, row 0 at the top). Tiles of a worker that
+        //disconnects or doesn't answer within tileTimeoutMs, also in the middle of a result, go back to the queue;
+        //fails when no worker is left for tileTimeoutMs.
+        bool render(std::vector<Color>& sums, double tileTimeoutMs = 60000.);
+
+        const Stats& getStats() const { return stats; }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Worker
+        {
+            socket_t s;
+            std::deque<int> inFlight;
+            Clock::time_point lastActivity;
+        };
+
+        static const int tilesInFlight = 2; //per worker, so it has the next tile while its result is on the way
+
+        void dropWorker(size_t w, std::deque<int>& pending);
+        bool receiveResult(Worker& worker, std::vector<Color>& sums);
+
+        DistributedJob job;
+        std::vector<TileAssignment> tiles;
+        socket_t listener = INVALID_SOCKET;
+        int listenPort = 0;
+        std::vector<Worker> workers;
+        std::vector<float> receiveBuffer;
+        Stats stats;
+#ifdef _WIN32
+        std::vector<HANDLE> spawned;
+#else
+        std::vector<pid_t> spawned;
+#endif
+};
+
+RenderCoordinator::RenderCoordinator(int scene, unsigned int seed, const RenderSettings& settings, int tileSize, int threadsPerWorker)
+{
+    job.magic = distributedMagic;
+    job.scene = scene;
+    job.seed = static_cast<int32_t>(seed);
+    job.width = settings.image_width;
+    job.height = settings.image_height;
+    job.samplesPerPixel = settings.samples_per_pixel;
+    job.maxDepth = settings.max_depth;
+    job.sequence = static_cast<int32_t>(settings.sequence);
+    job.lights = settings.lights ? static_cast<int32_t>(settings.lights->getSelection()) + 1 : 0;
+    job.threads = threadsPerWorker;
+    job.scatterSampling = static_cast<int32_t>(scatterSampling);
+
+    for (int y0 = 0; y0 < settings.image_height; y0 += tileSize)
+    {
+        for (int x0 = 0; x0 < settings.image_width; x0 += tileSize)
+        {
+            TileAssignment tile = { static_cast<int32_t>(tiles.size()), x0, y0, std::min(x0 + tileSize, settings.image_width),
+                std::min(y0 + tileSize, settings.image_height), 0, settings.samples_per_pixel };
+            tiles.push_back(tile);
+        }
+    }
+
+    if (initSockets())
+        listener = listenLocal(listenPort);
+}
+
+RenderCoordinator::~RenderCoordinator()
+{
+    for (auto& worker : workers)
+        closesocket(worker.s);
+    if (listener != INVALID_SOCKET)
+        closesocket(listener);
+    reapWorkers();
+}
+
+bool RenderCoordinator::spawnLocalWorkers(const std::string& program, const std::vector<std::string>& args, int count)
+{
+    std::vector<std::string> arguments = { program };
+    arguments.insert(arguments.end(), args.begin(), args.end());
+    arguments.push_back("127.0.0.1");
+    arguments.push_back(std::to_string(listenPort));
+#ifdef _WIN32
+    //one command line, the program quoted for paths with spaces; CreateProcess may write to it
+    std::string commandLine = "\"" + program + "\"";
+    for (size_t i = 1; i < arguments.size(); i++)
+        commandLine += " " + arguments[i];
+    for (int i = 0; i < count; i++)
+    {
+        std::vector<char> buffer(commandLine.begin(), commandLine.end());
+        buffer.push_back(0);
+        STARTUPINFOA startup = {};
+        startup.cb = sizeof(startup);
+        PROCESS_INFORMATION process = {};
+        if (!CreateProcessA(nullptr, buffer.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &process))
+            return false;
+        CloseHandle(process.hThread);
+        spawned.push_back(process.hProcess);
+    }
+    return true;
+#else
+    std::vector<char*> argv;
+    for (auto& argument : arguments)
+        argv.push_back(&argument[0]);
+    argv.push_back(nullptr);
+
+    for (int i = 0; i < count; i++)
+    {
+        pid_t pid;
+        if (posix_spawnp(&pid, program.c_str(), nullptr, nullptr, argv.data(), environ) != 0)
+            return false;
+        spawned.push_back(pid);
+    }
+    return true;
+#endif
+}
+
+void RenderCoordinator::reapWorkers()
+{
+#ifdef _WIN32
+    for (HANDLE process : spawned)
+    {
+        WaitForSingleObject(process, INFINITE);
+        CloseHandle(process);
+    }
+    spawned.clear();
+#else
+    for (pid_t pid : spawned)
+        waitpid(pid, nullptr, 0);
+    spawned.clear();
+#endif
+}
+
+void RenderCoordinator::dropWorker(size_t w, std::deque<int>& pending)
+{
+    Worker& worker = workers[w];
+    stats.workersFailed++;
+    stats.tilesReassigned += static_cast<int>(worker.inFlight.size());
+    for (int tile : worker.inFlight)
+        pending.push_front(tile);
+    closesocket(worker.s);
+    workers.erase(workers.begin() + w);
+}
+
+bool RenderCoordinator::receiveResult(Worker& worker, std::vector<Color>& sums)
+{
+    TileResultHeader header;
+    if (!recvAll(worker.s, &header, sizeof(header)) || worker.inFlight.empty() || header.index != worker.inFlight.front())
+        return false;
+    const TileAssignment& tile = tiles[header.index];
+    if (header.pixelCount != (tile.x1 - tile.x0) * (tile.y1 - tile.y0))
+        return false;
+
+    receiveBuffer.resize(3 * size_t(header.pixelCount));
+    if (!recvAll(worker.s, receiveBuffer.data(), receiveBuffer.size() * sizeof(float)))
+        return false;
+
+    size_t i = 0;
+    for (int row = tile.y0; row < tile.y1; row++)
+    {
+        for (int col = tile.x0; col < tile.x1; col++, i += 3)
+            sums[size_t(row) * job.width + col] += Color(receiveBuffer[i], receiveBuffer[i + 1], receiveBuffer[i + 2]);
+    }
+    worker.inFlight.pop_front();
+    worker.lastActivity = Clock::now();
+    return true;
+}
+
+bool RenderCoordinator::render(std::vector<Color>& sums, double tileTimeoutMs)
+{
+    if (!listening())
+        return false;
+
+    sums.assign(size_t(job.width) * job.height, Color(0, 0, 0));
+    std::deque<int> pending;
+    for (const auto& tile : tiles)
+        pending.push_back(tile.index);
+    size_t done = 0;
+    auto timeout = std::chrono::duration<double, std::milli>(tileTimeoutMs);
+    Clock::time_point lastWorkerSeen = Clock::now();
+
+    while (done < tiles.size())
+    {
+        //keep every worker busy
+        for (size_t w = 0; w < workers.size();)
+        {
+            bool ok = true;
+            while (ok && workers[w].inFlight.size() < tilesInFlight && !pending.empty())
+            {
+                int tile = pending.front();
+                ok = sendAll(workers[w].s, &tiles[tile], sizeof(TileAssignment));
+                if (ok)
+                {
+                    pending.pop_front();
+                    if (workers[w].inFlight.empty())
+                        workers[w].lastActivity = Clock::now();
+                    workers[w].inFlight.push_back(tile);
+                }
+            }
+            if (ok)
+                w++;
+            else
+                dropWorker(w, pending);
+        }
+
+        if (!workers.empty())
+            lastWorkerSeen = Clock::now();
+        else if (Clock::now() - lastWorkerSeen > timeout)
+            return false;
+
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listener, &readable);
+        socket_t maxSocket = listener;
+        for (const auto& worker : workers)
+        {
+            FD_SET(worker.s, &readable);
+            maxSocket = std::max(maxSocket, worker.s);
+        }
+        timeval wait = { 0, 100000 };
+        if (select(static_cast<int>(maxSocket + 1), &readable, nullptr, nullptr, &wait) < 0)
+            return false;
+
+        if (FD_ISSET(listener, &readable))
+        {
+            socket_t s = accept(listener, nullptr, nullptr);
+            if (s != INVALID_SOCKET)
+            {
+                //select only tells that a result started arriving, the rest of it must come within the timeout too
+                if (setReceiveTimeout(s, tileTimeoutMs) && sendAll(s, &job, sizeof(job)))
+                {
+                    workers.push_back({ s, {}, Clock::now() });
+                    stats.workersConnected++;
+                }
+                else
+                    closesocket(s);
+            }
+        }
+
+        for (size_t w = 0; w < workers.size();)
+        {
+            Worker& worker = workers[w];
+            bool ok = true;
+            if (FD_ISSET(worker.s, &readable))
+            {
+                ok = receiveResult(worker, sums);
+                if (ok)
+                    done++;
+            }
+            else if (!worker.inFlight.empty() && Clock::now() - worker.lastActivity > timeout)
+                ok = false; //hung
+
+            if (ok)
+                w++;
+            else
+                dropWorker(w, pending);
+        }
+    }
+
+    TileAssignment quit = { -1, 0, 0, 0, 0, 0, 0 };
+    for (auto& worker : workers)
+    {
+        sendAll(worker.s, &quit, sizeof(quit));
+        closesocket(worker.s);
+    }
+    workers.clear();
+    return true;
+}
+
+//Worker process: connects to the coordinator, renders the tiles it is sent until told to quit. failAfter >= 0
+//makes it exit without answering after that many tiles, to exercise the reassignment.
+int runRenderWorker(const char* host, int port, int failAfter = -1)
+{
+    if (!initSockets())
+        return 1;
+
+    //the coordinator may still be starting up
+    socket_t s = INVALID_SOCKET;
+    for (int attempt = 0; attempt < 50 && s == INVALID_SOCKET; attempt++)
+    {
+        s = connectTo(host, port);
+        if (s == INVALID_SOCKET)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    DistributedJob job;
+    if (s == INVALID_SOCKET || !recvAll(s, &job, sizeof(job)) || job.magic != distributedMagic)
+        return 1;
+
+#ifdef _OPENMP
+    if (job.threads > 0)
+        omp_set_num_threads(job.threads);
+#endif
+
+    //the materials and the camera lens sample with it
+    scatterSampling = static_cast<ScatterSampling>(job.scatterSampling);
+    seed_random(static_cast<unsigned int>(job.seed));
+    SceneDescription scene = load_scene(job.scene);
+    Camera cam = scene.camera();
+    RenderSettings settings;
+    settings.image_width = job.width;
+    settings.image_height = job.height;
+    settings.samples_per_pixel = job.samplesPerPixel;
+    settings.max_depth = job.maxDepth;
+    settings.sequence = static_cast<SampleSequence>(job.sequence);
+    settings.seed = static_cast<unsigned int>(job.seed);
+    settings.packets = usePackets(scene.world, settings);
+    if (scene.lights && job.lights > 0)
+    {
+        scene.lights->setSelection(static_cast<LightSelection>(job.lights - 1));
+        settings.lights = scene.lights.get();
+    }
+    PixelSampler sampler(settings.sequence, settings.samples_per_pixel, settings.seed);
+
+    std::vector<Color> sums;
+    std::vector<float> result;
+    int rendered = 0;
+    TileAssignment tile;
+    while (recvAll(s, &tile, sizeof(tile)) && tile.index >= 0)
+    {
+        if (failAfter >= 0 && rendered == failAfter)
+            std::_Exit(1);
+
+        int tileWidth = tile.x1 - tile.x0;
+        int pixelCount = tileWidth * (tile.y1 - tile.y0);
+        sums.assign(pixelCount, Color(0, 0, 0));
+        //strips of 8 rows (the height of a ray packet) in parallel, each one a tile of its own
+        const int stripHeight = 8;
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int row = tile.y0; row < tile.y1; row += stripHeight)
+            renderTile(scene.world, cam, scene.background, settings, sampler, tile.x0, row, tile.x1, std::min(row + stripHeight, tile.y1),
+                tile.firstSample, tile.sampleCount, sums.data() + size_t(row - tile.y0) * tileWidth, nullptr, tileWidth);
+
+        result.resize(3 * size_t(pixelCount));
+        for (int i = 0; i < pixelCount; i++)
+        {
+            result[3 * i] = static_cast<float>(sums[i].x());
+            result[3 * i + 1] = static_cast<float>(sums[i].y());
+            result[3 * i + 2] = static_cast<float>(sums[i].z());
+        }
+        TileResultHeader header = { tile.index, pixelCount };
+        if (!sendAll(s, &header, sizeof(header)) || !sendAll(s, result.data(), result.size() * sizeof(float)))
+            break;
+        rendered++;
+    }
+    closesocket(s);
+    return 0;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "util.h"
+#include "vec3.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+//Radiance arriving from infinitely far away in every direction, stored as an equirectangular (latitude-longitude)
+//image: column u = (phi + pi) / 2pi with phi = atan2(z, x), row v = theta / pi with theta the angle from +y, so
+//the top row is straight up. Pixels are constant over their solid angle.
+//Directions are importance sampled with a 2D piecewise constant distribution over the pixels: a marginal CDF picks
+//the row, the row's conditional CDF the column, each proportional to luminance times sin(theta) (the solid angle
+//of the pixels shrinks towards the poles). A small bright sun gets most of the samples instead of being found by
+//chance.
+class EnvironmentMap
+{
+public:
+    //linear rgb pixels, row 0 at the top
+    EnvironmentMap(int width, int height, std::vector<Color> pixels);
+
+    //loads a Radiance .hdr (or any image stb reads as floats), null with a message when it can't be read
+    static std::shared_ptr<EnvironmentMap> load(const char* filename);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    Color radiance(const Vec3& direction) const;
+    //Samples a direction from two uniform numbers with density pdf per solid angle, false when the map is black
+    bool sample(double u1, double u2, Vec3& direction, double& pdf) const;
+    double pdf(const Vec3& direction) const;
+
+private:
+    void pixelOf(const Vec3& direction, int& column, int& row) const;
+
+    int width, height;
+    std::vector<Color> pixels;
+    std::vector<double> rowCdf;    //marginal, height + 1 entries from 0 to 1
+    std::vector<double> columnCdf; //conditional of every row, width + 1 entries each
+    std::vector<double> weights;   //luminance times sin(theta) of every pixel
+    double weightSum = 0;
+};
+
+EnvironmentMap::EnvironmentMap(int width_, int height_, std::vector<Color> pixels_)
+    : width(width_), height(height_), pixels(std::move(pixels_))
+{
+    weights.resize(size_t(width) * height);
+    columnCdf.resize(size_t(width + 1) * height);
+    rowCdf.resize(height + 1);
+    std::vector<double> rowSums(height);
+    for (int row = 0; row < height; row++)
+    {
+        double sinTheta = std::sin(pi * (row + 0.5) / height);
+        double* cdf = &columnCdf[size_t(row) * (width + 1)];
+        cdf[0] = 0;
+        for (int column = 0; column < width; column++)
+        {
+            const Color& c = pixels[size_t(row) * width + column];
+            double weight = std::max(0., 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z()) * sinTheta;
+            weights[size_t(row) * width + column] = weight;
+            cdf[column + 1] = cdf[column] + weight;
+        }
+        rowSums[row] = cdf[width];
+        for (int column = 1; column <= width; column++)
+            cdf[column] = rowSums[row] > 0 ? cdf[column] / rowSums[row] : double(column) / width;
+    }
+    rowCdf[0] = 0;
+    for (int row = 0; row < height; row++)
+        rowCdf[row + 1] = rowCdf[row] + rowSums[row];
+    weightSum = rowCdf[height];
+    for (int row = 1; row <= height; row++)
+        rowCdf[row] = weightSum > 0 ? rowCdf[row] / weightSum : double(row) / height;
+}
+
+std::shared_ptr<EnvironmentMap> EnvironmentMap::load(const char* filename)
+{
+    int width = 0, height = 0, components = 0;
+    float* data = stbi_loadf(filename, &width, &height, &components, 3);
+    if (!data)
+    {
+        printf("Couldn't load environment map %s\n", filename);
+        return nullptr;
+    }
+    std::vector<Color> pixels(size_t(width) * height);
+    for (size_t i = 0; i < pixels.size(); i++)
+        pixels[i] = Color(data[3 * i], data[3 * i + 1], data[3 * i + 2]);
+    stbi_image_free(data);
+    return std::make_shared<EnvironmentMap>(width, height, std::move(pixels));
+}
+
+void EnvironmentMap::pixelOf(const Vec3& direction, int& column, int& row) const
+{
+    Vec3 d = unit_vector(direction);
+    double u = (std::atan2(d.z(), d.x()) + pi) / (2. * pi);
+    double v = std::acos(clamp(d.y(), -1., 1.)) / pi;
+    column = std::min(width - 1, std::max(0, static_cast<int>(u * width)));
+    row = std::min(height - 1, std::max(0, static_cast<int>(v * height)));
+}
+
+Color EnvironmentMap::radiance(const Vec3& direction) const
+{
+    int column, row;
+    pixelOf(direction, column, row);
+    return pixels[size_t(row) * width + column];
+}
+
+bool EnvironmentMap::sample(double u1, double u2, Vec3& direction, double& pdf) const
+{
+    if (weightSum <= 0)
+        return false;
+    //the row whose cdf interval holds u1, then the column in it, and the position within the pixel
+    int row = static_cast<int>(std::upper_bound(rowCdf.begin() + 1, rowCdf.end(), u1) - rowCdf.begin()) - 1;
+    row = std::min(height - 1, std::max(0, row));
+    const double* cdf = &columnCdf[size_t(row) * (width + 1)];
+    int column = static_cast<int>(std::upper_bound(cdf + 1, cdf + width + 1, u2) - cdf) - 1;
+    column = std::min(width - 1, std::max(0, column));
+
+    double rowWidth = rowCdf[row + 1] - rowCdf[row];
+    double columnWidth = cdf[column + 1] - cdf[column];
+    double v = (row + (rowWidth > 0 ? (u1 - rowCdf[row]) / rowWidth : 0.5)) / height;
+    double u = (column + (columnWidth > 0 ? (u2 - cdf[column]) / columnWidth : 0.5)) / width;
+    v = clamp(v, 0., 1.);
+    u = clamp(u, 0., 1.);
+
+    double theta = v * pi, phi = u * 2. * pi - pi;
+    double sinTheta = std::sin(theta);
+    if (sinTheta <= 0)
+        return false;
+    direction = Vec3(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+    //density over (u, v) is the pixel's share of the weights times the pixel count, over the sphere it is divided
+    //by the Jacobian 2 pi^2 sin(theta)
+    double pdfUv = weights[size_t(row) * width + column] * width * height / weightSum;
+    pdf = pdfUv / (2. * pi * pi * sinTheta);
+    return pdf > 0;
+}
+
+double EnvironmentMap::pdf(const Vec3& direction) const
+{
+    if (weightSum <= 0)
+        return 0;
+    int column, row;
+    pixelOf(direction, column, row);
+    double sinTheta = std::sqrt(std::max(0., 1. - unit_vector(direction).y() * unit_vector(direction).y()));
+    if (sinTheta <= 0)
+        return 0;
+    return weights[size_t(row) * width + column] * width * height / weightSum / (2. * pi * pi * sinTheta);
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "hittable.h"
+#include "material.h"
+
+#include <algorithm>
+#include <vector>
+
+using std::shared_ptr;
+using std::make_shared;
+
+//Heterogeneous medium with densities on a voxel grid spanning a box, trilinearly interpolated between voxel centers.
+//Free flights are sampled with delta tracking against a coarse grid of majorants (the largest density in each block
+//of majorantBlock^3 voxels): the ray walks the majorant cells with a 3D DDA and takes exponential steps sized by the
+//local majorant, so empty and thin regions are crossed in a few steps instead of being marched at a fixed step.
+//transmittance() estimates the fraction of light passing a segment with ratio tracking over the same cells.
+class GridMedium : public Hittable
+{
+    public:
+        //density holds nx*ny*nz values with x running fastest, scaled by densityScale
+        GridMedium(const aabb& bounds_, int nx, int ny, int nz, const std::vector<float>& density, double densityScale,
+            shared_ptr<Texture> albedo, int majorantBlock = 8);
+        GridMedium(const aabb& bounds_, int nx, int ny, int nz, const std::vector<float>& density, double densityScale,
+            Color albedo, int majorantBlock = 8)
+            : GridMedium(bounds_, nx, ny, nz, density, densityScale, make_shared<SolidColor>(albedo), majorantBlock) {}
+
+        virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
+        virtual bool boundingBox(double time0, double time1, aabb& output_box) const override
+        {
+            output_box = bounds;
+            return true;
+        }
+        virtual bool hitUsesRandom() const override { return true; }
+
+        double transmittance(const Ray& r, double min_t, double max_t) const;
+        double density(const Point3& p) const;
+
+    private:
+        bool clip(const Ray& r, double& t0, double& t1) const;
+
+        //calls visit(tEnter, tExit, majorant) for the majorant cells along the ray in order, until visit returns false
+        template <typename Visit>
+        void traverseMajorants(const Ray& r, double t0, double t1, Visit visit) const;
+
+        float voxel(int x, int y, int z) const
+        {
+            return voxels[(static_cast<size_t>(z) * size[1] + y) * size[0] + x];
+        }
+
+        aabb bounds;
+        int size[3];
+        Vec3 voxelSize;
+        std::vector<float> voxels;
+
+        int block;
+        int majorantSize[3];
+        Vec3 majorantCellSize;
+        std::vector<float> majorants;
+
+        shared_ptr<Material> phaseFunction;
+};
+
+GridMedium::GridMedium(const aabb& bounds_, int nx, int ny, int nz, const std::vector<float>& density, double densityScale,
+    shared_ptr<Texture> albedo, int majorantBlock)
+    : bounds(bounds_), block(std::max(1, majorantBlock)), phaseFunction(make_shared<Isotropic>(albedo))
+{
+    size[0] = std::max(2, nx);
+    size[1] = std::max(2, ny);
+    size[2] = std::max(2, nz);
+    voxels.assign(static_cast<size_t>(size[0]) * size[1] * size[2], 0.f);
+    for (int z = 0; z < std::min(nz, size[2]); z++)
+        for (int y = 0; y < std::min(ny, size[1]); y++)
+            for (int x = 0; x < std::min(nx, size[0]); x++)
+                voxels[(static_cast<size_t>(z) * size[1] + y) * size[0] + x] = static_cast<float>(densityScale * density[(static_cast<size_t>(z) * ny + y) * nx + x]);
+
+    Vec3 extent = bounds.extent();
+    voxelSize = Vec3(extent.x() / size[0], extent.y() / size[1], extent.z() / size[2]);
+    for (int a = 0; a < 3; a++)
+        majorantSize[a] = (size[a] + block - 1) / block;
+    majorantCellSize = block * voxelSize;
+
+    //interpolation inside a block reaches one voxel into the neighbouring blocks
+    majorants.assign(static_cast<size_t>(majorantSize[0]) * majorantSize[1] * majorantSize[2], 0.f);
+    for (int bz = 0; bz < majorantSize[2]; bz++)
+    {
+        for (int by = 0; by < majorantSize[1]; by++)
+        {
+            for (int bx = 0; bx < majorantSize[0]; bx++)
+            {
+                float majorant = 0.f;
+                for (int z = std::max(0, bz * block - 1); z <= std::min(size[2] - 1, (bz + 1) * block); z++)
+                    for (int y = std::max(0, by * block - 1); y <= std::min(size[1] - 1, (by + 1) * block); y++)
+                        for (int x = std::max(0, bx * block - 1); x <= std::min(size[0] - 1, (bx + 1) * block); x++)
+                            majorant = std::max(majorant, voxel(x, y, z));
+                majorants[(static_cast<size_t>(bz) * majorantSize[1] + by) * majorantSize[0] + bx] = majorant;
+            }
+        }
+    }
+}
+
+double GridMedium::density(const Point3& p) const
+{
+    int i[3];
+    double f[3];
+    for (int a = 0; a < 3; a++)
+    {
+        double g = clamp((p[a] - bounds.minimum()[a]) / voxelSize[a] - 0.5, 0., size[a] - 1.);
+        i[a] = std::min(static_cast<int>(g), size[a] - 2);
+        f[a] = g - i[a];
+    }
+
+    double d00 = voxel(i[0], i[1], i[2]) * (1. - f[0]) + voxel(i[0] + 1, i[1], i[2]) * f[0];
+    double d10 = voxel(i[0], i[1] + 1, i[2]) * (1. - f[0]) + voxel(i[0] + 1, i[1] + 1, i[2]) * f[0];
+    double d01 = voxel(i[0], i[1], i[2] + 1) * (1. - f[0]) + voxel(i[0] + 1, i[1], i[2] + 1) * f[0];
+    double d11 = voxel(i[0], i[1] + 1, i[2] + 1) * (1. - f[0]) + voxel(i[0] + 1, i[1] + 1, i[2] + 1) * f[0];
+    return (d00 * (1. - f[1]) + d10 * f[1]) * (1. - f[2]) + (d01 * (1. - f[1]) + d11 * f[1]) * f[2];
+}
+
+bool GridMedium::clip(const Ray& r, double& t0, double& t1) const
+{
+    for (int a = 0; a < 3; a++)
+    {
+        double invD = 1. / r.direction()[a];
+        double tNear = (bounds.minimum()[a] - r.origin()[a]) * invD;
+        double tFar = (bounds.maximum()[a] - r.origin()[a]) * invD;
+        if (invD < 0.)
+            std::swap(tNear, tFar);
+        t0 = std::max(t0, tNear);
+        t1 = std::min(t1, tFar);
+        if (t1 <= t0)
+            return false;
+    }
+    return true;
+}
+
+template <typename Visit>
+void GridMedium::traverseMajorants(const Ray& r, double t0, double t1, Visit visit) const
+{
+    Point3 start = r.at(t0);
+    int cell[3], step[3];
+    double tNext[3], tDelta[3];
+    for (int a = 0; a < 3; a++)
+    {
+        double d = r.direction()[a];
+        cell[a] = std::clamp(static_cast<int>((start[a] - bounds.minimum()[a]) / majorantCellSize[a]), 0, majorantSize[a] - 1);
+        if (d > 0.)
+        {
+            step[a] = 1;
+            tNext[a] = (bounds.minimum()[a] + (cell[a] + 1) * majorantCellSize[a] - r.origin()[a]) / d;
+            tDelta[a] = majorantCellSize[a] / d;
+        }
+        else if (d < 0.)
+        {
+            step[a] = -1;
+            tNext[a] = (bounds.minimum()[a] + cell[a] * majorantCellSize[a] - r.origin()[a]) / d;
+            tDelta[a] = -majorantCellSize[a] / d;
+        }
+        else
+        {
+            step[a] = 0;
+            tNext[a] = infinity;
+            tDelta[a] = infinity;
+        }
+    }
+
+    double t = t0;
+    while (t < t1)
+    {
+        int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+        double tExit = std::min(tNext[axis], t1);
+        float majorant = majorants[(static_cast<size_t>(cell[2]) * majorantSize[1] + cell[1]) * majorantSize[0] + cell[0]];
+        if (!visit(t, tExit, majorant))
+            return;
+
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= majorantSize[axis])
+            return;
+        t = tExit;
+        tNext[axis] += tDelta[axis];
+    }
+}
+
+bool GridMedium::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
+{
+    double t0 = std::max(min_t, 0.), t1 = max_t;
+    if (!clip(r, t0, t1))
+        return false;
+
+    //densities are per unit length, t is in units of the (not normalized) direction
+    double rayLength = r.direction().length();
+    bool scattered = false;
+    double hitT = 0.;
+    traverseMajorants(r, t0, t1, [&](double tEnter, double tExit, float majorant)
+        {
+            if (majorant <= 0.f)
+                return true;
+            double sigma = majorant * rayLength;
+            double t = tEnter;
+            while (true)
+            {
+                //tentative collision, the step is memoryless so it restarts in the next cell
+                t -= log(1. - random_double()) / sigma;
+                if (t >= tExit)
+                    return true;
+                if (random_double() * majorant < density(r.at(t)))
+                {
+                    scattered = true;
+                    hitT = t;
+                    return false;
+                }
+            }
+        });
+
+    if (!scattered)
+        return false;
+
+    hitrecord.t = hitT;
+    hitrecord.p = r.at(hitT);
+    hitrecord.u = hitrecord.v = 0.;
+    hitrecord.normal = Vec3(1, 0, 0); //arbitrary, the phase function doesn't use it
+    hitrecord.front_face = true;
+    hitrecord.material_ptr = phaseFunction.get();
+    return true;
+}
+
+double GridMedium::transmittance(const Ray& r, double min_t, double max_t) const
+{
+    double t0 = std::max(min_t, 0.), t1 = max_t;
+    if (!clip(r, t0, t1))
+        return 1.;
+
+    double rayLength = r.direction().length();
+    double transmitted = 1.;
+    traverseMajorants(r, t0, t1, [&](double tEnter, double tExit, float majorant)
+        {
+            if (majorant <= 0.f)
+                return true;
+            double sigma = majorant * rayLength;
+            double t = tEnter;
+            while (true)
+            {
+                t -= log(1. - random_double()) / sigma;
+                if (t >= tExit)
+                    return true;
+                //ratio tracking weighs every tentative collision instead of ending the walk at a real one
+                transmitted *= 1. - density(r.at(t)) / majorant;
+
+                //russian roulette once little light is left
+                if (transmitted < 0.1)
+                {
+                    if (random_double() < 0.5)
+                    {
+                        transmitted = 0.;
+                        return false;
+                    }
+                    transmitted *= 2.;
+                }
+            }
+        });
+    return transmitted;
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+#include "util.h"
+#include "vec3.h"
+#include "aabb.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+//Distribution of the light arriving at a region from every direction, as a quadtree over the square [0, 1]^2 the
+//sphere is mapped to with equal area (x = (cos theta + 1) / 2 with theta from +z, y = phi / 2pi). Each node holds
+//the light recorded in its four quadrants, quadrants with much of it are subdivided further.
+//Recording is thread safe and doesn't change the structure: it adds to the leaf quadrant only, finish() sums the
+//light up the tree and computes the quadrant probabilities sampling reads once the pass ended. refined() makes the
+//tree of the next pass.
+class DirectionalTree
+{
+public:
+    DirectionalTree() : nodes(1) {}
+
+    //draws a direction with density pdf per solid angle, false when nothing was recorded
+    bool sample(Vec3& direction, double& pdf) const;
+    double pdf(const Vec3& direction) const;
+    void record(const Vec3& direction, double radiance);
+    double total() const;
+    void finish();
+
+    //empty tree whose leaves split the quadrants holding more than threshold of this tree's light
+    DirectionalTree refined(double threshold, int maxDepth) const;
+
+private:
+    struct Node
+    {
+        std::atomic<double> sums[4];
+        double probabilities[4] = { 0, 0, 0, 0 }; //of the quadrants, from the sums by finish
+        uint32_t children[4] = { 0, 0, 0, 0 }; //0 for leaves, the root is no child
+
+        Node()
+        {
+            for (auto& sum : sums)
+                sum.store(0, std::memory_order_relaxed);
+        }
+        Node(const Node& other) { *this = other; }
+        Node& operator=(const Node& other)
+        {
+            for (int q = 0; q < 4; q++)
+            {
+                sums[q].store(other.sums[q].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                probabilities[q] = other.probabilities[q];
+                children[q] = other.children[q];
+            }
+            return *this;
+        }
+        double sum() const
+        {
+            return sums[0].load(std::memory_order_relaxed) + sums[1].load(std::memory_order_relaxed)
+                + sums[2].load(std::memory_order_relaxed) + sums[3].load(std::memory_order_relaxed);
+        }
+    };
+
+    static void toSquare(const Vec3& direction, double& x, double& y);
+    double finish(uint32_t node);
+    void refine(const DirectionalTree& from, uint32_t fromNode, uint32_t node, double fraction, double threshold, int depth,
+        int maxDepth);
+
+    std::vector<Node> nodes;
+};
+
+void DirectionalTree::toSquare(const Vec3& direction, double& x, double& y)
+{
+    Vec3 d = unit_vector(direction);
+    x = clamp((d.z() + 1.) * 0.5, 0., 1. - 1e-12);
+    double phi = std::atan2(d.y(), d.x());
+    if (phi < 0)
+        phi += 2. * pi;
+    y = clamp(phi / (2. * pi), 0., 1. - 1e-12);
+}
+
+double DirectionalTree::total() const
+{
+    return nodes[0].sum();
+}
+
+bool DirectionalTree::sample(Vec3& direction, double& pdf) const
+{
+    //the quadrant at every level in proportion to its light, then a uniform point of the leaf
+    double x0 = 0, y0 = 0, size = 1;
+    double squarePdf = 1;
+    uint32_t node = 0;
+    while (true)
+    {
+        const Node& n = nodes[node];
+        double u = random_double();
+        int q = 0;
+        while (q < 3 && u >= n.probabilities[q])
+            u -= n.probabilities[q++];
+        if (!(n.probabilities[q] > 0))
+            return false;
+        squarePdf *= 4. * n.probabilities[q];
+        size *= 0.5;
+        x0 += (q & 1) ? size : 0;
+        y0 += (q & 2) ? size : 0;
+        if (n.children[q] == 0)
+            break;
+        node = n.children[q];
+    }
+    double z = 2. * (x0 + random_double() * size) - 1.;
+    double phi = 2. * pi * (y0 + random_double() * size);
+    double r = std::sqrt(std::max(0., 1. - z * z));
+    direction = Vec3(r * std::cos(phi), r * std::sin(phi), z);
+    //the square maps to the 4 pi sphere with a constant Jacobian
+    pdf = squarePdf / (4. * pi);
+    return true;
+}
+
+double DirectionalTree::pdf(const Vec3& direction) const
+{
+    double x, y;
+    toSquare(direction, x, y);
+    double squarePdf = 1;
+    uint32_t node = 0;
+    while (true)
+    {
+        const Node& n = nodes[node];
+        int q = (x >= 0.5 ? 1 : 0) + (y >= 0.5 ? 2 : 0);
+        squarePdf *= 4. * n.probabilities[q];
+        if (squarePdf == 0)
+            return 0;
+        if (n.children[q] == 0)
+            break;
+        x = 2. * x - (x >= 0.5 ? 1. : 0.);
+        y = 2. * y - (y >= 0.5 ? 1. : 0.);
+        node = n.children[q];
+    }
+    return squarePdf / (4. * pi);
+}
+
+void DirectionalTree::record(const Vec3& direction, double radiance)
+{
+    if (!(radiance > 0) || !std::isfinite(radiance))
+        return;
+    double x, y;
+    toSquare(direction, x, y);
+    uint32_t node = 0;
+    while (true)
+    {
+        Node& n = nodes[node];
+        int q = (x >= 0.5 ? 1 : 0) + (y >= 0.5 ? 2 : 0);
+        if (n.children[q] == 0)
+        {
+            atomicAdd(n.sums[q], radiance);
+            return;
+        }
+        x = 2. * x - (x >= 0.5 ? 1. : 0.);
+        y = 2. * y - (y >= 0.5 ? 1. : 0.);
+        node = n.children[q];
+    }
+}
+
+void DirectionalTree::finish()
+{
+    finish(0);
+}
+
+//sum of the light of node, after setting the sums of its subdivided quadrants to their children's and the
+//probabilities of all four
+double DirectionalTree::finish(uint32_t node)
+{
+    for (int q = 0; q < 4; q++)
+    {
+        if (nodes[node].children[q] != 0)
+            nodes[node].sums[q].store(finish(nodes[node].children[q]), std::memory_order_relaxed);
+    }
+    Node& n = nodes[node];
+    double sum = n.sum();
+    for (int q = 0; q < 4; q++)
+        n.probabilities[q] = sum > 0 ? n.sums[q].load(std::memory_order_relaxed) / sum : 0;
+    return sum;
+}
+
+DirectionalTree DirectionalTree::refined(double threshold, int maxDepth) const
+{
+    DirectionalTree tree;
+    double rootTotal = total();
+    if (rootTotal > 0)
+        tree.refine(*this, 0, 0, 1., threshold, 1, maxDepth);
+    return tree;
+}
+
+//Splits the quadrants of node whose share of the light passes the threshold. Below the leaves of the old tree the
+//light of a quadrant is taken as spread evenly over it.
+void DirectionalTree::refine(const DirectionalTree& from, uint32_t fromNode, uint32_t node, double fraction, double threshold,
+    int depth, int maxDepth)
+{
+    for (int q = 0; q < 4; q++)
+    {
+        double quadrantFraction = fraction / 4;
+        uint32_t fromChild = 0;
+        if (fromNode != UINT32_MAX)
+        {
+            const Node& old = from.nodes[fromNode];
+            double sum = old.sum();
+            quadrantFraction = sum > 0 ? fraction * old.sums[q].load(std::memory_order_relaxed) / sum : 0;
+            fromChild = old.children[q];
+        }
+        if (depth >= maxDepth || quadrantFraction <= threshold)
+            continue;
+        uint32_t child = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        nodes[node].children[q] = child;
+        refine(from, fromChild != 0 ? fromChild : UINT32_MAX, child, quadrantFraction, threshold, depth + 1, maxDepth);
+    }
+}
+
+//Incident light learned while rendering, for path guiding (Mueller et al. 2017, "Practical Path Guiding for
+//Efficient Light-Transport Simulation"): a binary tree over the scene box, split in the middle along x, y and z in
+//turn, with a DirectionalTree in every leaf. Each leaf has the tree paths are sampled from, learned in the earlier
+//passes, and the tree of this pass that records the light of the paths.
+//Between passes refine() makes the recorded trees the sampling ones, splits leaves that recorded more than
+//spatialThreshold * sqrt(2^pass) paths and subdivides directional quadtrees where they got more than 1% of the light.
+//The trees don't change during a pass, so threads record concurrently with atomic additions.
+class GuidingField
+{
+public:
+    GuidingField(const aabb& bounds, double spatialThreshold = 12000., double guidedFraction = 0.5);
+
+    //leaf of the spatial tree holding p, for distribution() and record()
+    uint32_t cell(const Point3& p) const;
+    //distribution to sample in the cell, null until a pass has recorded light in it
+    const DirectionalTree* distribution(uint32_t cell) const
+    {
+        return leaves[cell].trained ? &leaves[cell].sampling : nullptr;
+    }
+    //light arriving in the cell from direction, as radiance over the density the direction was sampled with
+    void record(uint32_t cell, const Vec3& direction, double radiance);
+    void refine();
+
+    //probability that a diffuse hit samples the learned distribution instead of its material
+    double getGuidedFraction() const { return guidedFraction; }
+    int getPass() const { return pass; }
+    size_t leafCount() const { return leaves.size(); }
+
+private:
+    struct SpatialNode
+    {
+        uint32_t children[2] = { 0, 0 }; //0 for leaves
+        int axis = 0;
+        uint32_t leaf = 0;
+    };
+
+    struct Leaf
+    {
+        DirectionalTree sampling;
+        DirectionalTree building;
+        std::atomic<uint64_t> samples{ 0 };
+        bool trained = false;
+
+        Leaf() = default;
+        Leaf(const Leaf& other)
+            : sampling(other.sampling), building(other.building), samples(other.samples.load()), trained(other.trained)
+        {
+        }
+    };
+
+    void split(uint32_t node, double sampleThreshold);
+
+    Point3 origin;
+    double size;
+    std::vector<SpatialNode> nodes;
+    std::vector<Leaf> leaves;
+    double spatialThreshold;
+    double guidedFraction;
+    int pass = 0;
+
+    static constexpr int maxDirectionalDepth = 20;
+    static constexpr double directionalThreshold = 0.01;
+};
+
+GuidingField::GuidingField(const aabb& bounds, double spatialThreshold_, double guidedFraction_)
+    : spatialThreshold(spatialThreshold_), guidedFraction(guidedFraction_)
+{
+    //a cube around the box, so splitting the axes in turn keeps the cells cubes
+    Vec3 extent = bounds.maximum() - bounds.minimum();
+    size = std::max(extent.x(), std::max(extent.y(), extent.z())) * 1.01 + 1e-6;
+    origin = 0.5 * (bounds.minimum() + bounds.maximum()) - Vec3(size / 2, size / 2, size / 2);
+    nodes.emplace_back();
+    leaves.emplace_back();
+}
+
+uint32_t GuidingField::cell(const Point3& p) const
+{
+    Vec3 local = (p - origin) / size;
+    uint32_t node = 0;
+    while (nodes[node].children[0] != 0)
+    {
+        int axis = nodes[node].axis;
+        double coordinate = clamp(local[axis], 0., 1.);
+        int side = coordinate >= 0.5 ? 1 : 0;
+        local[axis] = 2. * coordinate - side;
+        node = nodes[node].children[side];
+    }
+    return nodes[node].leaf;
+}
+
+void GuidingField::record(uint32_t cell, const Vec3& direction, double radiance)
+{
+    Leaf& leaf = leaves[cell];
+    leaf.samples.fetch_add(1, std::memory_order_relaxed);
+    leaf.building.record(direction, radiance);
+}
+
+//Halves the leaf of node along the next axis while it holds more than sampleThreshold paths, the halves start from
+//its trees and are taken to have half of its paths each
+void GuidingField::split(uint32_t node, double sampleThreshold)
+{
+    uint32_t leaf = nodes[node].leaf;
+    uint64_t samples = leaves[leaf].samples.load();
+    if (samples <= sampleThreshold)
+        return;
+    uint32_t second = static_cast<uint32_t>(leaves.size());
+    leaves.push_back(leaves[leaf]);
+    leaves[leaf].samples = samples / 2;
+    leaves[second].samples = samples / 2;
+    for (int side = 0; side < 2; side++)
+    {
+        uint32_t child = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        nodes[child].axis = (nodes[node].axis + 1) % 3;
+        nodes[child].leaf = side == 0 ? leaf : second;
+        nodes[node].children[side] = child;
+    }
+    split(nodes[node].children[0], sampleThreshold);
+    split(nodes[node].children[1], sampleThreshold);
+}
+
+void GuidingField::refine()
+{
+    double sampleThreshold = spatialThreshold * std::sqrt(std::pow(2., pass));
+    size_t nodeCount = nodes.size();
+    for (size_t node = 0; node < nodeCount; node++)
+    {
+        if (nodes[node].children[0] == 0)
+            split(static_cast<uint32_t>(node), sampleThreshold);
+    }
+    for (Leaf& leaf : leaves)
+    {
+        //a leaf that recorded nothing keeps sampling what it had
+        leaf.building.finish();
+        if (leaf.building.total() > 0)
+        {
+            leaf.sampling = leaf.building;
+            leaf.trained = true;
+        }
+        leaf.building = leaf.sampling.refined(directionalThreshold, maxDirectionalDepth);
+        leaf.samples = 0;
+    }
+    pass++;
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <memory>
 
 #include "vec3.h"
@@ -14,7 +17,7 @@ struct HitRecord {
     Vec3 normal;
     double t; //hit point distance on the ray
     double u, v; //surface coordinates for texture
-    std::shared_ptr<Material> material_ptr;
+    const Material* material_ptr; //owned by the primitive, a shared_ptr copy per hit costs two atomic operations
     bool front_face;
 
     inline void set_face_normal(const Ray& r, const Vec3& outward_normal)
@@ -24,9 +27,124 @@ struct HitRecord {
     }
 };
 
+//Up to 64 rays traced together, in practice the camera rays of 8x8 neighbouring pixels. Every ray keeps its closest
+//hit so far in tMax and records[i] (valid when hit[i]), exactly as a single ray traced with hit() would.
+//The origin and reciprocal direction bounds over the packet let a box be rejected for all rays with one test.
+struct RayPacket
+{
+    static const int maxSize = 64;
+
+    int count = 0;
+    Ray rays[maxSize];
+    double origin[3][maxSize];
+    double invDirection[3][maxSize];
+    double tMax[maxSize];
+    bool hit[maxSize];
+    HitRecord records[maxSize];
+
+    //axes where the directions differ in sign or are parallel to the axis are not used for the packet test
+    double originMin[3], originMax[3], invMin[3], invMax[3];
+    bool coherent[3];
+
+    uint64_t allActive() const { return count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1; }
+
+    //call after filling rays[0, count)
+    void init()
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            originMin[a] = invMin[a] = infinity;
+            originMax[a] = invMax[a] = -infinity;
+            for (int i = 0; i < count; i++)
+            {
+                origin[a][i] = rays[i].origin()[a];
+                invDirection[a][i] = 1. / rays[i].direction()[a];
+                originMin[a] = std::min(originMin[a], origin[a][i]);
+                originMax[a] = std::max(originMax[a], origin[a][i]);
+                invMin[a] = std::min(invMin[a], invDirection[a][i]);
+                invMax[a] = std::max(invMax[a], invDirection[a][i]);
+            }
+            coherent[a] = count > 0 && (invMin[a] > 0 || invMax[a] < 0) && std::isfinite(invMin[a]) && std::isfinite(invMax[a]);
+        }
+        for (int i = 0; i < count; i++)
+        {
+            tMax[i] = infinity;
+            hit[i] = false;
+        }
+    }
+
+    //True when no ray of the packet can hit the box: interval arithmetic over the origin and direction bounds gives
+    //the earliest slab entry and the latest slab exit of any ray. Rounding is monotonic, so the bounds hold for the
+    //distances every ray computes itself.
+    bool missesBox(const aabb& box, double min_t) const
+    {
+        double entry = min_t, exit = infinity;
+        for (int a = 0; a < 3; a++)
+        {
+            if (!coherent[a])
+                continue;
+            double nearPlane = invMin[a] > 0 ? box.minimum()[a] : box.maximum()[a];
+            double farPlane = invMin[a] > 0 ? box.maximum()[a] : box.minimum()[a];
+            double nearProducts[4] = { (nearPlane - originMin[a]) * invMin[a], (nearPlane - originMin[a]) * invMax[a],
+                (nearPlane - originMax[a]) * invMin[a], (nearPlane - originMax[a]) * invMax[a] };
+            double farProducts[4] = { (farPlane - originMin[a]) * invMin[a], (farPlane - originMin[a]) * invMax[a],
+                (farPlane - originMax[a]) * invMin[a], (farPlane - originMax[a]) * invMax[a] };
+            entry = std::max(entry, *std::min_element(nearProducts, nearProducts + 4));
+            exit = std::min(exit, *std::max_element(farProducts, farProducts + 4));
+        }
+        return exit < entry;
+    }
+
+    //the active rays that hit the box before their closest hit, with the arithmetic of aabb::hit (branch free so
+    //the rays are tested in one SIMD loop)
+    uint64_t boxMask(const aabb& box, double min_t, uint64_t active) const
+    {
+        double boxMin[3] = { box.minimum().x(), box.minimum().y(), box.minimum().z() };
+        double boxMax[3] = { box.maximum().x(), box.maximum().y(), box.maximum().z() };
+        unsigned char hits[maxSize];
+        #pragma omp simd
+        for (int i = 0; i < count; i++)
+        {
+            double t_min = min_t, t_max = tMax[i];
+            for (int a = 0; a < 3; a++)
+            {
+                double t0 = (boxMin[a] - origin[a][i]) * invDirection[a][i];
+                double t1 = (boxMax[a] - origin[a][i]) * invDirection[a][i];
+                bool negative = invDirection[a][i] < 0.;
+                double tNear = negative ? t1 : t0;
+                double tFar = negative ? t0 : t1;
+                t_min = tNear > t_min ? tNear : t_min;
+                t_max = tFar < t_max ? tFar : t_max;
+            }
+            hits[i] = t_max > t_min;
+        }
+        uint64_t result = 0;
+        for (int i = 0; i < count; i++)
+            result |= uint64_t(hits[i]) << i;
+        return result & active;
+    }
+};
+
 class Hittable {
     public:
         virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const = 0;
         virtual bool boundingBox(double time0, double time1, aabb& output_box) const = 0;
 
+        //Closest hits of the active rays of the packet, nearer than their current ones. Acceleration structures
+        //test their boxes for the whole packet, everything else traces the active rays one by one.
+        virtual void hitPacket(RayPacket& packet, double min_t, uint64_t active) const
+        {
+            for (int i = 0; i < packet.count; i++)
+            {
+                if ((active >> i & 1) && hit(packet.rays[i], min_t, packet.tMax[i], packet.records[i]))
+                {
+                    packet.tMax[i] = packet.records[i].t;
+                    packet.hit[i] = true;
+                }
+            }
+        }
+
+        //true when hit() draws random numbers (participating media), the order rays are traced in then changes
+        //the result and packets can't be used
+        virtual bool hitUsesRandom() const { return false; }
 };
\ No newline at end of file
@@ -26,6 +26,8 @@ class HittableList : public Hittable
 
         virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
         virtual bool boundingBox(double time0, double time1, aabb& output_box) const override;
+        virtual void hitPacket(RayPacket& packet, double min_t, uint64_t active) const override;
+        virtual bool hitUsesRandom() const override;
 
         std::vector<std::shared_ptr<Hittable>> list;
       
@@ -48,6 +50,22 @@ bool HittableList::hit(const Ray& r, const double& t_min, const double& t_max, H
     return hit_anything;
 }
 
+void HittableList::hitPacket(RayPacket& packet, double min_t, uint64_t active) const
+{
+    for (const auto& object : list)
+        object->hitPacket(packet, min_t, active);
+}
+
+bool HittableList::hitUsesRandom() const
+{
+    for (const auto& object : list)
+    {
+        if (object->hitUsesRandom())
+            return true;
+    }
+    return false;
+}
+
 bool HittableList::boundingBox(double time0, double time1, aabb& output_box) const
 {
     bool found_anything = false;
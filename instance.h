@@ -0,0 +1,171 @@
+#pragma once
+
+#include "hittable.h"
+
+using std::shared_ptr;
+
+//Affine transform stored as a 3x4 matrix: rotation/scale in the left 3x3 block, translation in the last column.
+class Transform
+{
+    public:
+        Transform()
+        {
+            for (int row = 0; row < 3; row++)
+                for (int col = 0; col < 4; col++)
+                    m[row][col] = (row == col) ? 1. : 0.;
+        }
+
+        static Transform translate(const Vec3& offset)
+        {
+            Transform t;
+            for (int row = 0; row < 3; row++)
+                t.m[row][3] = offset[row];
+            return t;
+        }
+
+        static Transform scale(double s)
+        {
+            Transform t;
+            for (int row = 0; row < 3; row++)
+                t.m[row][row] = s;
+            return t;
+        }
+
+        static Transform rotateX(double degrees) { return rotate(degrees, 1, 2); }
+        static Transform rotateY(double degrees) { return rotate(degrees, 2, 0); }
+        static Transform rotateZ(double degrees) { return rotate(degrees, 0, 1); }
+
+        //applies other first, then this
+        Transform operator*(const Transform& other) const
+        {
+            Transform t;
+            for (int row = 0; row < 3; row++)
+            {
+                for (int col = 0; col < 4; col++)
+                {
+                    double sum = (col == 3) ? m[row][3] : 0.;
+                    for (int k = 0; k < 3; k++)
+                        sum += m[row][k] * other.m[k][col];
+                    t.m[row][col] = sum;
+                }
+            }
+            return t;
+        }
+
+        Transform inverse() const
+        {
+            //inverse of the 3x3 block from its cofactors, translation is then -inverse * translation
+            double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+                       - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                       + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+            double invDet = 1. / det;
+
+            Transform t;
+            t.m[0][0] =  (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * invDet;
+            t.m[0][1] = -(m[0][1] * m[2][2] - m[0][2] * m[2][1]) * invDet;
+            t.m[0][2] =  (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+            t.m[1][0] = -(m[1][0] * m[2][2] - m[1][2] * m[2][0]) * invDet;
+            t.m[1][1] =  (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+            t.m[1][2] = -(m[0][0] * m[1][2] - m[0][2] * m[1][0]) * invDet;
+            t.m[2][0] =  (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * invDet;
+            t.m[2][1] = -(m[0][0] * m[2][1] - m[0][1] * m[2][0]) * invDet;
+            t.m[2][2] =  (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+
+            for (int row = 0; row < 3; row++)
+                t.m[row][3] = -(t.m[row][0] * m[0][3] + t.m[row][1] * m[1][3] + t.m[row][2] * m[2][3]);
+            return t;
+        }
+
+        Point3 point(const Point3& p) const
+        {
+            return Point3(
+                m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+                m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+                m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]);
+        }
+
+        Vec3 vector(const Vec3& v) const
+        {
+            return Vec3(
+                m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+        }
+
+        //normals go through the transposed inverse, call this on the inverse transform
+        Vec3 normalFromInverse(const Vec3& n) const
+        {
+            return Vec3(
+                m[0][0] * n.x() + m[1][0] * n.y() + m[2][0] * n.z(),
+                m[0][1] * n.x() + m[1][1] * n.y() + m[2][1] * n.z(),
+                m[0][2] * n.x() + m[1][2] * n.y() + m[2][2] * n.z());
+        }
+
+    private:
+        static Transform rotate(double degrees, int a, int b)
+        {
+            double theta = degreeToRadians(degrees);
+            Transform t;
+            t.m[a][a] = cos(theta);
+            t.m[a][b] = -sin(theta);
+            t.m[b][a] = sin(theta);
+            t.m[b][b] = cos(theta);
+            return t;
+        }
+
+        double m[3][4];
+};
+
+//An object (typically a BvhNode built once) placed in the scene with a transform. Many instances can share
+//the same object, rays are moved into object space at the instance boundary instead of copying geometry.
+class Instance : public Hittable
+{
+    public:
+        Instance(shared_ptr<Hittable> object_, const Transform& objectToWorld_)
+            : object(object_), objectToWorld(objectToWorld_), worldToObject(objectToWorld_.inverse())
+        {
+            aabb objectBox;
+            hasBox = object->boundingBox(0, 1, objectBox);
+            if (hasBox)
+            {
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    Point3 p(
+                        (corner & 1) ? objectBox.maximum().x() : objectBox.minimum().x(),
+                        (corner & 2) ? objectBox.maximum().y() : objectBox.minimum().y(),
+                        (corner & 4) ? objectBox.maximum().z() : objectBox.minimum().z());
+                    bBox.surround(objectToWorld.point(p));
+                }
+            }
+        }
+
+        virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
+        virtual bool boundingBox(double time0, double time1, aabb& output_box) const override;
+        virtual bool hitUsesRandom() const override { return object->hitUsesRandom(); }
+
+    private:
+        shared_ptr<Hittable> object;
+        Transform objectToWorld;
+        Transform worldToObject;
+        aabb bBox;
+        bool hasBox;
+};
+
+bool Instance::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
+{
+    //the direction is not normalized, so t is the same in both spaces
+    Ray objectRay(worldToObject.point(r.origin()), worldToObject.vector(r.direction()), r.time());
+    if (!object->hit(objectRay, min_t, max_t, hitrecord))
+        return false;
+
+    //front_face does not change, dot(direction, normal) is invariant under the transform
+    hitrecord.p = objectToWorld.point(hitrecord.p);
+    hitrecord.normal = unit_vector(worldToObject.normalFromInverse(hitrecord.normal));
+    return true;
+}
+
+bool Instance::boundingBox(double time0, double time1, aabb& output_box) const
+{
+    output_box = bBox;
+    return hasBox;
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "bvh_node.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+//Subtree of a LazyBvh: its primitives, built into a BvhNode by the first ray that enters it. Other threads
+//reaching it meanwhile wait for that build, after it the subtree costs one atomic load.
+class LazySubtree
+{
+public:
+    LazySubtree(vector<shared_ptr<Hittable>>&& objects_, double time_0, double time_1, BvhBuildMethod method_)
+        : objects(std::move(objects_)), time0(time_0), time1(time_1), method(method_)
+    {
+        for (const auto& object : objects)
+            usesRandom = usesRandom || object->hitUsesRandom();
+    }
+
+    bool isBuilt() const { return built.load(std::memory_order_acquire) != nullptr; }
+    bool hitUsesRandom() const { return usesRandom; }
+
+    //the BvhNode, built on the first call
+    const Hittable* tree() const
+    {
+        const Hittable* node = built.load(std::memory_order_acquire);
+        if (node)
+            return node;
+        std::call_once(once, [this]
+            {
+                //the primitives move into the list and are released with it, the tree holds them from now on
+                HittableList list;
+                list.list.swap(objects);
+                subtree = make_shared<BvhNode>(list, time0, time1, method);
+                built.store(subtree.get(), std::memory_order_release);
+            });
+        return built.load(std::memory_order_acquire);
+    }
+
+private:
+    mutable vector<shared_ptr<Hittable>> objects;
+    double time0, time1;
+    BvhBuildMethod method;
+    bool usesRandom = false;
+
+    mutable std::once_flag once;
+    mutable shared_ptr<BvhNode> subtree;
+    mutable std::atomic<const Hittable*> built{ nullptr };
+};
+
+//BVH whose top levels are split eagerly, on the median centroid of the longest axis, down to subtrees of at most
+//subtreeSize primitives. These are built into BvhNodes the first time a ray enters them, so the first pixels of a
+//huge scene don't wait for the parts of it they never see. Rays visit the nearer child of a top level node first,
+//so subtrees behind the closest hit aren't entered (and built) at all.
+class LazyBvh : public Hittable
+{
+public:
+    LazyBvh(const HittableList& hittableList, double time_0, double time_1, size_t subtreeSize = 4096,
+        BvhBuildMethod method = BvhBuildMethod::BinnedSAH);
+
+    virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
+    virtual void hitPacket(RayPacket& packet, double min_t, uint64_t active) const override;
+    virtual bool boundingBox(double time0, double time1, aabb& output_box) const override;
+    virtual bool hitUsesRandom() const override { return usesRandom; }
+
+    size_t subtreeCount() const { return subtrees.size(); }
+    size_t builtCount() const;
+    //builds the subtrees no ray has entered yet, in parallel
+    void buildAll() const;
+
+private:
+    struct TopNode
+    {
+        aabb box;
+        uint32_t child[2] = { 0, 0 };
+        int subtree = -1; //index in subtrees for the leaves of the top levels
+    };
+
+    struct Centroid
+    {
+        Point3 point;
+        uint32_t index;
+    };
+
+    uint32_t split(vector<Centroid>& centroids, size_t start, size_t end);
+    bool hitNode(uint32_t index, const Ray& r, double min_t, double& closest, HitRecord& hitrecord) const;
+    void hitPacketNode(uint32_t index, RayPacket& packet, double min_t, uint64_t active) const;
+    //ray parameter where the ray enters the box within [min_t, max_t], infinity if it misses
+    static double entryDistance(const aabb& box, const Ray& r, double min_t, double max_t);
+
+    vector<TopNode> nodes;
+    vector<shared_ptr<LazySubtree>> subtrees;
+    vector<shared_ptr<Hittable>> objects; //the primitives until the top levels are split
+    vector<aabb> boxes;
+    double time0, time1;
+    size_t subtreeSize;
+    BvhBuildMethod method;
+    bool usesRandom = false;
+};
+
+LazyBvh::LazyBvh(const HittableList& hittableList, double time_0, double time_1, size_t subtreeSize_, BvhBuildMethod method_)
+    : objects(hittableList.list), time0(time_0), time1(time_1), subtreeSize(std::max<size_t>(subtreeSize_, 2)), method(method_)
+{
+    size_t count = objects.size();
+    boxes.resize(count);
+    vector<Centroid> centroids(count);
+    #pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(count); i++)
+    {
+        if (!objects[i]->boundingBox(time0, time1, boxes[i]))
+            std::cerr << "No bounding box in LazyBvh constructor.\n";
+        centroids[i].point = boxes[i].centroid();
+        centroids[i].index = static_cast<uint32_t>(i);
+    }
+    if (count > 0)
+        split(centroids, 0, count);
+
+    for (const auto& subtree : subtrees)
+        usesRandom = usesRandom || subtree->hitUsesRandom();
+    objects = vector<shared_ptr<Hittable>>();
+    boxes = vector<aabb>();
+}
+
+//partitions the centroids with their primitive index rather than the primitives, the boxes are fitted bottom up
+uint32_t LazyBvh::split(vector<Centroid>& centroids, size_t start, size_t end)
+{
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(TopNode());
+
+    if (end - start <= subtreeSize)
+    {
+        aabb box;
+        vector<shared_ptr<Hittable>> leaves;
+        leaves.reserve(end - start);
+        for (size_t i = start; i < end; i++)
+        {
+            box.surround(boxes[centroids[i].index]);
+            leaves.push_back(objects[centroids[i].index]);
+        }
+        nodes[index].box = box;
+        nodes[index].subtree = static_cast<int>(subtrees.size());
+        subtrees.push_back(make_shared<LazySubtree>(std::move(leaves), time0, time1, method));
+        return index;
+    }
+
+    aabb centroidBox;
+    for (size_t i = start; i < end; i++)
+        centroidBox.surround(centroids[i].point);
+    Vec3 extent = centroidBox.extent();
+    int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+    size_t mid = start + (end - start) / 2;
+    std::nth_element(centroids.begin() + start, centroids.begin() + mid, centroids.begin() + end,
+        [axis](const Centroid& a, const Centroid& b) { return a.point[axis] < b.point[axis]; });
+
+    uint32_t left = split(centroids, start, mid);
+    uint32_t right = split(centroids, mid, end);
+    nodes[index].child[0] = left;
+    nodes[index].child[1] = right;
+    nodes[index].box = surrounding_box(nodes[left].box, nodes[right].box);
+    return index;
+}
+
+double LazyBvh::entryDistance(const aabb& box, const Ray& r, double t_min, double t_max)
+{
+    //the slab test of aabb::hit, keeping the entry
+    for (int i = 0; i < 3; i++)
+    {
+        auto inv_bx = 1. / r.direction()[i];
+        double t0 = (box.minimum()[i] - r.origin()[i]) * inv_bx;
+        double t1 = (box.maximum()[i] - r.origin()[i]) * inv_bx;
+        if (inv_bx < 0.)
+            std::swap(t0, t1);
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+        if (t_max <= t_min)
+            return infinity;
+    }
+    return t_min;
+}
+
+bool LazyBvh::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
+{
+    if (nodes.empty() || entryDistance(nodes[0].box, r, min_t, max_t) == infinity)
+        return false;
+    double closest = max_t;
+    return hitNode(0, r, min_t, closest, hitrecord);
+}
+
+bool LazyBvh::hitNode(uint32_t index, const Ray& r, double min_t, double& closest, HitRecord& hitrecord) const
+{
+    const TopNode& node = nodes[index];
+    if (node.subtree >= 0)
+    {
+        if (!subtrees[node.subtree]->tree()->hit(r, min_t, closest, hitrecord))
+            return false;
+        closest = hitrecord.t;
+        return true;
+    }
+
+    double entry[2] = { entryDistance(nodes[node.child[0]].box, r, min_t, closest), entryDistance(nodes[node.child[1]].box, r, min_t, closest) };
+    int near = entry[1] < entry[0] ? 1 : 0;
+    bool hitAnything = false;
+    for (int side : { near, 1 - near })
+    {
+        //the entry is checked again against the closest hit found in the nearer child
+        if (entry[side] < closest)
+            hitAnything = hitNode(node.child[side], r, min_t, closest, hitrecord) || hitAnything;
+    }
+    return hitAnything;
+}
+
+void LazyBvh::hitPacket(RayPacket& packet, double min_t, uint64_t active) const
+{
+    if (!nodes.empty())
+        hitPacketNode(0, packet, min_t, active);
+}
+
+//like BvhNode::hitPacket, the subtrees are built when a ray of the packet enters their box
+void LazyBvh::hitPacketNode(uint32_t index, RayPacket& packet, double min_t, uint64_t active) const
+{
+    const TopNode& node = nodes[index];
+    if (packet.missesBox(node.box, min_t))
+        return;
+    active = packet.boxMask(node.box, min_t, active);
+    if (!active)
+        return;
+    if (node.subtree >= 0)
+    {
+        subtrees[node.subtree]->tree()->hitPacket(packet, min_t, active);
+        return;
+    }
+    hitPacketNode(node.child[0], packet, min_t, active);
+    hitPacketNode(node.child[1], packet, min_t, active);
+}
+
+bool LazyBvh::boundingBox(double time0, double time1, aabb& output_box) const
+{
+    if (nodes.empty())
+        return false;
+    output_box = nodes[0].box;
+    return true;
+}
+
+size_t LazyBvh::builtCount() const
+{
+    size_t built = 0;
+    for (const auto& subtree : subtrees)
+        built += subtree->isBuilt();
+    return built;
+}
+
+void LazyBvh::buildAll() const
+{
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(subtrees.size()); i++)
+        subtrees[i]->tree();
+}
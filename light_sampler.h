@@ -0,0 +1,720 @@
+#pragma once
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "bvh_node.h"
+#include "sphere.h"
+#include "axis_rectangle.h"
+#include "box.h"
+#include "material.h"
+#include "onb.h"
+#include "environment.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using std::shared_ptr;
+using std::vector;
+
+//how LightSampler picks the emitter a shading point samples
+enum class LightSelection
+{
+    Uniform, //every emitter equally likely
+    Bvh,     //walks down the light BVH choosing children by their importance for the point
+    None     //emitters are only found by scattered rays, an environment map can still be sampled
+};
+
+//Emitting sphere or rectangle of the world, as the light sampler sees it
+struct Emitter
+{
+    enum class Shape
+    {
+        Sphere,
+        RectXY,
+        RectXZ,
+        RectYZ
+    };
+
+    Shape shape = Shape::Sphere;
+    shared_ptr<Hittable> object; //intersected for the emitted light at the sampled point
+    const Material* material = nullptr;
+    Point3 center;
+    double radius = 0;
+    double a0 = 0, a1 = 0, b0 = 0, b1 = 0, k = 0; //rectangles: [a0, a1] x [b0, b1] in the plane k of the shape
+    aabb box;
+    double power = 0; //luminance of the light leaving the emitter, both sides of rectangles
+    double area = 0;  //of the surface, one side of rectangles
+};
+
+//Direction from a shading point to a point on an emitter
+struct LightSample
+{
+    Vec3 direction; //unit length
+    double distance = 0; //to the emitter along direction
+    Color emitted;
+    double pdf = 0; //solid angle density of the direction times the probability of picking the emitter
+    uint32_t emitter = 0;
+};
+
+//Point of an emitter and direction of light leaving it, where paths traced from the lights start
+struct EmissionSample
+{
+    Point3 p;
+    Vec3 normal;    //outward on spheres, along the axis on rectangles
+    Vec3 direction; //unit length
+    Color emitted;
+    double pdfPosition = 0;  //area density of p times the probability of picking the emitter
+    double pdfDirection = 0; //solid angle density of direction
+    uint32_t emitter = 0;
+};
+
+//Emitter index of a world, built once at scene load, for next event estimation: every diffuse hit samples a
+//direction to one emitter instead of waiting for its scattered rays to hit a light by chance.
+//The emitter is picked uniformly or with a light BVH (Conty Estevez & Kulla 2018, "Importance Sampling of Many
+//Lights with Adaptive Tree Splitting"), whose nodes bound the boxes, emission directions and power of their
+//emitters. Descending it picks a child by an upper bound of the light it can send to the point, so among
+//thousands of small lights a point mostly samples the near and bright ones, in O(log n).
+//Spheres and rectangles with a Light material are indexed, also inside boxes and BvhNodes. Emitters the index
+//can't see (in instances, moving spheres) are still found by scattered rays, pdf() is 0 for them.
+//An environment map set on the sampler is the light of rays leaving the scene. Sampled, it is picked with
+//probability 1/2 next to the emitters (1 without them) and a direction drawn from its own distribution.
+class LightSampler
+{
+public:
+    LightSampler(const HittableList& world, LightSelection selection = LightSelection::Bvh);
+
+    size_t emitterCount() const { return emitters.size(); }
+    const Emitter& emitter(size_t index) const { return emitters[index]; }
+    LightSelection getSelection() const { return selection; }
+    void setSelection(LightSelection selection_) { selection = selection_; }
+    //importanceSample false leaves the map to be found by scattered rays that escape
+    void setEnvironment(shared_ptr<const EnvironmentMap> environment_, bool importanceSample = true)
+    {
+        environment = environment_;
+        sampleEnvironment = importanceSample;
+    }
+    const EnvironmentMap* getEnvironment() const { return environment.get(); }
+
+    //Picks an emitter for the point p with normal n (zero for points in media) and samples a direction to it,
+    //false when no emitter can light the point
+    bool sample(const Point3& p, const Vec3& n, double time, LightSample& sample) const;
+    //Density sample() at p with normal n has for the direction of r, whose closest hit rec is on an emitter: to
+    //weigh the light a scattered ray finds against sampling it. 0 when the hit isn't on an indexed emitter.
+    double pdf(const Point3& p, const Vec3& n, const Ray& r, const HitRecord& rec) const;
+    //Density sample() has for the direction of a ray leaving the scene towards the environment map
+    double environmentPdf(const Vec3& direction) const;
+    //index of the emitter whose surface the hit rec is on, -1 when it isn't on an indexed one
+    int findEmitter(const HitRecord& rec) const;
+
+    //Picks an emitter in proportion to its power, a uniform point on it and a cosine weighted direction leaving it,
+    //outwards from spheres and to either side of rectangles. False when no emitter sends light.
+    bool sampleEmission(double time, EmissionSample& sample) const;
+    //densities of sampleEmission for the point of emitter with normal n sending light in direction (unit)
+    void emissionPdf(uint32_t emitter, const Vec3& n, const Vec3& direction, double& pdfPosition, double& pdfDirection) const;
+    double totalPower() const { return powerCdf.empty() ? 0 : powerCdf.back(); }
+
+    size_t nodeCount() const { return nodes.size(); }
+
+private:
+    //Bounds of the light of a set of emitters: box, cone of the normals (axis and cosine of its half angle theta_o)
+    //and the cosine of the angle theta_e around the normals that light is emitted in
+    struct LightBounds
+    {
+        aabb box;
+        Vec3 axis = Vec3(0, 0, 1);
+        double cosThetaO = 1;
+        double cosThetaE = 0;
+        double power = 0;
+
+        void surround(const LightBounds& other);
+        //upper bound of the light reaching p (and arriving above the plane of n when n isn't zero)
+        double importance(const Point3& p, const Vec3& n) const;
+        //cost of the bounds for the split heuristic, power times area times the solid angle of the cones
+        double cost(int axis) const;
+    };
+
+    struct LightNode
+    {
+        LightBounds bounds;
+        uint32_t right = 0; //the left child follows its parent
+        uint32_t parent = 0;
+        int emitter = -1;
+    };
+
+    void collect(const shared_ptr<Hittable>& object);
+    void addRect(const shared_ptr<Hittable>& object, Emitter::Shape shape, const Material* material, double a0, double a1,
+        double b0, double b1, double k);
+    void add(Emitter& emitter);
+    uint32_t build(vector<uint32_t>& order, size_t start, size_t end);
+    bool sampleEmitter(const Emitter& emitter, const Point3& p, double time, LightSample& sample) const;
+    //solid angle density of sampleEmitter for the direction reaching the emitter at distance
+    double emitterPdf(const Emitter& emitter, const Point3& p, const Vec3& direction, double distance) const;
+    //probability that sample() picks the emitter for p
+    double selectionPmf(uint32_t emitter, const Point3& p, const Vec3& n) const;
+    //probability that sample() samples the environment map instead of an emitter
+    double environmentProbability() const;
+
+    static constexpr int binCount = 12;
+
+    vector<Emitter> emitters;
+    vector<LightBounds> emitterBounds;
+    vector<LightNode> nodes;
+    vector<uint32_t> leaves; //node of every emitter
+    vector<double> powerCdf; //emitterCount() + 1 running sums of the emitters' power
+    vector<std::pair<const Material*, uint32_t>> byMaterial; //emitters sorted by material, to find the one hit
+    LightSelection selection;
+    shared_ptr<const EnvironmentMap> environment;
+    bool sampleEnvironment = false;
+};
+
+LightSampler::LightSampler(const HittableList& world, LightSelection selection_) : selection(selection_)
+{
+    for (const auto& object : world.list)
+        collect(object);
+    for (size_t i = 0; i < emitters.size(); i++)
+        byMaterial.push_back({ emitters[i].material, static_cast<uint32_t>(i) });
+    std::sort(byMaterial.begin(), byMaterial.end());
+
+    if (emitters.empty())
+        return;
+    powerCdf.push_back(0);
+    for (const Emitter& emitter : emitters)
+        powerCdf.push_back(powerCdf.back() + emitter.power);
+    vector<uint32_t> order(emitters.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = static_cast<uint32_t>(i);
+    nodes.reserve(2 * emitters.size() - 1);
+    leaves.resize(emitters.size());
+    build(order, 0, order.size());
+}
+
+void LightSampler::collect(const shared_ptr<Hittable>& object)
+{
+    const Hittable* hittable = object.get();
+    if (auto list = dynamic_cast<const HittableList*>(hittable))
+    {
+        for (const auto& child : list->list)
+            collect(child);
+    }
+    else if (auto node = dynamic_cast<const BvhNode*>(hittable))
+    {
+        vector<shared_ptr<Hittable>> primitives;
+        node->collectPrimitives(primitives);
+        for (const auto& primitive : primitives)
+            collect(primitive);
+    }
+    else if (auto box = dynamic_cast<const Box*>(hittable))
+    {
+        for (const auto& side : box->sides.list)
+            collect(side);
+    }
+    else if (auto sphere = dynamic_cast<const Sphere*>(hittable))
+    {
+        if (sphere->material && sphere->material->type == MaterialType::Light && sphere->radius > 0)
+        {
+            Emitter emitter;
+            emitter.shape = Emitter::Shape::Sphere;
+            emitter.object = object;
+            emitter.material = sphere->material.get();
+            emitter.center = sphere->center;
+            emitter.radius = sphere->radius;
+            add(emitter);
+        }
+    }
+    else if (auto rect = dynamic_cast<const Rect_xy*>(hittable))
+        addRect(object, Emitter::Shape::RectXY, rect->material.get(), rect->x0, rect->x1, rect->y0, rect->y1, rect->k);
+    else if (auto rect = dynamic_cast<const Rect_xz*>(hittable))
+        addRect(object, Emitter::Shape::RectXZ, rect->material.get(), rect->x0, rect->x1, rect->z0, rect->z1, rect->k);
+    else if (auto rect = dynamic_cast<const Rect_yz*>(hittable))
+        addRect(object, Emitter::Shape::RectYZ, rect->material.get(), rect->y0, rect->y1, rect->z0, rect->z1, rect->k);
+}
+
+void LightSampler::addRect(const shared_ptr<Hittable>& object, Emitter::Shape shape, const Material* material, double a0,
+    double a1, double b0, double b1, double k)
+{
+    if (!material || material->type != MaterialType::Light)
+        return;
+    Emitter emitter;
+    emitter.shape = shape;
+    emitter.object = object;
+    emitter.material = material;
+    emitter.a0 = a0;
+    emitter.a1 = a1;
+    emitter.b0 = b0;
+    emitter.b1 = b1;
+    emitter.k = k;
+    add(emitter);
+}
+
+//fills in the box and power of the emitter and its light bounds
+void LightSampler::add(Emitter& emitter)
+{
+    LightBounds bounds;
+    double area;
+    if (emitter.shape == Emitter::Shape::Sphere)
+    {
+        Vec3 r(emitter.radius, emitter.radius, emitter.radius);
+        emitter.box = aabb(emitter.center - r, emitter.center + r);
+        area = 4. * pi * emitter.radius * emitter.radius;
+        //normals in all directions
+        bounds.cosThetaO = -1;
+    }
+    else
+    {
+        //the plane's two axes, the normal on the third
+        int a = emitter.shape == Emitter::Shape::RectYZ ? 1 : 0;
+        int b = emitter.shape == Emitter::Shape::RectXY ? 1 : 2;
+        int normalAxis = 3 - a - b;
+        Point3 lo, hi;
+        lo[a] = emitter.a0, hi[a] = emitter.a1;
+        lo[b] = emitter.b0, hi[b] = emitter.b1;
+        lo[normalAxis] = hi[normalAxis] = emitter.k;
+        emitter.center = 0.5 * (lo + hi);
+        emitter.box = aabb(lo, hi);
+        area = (emitter.a1 - emitter.a0) * (emitter.b1 - emitter.b0);
+        //Light doesn't look at the side that was hit, rectangles emit on both
+        bounds.axis = Vec3(0, 0, 0);
+        bounds.axis[normalAxis] = 1;
+        bounds.cosThetaO = -1;
+        area *= 2;
+    }
+    //textured lights are rated by their color in the middle
+    Color emitted = emitted_material(emitter.material, 0.5, 0.5, emitter.center);
+    emitter.area = emitter.shape == Emitter::Shape::Sphere ? area : area / 2;
+    emitter.power = pi * area * (0.2126 * emitted.x() + 0.7152 * emitted.y() + 0.0722 * emitted.z());
+
+    bounds.box = emitter.box;
+    bounds.cosThetaE = 0; //cosine emission, up to 90 degrees from the normal
+    bounds.power = emitter.power;
+    emitters.push_back(emitter);
+    emitterBounds.push_back(bounds);
+}
+
+//Union of the bounds, the cone around both cones is found as in pbrt-v4's DirectionCone::Union
+void LightSampler::LightBounds::surround(const LightBounds& other)
+{
+    box.surround(other.box);
+    power += other.power;
+    cosThetaE = std::min(cosThetaE, other.cosThetaE);
+    if (cosThetaO == -1 || other.cosThetaO == -1)
+    {
+        cosThetaO = -1;
+        return;
+    }
+    double thetaA = std::acos(clamp(cosThetaO, -1., 1.)), thetaB = std::acos(clamp(other.cosThetaO, -1., 1.));
+    double thetaD = std::acos(clamp(dot(axis, other.axis), -1., 1.));
+    if (std::min(thetaD + thetaB, pi) <= thetaA)
+        return;
+    if (std::min(thetaD + thetaA, pi) <= thetaB)
+    {
+        axis = other.axis;
+        cosThetaO = other.cosThetaO;
+        return;
+    }
+    //the cone spanning both, rotated from this axis towards the other
+    double thetaO = 0.5 * (thetaA + thetaD + thetaB);
+    Vec3 rotationAxis = cross(axis, other.axis);
+    if (thetaO >= pi || rotationAxis.length_squared() == 0)
+    {
+        cosThetaO = -1;
+        return;
+    }
+    double thetaR = thetaO - thetaA;
+    Vec3 k = unit_vector(rotationAxis);
+    axis = unit_vector(axis * std::cos(thetaR) + cross(k, axis) * std::sin(thetaR) + k * dot(k, axis) * (1 - std::cos(thetaR)));
+    cosThetaO = std::cos(thetaO);
+}
+
+double LightSampler::LightBounds::importance(const Point3& p, const Vec3& n) const
+{
+    if (power == 0)
+        return 0;
+    Point3 center = box.centroid();
+    Vec3 toPoint = p - center;
+    double radiusSquared = 0.25 * box.extent().length_squared();
+    //the distance is kept from falling below the box size, points inside the box would get unbounded importance
+    double distanceSquared = std::max(toPoint.length_squared(), radiusSquared);
+
+    //cos(max(0, a - b)) from the sines and cosines of the angles, 1 when b covers a
+    auto cosSubClamped = [](double sinA, double cosA, double sinB, double cosB)
+    {
+        return cosA > cosB ? 1. : cosA * cosB + sinA * sinB;
+    };
+    auto sinOf = [](double cosine) { return std::sqrt(std::max(0., 1. - cosine * cosine)); };
+
+    //half angle theta_b of the cone of directions from p to the bounding sphere of the box
+    double cosThetaB = -1;
+    if (toPoint.length_squared() > radiusSquared)
+        cosThetaB = std::sqrt(std::max(0., 1. - radiusSquared / toPoint.length_squared()));
+    double sinThetaB = sinOf(cosThetaB);
+
+    //angle theta between the cone axis and the direction to p, reduced by the spread of the normals and of the box
+    double toPointLength = std::sqrt(toPoint.length_squared());
+    double cosTheta = toPointLength > 0 ? dot(axis, toPoint) / toPointLength : 1.;
+    double cosThetaX = cosSubClamped(sinOf(cosTheta), cosTheta, sinOf(cosThetaO), cosThetaO);
+    double cosThetaP = cosSubClamped(sinOf(cosThetaX), cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= cosThetaE)
+        return 0;
+    double result = power * cosThetaP / distanceSquared;
+
+    //the cosine at the shading point, lights below its plane (beyond the box spread) send nothing
+    if (n.length_squared() > 0 && toPointLength > 0)
+    {
+        double cosThetaI = -dot(n, toPoint) / toPointLength;
+        double cosThetaIP = cosSubClamped(sinOf(cosThetaI), cosThetaI, sinThetaB, cosThetaB);
+        if (cosThetaIP <= 0)
+            return 0;
+        result *= cosThetaIP;
+    }
+    return result;
+}
+
+double LightSampler::LightBounds::cost(int splitAxis) const
+{
+    //solid angle measure of the normals cone widened by the emission angle (pbrt-v4's EvaluateCost)
+    double thetaO = std::acos(clamp(cosThetaO, -1., 1.));
+    double thetaE = std::acos(clamp(cosThetaE, -1., 1.));
+    double thetaW = std::min(thetaO + thetaE, pi);
+    double sinThetaO = std::sin(thetaO);
+    double orientation = 2 * pi * (1 - cosThetaO)
+        + pi / 2 * (2 * thetaW * sinThetaO - std::cos(thetaO - 2 * thetaW) - 2 * thetaO * sinThetaO + cosThetaO);
+    //thin boxes are penalized on their thin axis, otherwise they would always win
+    Vec3 extent = box.extent();
+    double maxExtent = std::max(extent.x(), std::max(extent.y(), extent.z()));
+    double regularization = extent[splitAxis] > 0 ? maxExtent / extent[splitAxis] : 1.;
+    return regularization * power * orientation * box.surfaceArea();
+}
+
+//Builds the node of the emitters order[start, end) and below, splitting them into binCount bins of centroids on
+//the axis and bin boundary of least cost, one emitter per leaf
+uint32_t LightSampler::build(vector<uint32_t>& order, size_t start, size_t end)
+{
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(LightNode());
+    if (end - start == 1)
+    {
+        nodes[index].bounds = emitterBounds[order[start]];
+        nodes[index].emitter = static_cast<int>(order[start]);
+        leaves[order[start]] = index;
+        return index;
+    }
+
+    aabb centroids;
+    for (size_t i = start; i < end; i++)
+        centroids.surround(emitterBounds[order[i]].box.centroid());
+
+    double bestCost = infinity;
+    int bestAxis = -1, bestSplit = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double lo = centroids.minimum()[axis], extent = centroids.extent()[axis];
+        if (extent <= 0)
+            continue;
+        LightBounds bins[binCount];
+        for (size_t i = start; i < end; i++)
+        {
+            const LightBounds& bounds = emitterBounds[order[i]];
+            int bin = std::min(binCount - 1, static_cast<int>(binCount * (bounds.box.centroid()[axis] - lo) / extent));
+            if (bins[bin].box.empty())
+                bins[bin] = bounds;
+            else
+                bins[bin].surround(bounds);
+        }
+        for (int split = 1; split < binCount; split++)
+        {
+            LightBounds below, above;
+            bool anyBelow = false, anyAbove = false;
+            for (int bin = 0; bin < binCount; bin++)
+            {
+                if (bins[bin].box.empty())
+                    continue;
+                LightBounds& side = bin < split ? below : above;
+                bool& any = bin < split ? anyBelow : anyAbove;
+                if (any)
+                    side.surround(bins[bin]);
+                else
+                    side = bins[bin];
+                any = true;
+            }
+            if (!anyBelow || !anyAbove)
+                continue;
+            double cost = below.cost(axis) + above.cost(axis);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    size_t mid = start + (end - start) / 2;
+    if (bestAxis >= 0)
+    {
+        double lo = centroids.minimum()[bestAxis], extent = centroids.extent()[bestAxis];
+        auto below = std::partition(order.begin() + start, order.begin() + end, [&](uint32_t e)
+            {
+                int bin = std::min(binCount - 1, static_cast<int>(binCount * (emitterBounds[e].box.centroid()[bestAxis] - lo) / extent));
+                return bin < bestSplit;
+            });
+        mid = below - order.begin();
+    }
+
+    build(order, start, mid);
+    uint32_t right = build(order, mid, end);
+    nodes[index].right = right;
+    nodes[index + 1].parent = nodes[right].parent = index;
+    nodes[index].bounds = nodes[index + 1].bounds;
+    nodes[index].bounds.surround(nodes[right].bounds);
+    return index;
+}
+
+double LightSampler::environmentProbability() const
+{
+    if (!environment || !sampleEnvironment)
+        return 0;
+    return emitters.empty() || selection == LightSelection::None ? 1. : 0.5;
+}
+
+bool LightSampler::sample(const Point3& p, const Vec3& n, double time, LightSample& sample) const
+{
+    double environmentChance = environmentProbability();
+    if (environmentChance > 0 && (environmentChance == 1 || random_double() < environmentChance))
+    {
+        if (!environment->sample(random_double(), random_double(), sample.direction, sample.pdf))
+            return false;
+        sample.distance = infinity;
+        sample.emitted = environment->radiance(sample.direction);
+        sample.pdf *= environmentChance;
+        sample.emitter = static_cast<uint32_t>(emitters.size());
+        return true;
+    }
+    if (emitters.empty() || selection == LightSelection::None)
+        return false;
+
+    uint32_t emitter;
+    double pmf = 1;
+    if (selection == LightSelection::Uniform)
+    {
+        emitter = std::min(static_cast<uint32_t>(random_double() * emitters.size()), static_cast<uint32_t>(emitters.size() - 1));
+        pmf = 1. / emitters.size();
+    }
+    else
+    {
+        uint32_t index = 0;
+        if (nodes[0].bounds.importance(p, n) == 0)
+            return false;
+        while (nodes[index].emitter < 0)
+        {
+            uint32_t left = index + 1, right = nodes[index].right;
+            double leftImportance = nodes[left].bounds.importance(p, n);
+            double rightImportance = nodes[right].bounds.importance(p, n);
+            if (leftImportance == 0 && rightImportance == 0)
+                return false;
+            double leftProbability = leftImportance / (leftImportance + rightImportance);
+            if (random_double() < leftProbability)
+            {
+                index = left;
+                pmf *= leftProbability;
+            }
+            else
+            {
+                index = right;
+                pmf *= 1 - leftProbability;
+            }
+        }
+        emitter = static_cast<uint32_t>(nodes[index].emitter);
+    }
+
+    if (!sampleEmitter(emitters[emitter], p, time, sample))
+        return false;
+    sample.pdf *= pmf * (1. - environmentChance);
+    sample.emitter = emitter;
+    return true;
+}
+
+//Samples a direction from p to the emitter: uniformly in the cone the sphere subtends, or to a uniform point of
+//the rectangle. The emitter is intersected along it for the distance and its light there.
+bool LightSampler::sampleEmitter(const Emitter& emitter, const Point3& p, double time, LightSample& sample) const
+{
+    if (emitter.shape == Emitter::Shape::Sphere)
+    {
+        Vec3 toCenter = emitter.center - p;
+        double distanceSquared = toCenter.length_squared();
+        double radiusSquared = emitter.radius * emitter.radius;
+        if (distanceSquared <= radiusSquared)
+        {
+            //inside the sphere every direction reaches it
+            sample.direction = random_unit_vector_analytic();
+        }
+        else
+        {
+            double cosThetaMax = std::sqrt(1. - radiusSquared / distanceSquared);
+            //1 - cos, without the cancellation for far spheres
+            double oneMinusCos = radiusSquared / distanceSquared / (1. + cosThetaMax);
+            double z = 1. - random_double() * oneMinusCos;
+            double phi = 2. * pi * random_double();
+            double sinTheta = std::sqrt(std::max(0., 1. - z * z));
+            sample.direction = unit_vector(Onb(unit_vector(toCenter)).local(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, z));
+        }
+    }
+    else
+    {
+        int a = emitter.shape == Emitter::Shape::RectYZ ? 1 : 0;
+        int b = emitter.shape == Emitter::Shape::RectXY ? 1 : 2;
+        int normalAxis = 3 - a - b;
+        Point3 q;
+        q[a] = random_double(emitter.a0, emitter.a1);
+        q[b] = random_double(emitter.b0, emitter.b1);
+        q[normalAxis] = emitter.k;
+        Vec3 toPoint = q - p;
+        if (toPoint.length_squared() == 0)
+            return false;
+        sample.direction = unit_vector(toPoint);
+    }
+
+    HitRecord rec;
+    if (!emitter.object->hit(Ray(p, sample.direction, time), 0.001, infinity, rec))
+        return false;
+    sample.distance = rec.t;
+    sample.pdf = emitterPdf(emitter, p, sample.direction, rec.t);
+    if (sample.pdf == 0)
+        return false;
+    sample.emitted = emitted_material(rec.material_ptr, rec.u, rec.v, rec.p);
+    return true;
+}
+
+double LightSampler::emitterPdf(const Emitter& emitter, const Point3& p, const Vec3& direction, double distance) const
+{
+    if (emitter.shape == Emitter::Shape::Sphere)
+    {
+        double distanceSquared = (emitter.center - p).length_squared();
+        double radiusSquared = emitter.radius * emitter.radius;
+        if (distanceSquared <= radiusSquared)
+            return 1. / (4. * pi);
+        double cosThetaMax = std::sqrt(1. - radiusSquared / distanceSquared);
+        return 1. / (2. * pi * (radiusSquared / distanceSquared / (1. + cosThetaMax)));
+    }
+    //uniform on the area, turned into solid angle
+    int normalAxis = emitter.shape == Emitter::Shape::RectXY ? 2 : emitter.shape == Emitter::Shape::RectXZ ? 1 : 0;
+    double cosine = std::abs(direction[normalAxis]);
+    double area = (emitter.a1 - emitter.a0) * (emitter.b1 - emitter.b0);
+    if (cosine < 1e-9 || area <= 0)
+        return 0;
+    return distance * distance / (cosine * area);
+}
+
+double LightSampler::selectionPmf(uint32_t emitter, const Point3& p, const Vec3& n) const
+{
+    if (selection == LightSelection::Uniform)
+        return 1. / emitters.size();
+    //the choices sample() makes on the way down, from the leaf up
+    double pmf = 1;
+    uint32_t node = leaves[emitter];
+    while (node != 0)
+    {
+        uint32_t parent = nodes[node].parent;
+        uint32_t sibling = node == parent + 1 ? nodes[parent].right : parent + 1;
+        double importance = nodes[node].bounds.importance(p, n);
+        if (importance == 0)
+            return 0;
+        pmf *= importance / (importance + nodes[sibling].bounds.importance(p, n));
+        node = parent;
+    }
+    return nodes[0].bounds.importance(p, n) > 0 ? pmf : 0;
+}
+
+double LightSampler::pdf(const Point3& p, const Vec3& n, const Ray& r, const HitRecord& rec) const
+{
+    if (selection == LightSelection::None)
+        return 0;
+    int emitter = findEmitter(rec);
+    if (emitter < 0)
+        return 0;
+    double length = r.direction().length();
+    return (1. - environmentProbability()) * selectionPmf(static_cast<uint32_t>(emitter), p, n)
+        * emitterPdf(emitters[emitter], p, r.direction() / length, rec.t * length);
+}
+
+int LightSampler::findEmitter(const HitRecord& rec) const
+{
+    //the emitters of the material, the one whose surface the hit is on
+    auto first = std::lower_bound(byMaterial.begin(), byMaterial.end(), std::make_pair(rec.material_ptr, uint32_t(0)));
+    for (auto it = first; it != byMaterial.end() && it->first == rec.material_ptr; ++it)
+    {
+        const Emitter& emitter = emitters[it->second];
+        bool onSurface;
+        if (emitter.shape == Emitter::Shape::Sphere)
+        {
+            onSurface = std::abs((rec.p - emitter.center).length() - emitter.radius) <= 1e-6 * emitter.radius;
+        }
+        else
+        {
+            int a = emitter.shape == Emitter::Shape::RectYZ ? 1 : 0;
+            int b = emitter.shape == Emitter::Shape::RectXY ? 1 : 2;
+            double tolerance = 1e-6 * std::max(1., std::abs(emitter.k));
+            onSurface = std::abs(rec.p[3 - a - b] - emitter.k) <= tolerance && rec.p[a] >= emitter.a0 && rec.p[a] <= emitter.a1
+                && rec.p[b] >= emitter.b0 && rec.p[b] <= emitter.b1;
+        }
+        if (onSurface)
+            return static_cast<int>(it->second);
+    }
+    return -1;
+}
+
+bool LightSampler::sampleEmission(double time, EmissionSample& sample) const
+{
+    if (totalPower() <= 0)
+        return false;
+    double u = random_double() * totalPower();
+    int index = static_cast<int>(std::upper_bound(powerCdf.begin() + 1, powerCdf.end(), u) - powerCdf.begin()) - 1;
+    index = std::min(std::max(index, 0), static_cast<int>(emitters.size()) - 1);
+    const Emitter& emitter = emitters[index];
+
+    Vec3 side;
+    if (emitter.shape == Emitter::Shape::Sphere)
+    {
+        sample.normal = random_unit_vector_analytic();
+        sample.p = emitter.center + emitter.radius * sample.normal;
+        side = sample.normal;
+    }
+    else
+    {
+        int a = emitter.shape == Emitter::Shape::RectYZ ? 1 : 0;
+        int b = emitter.shape == Emitter::Shape::RectXY ? 1 : 2;
+        int normalAxis = 3 - a - b;
+        sample.p[a] = random_double(emitter.a0, emitter.a1);
+        sample.p[b] = random_double(emitter.b0, emitter.b1);
+        sample.p[normalAxis] = emitter.k;
+        sample.normal = Vec3(0, 0, 0);
+        sample.normal[normalAxis] = 1;
+        side = random_double() < 0.5 ? sample.normal : -sample.normal;
+    }
+    //the emitted light at the point, through the emitter's own hit for its texture coordinates
+    HitRecord rec;
+    if (!emitter.object->hit(Ray(sample.p + side, -side, time), 0.5, 1.5, rec))
+        return false;
+    sample.emitted = emitted_material(emitter.material, rec.u, rec.v, rec.p);
+    sample.direction = unit_vector(Onb(side).local(random_cosine_direction()));
+    sample.emitter = static_cast<uint32_t>(index);
+    emissionPdf(sample.emitter, sample.normal, sample.direction, sample.pdfPosition, sample.pdfDirection);
+    return sample.pdfPosition > 0 && sample.pdfDirection > 0;
+}
+
+void LightSampler::emissionPdf(uint32_t emitter, const Vec3& n, const Vec3& direction, double& pdfPosition, double& pdfDirection) const
+{
+    const Emitter& e = emitters[emitter];
+    pdfPosition = totalPower() > 0 && e.area > 0 ? e.power / totalPower() / e.area : 0;
+    double cosine = dot(n, direction);
+    if (e.shape == Emitter::Shape::Sphere)
+        pdfDirection = std::max(0., cosine) / pi;
+    else
+        pdfDirection = 0.5 * std::abs(cosine) / pi;
+}
+
+double LightSampler::environmentPdf(const Vec3& direction) const
+{
+    double probability = environmentProbability();
+    return probability > 0 ? probability * environment->pdf(direction) : 0;
+}
@@ -4,9 +4,29 @@
 #include "texture.h"
 #include "ray.h"
 #include "hittable.h"
+#include "onb.h"
+
+#include <cstdint>
+#include <vector>
+
+//Tag of the built in materials, so the integrator can switch over them instead of calling through the vtable.
+//Materials defined elsewhere use Other and are still called virtually.
+enum class MaterialType
+{
+    Lambertian,
+    Metal,
+    Dielectric,
+    Light,
+    Isotropic,
+    Other
+};
 
 class Material {
     public:
+        Material(MaterialType type_ = MaterialType::Other) : type(type_) {}
+
+        const MaterialType type;
+
         virtual Color color_emitted(double u, double v, const Point3& p) const 
         {
             return Color(0, 0, 0);
@@ -14,35 +34,53 @@ class Material {
         virtual bool scatter(const Ray& ray_in, const HitRecord& rec, Color& attenuation, Ray& scatter_ray) const = 0;
 };
 
-class Lambertian : public Material
+class Lambertian final : public Material
 {
     public:
-    Lambertian(const Color& a) : albedo(make_shared<SolidColor>(a)) {}
-    Lambertian(shared_ptr<Texture> _albedo) : albedo(_albedo) {}
+    Lambertian(const Color& a) : Material(MaterialType::Lambertian), albedo(make_shared<SolidColor>(a)), solid(true), solidAlbedo(a) {}
+    Lambertian(shared_ptr<Texture> _albedo) : Material(MaterialType::Lambertian), albedo(_albedo)
+    {
+        //solid colors are read inline instead of through the texture
+        auto solidColor = std::dynamic_pointer_cast<SolidColor>(_albedo);
+        solid = solidColor != nullptr;
+        if (solid)
+            solidAlbedo = solidColor->color();
+    }
     
         virtual bool scatter(const Ray& ray_in, const HitRecord& rec, Color& attenuation, Ray& scatter_ray) const override
         {
-            //Diffuse reflection of randomly scattered rays
-            auto scatter_direction = rec.normal + random_unit_vector();
-            if (scatter_direction.near_zero())
-                scatter_direction = rec.normal;
+            //Diffuse reflection of randomly scattered rays, both ways are cosine weighted around the normal
+            Vec3 scatter_direction;
+            if (scatterSampling == ScatterSampling::Analytic)
+            {
+                scatter_direction = Onb(rec.normal).local(random_cosine_direction());
+            }
+            else
+            {
+                scatter_direction = rec.normal + random_unit_vector();
+                if (scatter_direction.near_zero())
+                    scatter_direction = rec.normal;
+            }
             scatter_ray = Ray(rec.p, scatter_direction, ray_in.time());
-            attenuation = albedo->colorValue(rec.u, rec.v, rec.p);
+            attenuation = solid ? solidAlbedo : albedo->colorValue(rec.u, rec.v, rec.p);
             return true;
         }
     private:
         shared_ptr<Texture> albedo;
+        bool solid;
+        Color solidAlbedo;
 };
 
-class Metal : public Material
+class Metal final : public Material
 {
     public:
-    Metal(Color _albedo, double _fuzz) : albedo(_albedo), fuzz(std::min(_fuzz, 1.0)) {}
+    Metal(Color _albedo, double _fuzz) : Material(MaterialType::Metal), albedo(_albedo), fuzz(std::min(_fuzz, 1.0)) {}
     virtual bool scatter(const Ray& ray_in, const HitRecord& rec, Color& attenuation, Ray& scatter_ray) const override
     {
         Vec3 reflected = reflect(ray_in.direction(), rec.normal);
         //scattered is the left over of what wasn't directly reflected
-        scatter_ray = Ray(rec.p, reflected + fuzz* random_in_unit_sphere(), ray_in.time());
+        Vec3 fuzz_offset = (scatterSampling == ScatterSampling::Analytic) ? random_in_unit_sphere_analytic() : random_in_unit_sphere();
+        scatter_ray = Ray(rec.p, reflected + fuzz * fuzz_offset, ray_in.time());
         attenuation = albedo;
         return (dot(scatter_ray.direction(), rec.normal) > 0);
     }
@@ -51,10 +89,10 @@ private:
     double fuzz;
 };
 
-class Dielectric : public Material
+class Dielectric final : public Material
 {
     public: 
-        Dielectric( double refraction_index):  refractionIndex(refraction_index) {}
+        Dielectric( double refraction_index): Material(MaterialType::Dielectric), refractionIndex(refraction_index) {}
         virtual bool scatter(const Ray& ray_in, const HitRecord& rec, Color& attenuation, Ray& scatter_ray) const override
         {
             attenuation = Color(1.0, 1.0, 1.0);
@@ -86,12 +124,12 @@ class Dielectric : public Material
 };
 
 
-class Light : public Material
+class Light final : public Material
 {
     public:
 
-        Light(shared_ptr<Texture> texture) : emit(texture){}
-        Light(Color color, int intensity = 1)
+        Light(shared_ptr<Texture> texture) : Material(MaterialType::Light), emit(texture){}
+        Light(Color color, int intensity = 1) : Material(MaterialType::Light)
         {
             emit = make_shared<SolidColor>(intensity*color);
         }
@@ -105,4 +143,92 @@ class Light : public Material
             return emit->colorValue(u, v, p);
         }
         shared_ptr<Texture> emit;
-};
\ No newline at end of file
+};
+
+//Phase function of participating media: scatters uniformly in all directions
+class Isotropic final : public Material
+{
+    public:
+        Isotropic(Color c) : Material(MaterialType::Isotropic), albedo(make_shared<SolidColor>(c)) {}
+        Isotropic(shared_ptr<Texture> a) : Material(MaterialType::Isotropic), albedo(a) {}
+
+        virtual bool scatter(const Ray& ray_in, const HitRecord& rec, Color& attenuation, Ray& scatter_ray) const override
+        {
+            Vec3 direction = scatterSampling == ScatterSampling::Analytic ? random_unit_vector_analytic() : random_unit_vector();
+            scatter_ray = Ray(rec.p, direction, ray_in.time());
+            attenuation = albedo->colorValue(rec.u, rec.v, rec.p);
+            return true;
+        }
+
+    private:
+        shared_ptr<Texture> albedo;
+};
+
+//Scatter through a switch on the material tag. The classes are final, so the calls are direct and inline.
+inline bool scatter_material(const Material* material, const Ray& ray_in, const HitRecord& rec, Color& attenuation, Ray& scatter_ray)
+{
+    switch (material->type)
+    {
+    case MaterialType::Lambertian:
+        return static_cast<const Lambertian*>(material)->scatter(ray_in, rec, attenuation, scatter_ray);
+    case MaterialType::Metal:
+        return static_cast<const Metal*>(material)->scatter(ray_in, rec, attenuation, scatter_ray);
+    case MaterialType::Dielectric:
+        return static_cast<const Dielectric*>(material)->scatter(ray_in, rec, attenuation, scatter_ray);
+    case MaterialType::Light:
+        return false;
+    case MaterialType::Isotropic:
+        return static_cast<const Isotropic*>(material)->scatter(ray_in, rec, attenuation, scatter_ray);
+    default:
+        return material->scatter(ray_in, rec, attenuation, scatter_ray);
+    }
+}
+
+inline Color emitted_material(const Material* material, double u, double v, const Point3& p)
+{
+    switch (material->type)
+    {
+    case MaterialType::Light:
+        return static_cast<const Light*>(material)->color_emitted(u, v, p);
+    case MaterialType::Other:
+        return material->color_emitted(u, v, p);
+    default:
+        return Color(0, 0, 0);
+    }
+}
+
+//One hit waiting to be shaded by scatter_batch
+struct ShadingRequest
+{
+    Ray ray_in;
+    HitRecord rec;
+    Color emitted;
+    Color attenuation;
+    Ray scattered;
+    bool did_scatter;
+};
+
+//Shades a batch of hits grouped by material type, so every group runs one material's code in a tight loop
+//instead of jumping between materials hit after hit. Requests are shaded in place, their order is unchanged.
+//Batches should be small enough to stay in cache (a wavefront of a few thousand hits), order is scratch space.
+inline void scatter_batch(ShadingRequest* requests, size_t count, std::vector<uint32_t>& order)
+{
+    const int typeCount = static_cast<int>(MaterialType::Other) + 1;
+    size_t offsets[typeCount + 1] = {};
+    for (size_t i = 0; i < count; i++)
+        offsets[static_cast<int>(requests[i].rec.material_ptr->type) + 1]++;
+    for (int t = 0; t < typeCount; t++)
+        offsets[t + 1] += offsets[t];
+
+    order.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+        order[offsets[static_cast<int>(requests[i].rec.material_ptr->type)]++] = i;
+
+    for (uint32_t i : order)
+    {
+        ShadingRequest& request = requests[i];
+        const Material* material = request.rec.material_ptr;
+        request.emitted = emitted_material(material, request.rec.u, request.rec.v, request.rec.p);
+        request.did_scatter = scatter_material(material, request.ray_in, request.rec, request.attenuation, request.scattered);
+    }
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "bvh_node.h"
+
+#include <algorithm>
+#include <vector>
+
+using std::shared_ptr;
+using std::make_shared;
+using std::vector;
+
+//BVH for moving geometry. Instead of one box swept over the whole shutter interval every node keeps its box at
+//shutter open and at shutter close and tests the box interpolated to the time of the ray. For primitives moving
+//linearly (MovingSphere) the interpolated box of a node always contains its children at that time.
+class MotionBvhNode : public Hittable
+{
+public:
+    MotionBvhNode() {}
+    MotionBvhNode(const HittableList& hittableList, double time_0, double time_1);
+
+    virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
+    virtual bool boundingBox(double time0, double time1, aabb& output_box) const override;
+    virtual bool hitUsesRandom() const override
+    {
+        return (leftNode && leftNode->hitUsesRandom()) || (rightNode && rightNode->hitUsesRandom());
+    }
+
+private:
+    struct Primitive
+    {
+        aabb box0, box1;
+        Point3 centroid; //at the middle of the shutter interval
+        shared_ptr<Hittable> object;
+    };
+
+    static const int binCount = 16;
+
+    void build(vector<Primitive>& prims, size_t start, size_t end);
+    static size_t findSplit(vector<Primitive>& prims, size_t start, size_t end);
+    static double motionArea(const aabb& box0, const aabb& box1);
+
+    shared_ptr<Hittable> leftNode;
+    shared_ptr<Hittable> rightNode;
+
+    aabb box0, box1; //at shutter open and close
+    aabb sweptBox;   //both of them, for rays outside the shutter interval
+    double time0 = 0, time1 = 0;
+    double invDuration = 0;
+};
+
+MotionBvhNode::MotionBvhNode(const HittableList& hittableList, double time_0, double time_1)
+{
+    vector<Primitive> prims(hittableList.list.size());
+    for (size_t i = 0; i < prims.size(); i++)
+    {
+        const auto& object = hittableList.list[i];
+        if (!object->boundingBox(time_0, time_0, prims[i].box0) || !object->boundingBox(time_1, time_1, prims[i].box1))
+            std::cerr << "No bounding box in motion bvh constructor.\n";
+        prims[i].centroid = 0.5 * (prims[i].box0.centroid() + prims[i].box1.centroid());
+        prims[i].object = object;
+    }
+
+    time0 = time_0;
+    time1 = time_1;
+    if (!prims.empty())
+        build(prims, 0, prims.size());
+}
+
+void MotionBvhNode::build(vector<Primitive>& prims, size_t start, size_t end)
+{
+    invDuration = time1 > time0 ? 1. / (time1 - time0) : 0.;
+
+    size_t span = end - start;
+    if (span == 1)
+    {
+        leftNode = rightNode = prims[start].object;
+        box0 = prims[start].box0;
+        box1 = prims[start].box1;
+    }
+    else
+    {
+        size_t mid = findSplit(prims, start, end);
+        shared_ptr<Hittable>* slots[2] = { &leftNode, &rightNode };
+        size_t ranges[3] = { start, mid, end };
+        for (int side = 0; side < 2; side++)
+        {
+            if (ranges[side + 1] - ranges[side] == 1)
+            {
+                *slots[side] = prims[ranges[side]].object;
+                box0.surround(prims[ranges[side]].box0);
+                box1.surround(prims[ranges[side]].box1);
+            }
+            else
+            {
+                auto child = make_shared<MotionBvhNode>();
+                child->time0 = time0;
+                child->time1 = time1;
+                child->build(prims, ranges[side], ranges[side + 1]);
+                box0.surround(child->box0);
+                box1.surround(child->box1);
+                *slots[side] = child;
+            }
+        }
+    }
+    sweptBox = surrounding_box(box0, box1);
+}
+
+double MotionBvhNode::motionArea(const aabb& box0, const aabb& box1)
+{
+    //average area over the shutter interval of the linearly interpolated box
+    aabb middle(0.5 * (box0.minimum() + box1.minimum()), 0.5 * (box0.maximum() + box1.maximum()));
+    return (box0.surfaceArea() + 4. * middle.surfaceArea() + box1.surfaceArea()) / 6.;
+}
+
+size_t MotionBvhNode::findSplit(vector<Primitive>& prims, size_t start, size_t end)
+{
+    size_t half = start + (end - start) / 2;
+    if (end - start == 2)
+        return start + 1;
+
+    aabb centroidBounds;
+    for (size_t i = start; i < end; i++)
+        centroidBounds.surround(prims[i].centroid);
+
+    //binned SAH with the area of each side averaged over the shutter interval
+    double bestCost = infinity;
+    int bestAxis = -1;
+    int bestBin = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double extent = centroidBounds.extent()[axis];
+        if (extent <= 0)
+            continue;
+        double scale = binCount / extent;
+
+        aabb bins0[binCount], bins1[binCount];
+        size_t counts[binCount] = {};
+        for (size_t i = start; i < end; i++)
+        {
+            int b = std::min(binCount - 1, static_cast<int>((prims[i].centroid[axis] - centroidBounds.minimum()[axis]) * scale));
+            counts[b]++;
+            bins0[b].surround(prims[i].box0);
+            bins1[b].surround(prims[i].box1);
+        }
+
+        double rightArea[binCount];
+        size_t rightCount[binCount];
+        aabb accumulated0, accumulated1;
+        size_t count = 0;
+        for (int b = binCount - 1; b > 0; b--)
+        {
+            accumulated0.surround(bins0[b]);
+            accumulated1.surround(bins1[b]);
+            count += counts[b];
+            rightArea[b] = motionArea(accumulated0, accumulated1);
+            rightCount[b] = count;
+        }
+
+        accumulated0 = aabb();
+        accumulated1 = aabb();
+        count = 0;
+        for (int b = 1; b < binCount; b++)
+        {
+            accumulated0.surround(bins0[b - 1]);
+            accumulated1.surround(bins1[b - 1]);
+            count += counts[b - 1];
+            if (count == 0 || rightCount[b] == 0)
+                continue;
+            double cost = count * motionArea(accumulated0, accumulated1) + rightCount[b] * rightArea[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    if (bestAxis < 0)
+        return half;
+
+    double minCentroid = centroidBounds.minimum()[bestAxis];
+    double scale = binCount / centroidBounds.extent()[bestAxis];
+    auto mid = std::partition(prims.begin() + start, prims.begin() + end, [&](const Primitive& prim)
+        {
+            return std::min(binCount - 1, static_cast<int>((prim.centroid[bestAxis] - minCentroid) * scale)) < bestBin;
+        });
+    size_t split = mid - prims.begin();
+    return (split <= start || split >= end) ? half : split;
+}
+
+bool MotionBvhNode::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
+{
+    BVH_COUNT_VISIT();
+
+    double s = (r.time() - time0) * invDuration;
+    if (s >= 0. && s <= 1.)
+    {
+        aabb box((1. - s) * box0.minimum() + s * box1.minimum(), (1. - s) * box0.maximum() + s * box1.maximum());
+        if (!box.hit(r, min_t, max_t))
+            return false;
+    }
+    else if (!sweptBox.hit(r, min_t, max_t))
+        return false;
+
+    bool hitleft = leftNode->hit(r, min_t, max_t, hitrecord);
+    double max_t_temp = hitleft ? std::min(max_t, hitrecord.t) : max_t;
+    bool hitright = rightNode->hit(r, min_t, max_t_temp, hitrecord);
+
+    return hitleft || hitright;
+}
+
+bool MotionBvhNode::boundingBox(double time0, double time1, aabb& output_box) const
+{
+    output_box = sweptBox;
+    return true;
+}
@@ -56,7 +56,7 @@ bool MovingSphere::hit(const Ray& r, const double& min_t, const double& max_t, H
     hitrecord.t = root;
     hitrecord.p = r.at(hitrecord.t);
     hitrecord.normal = (hitrecord.p - center) / radius;
-    hitrecord.material_ptr = m;
+    hitrecord.material_ptr = m.get();
 
     Vec3 outward_normal = (hitrecord.p - center) / radius;
     hitrecord.set_face_normal(r, outward_normal);
@@ -66,8 +66,9 @@ bool MovingSphere::hit(const Ray& r, const double& min_t, const double& max_t, H
 
 bool MovingSphere::boundingBox(double time0, double time1, aabb& output_box) const
 {
-    auto center0 = centerAtTime(t0);
-    auto center1 = centerAtTime(t1);
+    //centers at the start and end of the requested interval, the motion is linear in between
+    auto center0 = centerAtTime(time0);
+    auto center1 = centerAtTime(time1);
 
     output_box = aabb();
     aabb box1 = aabb( center0- radius,  center0 + radius);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "vec3.h"
+
+//Orthonormal basis around a unit vector w, built without branches (Duff et al. 2017, "Building an Orthonormal
+//Basis, Revisited"). local() turns coordinates in the basis into a world direction.
+class Onb
+{
+    public:
+        Onb(const Vec3& n)
+        {
+            double sign = std::copysign(1., n.z());
+            double a = -1. / (sign + n.z());
+            double b = n.x() * n.y() * a;
+            axis[0] = Vec3(1. + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+            axis[1] = Vec3(b, sign + n.y() * n.y() * a, -n.y());
+            axis[2] = n;
+        }
+
+        Vec3 u() const { return axis[0]; }
+        Vec3 v() const { return axis[1]; }
+        Vec3 w() const { return axis[2]; }
+
+        Vec3 local(double a, double b, double c) const
+        {
+            return a * axis[0] + b * axis[1] + c * axis[2];
+        }
+
+        Vec3 local(const Vec3& a) const
+        {
+            return a.x() * axis[0] + a.y() * axis[1] + a.z() * axis[2];
+        }
+
+    private:
+        Vec3 axis[3];
+};
@@ -0,0 +1,755 @@
+#pragma once
+
+#include "renderer.h"
+#include "sphere.h"
+#include "material.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//Out of core geometry: spheres stored on disk in pages, each page a spatially compact group of spheres with its
+//own BVH, loaded on demand into a page cache bounded by a memory limit, so scenes larger than memory can be
+//rendered. Only the page table (bounds and file offsets) and a BVH over the page bounds stay in memory.
+//
+//File layout (native byte order): PagedFileHeader, the pages one after the other (nodes, then spheres), then the
+//page table of PagedPageEntry at header.tableOffset.
+
+struct PagedSphere
+{
+    double center[3];
+    double radius;
+    uint32_t material; //index in the scene's material palette
+    uint32_t padding;
+};
+
+//node of the BVH of a page: a leaf (count > 0) holds spheres [first, first + count), an inner node has its left
+//child right after it and its right child at first
+struct PagedNode
+{
+    double boxMin[3], boxMax[3];
+    uint32_t first;
+    uint32_t count;
+};
+
+struct PagedFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t pageCount;
+    uint64_t sphereCount;
+    uint64_t tableOffset;
+};
+
+struct PagedPageEntry
+{
+    uint64_t offset;
+    uint32_t nodeCount;
+    uint32_t sphereCount;
+    double boxMin[3], boxMax[3];
+};
+
+const char pagedMagic[8] = { 'R', 'T', 'P', 'A', 'G', 'E', 'S', 0 };
+const uint32_t pagedVersion = 1;
+
+//fseek takes a long, which is 32 bits on Windows: page offsets go through the 64 bit seek of the platform
+bool seekPagedFile(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+//Writes pages of spheres to a paged scene file, building the BVH of every page on the way. Only the page being
+//written is in memory.
+class PagedSceneWriter
+{
+public:
+    bool open(const std::string& filename);
+    bool addPage(std::vector<PagedSphere>& spheres);
+    bool close();
+
+private:
+    uint32_t buildNode(std::vector<PagedSphere>& spheres, size_t start, size_t end, std::vector<PagedNode>& nodes);
+
+    FILE* file = nullptr;
+    std::vector<PagedPageEntry> table;
+    uint64_t sphereCount = 0;
+    uint64_t offset = 0;
+};
+
+bool PagedSceneWriter::open(const std::string& filename)
+{
+    file = fopen(filename.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Couldn't write " << filename << "\n";
+        return false;
+    }
+    PagedFileHeader header = {};
+    offset = sizeof(header);
+    return fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+bool PagedSceneWriter::addPage(std::vector<PagedSphere>& spheres)
+{
+    if (!file || spheres.empty())
+        return file != nullptr;
+    std::vector<PagedNode> nodes;
+    nodes.reserve(spheres.size() / 2 + 1);
+    buildNode(spheres, 0, spheres.size(), nodes);
+
+    PagedPageEntry entry;
+    entry.offset = offset;
+    entry.nodeCount = static_cast<uint32_t>(nodes.size());
+    entry.sphereCount = static_cast<uint32_t>(spheres.size());
+    std::copy(nodes[0].boxMin, nodes[0].boxMin + 3, entry.boxMin);
+    std::copy(nodes[0].boxMax, nodes[0].boxMax + 3, entry.boxMax);
+    table.push_back(entry);
+
+    bool written = fwrite(nodes.data(), sizeof(PagedNode), nodes.size(), file) == nodes.size()
+        && fwrite(spheres.data(), sizeof(PagedSphere), spheres.size(), file) == spheres.size();
+    offset += nodes.size() * sizeof(PagedNode) + spheres.size() * sizeof(PagedSphere);
+    sphereCount += spheres.size();
+    return written;
+}
+
+bool PagedSceneWriter::close()
+{
+    if (!file)
+        return false;
+    PagedFileHeader header;
+    std::copy(pagedMagic, pagedMagic + 8, header.magic);
+    header.version = pagedVersion;
+    header.pageCount = static_cast<uint32_t>(table.size());
+    header.sphereCount = sphereCount;
+    header.tableOffset = offset;
+    bool written = fwrite(table.data(), sizeof(PagedPageEntry), table.size(), file) == table.size()
+        && seekPagedFile(file, 0) && fwrite(&header, sizeof(header), 1, file) == 1;
+    written = fclose(file) == 0 && written;
+    file = nullptr;
+    return written;
+}
+
+//median split on the longest axis of the centers, up to 4 spheres per leaf
+uint32_t PagedSceneWriter::buildNode(std::vector<PagedSphere>& spheres, size_t start, size_t end, std::vector<PagedNode>& nodes)
+{
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(PagedNode());
+    PagedNode node;
+    double centerMin[3] = { infinity, infinity, infinity }, centerMax[3] = { -infinity, -infinity, -infinity };
+    for (int a = 0; a < 3; a++)
+    {
+        node.boxMin[a] = infinity;
+        node.boxMax[a] = -infinity;
+    }
+    for (size_t i = start; i < end; i++)
+    {
+        double r = std::abs(spheres[i].radius);
+        for (int a = 0; a < 3; a++)
+        {
+            node.boxMin[a] = std::min(node.boxMin[a], spheres[i].center[a] - r);
+            node.boxMax[a] = std::max(node.boxMax[a], spheres[i].center[a] + r);
+            centerMin[a] = std::min(centerMin[a], spheres[i].center[a]);
+            centerMax[a] = std::max(centerMax[a], spheres[i].center[a]);
+        }
+    }
+
+    if (end - start <= 4)
+    {
+        node.first = static_cast<uint32_t>(start);
+        node.count = static_cast<uint32_t>(end - start);
+        nodes[index] = node;
+        return index;
+    }
+
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+        if (centerMax[a] - centerMin[a] > centerMax[axis] - centerMin[axis])
+            axis = a;
+    size_t mid = start + (end - start) / 2;
+    std::nth_element(spheres.begin() + start, spheres.begin() + mid, spheres.begin() + end,
+        [axis](const PagedSphere& a, const PagedSphere& b) { return a.center[axis] < b.center[axis]; });
+    buildNode(spheres, start, mid, nodes);
+    node.first = buildNode(spheres, mid, end, nodes);
+    node.count = 0;
+    nodes[index] = node;
+    return index;
+}
+
+//a page loaded from the file
+struct PagedPage
+{
+    std::vector<PagedNode> nodes;
+    std::vector<PagedSphere> spheres;
+
+    size_t bytes() const { return nodes.size() * sizeof(PagedNode) + spheres.size() * sizeof(PagedSphere); }
+};
+
+struct PageCacheStats
+{
+    long long requests = 0;
+    long long faults = 0; //requests that had to read the page from the file
+    long long evictions = 0;
+    double bytesRead = 0;
+};
+
+//Least recently used cache of the pages of a file, holding at most memoryLimit bytes of pages. A page handed out
+//stays valid while its shared_ptr is held, even if it's evicted meanwhile, so the pages in use by the threads can
+//briefly go beyond the limit. Thread safe: a page is read without holding the cache lock, so hits on other pages
+//go on meanwhile, and the threads asking for a page being read wait for it rather than reading it twice.
+class PageCache
+{
+public:
+    PageCache(const std::string& filename, const std::vector<PagedPageEntry>& table_, size_t memoryLimit_)
+        : file(fopen(filename.c_str(), "rb")), table(table_), memoryLimit(memoryLimit_) {}
+    ~PageCache()
+    {
+        if (file)
+            fclose(file);
+    }
+
+    bool isOpen() const { return file != nullptr; }
+    std::shared_ptr<const PagedPage> acquire(uint32_t page);
+    bool contains(uint32_t page) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.count(page) != 0;
+    }
+    PageCacheStats getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+    void resetStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats = PageCacheStats();
+    }
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        lru.clear();
+        residentBytes = 0;
+    }
+    size_t memoryLimitBytes() const { return memoryLimit; }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const PagedPage> page;
+        std::list<uint32_t>::iterator position;
+    };
+
+    FILE* file;
+    std::vector<PagedPageEntry> table;
+    size_t memoryLimit;
+    size_t residentBytes = 0;
+    std::list<uint32_t> lru; //most recently used first
+    std::unordered_map<uint32_t, Entry> entries;
+    std::unordered_set<uint32_t> loading; //pages being read by a thread
+    std::condition_variable pageLoaded;
+    PageCacheStats stats;
+    mutable std::mutex mutex;
+    std::mutex fileMutex; //the seek and reads of a page go together on the shared file
+};
+
+std::shared_ptr<const PagedPage> PageCache::acquire(uint32_t page)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    stats.requests++;
+    for (;;)
+    {
+        auto found = entries.find(page);
+        if (found != entries.end())
+        {
+            lru.splice(lru.begin(), lru, found->second.position);
+            return found->second.page;
+        }
+        if (loading.count(page) == 0)
+            break;
+        pageLoaded.wait(lock);
+    }
+    loading.insert(page);
+    stats.faults++;
+    lock.unlock();
+
+    const PagedPageEntry& entry = table[page];
+    auto loaded = std::make_shared<PagedPage>();
+    loaded->nodes.resize(entry.nodeCount);
+    loaded->spheres.resize(entry.sphereCount);
+    bool read;
+    {
+        std::lock_guard<std::mutex> fileLock(fileMutex);
+        read = seekPagedFile(file, entry.offset)
+            && fread(loaded->nodes.data(), sizeof(PagedNode), entry.nodeCount, file) == entry.nodeCount
+            && fread(loaded->spheres.data(), sizeof(PagedSphere), entry.sphereCount, file) == entry.sphereCount;
+    }
+    if (!read)
+    {
+        std::cerr << "Couldn't read page " << page << "\n";
+        loaded->nodes.clear();
+        loaded->spheres.clear();
+    }
+
+    lock.lock();
+    loading.erase(page);
+    stats.bytesRead += static_cast<double>(loaded->bytes());
+    while (!lru.empty() && residentBytes + loaded->bytes() > memoryLimit)
+    {
+        auto evicted = entries.find(lru.back());
+        residentBytes -= evicted->second.page->bytes();
+        entries.erase(evicted);
+        lru.pop_back();
+        stats.evictions++;
+    }
+    lru.push_front(page);
+    entries[page] = { loaded, lru.begin() };
+    residentBytes += loaded->bytes();
+    pageLoaded.notify_all();
+    return loaded;
+}
+
+//Ray tracing and rendering statistics of a PagedScene
+struct PagedSceneStats
+{
+    PageCacheStats cache;
+    long long rays = 0;
+    long long pageBatches = 0; //pages processed by intersect, each with all the rays queued on it
+};
+
+//Scene of paged spheres, with a list of resident objects (e.g. the ground) always in memory. Single rays (hit)
+//go through the pages their path crosses in order, each ray loading what it needs: incoherent rays make the cache
+//thrash once the pages they touch don't fit. intersect() instead queues a batch of rays on the pages and
+//processes every page once per round with all the rays waiting on it.
+class PagedScene : public Hittable
+{
+public:
+    PagedScene(std::vector<shared_ptr<Material>> materials_, HittableList resident_ = HittableList())
+        : materials(std::move(materials_)), resident(std::move(resident_)) {}
+
+    //reads the page table of filename, pages are then read through a cache of memoryLimit bytes
+    bool open(const std::string& filename, size_t memoryLimit);
+
+    virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
+    virtual bool boundingBox(double time0, double time1, aabb& output_box) const override;
+
+    //closest hits of a batch of rays with the page queues, hits[i] tells whether records[i] is valid
+    void intersect(const std::vector<Ray>& rays, std::vector<HitRecord>& records, std::vector<char>& hits) const;
+
+    size_t pageCount() const { return table.size(); }
+    uint64_t sphereCount() const { return spheres; }
+    uint64_t fileBytes() const;
+    PagedSceneStats getStats() const;
+    void resetStats();
+    void clearCache() { cache->clear(); }
+
+private:
+    struct TopNode
+    {
+        aabb box;
+        uint32_t child[2] = { 0, 0 };
+        int page = -1;
+    };
+    struct Candidate
+    {
+        double entry;
+        uint32_t page;
+    };
+
+    uint32_t buildTop(std::vector<uint32_t>& pages, size_t start, size_t end);
+    //the pages whose box the ray enters before max_t, nearest first
+    void findPages(const Ray& r, double min_t, double max_t, std::vector<Candidate>& candidates) const;
+    bool hitPage(const PagedPage& page, const Ray& r, double min_t, double max_t, HitRecord& rec) const;
+    static double entryDistance(const double* boxMin, const double* boxMax, const Ray& r, double t_min, double t_max);
+
+    std::vector<shared_ptr<Material>> materials;
+    HittableList resident;
+    std::vector<PagedPageEntry> table;
+    std::vector<TopNode> top;
+    std::unique_ptr<PageCache> cache;
+    uint64_t spheres = 0;
+    mutable std::atomic<long long> rayCount{ 0 };
+    mutable std::atomic<long long> pageBatches{ 0 };
+};
+
+bool PagedScene::open(const std::string& filename, size_t memoryLimit)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+        std::cerr << "Couldn't read " << filename << "\n";
+        return false;
+    }
+    PagedFileHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && std::equal(pagedMagic, pagedMagic + 8, header.magic)
+        && header.version == pagedVersion;
+    if (valid)
+    {
+        table.resize(header.pageCount);
+        valid = seekPagedFile(file, header.tableOffset)
+            && fread(table.data(), sizeof(PagedPageEntry), table.size(), file) == table.size();
+    }
+    fclose(file);
+    if (!valid)
+    {
+        std::cerr << filename << " isn't a paged scene file\n";
+        table.clear();
+        return false;
+    }
+    spheres = header.sphereCount;
+
+    std::vector<uint32_t> pages(table.size());
+    for (size_t i = 0; i < pages.size(); i++)
+        pages[i] = static_cast<uint32_t>(i);
+    top.clear();
+    if (!pages.empty())
+        buildTop(pages, 0, pages.size());
+    cache.reset(new PageCache(filename, table, memoryLimit));
+    return cache->isOpen();
+}
+
+//median split of the page centers on the longest axis, there are few enough pages for anything to do
+uint32_t PagedScene::buildTop(std::vector<uint32_t>& pages, size_t start, size_t end)
+{
+    uint32_t index = static_cast<uint32_t>(top.size());
+    top.push_back(TopNode());
+    if (end - start == 1)
+    {
+        const PagedPageEntry& entry = table[pages[start]];
+        top[index].box = aabb(Point3(entry.boxMin[0], entry.boxMin[1], entry.boxMin[2]), Point3(entry.boxMax[0], entry.boxMax[1], entry.boxMax[2]));
+        top[index].page = static_cast<int>(pages[start]);
+        return index;
+    }
+
+    aabb centers;
+    for (size_t i = start; i < end; i++)
+    {
+        const PagedPageEntry& entry = table[pages[i]];
+        centers.surround(0.5 * (Point3(entry.boxMin[0], entry.boxMin[1], entry.boxMin[2]) + Point3(entry.boxMax[0], entry.boxMax[1], entry.boxMax[2])));
+    }
+    Vec3 extent = centers.extent();
+    int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+    size_t mid = start + (end - start) / 2;
+    std::nth_element(pages.begin() + start, pages.begin() + mid, pages.begin() + end, [this, axis](uint32_t a, uint32_t b)
+        { return table[a].boxMin[axis] + table[a].boxMax[axis] < table[b].boxMin[axis] + table[b].boxMax[axis]; });
+
+    uint32_t left = buildTop(pages, start, mid);
+    uint32_t right = buildTop(pages, mid, end);
+    top[index].child[0] = left;
+    top[index].child[1] = right;
+    top[index].box = surrounding_box(top[left].box, top[right].box);
+    return index;
+}
+
+double PagedScene::entryDistance(const double* boxMin, const double* boxMax, const Ray& r, double t_min, double t_max)
+{
+    //the slab test of aabb::hit, keeping the entry
+    for (int i = 0; i < 3; i++)
+    {
+        auto inv_bx = 1. / r.direction()[i];
+        double t0 = (boxMin[i] - r.origin()[i]) * inv_bx;
+        double t1 = (boxMax[i] - r.origin()[i]) * inv_bx;
+        if (inv_bx < 0.)
+            std::swap(t0, t1);
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+        if (t_max <= t_min)
+            return infinity;
+    }
+    return t_min;
+}
+
+void PagedScene::findPages(const Ray& r, double min_t, double max_t, std::vector<Candidate>& candidates) const
+{
+    candidates.clear();
+    if (top.empty())
+        return;
+    uint32_t stack[64];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        const TopNode& node = top[stack[--size]];
+        if (!node.box.hit(r, min_t, max_t))
+            continue;
+        if (node.page >= 0)
+        {
+            const PagedPageEntry& entry = table[node.page];
+            double entryT = entryDistance(entry.boxMin, entry.boxMax, r, min_t, max_t);
+            if (entryT < infinity)
+                candidates.push_back({ entryT, static_cast<uint32_t>(node.page) });
+            continue;
+        }
+        stack[size++] = node.child[0];
+        stack[size++] = node.child[1];
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+        { return a.entry < b.entry || (a.entry == b.entry && a.page < b.page); });
+}
+
+bool PagedScene::hitPage(const PagedPage& page, const Ray& r, double min_t, double max_t, HitRecord& rec) const
+{
+    if (page.nodes.empty())
+        return false;
+    uint32_t stack[64];
+    int size = 0;
+    stack[size++] = 0;
+    bool hitAnything = false;
+    double closest = max_t;
+    while (size > 0)
+    {
+        uint32_t index = stack[--size];
+        const PagedNode& node = page.nodes[index];
+        if (entryDistance(node.boxMin, node.boxMax, r, min_t, closest) == infinity)
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                const PagedSphere& sphere = page.spheres[i];
+                Point3 center(sphere.center[0], sphere.center[1], sphere.center[2]);
+                if (Sphere::hitSphere(center, sphere.radius, materials[sphere.material].get(), r, min_t, closest, rec))
+                {
+                    hitAnything = true;
+                    closest = rec.t;
+                }
+            }
+            continue;
+        }
+        stack[size++] = node.first;
+        stack[size++] = index + 1;
+    }
+    return hitAnything;
+}
+
+bool PagedScene::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
+{
+    rayCount++;
+    double closest = max_t;
+    bool hitAnything = resident.hit(r, min_t, closest, hitrecord);
+    if (hitAnything)
+        closest = hitrecord.t;
+
+    static thread_local std::vector<Candidate> candidates;
+    findPages(r, min_t, closest, candidates);
+    for (const Candidate& candidate : candidates)
+    {
+        if (candidate.entry >= closest)
+            break;
+        auto page = cache->acquire(candidate.page);
+        if (hitPage(*page, r, min_t, closest, hitrecord))
+        {
+            hitAnything = true;
+            closest = hitrecord.t;
+        }
+    }
+    return hitAnything;
+}
+
+void PagedScene::intersect(const std::vector<Ray>& rays, std::vector<HitRecord>& records, std::vector<char>& hits) const
+{
+    const double min_t = 0.001;
+    size_t count = rays.size();
+    rayCount += static_cast<long long>(count);
+    records.resize(count);
+    hits.assign(count, 0);
+    std::vector<double> closest(count, infinity);
+    std::vector<std::vector<Candidate>> candidates(count);
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(count); i++)
+    {
+        if (resident.hit(rays[i], min_t, closest[i], records[i]))
+        {
+            hits[i] = 1;
+            closest[i] = records[i].t;
+        }
+        findPages(rays[i], min_t, closest[i], candidates[i]);
+    }
+
+    //In rounds: every ray waits on the next page it enters, unless its closest hit is before that page, then every
+    //page with rays waiting is processed once with all of them. Pages still in the cache go first, before they
+    //are evicted. Rays go through their pages front to back as with hit(), so they read no page hit() wouldn't.
+    std::vector<uint32_t> next(count, 0), active, waiting;
+    for (size_t i = 0; i < count; i++)
+        if (!candidates[i].empty())
+            active.push_back(static_cast<uint32_t>(i));
+    std::vector<std::vector<uint32_t>> queues(table.size());
+    std::vector<uint32_t> pages;
+    std::vector<char> cached(table.size(), 0);
+    while (!active.empty())
+    {
+        pages.clear();
+        waiting.clear();
+        for (uint32_t i : active)
+        {
+            if (next[i] >= candidates[i].size() || candidates[i][next[i]].entry >= closest[i])
+                continue;
+            uint32_t p = candidates[i][next[i]].page;
+            if (queues[p].empty())
+                pages.push_back(p);
+            queues[p].push_back(i);
+            waiting.push_back(i);
+        }
+        for (uint32_t p : pages)
+            cached[p] = cache->contains(p);
+        std::sort(pages.begin(), pages.end(), [&](uint32_t a, uint32_t b) { return cached[a] != cached[b] ? cached[a] > cached[b] : a < b; });
+
+        for (uint32_t p : pages)
+        {
+            const std::vector<uint32_t>& batch = queues[p];
+            auto page = cache->acquire(p);
+            pageBatches++;
+            #pragma omp parallel for schedule(dynamic, 64)
+            for (std::ptrdiff_t k = 0; k < static_cast<std::ptrdiff_t>(batch.size()); k++)
+            {
+                uint32_t i = batch[k];
+                if (hitPage(*page, rays[i], min_t, closest[i], records[i]))
+                {
+                    hits[i] = 1;
+                    closest[i] = records[i].t;
+                }
+                next[i]++;
+            }
+            queues[p].clear();
+        }
+        active.swap(waiting);
+    }
+}
+
+bool PagedScene::boundingBox(double time0, double time1, aabb& output_box) const
+{
+    aabb box;
+    bool bounded = resident.list.empty() || resident.boundingBox(time0, time1, box);
+    if (!top.empty())
+        box.surround(top[0].box);
+    output_box = box;
+    return bounded && (!top.empty() || !resident.list.empty());
+}
+
+uint64_t PagedScene::fileBytes() const
+{
+    uint64_t bytes = sizeof(PagedFileHeader) + table.size() * sizeof(PagedPageEntry);
+    for (const PagedPageEntry& entry : table)
+        bytes += entry.nodeCount * sizeof(PagedNode) + entry.sphereCount * sizeof(PagedSphere);
+    return bytes;
+}
+
+PagedSceneStats PagedScene::getStats() const
+{
+    PagedSceneStats stats;
+    stats.cache = cache->getStats();
+    stats.rays = rayCount;
+    stats.pageBatches = pageBatches;
+    return stats;
+}
+
+void PagedScene::resetStats()
+{
+    cache->resetStats();
+    rayCount = 0;
+    pageBatches = 0;
+}
+
+//Adds samples_per_pixel samples of every pixel to sums like renderSamples, tracing the paths of a block of
+//blockSize x blockSize pixels together bounce by bounce so every bounce is one intersect batch over the pages. A
+//block keeps the pages its rays touch few enough to stay in the cache from one bounce and sample to the next.
+//Every pixel draws its random numbers from its own state in the same order as renderTile, the image only differs
+//from renderSamples' by the rounding of summing the path front to back.
+void renderPagedSamples(const PagedScene& scene, const Camera& cam, const Color& background, const RenderSettings& settings,
+    std::vector<Color>& sums, int blockSize = 16)
+{
+    int width = settings.image_width, height = settings.image_height;
+    sums.assign(size_t(width) * height, Color(0, 0, 0));
+    PixelSampler sampler(settings.sequence, settings.samples_per_pixel, settings.seed);
+    blockSize = std::max(blockSize, 1);
+
+    std::vector<Ray> rays, batch;
+    std::vector<HitRecord> records;
+    std::vector<char> hits;
+    std::vector<uint32_t> paths;
+    std::vector<RandomState> states;
+    std::vector<Color> throughput, colors;
+    for (int y0 = 0; y0 < height; y0 += blockSize)
+    {
+        for (int x0 = 0; x0 < width; x0 += blockSize)
+        {
+            int x1 = std::min(x0 + blockSize, width), y1 = std::min(y0 + blockSize, height);
+            size_t blockWidth = x1 - x0, pixelCount = blockWidth * (y1 - y0);
+            states.resize(pixelCount);
+            throughput.resize(pixelCount);
+            colors.resize(pixelCount);
+            for (int row = y0; row < y1; row++)
+            {
+                for (int col = x0; col < x1; col++)
+                {
+                    seed_random((uint64_t(settings.seed) << 48) ^ (uint64_t(row) << 16) ^ uint64_t(col));
+                    states[(row - y0) * blockWidth + (col - x0)] = random_state();
+                }
+            }
+
+            for (int s = 0; s < settings.samples_per_pixel; s++)
+            {
+                cam.generateTile(x0, y0, x1, y1, width, height, s, 1, sampler, rays);
+                paths.resize(pixelCount);
+                for (size_t p = 0; p < pixelCount; p++)
+                {
+                    paths[p] = static_cast<uint32_t>(p);
+                    throughput[p] = Color(1, 1, 1);
+                    colors[p] = Color(0, 0, 0);
+                }
+
+                for (int depth = 0; depth < settings.max_depth && !paths.empty(); depth++)
+                {
+                    batch.resize(paths.size());
+                    for (size_t k = 0; k < paths.size(); k++)
+                        batch[k] = rays[paths[k]];
+                    scene.intersect(batch, records, hits);
+
+                    #pragma omp parallel for schedule(dynamic, 256)
+                    for (std::ptrdiff_t k = 0; k < static_cast<std::ptrdiff_t>(paths.size()); k++)
+                    {
+                        uint32_t p = paths[k];
+                        if (!hits[k])
+                        {
+                            colors[p] += throughput[p] * background;
+                            paths[k] = UINT32_MAX;
+                            continue;
+                        }
+                        random_state() = states[p];
+                        const HitRecord& rec = records[k];
+                        colors[p] += throughput[p] * emitted_material(rec.material_ptr, rec.u, rec.v, rec.p);
+                        Color attenuation;
+                        if (scatter_material(rec.material_ptr, batch[k], rec, attenuation, rays[p]))
+                            throughput[p] = throughput[p] * attenuation;
+                        else
+                            paths[k] = UINT32_MAX;
+                        states[p] = random_state();
+                    }
+                    paths.erase(std::remove(paths.begin(), paths.end(), UINT32_MAX), paths.end());
+                }
+
+                for (int row = y0; row < y1; row++)
+                    for (int col = x0; col < x1; col++)
+                        sums[size_t(row) * width + col] += colors[(row - y0) * blockWidth + (col - x0)];
+            }
+        }
+    }
+}
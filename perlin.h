@@ -0,0 +1,135 @@
+#pragma once
+
+#include "util.h"
+#include "vec3.h"
+
+#include <algorithm>
+#include <cmath>
+
+//Gradient (Perlin) noise as in Book 2: random unit gradients on the integer lattice picked through three permutation
+//tables, trilinearly blended with Hermite smoothing. Values lie roughly in [-1,1].
+//The batch functions evaluate arrays of points in one SIMD loop; the lattice lookups become gathers, so there are no
+//branches and no calls per point. The single point functions share the same code and are the scalar fallback.
+//The batch functions are built for each instruction set with RT_ISA_KERNEL.
+class Perlin
+{
+    public:
+        Perlin()
+        {
+            for (int i = 0; i < pointCount; i++)
+            {
+                Vec3 gradient = unit_vector(Vec3::random(-1, 1));
+                gradientX[i] = gradient.x();
+                gradientY[i] = gradient.y();
+                gradientZ[i] = gradient.z();
+            }
+            generatePermutation(permX);
+            generatePermutation(permY);
+            generatePermutation(permZ);
+        }
+
+        double noise(const Point3& p) const
+        {
+            return noiseAt(p.x(), p.y(), p.z());
+        }
+
+        //sum of depth octaves of noise, each at twice the frequency and half the weight of the previous one
+        double turbulence(const Point3& p, int depth = 7) const
+        {
+            return turbulenceAt(p.x(), p.y(), p.z(), depth);
+        }
+
+        RT_ISA_KERNEL void noise(size_t count, const double* x, const double* y, const double* z, double* out) const
+        {
+            #pragma omp simd
+            for (size_t i = 0; i < count; i++)
+                out[i] = noiseAt(x[i], y[i], z[i]);
+        }
+
+        RT_ISA_KERNEL void turbulence(size_t count, const double* x, const double* y, const double* z, double* out, int depth = 7) const
+        {
+            //octaves in the outer loop, so the inner loop over the points is a single noise lookup
+            std::fill(out, out + count, 0.);
+            double weight = 1.;
+            double frequency = 1.;
+            for (int octave = 0; octave < depth; octave++)
+            {
+                #pragma omp simd
+                for (size_t i = 0; i < count; i++)
+                    out[i] += weight * noiseAt(frequency * x[i], frequency * y[i], frequency * z[i]);
+                weight *= 0.5;
+                frequency *= 2.;
+            }
+            #pragma omp simd
+            for (size_t i = 0; i < count; i++)
+                out[i] = std::fabs(out[i]);
+        }
+
+    private:
+        static const int pointCount = 256;
+
+        static void generatePermutation(int* perm)
+        {
+            for (int i = 0; i < pointCount; i++)
+                perm[i] = i;
+            for (int i = pointCount - 1; i > 0; i--)
+                std::swap(perm[i], perm[random_int(0, i)]);
+        }
+
+        double noiseAt(double x, double y, double z) const
+        {
+            double fx = std::floor(x);
+            double fy = std::floor(y);
+            double fz = std::floor(z);
+            double u = x - fx;
+            double v = y - fy;
+            double w = z - fz;
+            int i = static_cast<int>(fx);
+            int j = static_cast<int>(fy);
+            int k = static_cast<int>(fz);
+
+            //Hermite weights of the lower corner on every axis, the upper corner gets 1 - weight
+            double wu = 1. - u * u * (3. - 2. * u);
+            double wv = 1. - v * v * (3. - 2. * v);
+            double ww = 1. - w * w * (3. - 2. * w);
+
+            double accum = 0.;
+            for (int di = 0; di < 2; di++)
+            {
+                for (int dj = 0; dj < 2; dj++)
+                {
+                    for (int dk = 0; dk < 2; dk++)
+                    {
+                        int g = permX[(i + di) & (pointCount - 1)] ^ permY[(j + dj) & (pointCount - 1)] ^ permZ[(k + dk) & (pointCount - 1)];
+                        double dot = gradientX[g] * (u - di) + gradientY[g] * (v - dj) + gradientZ[g] * (w - dk);
+                        double weight = (di ? 1. - wu : wu) * (dj ? 1. - wv : wv) * (dk ? 1. - ww : ww);
+                        accum += weight * dot;
+                    }
+                }
+            }
+            return accum;
+        }
+
+        double turbulenceAt(double x, double y, double z, int depth) const
+        {
+            double accum = 0.;
+            double weight = 1.;
+            for (int octave = 0; octave < depth; octave++)
+            {
+                accum += weight * noiseAt(x, y, z);
+                weight *= 0.5;
+                x *= 2.;
+                y *= 2.;
+                z *= 2.;
+            }
+            return std::fabs(accum);
+        }
+
+        //gradients as separate arrays, so the SIMD loops gather single doubles
+        double gradientX[pointCount];
+        double gradientY[pointCount];
+        double gradientZ[pointCount];
+        int permX[pointCount];
+        int permY[pointCount];
+        int permZ[pointCount];
+};
@@ -0,0 +1,419 @@
+#pragma once
+
+#include "renderer.h"
+#include "light_sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+//Light a photon brought to a diffuse surface, in floats to keep the array it lives in compact (36 bytes)
+struct Photon
+{
+    float position[3];
+    float direction[3]; //of travel, unit length
+    float power[3];
+};
+
+//Photons sorted by the grid cell they lie in, cells hashed into a table as large as the photon count. A cell's
+//photons are contiguous in one flat array, so a radius query reads at most 8 runs of memory. Different cells can
+//share a hash bucket, queries skip the photons farther than the radius anyway.
+class PhotonGrid
+{
+public:
+    //takes the photons, cellSize has to be at least twice the radius of the queries
+    void build(std::vector<Photon>& photons_, double cellSize_);
+
+    //calls visit(photon, squared distance) for every photon within radius of p
+    template <typename Visit>
+    void query(const Point3& p, double radius, Visit&& visit) const
+    {
+        if (photons.empty())
+            return;
+        int lo[3], hi[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            lo[axis] = static_cast<int>(std::floor((p[axis] - radius) * inverseCellSize));
+            hi[axis] = static_cast<int>(std::floor((p[axis] + radius) * inverseCellSize));
+        }
+        //the (at most 8) cells around the query, each bucket read once even when two of them share it
+        uint32_t visited[8];
+        int visitedCount = 0;
+        double radiusSquared = radius * radius;
+        for (int x = lo[0]; x <= hi[0]; x++)
+        {
+            for (int y = lo[1]; y <= hi[1]; y++)
+            {
+                for (int z = lo[2]; z <= hi[2]; z++)
+                {
+                    uint32_t bucket = hashCell(x, y, z);
+                    if (std::find(visited, visited + visitedCount, bucket) != visited + visitedCount)
+                        continue;
+                    if (visitedCount < 8)
+                        visited[visitedCount++] = bucket;
+                    for (uint32_t i = cellStart[bucket]; i < cellStart[bucket + 1]; i++)
+                    {
+                        const Photon& photon = photons[i];
+                        double dx = photon.position[0] - p[0];
+                        double dy = photon.position[1] - p[1];
+                        double dz = photon.position[2] - p[2];
+                        double distanceSquared = dx * dx + dy * dy + dz * dz;
+                        if (distanceSquared <= radiusSquared)
+                            visit(photon, distanceSquared);
+                    }
+                }
+            }
+        }
+    }
+
+    size_t size() const { return photons.size(); }
+    size_t bytes() const { return photons.size() * sizeof(Photon) + cellStart.size() * sizeof(uint32_t); }
+
+private:
+    uint32_t hashCell(int x, int y, int z) const
+    {
+        //Teschner et al. 2003
+        return ((uint32_t(x) * 73856093u) ^ (uint32_t(y) * 19349663u) ^ (uint32_t(z) * 83492791u)) & tableMask;
+    }
+
+    std::vector<Photon> photons;
+    std::vector<uint32_t> cellStart; //first photon of every bucket, and the photon count at the end
+    double inverseCellSize = 1;
+    uint32_t tableMask = 0;
+};
+
+void PhotonGrid::build(std::vector<Photon>& photons_, double cellSize_)
+{
+    inverseCellSize = 1. / cellSize_;
+    uint32_t tableSize = 1;
+    while (tableSize < photons_.size())
+        tableSize *= 2;
+    tableMask = tableSize - 1;
+
+    //counting sort by bucket
+    std::vector<uint32_t> buckets(photons_.size());
+    cellStart.assign(size_t(tableSize) + 1, 0);
+    for (size_t i = 0; i < photons_.size(); i++)
+    {
+        const Photon& photon = photons_[i];
+        buckets[i] = hashCell(static_cast<int>(std::floor(photon.position[0] * inverseCellSize)),
+            static_cast<int>(std::floor(photon.position[1] * inverseCellSize)),
+            static_cast<int>(std::floor(photon.position[2] * inverseCellSize)));
+        cellStart[buckets[i] + 1]++;
+    }
+    for (uint32_t bucket = 0; bucket < tableSize; bucket++)
+        cellStart[bucket + 1] += cellStart[bucket];
+    photons.resize(photons_.size());
+    std::vector<uint32_t> next(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < photons_.size(); i++)
+        photons[next[buckets[i]]++] = photons_[i];
+    photons_.clear();
+}
+
+//Stochastic progressive photon mapping (Hachisuka & Jensen 2009, as in pbrt-v3's SPPM integrator). Every pass
+//traces one camera path per pixel through mirrors, glass and media to its first diffuse hit, the pixel's visible
+//point, where direct light is sampled as in get_hit_color. Then photons are shot from the emitters of
+//settings.lights in proportion to their power and left at every diffuse surface they reach after their first
+//bounce, in a PhotonGrid. Each visible point gathers the photons within its pixel's radius; the radius shrinks
+//with the photons found, so the estimate of the indirect light converges while a pass only ever holds its own
+//photons. Caustics, light through glass onto diffuse surfaces, are found by photons instead of camera paths
+//that have to hit a small light through the glass.
+//Photons are traced at time 0 and start on the emitters the LightSampler indexes only, light from the
+//environment and from other emitters reaches visible points directly but not through photons.
+class PhotonMapper
+{
+public:
+    //photons found and stored in the passes so far
+    struct Stats
+    {
+        long long photonsShot = 0;
+        long long photonsStored = 0;
+        long long lookups = 0;
+        long long photonsGathered = 0; //within the radius of the lookups, arriving on the visible side
+    };
+
+    //settings.lights has to index at least one emitter. radiusPixels is the initial radius of the pixels in widths
+    //of the median pixel footprint at their visible points.
+    PhotonMapper(const Hittable& world_, const Camera& cam_, const Color& background_, const RenderSettings& settings_,
+        int photonsPerPass_, double radiusPixels_ = 4.)
+        : world(world_), cam(cam_), background(background_), settings(settings_), photonsPerPass(photonsPerPass_),
+        radiusPixels(radiusPixels_), pixels(size_t(settings_.image_width) * settings_.image_height)
+    {
+    }
+
+    //The steps of one pass, in this order; pass counts from 0
+    void traceVisiblePoints(int pass);
+    void shootPhotons(int pass);
+    void buildGrid();
+    void gather();
+
+    void renderPass(int pass)
+    {
+        traceVisiblePoints(pass);
+        shootPhotons(pass);
+        buildGrid();
+        gather();
+    }
+    //runs settings.samples_per_pixel passes
+    void render(bool showProgress = true);
+
+    //radiance of every pixel after the passes so far, row 0 at the top
+    void image(std::vector<Color>& colors) const;
+
+    const Stats& getStats() const { return stats; }
+    const PhotonGrid& getGrid() const { return grid; }
+
+private:
+    struct Pixel
+    {
+        Color direct; //sum over the passes
+        Color flux;   //tau, the photon flux within radius, scaled as the radius shrinks
+        double radius = 0;
+        double photonCount = 0; //N, the photons the estimate is made of
+
+        //visible point of the current pass
+        bool visible = false;
+        Point3 p;
+        Vec3 normal;
+        Color weight;    //camera path throughput times the Lambertian BRDF
+        double footprint = 0; //pixel width at the distance along the camera path
+    };
+
+    const Hittable& world;
+    const Camera& cam;
+    Color background;
+    const RenderSettings& settings;
+    int photonsPerPass;
+    double radiusPixels;
+
+    std::vector<Pixel> pixels;
+    std::vector<Photon> photons; //of the current pass, until buildGrid takes them
+    PhotonGrid grid;
+    int passes = 0;
+    Stats stats;
+};
+
+void PhotonMapper::traceVisiblePoints(int pass)
+{
+    const LightSampler& lights = *settings.lights;
+    PixelSampler sampler(settings.sequence, settings.samples_per_pixel, settings.seed);
+    //width of a pixel per unit of distance, from the solid angle of a pixel in the middle of the image
+    double pixelAngle = std::sqrt(1. / (double(settings.image_width) * settings.image_height *
+        cam.directionPdf(cam.forward(), settings.image_width, settings.image_height)));
+
+    const int tile_size = settings.tile_size;
+    int tilesX = (settings.image_width + tile_size - 1) / tile_size;
+    int tilesY = (settings.image_height + tile_size - 1) / tile_size;
+    int tileCount = tilesX * tilesY;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int tile = 0; tile < tileCount; tile++)
+    {
+        int x0 = (tile % tilesX) * tile_size;
+        int y0 = (tile / tilesX) * tile_size;
+        int x1 = std::min(x0 + tile_size, settings.image_width);
+        int y1 = std::min(y0 + tile_size, settings.image_height);
+        static thread_local std::vector<Ray> rays;
+        cam.generateTile(x0, y0, x1, y1, settings.image_width, settings.image_height, pass, 1, sampler, rays);
+
+        size_t ray = 0;
+        for (int row = y0; row < y1; row++)
+        {
+            for (int col = x0; col < x1; col++)
+            {
+                seed_random((uint64_t(settings.seed) << 48) ^ (uint64_t(pass) << 32) ^ (uint64_t(row) << 16) ^ uint64_t(col));
+                Pixel& pixel = pixels[size_t(row) * settings.image_width + col];
+                pixel.visible = false;
+                Ray r = rays[ray++];
+                Color beta(1, 1, 1);
+                double distance = 0;
+                for (int depth = 0; depth < settings.max_depth; depth++)
+                {
+                    HitRecord rec;
+                    if (!world.hit(r, 0.001, infinity, rec))
+                    {
+                        pixel.direct += beta * escaped_color(r, &lights, background);
+                        break;
+                    }
+                    distance += (rec.p - r.origin()).length();
+                    pixel.direct += beta * emitted_material(rec.material_ptr, rec.u, rec.v, rec.p);
+                    Color attenuation;
+                    Ray scattered;
+                    if (!scatter_material(rec.material_ptr, r, rec, attenuation, scattered))
+                        break;
+                    if (rec.material_ptr->type == MaterialType::Lambertian)
+                    {
+                        //direct light as get_hit_color finds it, the indirect light is left to the photons
+                        LightSampledHit hit = { rec.p, rec.normal, std::max(0., dot(rec.normal, unit_vector(scattered.direction()))) / pi };
+                        pixel.direct += beta * (sample_direct_light(lights, world, r, rec, attenuation)
+                            + attenuation * get_ray_color(scattered, world, lights, 1, background, &hit));
+                        pixel.visible = true;
+                        pixel.p = rec.p;
+                        pixel.normal = rec.normal;
+                        pixel.weight = beta * attenuation / pi;
+                        pixel.footprint = distance * pixelAngle;
+                        break;
+                    }
+                    beta = beta * attenuation;
+                    r = scattered;
+                }
+            }
+        }
+    }
+
+    if (passes == 0)
+    {
+        //every pixel starts with the same radius, a few median footprints wide
+        std::vector<double> footprints;
+        for (const Pixel& pixel : pixels)
+        {
+            if (pixel.visible)
+                footprints.push_back(pixel.footprint);
+        }
+        double radius = 1;
+        if (!footprints.empty())
+        {
+            std::nth_element(footprints.begin(), footprints.begin() + footprints.size() / 2, footprints.end());
+            radius = std::max(1e-6, radiusPixels * footprints[footprints.size() / 2]);
+        }
+        for (Pixel& pixel : pixels)
+            pixel.radius = radius;
+    }
+}
+
+void PhotonMapper::shootPhotons(int pass)
+{
+    const LightSampler& lights = *settings.lights;
+    const int chunkSize = 1024;
+    int chunkCount = (photonsPerPass + chunkSize - 1) / chunkSize;
+    std::vector<std::vector<Photon>> chunks(chunkCount);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int chunk = 0; chunk < chunkCount; chunk++)
+    {
+        //seeds apart from the pixels' by bit 47
+        seed_random((uint64_t(settings.seed) << 48) ^ (uint64_t(1) << 47) ^ (uint64_t(pass) << 20) ^ uint64_t(chunk));
+        std::vector<Photon>& stored = chunks[chunk];
+        int count = std::min(chunkSize, photonsPerPass - chunk * chunkSize);
+        for (int i = 0; i < count; i++)
+        {
+            EmissionSample emission;
+            if (!lights.sampleEmission(0., emission))
+                continue;
+            Color beta = emission.emitted * (std::abs(dot(emission.normal, emission.direction)) /
+                (emission.pdfPosition * emission.pdfDirection));
+            Ray r(emission.p, emission.direction, 0.);
+            for (int depth = 0; depth < settings.max_depth; depth++)
+            {
+                HitRecord rec;
+                if (!world.hit(r, 0.001, infinity, rec))
+                    break;
+                //the first hit is direct light, sampled at the visible points
+                if (depth > 0 && rec.material_ptr->type == MaterialType::Lambertian)
+                {
+                    Vec3 direction = unit_vector(r.direction());
+                    Photon photon;
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        photon.position[axis] = static_cast<float>(rec.p[axis]);
+                        photon.direction[axis] = static_cast<float>(direction[axis]);
+                        photon.power[axis] = static_cast<float>(beta[axis]);
+                    }
+                    stored.push_back(photon);
+                }
+                Color attenuation;
+                Ray scattered;
+                if (!scatter_material(rec.material_ptr, r, rec, attenuation, scattered))
+                    break;
+                //Russian roulette on the reflectance keeps the power of the photons that go on about the same
+                double survival = std::min(1., std::max(attenuation.x(), std::max(attenuation.y(), attenuation.z())));
+                if (survival <= 0 || random_double() >= survival)
+                    break;
+                beta = beta * attenuation / survival;
+                r = scattered;
+            }
+        }
+    }
+
+    //one flat array in chunk order
+    size_t total = 0;
+    for (const auto& chunk : chunks)
+        total += chunk.size();
+    photons.clear();
+    photons.reserve(total);
+    for (const auto& chunk : chunks)
+        photons.insert(photons.end(), chunk.begin(), chunk.end());
+    stats.photonsShot += photonsPerPass;
+    stats.photonsStored += static_cast<long long>(total);
+}
+
+void PhotonMapper::buildGrid()
+{
+    double maxRadius = 0;
+    for (const Pixel& pixel : pixels)
+        maxRadius = std::max(maxRadius, pixel.radius);
+    grid.build(photons, 2. * maxRadius);
+}
+
+//The progressive radius reduction of SPPM with alpha 2/3: of the M photons a pass finds only 2/3 are kept in N,
+//the radius shrinks so the density they were found at stays the same, and so does the flux found so far
+void PhotonMapper::gather()
+{
+    const double alpha = 2. / 3.;
+    long long lookups = 0, gathered = 0;
+
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+ : lookups, gathered)
+    for (long long i = 0; i < static_cast<long long>(pixels.size()); i++)
+    {
+        Pixel& pixel = pixels[i];
+        if (!pixel.visible)
+            continue;
+        Color flux(0, 0, 0);
+        int found = 0;
+        grid.query(pixel.p, pixel.radius, [&](const Photon& photon, double)
+        {
+            //photons arriving on the side of the surface the camera sees
+            if (photon.direction[0] * pixel.normal[0] + photon.direction[1] * pixel.normal[1] + photon.direction[2] * pixel.normal[2] >= 0)
+                return;
+            flux += Color(photon.power[0], photon.power[1], photon.power[2]);
+            found++;
+        });
+        lookups++;
+        gathered += found;
+        if (found == 0)
+            continue;
+        double count = pixel.photonCount + alpha * found;
+        double radius = pixel.radius * std::sqrt(count / (pixel.photonCount + found));
+        pixel.flux = (pixel.flux + pixel.weight * flux) * ((radius * radius) / (pixel.radius * pixel.radius));
+        pixel.photonCount = count;
+        pixel.radius = radius;
+    }
+    stats.lookups += lookups;
+    stats.photonsGathered += gathered;
+    passes++;
+}
+
+void PhotonMapper::render(bool showProgress)
+{
+    for (int pass = 0; pass < settings.samples_per_pixel; pass++)
+    {
+        renderPass(pass);
+        if (showProgress)
+            std::cerr << "\rPasses remaining: " << settings.samples_per_pixel - pass - 1 << ' ' << std::flush;
+    }
+}
+
+void PhotonMapper::image(std::vector<Color>& colors) const
+{
+    colors.resize(pixels.size());
+    double photonsShot = static_cast<double>(stats.photonsShot);
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        const Pixel& pixel = pixels[i];
+        Color c = passes > 0 ? pixel.direct / passes : Color(0, 0, 0);
+        if (photonsShot > 0 && pixel.radius > 0)
+            c += pixel.flux / (photonsShot * pi * pixel.radius * pixel.radius);
+        colors[i] = c;
+    }
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include "scenes.h"
+#include "renderer.h"
+#include "bvh_node.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//camera parameters that can be changed while previewing
+struct PreviewCamera
+{
+    Point3 position;
+    Point3 lookAt;
+    Vec3 up = Vec3(0, 1, 0);
+    double fieldOfView_deg = 20.;
+    double aperture = 0.;
+    double dist_to_focus = 10.;
+};
+
+//Long running progressive render of one scene for look-dev. The scene and its BVH stay resident, a render thread
+//adds one sample per pixel per pass to the accumulated image and publishes it as a PNG, at most maxFps times a
+//second. A camera change restarts accumulation: the pass in flight skips its remaining tiles and the next pass
+//starts from sample 0 with the new camera, without touching the scene.
+class PreviewSession
+{
+    public:
+        struct Stats
+        {
+            double bvhBuildMs = 0;
+            double firstImageMs = -1;    //from start() to the first published image
+            double lastUpdateMs = -1;    //from the last camera change to its first published image
+            int samples = 0;             //accumulated in the published image
+            uint64_t version = 0;        //camera version of the published image
+        };
+
+        //settings.samples_per_pixel is where accumulation stops
+        PreviewSession(const SceneDescription& scene_, const RenderSettings& settings_, double maxFps_ = 10.);
+        ~PreviewSession() { stop(); }
+
+        void start();
+        void stop();
+
+        //returns the version of the new camera
+        uint64_t setCamera(const PreviewCamera& camera);
+        PreviewCamera getCamera() const;
+
+        //latest published image as a PNG
+        void latestFrame(std::vector<unsigned char>& png, Stats& frameStats) const;
+        Stats stats() const;
+
+        //waits until an image of camera version >= version with at least minSamples samples is published
+        bool waitForFrame(uint64_t version, int minSamples, double timeoutMs) const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        void renderLoop();
+        void publish(uint64_t version, int samples, Clock::time_point changeTime);
+
+        static double msSince(Clock::time_point t)
+        {
+            return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+        }
+
+        SceneDescription scene;
+        RenderSettings settings;
+        double maxFps;
+        shared_ptr<BvhNode> bvh;
+
+        mutable std::mutex cameraMutex;
+        std::condition_variable cameraChanged;
+        PreviewCamera camera;
+        std::atomic<uint64_t> cameraVersion;
+        Clock::time_point cameraChangeTime;
+
+        mutable std::mutex frameMutex;
+        mutable std::condition_variable framePublished;
+        std::vector<unsigned char> png;
+        Stats published;
+        Clock::time_point lastPublish;
+
+        Clock::time_point startTime;
+        std::atomic<bool> running;
+        std::thread renderThread;
+        std::vector<Color> sums;
+        std::vector<unsigned char> pixels;
+};
+
+PreviewSession::PreviewSession(const SceneDescription& scene_, const RenderSettings& settings_, double maxFps_)
+    : scene(scene_), settings(settings_), maxFps(maxFps_), cameraVersion(0), running(false)
+{
+    auto buildStart = Clock::now();
+    bvh = make_shared<BvhNode>(scene.world, 0, 0);
+    published.bvhBuildMs = msSince(buildStart);
+
+    camera.position = scene.cameraPosition;
+    camera.lookAt = scene.cameraLookAt;
+    camera.up = scene.cameraUp;
+    camera.fieldOfView_deg = scene.fieldOfView_deg;
+    camera.aperture = scene.aperture;
+    camera.dist_to_focus = scene.dist_to_focus;
+}
+
+void PreviewSession::start()
+{
+    if (running)
+        return;
+    startTime = Clock::now();
+    cameraChangeTime = startTime;
+    running = true;
+    renderThread = std::thread(&PreviewSession::renderLoop, this);
+}
+
+void PreviewSession::stop()
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(cameraMutex);
+        running = false;
+    }
+    cameraChanged.notify_all();
+    renderThread.join();
+}
+
+uint64_t PreviewSession::setCamera(const PreviewCamera& newCamera)
+{
+    uint64_t version;
+    {
+        std::lock_guard<std::mutex> lock(cameraMutex);
+        camera = newCamera;
+        cameraChangeTime = Clock::now();
+        version = ++cameraVersion;
+    }
+    cameraChanged.notify_all();
+    return version;
+}
+
+PreviewCamera PreviewSession::getCamera() const
+{
+    std::lock_guard<std::mutex> lock(cameraMutex);
+    return camera;
+}
+
+void PreviewSession::latestFrame(std::vector<unsigned char>& out, Stats& frameStats) const
+{
+    std::lock_guard<std::mutex> lock(frameMutex);
+    out = png;
+    frameStats = published;
+}
+
+PreviewSession::Stats PreviewSession::stats() const
+{
+    std::lock_guard<std::mutex> lock(frameMutex);
+    return published;
+}
+
+bool PreviewSession::waitForFrame(uint64_t version, int minSamples, double timeoutMs) const
+{
+    std::unique_lock<std::mutex> lock(frameMutex);
+    return framePublished.wait_for(lock, std::chrono::duration<double, std::milli>(timeoutMs), [&]
+        {
+            return published.version > version || (published.version == version && published.samples >= minSamples);
+        });
+}
+
+void PreviewSession::renderLoop()
+{
+    size_t pixelCount = size_t(settings.image_width) * settings.image_height;
+    PixelSampler sampler(settings.sequence, settings.samples_per_pixel, settings.seed);
+    settings.packets = usePackets(*bvh, settings);
+    const int tile_size = settings.tile_size;
+    int tilesX = (settings.image_width + tile_size - 1) / tile_size;
+    int tilesY = (settings.image_height + tile_size - 1) / tile_size;
+    int tileCount = tilesX * tilesY;
+
+    uint64_t version = 0;
+    Clock::time_point changeTime = startTime;
+    Camera cam = scene.camera();
+    int samples = -1; //nothing rendered for the camera yet
+
+    while (running)
+    {
+        {
+            std::unique_lock<std::mutex> lock(cameraMutex);
+            //accumulation is complete, sleep until the camera changes
+            cameraChanged.wait(lock, [&] { return !running || cameraVersion != version || samples < settings.samples_per_pixel; });
+            if (!running)
+                break;
+            if (cameraVersion != version || samples < 0)
+            {
+                version = cameraVersion;
+                changeTime = cameraChangeTime;
+                cam = Camera(camera.position, camera.lookAt, camera.up, camera.fieldOfView_deg, scene.aspect_ratio,
+                    camera.dist_to_focus, camera.aperture);
+                samples = 0;
+                sums.assign(pixelCount, Color(0, 0, 0));
+            }
+        }
+
+        //one sample per pixel, the tiles left are skipped as soon as the camera changes
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int tile = 0; tile < tileCount; tile++)
+        {
+            if (cameraVersion != version)
+                continue;
+            int x0 = (tile % tilesX) * tile_size;
+            int y0 = (tile / tilesX) * tile_size;
+            int x1 = std::min(x0 + tile_size, settings.image_width);
+            int y1 = std::min(y0 + tile_size, settings.image_height);
+            renderTile(*bvh, cam, scene.background, settings, sampler, x0, y0, x1, y1, samples, 1, sums.data());
+        }
+        if (cameraVersion != version)
+            continue;
+
+        samples++;
+        publish(version, samples, changeTime);
+    }
+}
+
+void PreviewSession::publish(uint64_t version, int samples, Clock::time_point changeTime)
+{
+    bool first = samples == 1;
+    bool last = samples == settings.samples_per_pixel;
+    if (!first && !last && msSince(lastPublish) < 1000. / maxFps)
+        return;
+
+    pixels.resize(sums.size() * 3);
+    toImage(sums, samples, pixels.data());
+    std::vector<unsigned char> encoded;
+    stbi_write_png_to_func([](void* context, void* data, int size)
+        {
+            auto bytes = static_cast<unsigned char*>(data);
+            static_cast<std::vector<unsigned char>*>(context)->insert(static_cast<std::vector<unsigned char>*>(context)->end(), bytes, bytes + size);
+        }, &encoded, settings.image_width, settings.image_height, 3, pixels.data(), 3 * settings.image_width);
+
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        png.swap(encoded);
+        published.samples = samples;
+        published.version = version;
+        if (first)
+        {
+            if (version == 0)
+                published.firstImageMs = msSince(startTime);
+            else
+                published.lastUpdateMs = msSince(changeTime);
+        }
+        lastPublish = Clock::now();
+    }
+    framePublished.notify_all();
+}
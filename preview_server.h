@@ -0,0 +1,179 @@
+#pragma once
+
+#include "preview.h"
+#include "socket_util.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+//Minimal HTTP server for a PreviewSession on localhost, one connection at a time:
+//  /             page showing the image, polling it at the session's frame rate, with camera controls
+//  /frame.png    latest accumulated image
+//  /camera?...   sets px py pz (position), lx ly lz (look at), fov, aperture, focus; accumulation restarts
+//  /stats        JSON with samples, camera version, BVH build time, time to first image and last update latency
+class PreviewServer
+{
+    public:
+        PreviewServer(PreviewSession& session_, int port_, double maxFps_ = 10.) : session(session_), port(port_), maxFps(maxFps_) {}
+
+        //serves until the listening socket fails, returns false when it can't be opened
+        bool run();
+
+    private:
+        void handle(socket_t client);
+        void respond(socket_t client, const char* status, const char* contentType, const std::string& body, const std::string& extraHeaders = "");
+        std::string statsJson() const;
+        std::string indexPage() const;
+        static bool queryValue(const std::string& query, const char* name, double& value);
+
+        PreviewSession& session;
+        int port;
+        double maxFps;
+};
+
+bool PreviewServer::run()
+{
+    if (!initSockets())
+        return false;
+    socket_t listener = listenLocal(port);
+    if (listener == INVALID_SOCKET)
+        return false;
+
+    std::cerr << "\nPreview at http://localhost:" << port << "/\n";
+    while (true)
+    {
+        socket_t client = accept(listener, nullptr, nullptr);
+        if (client == INVALID_SOCKET)
+            break;
+        handle(client);
+        closesocket(client);
+    }
+    closesocket(listener);
+    return true;
+}
+
+void PreviewServer::handle(socket_t client)
+{
+    //the request line is all that's needed, headers and body are ignored
+    char buffer[4096];
+    int received = recv(client, buffer, sizeof(buffer) - 1, 0);
+    if (received <= 0)
+        return;
+    buffer[received] = '\0';
+
+    std::string request(buffer);
+    if (request.compare(0, 4, "GET ") != 0)
+    {
+        respond(client, "405 Method Not Allowed", "text/plain", "GET only\n");
+        return;
+    }
+    std::string target = request.substr(4, request.find(' ', 4) - 4);
+    size_t queryStart = target.find('?');
+    std::string path = target.substr(0, queryStart);
+    std::string query = queryStart == std::string::npos ? "" : target.substr(queryStart + 1);
+
+    if (path == "/")
+        respond(client, "200 OK", "text/html", indexPage());
+    else if (path == "/frame.png")
+    {
+        std::vector<unsigned char> png;
+        PreviewSession::Stats stats;
+        session.latestFrame(png, stats);
+        respond(client, "200 OK", "image/png", std::string(png.begin(), png.end()),
+            "Cache-Control: no-store\r\nX-Samples: " + std::to_string(stats.samples) + "\r\n");
+    }
+    else if (path == "/camera")
+    {
+        PreviewCamera camera = session.getCamera();
+        double value;
+        for (int a = 0; a < 3; a++)
+        {
+            const char* positionNames[] = { "px", "py", "pz" };
+            const char* lookAtNames[] = { "lx", "ly", "lz" };
+            if (queryValue(query, positionNames[a], value))
+                camera.position[a] = value;
+            if (queryValue(query, lookAtNames[a], value))
+                camera.lookAt[a] = value;
+        }
+        if (queryValue(query, "fov", value))
+            camera.fieldOfView_deg = value;
+        if (queryValue(query, "aperture", value))
+            camera.aperture = value;
+        if (queryValue(query, "focus", value))
+            camera.dist_to_focus = value;
+        uint64_t version = session.setCamera(camera);
+        respond(client, "200 OK", "application/json", "{\"version\": " + std::to_string(version) + "}\n");
+    }
+    else if (path == "/stats")
+        respond(client, "200 OK", "application/json", statsJson());
+    else
+        respond(client, "404 Not Found", "text/plain", "Not found\n");
+}
+
+void PreviewServer::respond(socket_t client, const char* status, const char* contentType, const std::string& body, const std::string& extraHeaders)
+{
+    std::string response = std::string("HTTP/1.1 ") + status + "\r\nContent-Type: " + contentType
+        + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n" + extraHeaders + "\r\n" + body;
+    sendAll(client, response.data(), response.size());
+}
+
+std::string PreviewServer::statsJson() const
+{
+    PreviewSession::Stats stats = session.stats();
+    PreviewCamera camera = session.getCamera();
+    char json[512];
+    snprintf(json, sizeof(json),
+        "{\"samples\": %d, \"version\": %llu, \"bvhBuildMs\": %.1f, \"firstImageMs\": %.1f, \"lastUpdateMs\": %.1f, "
+        "\"camera\": {\"px\": %g, \"py\": %g, \"pz\": %g, \"lx\": %g, \"ly\": %g, \"lz\": %g, \"fov\": %g, \"aperture\": %g, \"focus\": %g}}\n",
+        stats.samples, static_cast<unsigned long long>(stats.version), stats.bvhBuildMs, stats.firstImageMs, stats.lastUpdateMs,
+        camera.position.x(), camera.position.y(), camera.position.z(), camera.lookAt.x(), camera.lookAt.y(), camera.lookAt.z(),
+        camera.fieldOfView_deg, camera.aperture, camera.dist_to_focus);
+    return json;
+}
+
+std::string PreviewServer::indexPage() const
+{
+    //the image is requested again once the previous one has loaded, at most maxFps times a second
+    return std::string(
+        "<!DOCTYPE html><html><head><title>Preview</title></head><body style=\"font-family:sans-serif\">\n"
+        "<img id=\"frame\" src=\"/frame.png\"><div id=\"stats\"></div>\n"
+        "<form id=\"camera\">"
+        "position <input name=\"px\" size=6><input name=\"py\" size=6><input name=\"pz\" size=6> "
+        "look at <input name=\"lx\" size=6><input name=\"ly\" size=6><input name=\"lz\" size=6> "
+        "fov <input name=\"fov\" size=4> aperture <input name=\"aperture\" size=4> focus <input name=\"focus\" size=4> "
+        "<input type=\"submit\" value=\"Set camera\"></form>\n"
+        "<script>\n"
+        "const interval = ") + std::to_string(1000. / maxFps) + ";\n"
+        "const frame = document.getElementById('frame');\n"
+        "frame.onload = frame.onerror = () => setTimeout(() => { frame.src = '/frame.png?t=' + Date.now(); }, interval);\n"
+        "const form = document.getElementById('camera');\n"
+        "async function refreshStats(fill) {\n"
+        "  const stats = await (await fetch('/stats')).json();\n"
+        "  document.getElementById('stats').textContent = stats.samples + ' spp, first image ' + stats.firstImageMs.toFixed(0)\n"
+        "    + ' ms, last camera update ' + stats.lastUpdateMs.toFixed(0) + ' ms';\n"
+        "  if (fill) for (const key in stats.camera) form.elements[key].value = stats.camera[key];\n"
+        "}\n"
+        "form.onsubmit = async (e) => { e.preventDefault(); await fetch('/camera?' + new URLSearchParams(new FormData(form))); };\n"
+        "refreshStats(true); setInterval(() => refreshStats(false), 1000);\n"
+        "</script></body></html>\n";
+}
+
+bool PreviewServer::queryValue(const std::string& query, const char* name, double& value)
+{
+    std::string key = std::string(name) + "=";
+    size_t start = 0;
+    while (start < query.size())
+    {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos)
+            end = query.size();
+        if (query.compare(start, key.size(), key) == 0 && end > start + key.size())
+        {
+            value = atof(query.substr(start + key.size(), end - start - key.size()).c_str());
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
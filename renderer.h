@@ -0,0 +1,573 @@
+#pragma once
+
+#include "util.h"
+#include "hittable.h"
+#include "material.h"
+#include "camera.h"
+#include "sampler.h"
+#include "light_sampler.h"
+#include "guiding.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+struct RenderSettings
+{
+    int image_width = 1000;
+    int image_height = 1000;
+    int samples_per_pixel = 100;
+    int max_depth = 50;
+
+    SampleSequence sequence = SampleSequence::Sobol;
+    unsigned int seed = 0; //same seed, same image
+    int tile_size = 16;
+
+    //camera rays traced as 8x8 pixel packets; callers turn this off for worlds whose hits use random numbers,
+    //see usePackets
+    bool packets = true;
+
+    //emitters of the world sampled at every diffuse hit (next event estimation, see get_hit_color), null to find
+    //lights only by scattered rays. Its environment map, if any, replaces the background.
+    const LightSampler* lights = nullptr;
+
+    //incident light learned by renderGuided, sampled at diffuse hits next to their material and updated with the
+    //light the paths find (see get_guided_ray_color), null for plain path tracing. The feature pass doesn't use it.
+    GuidingField* guiding = nullptr;
+};
+
+//First hit features of a pixel (auxiliary outputs next to its color) for the denoiser, summed over the samples of
+//the pixel like the color. Albedo is the attenuation of the first scatter (or emitted color of a light), depth the
+//distance to the first hit, both are 0 where the camera ray leaves the scene.
+struct PixelFeatures
+{
+    Color albedo;
+    Vec3 normal;
+    double depth = 0;
+    double luminanceSquared = 0; //of the color samples, for the variance of the pixel
+
+    PixelFeatures& operator+=(const PixelFeatures& other)
+    {
+        albedo += other.albedo;
+        normal += other.normal;
+        depth += other.depth;
+        luminanceSquared += other.luminanceSquared;
+        return *this;
+    }
+};
+
+inline double luminance(const Color& c)
+{
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+Color calculate_color(Color pixel_color, int samples_per_pixel)
+{
+    double avg = 1. / samples_per_pixel;
+    double r = clamp(pixel_color.x() * avg, 0., 0.999);
+    double g = clamp(pixel_color.y() * avg, 0., 0.999);
+    double b = clamp(pixel_color.z() * avg, 0., 0.999);
+
+    //gamma corrected:
+    r = std::sqrt(r);
+    g = std::sqrt(g);
+    b = std::sqrt(b);
+
+    return Color((255.999 * r),(255.999 * g), (255.999 * b));
+}
+
+Color get_hit_color(const Ray& r, const HitRecord& rec, const Hittable& world, int depth, const Color& backgroundColor);
+
+Color get_ray_color(const Ray& r, const Hittable &world, int depth, const Color &backgroundColor)
+{
+    HitRecord rec;
+
+    // If we've exceeded the ray bounce limit, no more light is gathered.
+    if (depth <= 0)
+        return Color();
+
+
+    //Setting t_min = 0.001 instead of 0 gets rid of the shadow acne problem
+    if (!world.hit(r, 0.001, infinity, rec))
+    {
+        //nothing hit, return background color
+        return backgroundColor;
+    }
+    return get_hit_color(r, rec, world, depth, backgroundColor);
+}
+
+//color of a ray whose closest hit is rec, the rest of the path is traced with get_ray_color
+Color get_hit_color(const Ray& r, const HitRecord& rec, const Hittable& world, int depth, const Color& backgroundColor)
+{
+    Ray scattered;
+    Color attenuation; //value of obsorbed color 
+    Color emitted = emitted_material(rec.material_ptr, rec.u, rec.v, rec.p); //if Material is light emitting
+    if (scatter_material(rec.material_ptr, r, rec, attenuation, scattered))
+    {
+        return emitted + attenuation * get_ray_color(scattered, world, depth - 1, backgroundColor);
+    }
+    else
+        return emitted;
+}
+
+//Diffuse hit that sampled a light, the ray it scatters weighs the light it finds against that sample
+struct LightSampledHit
+{
+    Point3 p;
+    Vec3 normal;
+    double scatterPdf; //solid angle density of the scattered direction
+};
+
+//weight of a sample of density pdf when another strategy with density otherPdf samples the same light (Veach's
+//power heuristic), the weights of the two add up to 1
+inline double power_heuristic(double pdf, double otherPdf)
+{
+    return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+}
+
+//Light of a ray leaving the scene: the environment map of lights when there is one, else the constant background.
+//A ray scattered from a hit that sampled a light (from) is weighed against sampling the map.
+Color escaped_color(const Ray& r, const LightSampler* lights, const Color& backgroundColor, const LightSampledHit* from = nullptr)
+{
+    const EnvironmentMap* environment = lights ? lights->getEnvironment() : nullptr;
+    if (!environment)
+        return backgroundColor;
+    Color radiance = environment->radiance(r.direction());
+    if (from)
+        radiance = radiance * power_heuristic(from->scatterPdf, lights->environmentPdf(r.direction()));
+    return radiance;
+}
+
+//Density of a Lambertian hit with the normal scattering towards direction (unit), when it samples guide with
+//probability guidedFraction and its cosine weighted directions otherwise
+inline double scatter_pdf(const Vec3& normal, const Vec3& direction, const DirectionalTree* guide = nullptr, double guidedFraction = 0)
+{
+    double cosinePdf = std::max(0., dot(normal, direction)) / pi;
+    if (!guide)
+        return cosinePdf;
+    return (1. - guidedFraction) * cosinePdf + guidedFraction * guide->pdf(direction);
+}
+
+//Light from one emitter picked by lights reflected by the Lambertian hit rec with albedo towards r, traced with a
+//shadow ray. Media on the way scatter the shadow ray with the probability they would scatter the light.
+//The light sample is weighed against the scattered ray, which samples guide with probability guidedFraction.
+Color sample_direct_light(const LightSampler& lights, const Hittable& world, const Ray& r, const HitRecord& rec, const Color& albedo,
+    const DirectionalTree* guide = nullptr, double guidedFraction = 0)
+{
+    LightSample sample;
+    if (!lights.sample(rec.p, rec.normal, r.time(), sample))
+        return Color();
+    double cosine = dot(rec.normal, sample.direction);
+    if (cosine <= 0)
+        return Color();
+    HitRecord blocker;
+    if (world.hit(Ray(rec.p, sample.direction, r.time()), 0.001, sample.distance * (1. - 1e-7), blocker))
+        return Color();
+    double weight = power_heuristic(sample.pdf, scatter_pdf(rec.normal, sample.direction, guide, guidedFraction));
+    return albedo * sample.emitted * (weight * cosine / (pi * sample.pdf));
+}
+
+Color get_hit_color(const Ray& r, const HitRecord& rec, const Hittable& world, const LightSampler& lights, int depth,
+    const Color& backgroundColor, const LightSampledHit* from = nullptr);
+
+//get_ray_color with next event estimation: diffuse hits also sample a light. When the ray was scattered from
+//such a hit (from), the emitter it hits is weighed by multiple importance sampling against the light sample.
+Color get_ray_color(const Ray& r, const Hittable& world, const LightSampler& lights, int depth, const Color& backgroundColor,
+    const LightSampledHit* from = nullptr)
+{
+    HitRecord rec;
+    if (depth <= 0)
+        return Color();
+    if (!world.hit(r, 0.001, infinity, rec))
+        return escaped_color(r, &lights, backgroundColor, from);
+    return get_hit_color(r, rec, world, lights, depth, backgroundColor, from);
+}
+
+Color get_hit_color(const Ray& r, const HitRecord& rec, const Hittable& world, const LightSampler& lights, int depth,
+    const Color& backgroundColor, const LightSampledHit* from)
+{
+    Color emitted = emitted_material(rec.material_ptr, rec.u, rec.v, rec.p);
+    if (from && rec.material_ptr->type == MaterialType::Light)
+        emitted = emitted * power_heuristic(from->scatterPdf, lights.pdf(from->p, from->normal, r, rec));
+    Ray scattered;
+    Color attenuation;
+    if (!scatter_material(rec.material_ptr, r, rec, attenuation, scattered))
+        return emitted;
+    //Mirrors, glass and media only find lights through their scattered ray. Paths keep at most depth segments, the
+    //last hit doesn't sample a light either.
+    if (rec.material_ptr->type != MaterialType::Lambertian || depth <= 1)
+        return emitted + attenuation * get_ray_color(scattered, world, lights, depth - 1, backgroundColor);
+    LightSampledHit hit = { rec.p, rec.normal, std::max(0., dot(rec.normal, unit_vector(scattered.direction()))) / pi };
+    return emitted + sample_direct_light(lights, world, r, rec, attenuation)
+        + attenuation * get_ray_color(scattered, world, lights, depth - 1, backgroundColor, &hit);
+}
+
+Color get_guided_hit_color(const Ray& r, const HitRecord& rec, const Hittable& world, const LightSampler* lights, GuidingField& guiding,
+    int depth, const Color& backgroundColor, const LightSampledHit* from = nullptr);
+
+//get_ray_color with path guiding: diffuse hits scatter towards the light guiding learned in earlier passes as often
+//as towards their cosine lobe, and record the light their scattered ray finds for the next passes. With lights
+//they also sample a light, weighed against the scattered ray of both strategies.
+Color get_guided_ray_color(const Ray& r, const Hittable& world, const LightSampler* lights, GuidingField& guiding, int depth,
+    const Color& backgroundColor, const LightSampledHit* from = nullptr)
+{
+    HitRecord rec;
+    if (depth <= 0)
+        return Color();
+    if (!world.hit(r, 0.001, infinity, rec))
+        return escaped_color(r, lights, backgroundColor, from);
+    return get_guided_hit_color(r, rec, world, lights, guiding, depth, backgroundColor, from);
+}
+
+Color get_guided_hit_color(const Ray& r, const HitRecord& rec, const Hittable& world, const LightSampler* lights, GuidingField& guiding,
+    int depth, const Color& backgroundColor, const LightSampledHit* from)
+{
+    Color emitted = emitted_material(rec.material_ptr, rec.u, rec.v, rec.p);
+    if (from && rec.material_ptr->type == MaterialType::Light)
+        emitted = emitted * power_heuristic(from->scatterPdf, lights->pdf(from->p, from->normal, r, rec));
+    Ray scattered;
+    Color attenuation;
+    if (!scatter_material(rec.material_ptr, r, rec, attenuation, scattered))
+        return emitted;
+    if (rec.material_ptr->type != MaterialType::Lambertian || depth <= 1)
+        return emitted + attenuation * get_guided_ray_color(scattered, world, lights, guiding, depth - 1, backgroundColor);
+
+    uint32_t cell = guiding.cell(rec.p);
+    const DirectionalTree* guide = guiding.distribution(cell);
+    double guidedFraction = guide ? guiding.getGuidedFraction() : 0.;
+    Vec3 direction = unit_vector(scattered.direction());
+    double guidedPdf = -1;
+    //a guided draw that fails (rounding at an empty quadrant) keeps the cosine direction, whose density is the mixture
+    if (guide && random_double() < guidedFraction && !guide->sample(direction, guidedPdf))
+    {
+        direction = unit_vector(scattered.direction());
+        guidedPdf = -1;
+    }
+    Color direct = lights ? sample_direct_light(*lights, world, r, rec, attenuation, guide, guidedFraction) : Color();
+    double cosine = dot(rec.normal, direction);
+    //the density of both strategies, the guided one is known when it drew the direction
+    double pdf = guidedPdf < 0 ? scatter_pdf(rec.normal, direction, guide, guidedFraction)
+        : (1. - guidedFraction) * std::max(0., cosine) / pi + guidedFraction * guidedPdf;
+    if (cosine <= 0 || !(pdf > 0))
+        return emitted + direct;
+
+    LightSampledHit hit = { rec.p, rec.normal, pdf };
+    Color incoming = get_guided_ray_color(Ray(rec.p, direction, r.time()), world, lights, guiding, depth - 1, backgroundColor,
+        lights ? &hit : nullptr);
+    guiding.record(cell, direction, luminance(incoming) / pdf);
+    return emitted + direct + attenuation * incoming * (cosine / (pi * pdf));
+}
+
+//color of a camera ray, also filling the features of its first hit. Features are taken through mirrors and glass
+//from the first diffuse hit behind them, so reflections and refractions keep their edges in the denoiser.
+Color get_ray_color(const Ray& r, const Hittable& world, int depth, const Color& backgroundColor, PixelFeatures& features,
+    const LightSampler* lights = nullptr)
+{
+    HitRecord rec;
+    if (depth <= 0 || !world.hit(r, 0.001, infinity, rec))
+    {
+        features.albedo = depth <= 0 ? Color() : escaped_color(r, lights, backgroundColor);
+        return features.albedo;
+    }
+
+    features.normal = rec.normal;
+    features.depth = rec.t * r.direction().length();
+
+    Ray scattered;
+    Color attenuation;
+    Color emitted = emitted_material(rec.material_ptr, rec.u, rec.v, rec.p);
+    if (scatter_material(rec.material_ptr, r, rec, attenuation, scattered))
+    {
+        MaterialType type = rec.material_ptr->type;
+        if (type == MaterialType::Metal || type == MaterialType::Dielectric)
+        {
+            PixelFeatures behind;
+            Color color = get_ray_color(scattered, world, depth - 1, backgroundColor, behind, lights);
+            features.albedo = attenuation * behind.albedo;
+            features.normal = behind.normal;
+            features.depth += behind.depth;
+            return emitted + attenuation * color;
+        }
+        features.albedo = attenuation;
+        if (lights && type == MaterialType::Lambertian && depth > 1)
+        {
+            LightSampledHit hit = { rec.p, rec.normal, std::max(0., dot(rec.normal, unit_vector(scattered.direction()))) / pi };
+            return emitted + sample_direct_light(*lights, world, r, rec, attenuation)
+                + attenuation * get_ray_color(scattered, world, *lights, depth - 1, backgroundColor, &hit);
+        }
+        if (lights)
+            return emitted + attenuation * get_ray_color(scattered, world, *lights, depth - 1, backgroundColor);
+        return emitted + attenuation * get_ray_color(scattered, world, depth - 1, backgroundColor);
+    }
+    features.albedo = emitted;
+    return emitted;
+}
+
+void writeImage(const unsigned char* image, const char* filename, int h, int w, int color_channels) 
+{
+    int result = stbi_write_png(filename, w, h, color_channels, image, 3 * w);
+    if (result == 0)
+        std::cerr << "Failed to write image.";
+}
+
+//Portable float map of linear colors (row 0 at the top), written as 32 bit little endian floats, bottom row first
+bool writePfm(const std::vector<Color>& colors, int width, int height, const char* filename)
+{
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+        return false;
+    fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
+    std::vector<float> row(3 * size_t(width));
+    for (int y = height - 1; y >= 0; y--)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < 3; c++)
+                row[3 * x + c] = static_cast<float>(colors[size_t(y) * width + x][c]);
+        }
+        fwrite(row.data(), sizeof(float), row.size(), file);
+    }
+    return fclose(file) == 0;
+}
+
+bool readPfm(const char* filename, std::vector<Color>& colors, int& width, int& height)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+        return false;
+    char type[3] = {};
+    double scale = 0;
+    //a single whitespace character separates the header from the data
+    if (fscanf(file, "%2s %d %d %lf", type, &width, &height, &scale) != 4 || strcmp(type, "PF") != 0 || scale >= 0
+        || width <= 0 || height <= 0 || fgetc(file) == EOF)
+    {
+        fclose(file);
+        return false;
+    }
+    colors.resize(size_t(width) * height);
+    std::vector<float> row(3 * size_t(width));
+    bool complete = true;
+    for (int y = height - 1; y >= 0 && complete; y--)
+    {
+        complete = fread(row.data(), sizeof(float), row.size(), file) == row.size();
+        for (int x = 0; x < width; x++)
+            colors[size_t(y) * width + x] = Color(row[3 * x], row[3 * x + 1], row[3 * x + 2]);
+    }
+    fclose(file);
+    return complete;
+}
+
+//Packet path of renderTile: sample by sample, the camera rays of every 8x8 pixel block are traced as one packet,
+//then each pixel shades its ray with its own random state, which is saved between samples. The random numbers of
+//a pixel are drawn in the same order as with single rays, so the image is the same.
+template <typename PixelIndex>
+void renderTilePackets(const Hittable& world, const Color& background, const RenderSettings& settings, const std::vector<Ray>& rays,
+    int x0, int y0, int x1, int y1, int firstSample, int sampleCount, Color* sums, const PixelIndex& pixelIndex)
+{
+    static thread_local std::vector<RandomState> states;
+    static thread_local std::vector<Color> colors;
+    static thread_local std::unique_ptr<RayPacket> packet(new RayPacket());
+    const int blockSize = 8;
+    int tileWidth = x1 - x0;
+    size_t pixelCount = size_t(tileWidth) * (y1 - y0);
+    states.resize(pixelCount);
+    colors.assign(pixelCount, Color(0, 0, 0));
+
+    for (int row = y0; row < y1; row++)
+    {
+        for (int col = x0; col < x1; col++)
+        {
+            seed_random((uint64_t(settings.seed) << 48) ^ (uint64_t(firstSample) << 32) ^ (uint64_t(row) << 16) ^ uint64_t(col));
+            states[size_t(row - y0) * tileWidth + (col - x0)] = random_state();
+        }
+    }
+
+    int pixels[RayPacket::maxSize];
+    for (int s = 0; s < sampleCount; s++)
+    {
+        for (int by = y0; by < y1; by += blockSize)
+        {
+            for (int bx = x0; bx < x1; bx += blockSize)
+            {
+                packet->count = 0;
+                for (int row = by; row < std::min(by + blockSize, y1); row++)
+                {
+                    for (int col = bx; col < std::min(bx + blockSize, x1); col++)
+                    {
+                        int pixel = (row - y0) * tileWidth + (col - x0);
+                        pixels[packet->count] = pixel;
+                        packet->rays[packet->count++] = rays[size_t(pixel) * sampleCount + s];
+                    }
+                }
+                packet->init();
+                world.hitPacket(*packet, 0.001, packet->allActive());
+
+                for (int i = 0; i < packet->count; i++)
+                {
+                    random_state() = states[pixels[i]];
+                    if (!packet->hit[i] || settings.max_depth <= 0)
+                        colors[pixels[i]] += settings.max_depth > 0 ? escaped_color(packet->rays[i], settings.lights, background) : Color(0, 0, 0);
+                    else if (settings.guiding)
+                        colors[pixels[i]] += get_guided_hit_color(packet->rays[i], packet->records[i], world, settings.lights,
+                            *settings.guiding, settings.max_depth, background);
+                    else if (settings.lights)
+                        colors[pixels[i]] += get_hit_color(packet->rays[i], packet->records[i], world, *settings.lights, settings.max_depth, background);
+                    else
+                        colors[pixels[i]] += get_hit_color(packet->rays[i], packet->records[i], world, settings.max_depth, background);
+                    states[pixels[i]] = random_state();
+                }
+            }
+        }
+    }
+
+    for (int row = y0; row < y1; row++)
+    {
+        for (int col = x0; col < x1; col++)
+            sums[pixelIndex(row, col)] += colors[size_t(row - y0) * tileWidth + (col - x0)];
+    }
+}
+
+//true when the packet path of renderTile can be used for the world
+inline bool usePackets(const Hittable& world, const RenderSettings& settings)
+{
+    return settings.packets && !world.hitUsesRandom();
+}
+
+//Adds samples [firstSample, firstSample + sampleCount) of every pixel in the tile [x0, x1) x [y0, y1) to sums,
+//which holds image_width * image_height linear colors with row 0 at the top. The first hit features of the samples
+//are added to features in the same layout when it is given.
+//With tileStride > 0 sums holds only the tile instead, its first pixel at (x0, y0) and rows tileStride apart.
+//Camera rays are traced in packets when settings.packets is set and no features are asked for.
+void renderTile(const Hittable& world, const Camera& cam, const Color& background, const RenderSettings& settings,
+    const PixelSampler& sampler, int x0, int y0, int x1, int y1, int firstSample, int sampleCount, Color* sums,
+    PixelFeatures* features = nullptr, int tileStride = 0)
+{
+    auto pixelIndex = [&](int row, int col)
+    {
+        return tileStride > 0 ? size_t(row - y0) * tileStride + (col - x0) : size_t(row) * settings.image_width + col;
+    };
+
+    static thread_local std::vector<Ray> rays;
+    cam.generateTile(x0, y0, x1, y1, settings.image_width, settings.image_height, firstSample, sampleCount, sampler, rays);
+
+    if (settings.packets && !features)
+    {
+        renderTilePackets(world, background, settings, rays, x0, y0, x1, y1, firstSample, sampleCount, sums, pixelIndex);
+        return;
+    }
+
+    size_t ray = 0;
+    for (int row = y0; row < y1; row++)
+    {
+        for (int col = x0; col < x1; col++)
+        {
+            //the paths of a pixel don't depend on which thread renders it or in which order
+            seed_random((uint64_t(settings.seed) << 48) ^ (uint64_t(firstSample) << 32) ^ (uint64_t(row) << 16) ^ uint64_t(col));
+
+            Color pixel_color(0, 0, 0);
+            if (features)
+            {
+                PixelFeatures pixelFeatures;
+                for (int s = 0; s < sampleCount; s++)
+                {
+                    PixelFeatures sampleFeatures;
+                    Color sample = get_ray_color(rays[ray++], world, settings.max_depth, background, sampleFeatures, settings.lights);
+                    sampleFeatures.luminanceSquared = luminance(sample) * luminance(sample);
+                    pixel_color += sample;
+                    pixelFeatures += sampleFeatures;
+                }
+                features[pixelIndex(row, col)] += pixelFeatures;
+            }
+            else if (settings.guiding)
+            {
+                for (int s = 0; s < sampleCount; s++)
+                    pixel_color += get_guided_ray_color(rays[ray++], world, settings.lights, *settings.guiding, settings.max_depth, background);
+            }
+            else
+            {
+                for (int s = 0; s < sampleCount; s++)
+                {
+                    pixel_color += settings.lights ? get_ray_color(rays[ray++], world, *settings.lights, settings.max_depth, background)
+                        : get_ray_color(rays[ray++], world, settings.max_depth, background);
+                }
+            }
+            sums[pixelIndex(row, col)] += pixel_color;
+        }
+    }
+}
+
+//adds samples [firstSample, firstSample + sampleCount) of every pixel to sums (and their first hit features to
+//features when given), tiles are rendered in parallel
+void renderSamples(const Hittable& world, const Camera& cam, const Color& background, const RenderSettings& settings,
+    int firstSample, int sampleCount, std::vector<Color>& sums, bool showProgress = true, std::vector<PixelFeatures>* features = nullptr)
+{
+    sums.resize(size_t(settings.image_width) * settings.image_height);
+    if (features)
+        features->resize(sums.size());
+    PixelSampler sampler(settings.sequence, settings.samples_per_pixel, settings.seed);
+    RenderSettings tileSettings = settings;
+    tileSettings.packets = usePackets(world, settings);
+
+    const int tile_size = settings.tile_size;
+    int tilesX = (settings.image_width + tile_size - 1) / tile_size;
+    int tilesY = (settings.image_height + tile_size - 1) / tile_size;
+    int tileCount = tilesX * tilesY;
+    std::atomic<int> tilesDone(0);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int tile = 0; tile < tileCount; tile++)
+    {
+        int x0 = (tile % tilesX) * tile_size;
+        int y0 = (tile / tilesX) * tile_size;
+        int x1 = std::min(x0 + tile_size, settings.image_width);
+        int y1 = std::min(y0 + tile_size, settings.image_height);
+        renderTile(world, cam, background, tileSettings, sampler, x0, y0, x1, y1, firstSample, sampleCount, sums.data(),
+            features ? features->data() : nullptr);
+
+        int done = ++tilesDone;
+        if (showProgress)
+        {
+            #pragma omp critical
+            std::cerr << "\rTiles remaining: " << tileCount - done << ' ' << std::flush;
+        }
+    }
+}
+
+//Renders samples [0, settings.samples_per_pixel) of every pixel to sums in passes of 1, 2, 4... samples (the last
+//one takes the rest), settings.guiding records the light of each pass and is refined after it for the next.
+//Every pass is unbiased, so all are added to sums.
+void renderGuided(const Hittable& world, const Camera& cam, const Color& background, const RenderSettings& settings,
+    std::vector<Color>& sums, bool showProgress = true)
+{
+    sums.assign(size_t(settings.image_width) * settings.image_height, Color(0, 0, 0));
+    int passSamples = 1;
+    for (int firstSample = 0; firstSample < settings.samples_per_pixel; firstSample += passSamples, passSamples *= 2)
+    {
+        int sampleCount = std::min(passSamples, settings.samples_per_pixel - firstSample);
+        renderSamples(world, cam, background, settings, firstSample, sampleCount, sums, showProgress);
+        settings.guiding->refine();
+    }
+}
+
+//8 bit gamma corrected rgb of the average of samples_per_pixel samples
+void toImage(const std::vector<Color>& sums, int samples_per_pixel, unsigned char* image)
+{
+    for (size_t i = 0; i < sums.size(); i++)
+    {
+        Color c = calculate_color(sums[i], samples_per_pixel);
+        image[3 * i] = static_cast<unsigned char>(c.x());
+        image[3 * i + 1] = static_cast<unsigned char>(c.y());
+        image[3 * i + 2] = static_cast<unsigned char>(c.z());
+    }
+}
+
+//renders to an 8 bit rgb image of image_width * image_height pixels
+void renderImage(const Hittable& world, const Camera& cam, const Color& background, const RenderSettings& settings, unsigned char* image)
+{
+    std::vector<Color> sums;
+    renderSamples(world, cam, background, settings, 0, settings.samples_per_pixel, sums);
+    toImage(sums, settings.samples_per_pixel, image);
+}
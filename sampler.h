@@ -0,0 +1,251 @@
+#pragma once
+
+#include "util.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+enum class SampleSequence
+{
+    Random,     //independent uniform samples, what the render loop used to do with rand()
+    Stratified, //jittered grid of samples in every pixel
+    Halton,     //Halton points with a random toroidal shift per pixel
+    Sobol,      //Owen scrambled Sobol points, scrambled differently in every pixel
+    BlueNoise   //R2 lattice points shifted by a blue noise like dither mask over the pixels
+};
+
+inline const char* sampleSequenceName(SampleSequence sequence)
+{
+    switch (sequence)
+    {
+    case SampleSequence::Random: return "random";
+    case SampleSequence::Stratified: return "stratified";
+    case SampleSequence::Halton: return "halton";
+    case SampleSequence::Sobol: return "sobol";
+    case SampleSequence::BlueNoise: return "bluenoise";
+    }
+    return "";
+}
+
+inline bool parseSampleSequence(const char* name, SampleSequence& sequence)
+{
+    for (auto candidate : { SampleSequence::Random, SampleSequence::Stratified, SampleSequence::Halton, SampleSequence::Sobol, SampleSequence::BlueNoise })
+    {
+        if (strcmp(name, sampleSequenceName(candidate)) == 0)
+        {
+            sequence = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+//Sample points of the pixels of an image. Sample index of a pixel gives a 2D point in [0,1)^2 for every dimension
+//(position in the pixel, position on the lens, ...), points are a pure function of pixel, index and dimension so
+//tiles can be generated in any order on any thread.
+class PixelSampler
+{
+    public:
+        enum Dimension
+        {
+            PixelJitter = 0,
+            Lens = 1,
+            Time = 2
+        };
+
+        PixelSampler(SampleSequence sequence_ = SampleSequence::Sobol, int samplesPerPixel_ = 1, uint32_t seed_ = 0)
+            : sequence(sequence_), samplesPerPixel(samplesPerPixel_ > 0 ? samplesPerPixel_ : 1), seed(seed_)
+        {
+            //smallest grid with at least samplesPerPixel cells
+            strataX = static_cast<int>(std::sqrt(static_cast<double>(samplesPerPixel)));
+            strataY = (samplesPerPixel + strataX - 1) / strataX;
+        }
+
+        void sample2D(int x, int y, int index, int dimension, double& u, double& v) const;
+
+        double sample1D(int x, int y, int index, int dimension) const
+        {
+            double u, v;
+            sample2D(x, y, index, dimension, u, v);
+            return u;
+        }
+
+        SampleSequence getSequence() const { return sequence; }
+
+    private:
+        uint32_t pixelHash(int x, int y, int dimension) const
+        {
+            return hash(static_cast<uint32_t>(x) ^ hash(static_cast<uint32_t>(y) ^ hash(static_cast<uint32_t>(dimension) ^ hash(seed))));
+        }
+
+        static uint32_t hash(uint32_t x)
+        {
+            //lowbias32 integer hash
+            x ^= x >> 16;
+            x *= 0x7feb352du;
+            x ^= x >> 15;
+            x *= 0x846ca68bu;
+            x ^= x >> 16;
+            return x;
+        }
+
+        static double toUnit(uint32_t bits)
+        {
+            return std::min(bits * (1. / 4294967296.), 1. - 1e-16);
+        }
+
+        static double fraction(double x)
+        {
+            return x - std::floor(x);
+        }
+
+        static uint32_t reverseBits(uint32_t x)
+        {
+            x = (x << 16) | (x >> 16);
+            x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+            x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+            x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+            x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+            return x;
+        }
+
+        static double radicalInverse(uint32_t base, uint32_t index)
+        {
+            double inverseBase = 1. / base;
+            double factor = inverseBase;
+            double result = 0.;
+            while (index > 0)
+            {
+                result += (index % base) * factor;
+                index /= base;
+                factor *= inverseBase;
+            }
+            return result;
+        }
+
+        //second dimension of the Sobol sequence, the first one is the bit reversed index
+        static uint32_t sobolSecond(uint32_t index)
+        {
+            uint32_t result = 0;
+            for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+            {
+                if (index & 1)
+                    result ^= v;
+            }
+            return result;
+        }
+
+        //Burley's hash based Owen scrambling: a random permutation of every binary subinterval
+        static uint32_t nestedUniformScramble(uint32_t x, uint32_t scrambleSeed)
+        {
+            x = reverseBits(x);
+            x ^= x * 0x3d20adeau;
+            x += scrambleSeed;
+            x *= (scrambleSeed >> 16) | 1;
+            x ^= x * 0x05526c56u;
+            x ^= x * 0x53a22864u;
+            return reverseBits(x);
+        }
+
+        //Kensler's permutation of [0, length) for decorrelating the strata order between dimensions
+        static uint32_t permuteIndex(uint32_t i, uint32_t length, uint32_t permutationSeed)
+        {
+            uint32_t mask = length - 1;
+            mask |= mask >> 1;
+            mask |= mask >> 2;
+            mask |= mask >> 4;
+            mask |= mask >> 8;
+            mask |= mask >> 16;
+            do
+            {
+                i ^= permutationSeed;
+                i *= 0xe170893du;
+                i ^= permutationSeed >> 16;
+                i ^= (i & mask) >> 4;
+                i ^= permutationSeed >> 8;
+                i *= 0x0929eb3fu;
+                i ^= permutationSeed >> 23;
+                i ^= (i & mask) >> 1;
+                i *= 1 | permutationSeed >> 27;
+                i *= 0x6935fa69u;
+                i ^= (i & mask) >> 11;
+                i *= 0x74dcb303u;
+                i ^= (i & mask) >> 2;
+                i *= 0x9e501cc3u;
+                i ^= (i & mask) >> 2;
+                i *= 0xc860a3dfu;
+                i &= mask;
+                i ^= i >> 5;
+            } while (i >= length);
+            return (i + permutationSeed) % length;
+        }
+
+        SampleSequence sequence;
+        int samplesPerPixel;
+        uint32_t seed;
+        int strataX, strataY;
+};
+
+void PixelSampler::sample2D(int x, int y, int index, int dimension, double& u, double& v) const
+{
+    uint32_t pixel = pixelHash(x, y, dimension);
+    uint32_t i = static_cast<uint32_t>(index);
+
+    switch (sequence)
+    {
+    case SampleSequence::Random:
+        u = toUnit(hash(pixel ^ hash(2 * i)));
+        v = toUnit(hash(pixel ^ hash(2 * i + 1)));
+        break;
+
+    case SampleSequence::Stratified:
+    {
+        uint32_t cells = static_cast<uint32_t>(strataX * strataY);
+        uint32_t cell = i % cells;
+        if (dimension != PixelJitter)
+            cell = permuteIndex(cell, cells, pixel);
+        u = (cell % strataX + toUnit(hash(pixel ^ hash(2 * i)))) / strataX;
+        v = (cell / strataX + toUnit(hash(pixel ^ hash(2 * i + 1)))) / strataY;
+        break;
+    }
+
+    case SampleSequence::Halton:
+    {
+        static const uint32_t primes[] = { 2, 3, 5, 7, 11, 13 };
+        int d = (2 * dimension) % 6;
+        u = fraction(radicalInverse(primes[d], i) + toUnit(hash(pixel)));
+        v = fraction(radicalInverse(primes[d + 1], i) + toUnit(hash(pixel + 1)));
+        break;
+    }
+
+    case SampleSequence::Sobol:
+    {
+        //shuffle the order of the points per pixel and dimension, then scramble the points themselves
+        uint32_t shuffled = nestedUniformScramble(i, pixel);
+        u = toUnit(nestedUniformScramble(reverseBits(shuffled), hash(pixel)));
+        v = toUnit(nestedUniformScramble(sobolSecond(shuffled), hash(pixel + 1)));
+        break;
+    }
+
+    case SampleSequence::BlueNoise:
+    {
+        //R2 sequence (Roberts) inside the pixel, toroidally shifted by the R2 dither mask of the pixel
+        const double g = 1.32471795724474602596;
+        const double a1 = 1. / g;
+        const double a2 = 1. / (g * g);
+        //the other dimensions use the same points in a different order, so they don't pair up with the jitter
+        if (dimension != PixelJitter)
+        {
+            uint32_t count = static_cast<uint32_t>(samplesPerPixel);
+            i = permuteIndex(i % count, count, hash(seed + dimension)) + (i / count) * count;
+        }
+        int shiftedX = x + 37 * dimension;
+        int shiftedY = y + 59 * dimension;
+        double mask = fraction(a1 * shiftedX + a2 * shiftedY);
+        u = fraction(0.5 + a1 * i + mask);
+        v = fraction(0.5 + a2 * i + fraction(mask + toUnit(hash(seed + dimension))));
+        break;
+    }
+    }
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include "util.h"
+#include "sphere.h"
+#include "moving_sphere.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "bvh_node.h"
+#include "motion_bvh.h"
+#include "axis_rectangle.h"
+#include "box.h"
+#include "instance.h"
+#include "constant_medium.h"
+#include "grid_medium.h"
+#include "camera.h"
+#include "light_sampler.h"
+
+using std::shared_ptr;
+using std::make_shared;
+
+//the image textures ship with the sources, CMake passes their absolute path so any working directory finds them
+#ifndef RT_TEXTURE_DIR
+#define RT_TEXTURE_DIR "textures"
+#endif
+
+HittableList initial_scene()
+{
+    HittableList world;
+
+    auto checker = make_shared<CheckeredTexture>(Color(0.1, 0.1, 0.1), Color(0.9, 0.9, 0.9));
+    auto material_ground = make_shared<Lambertian>(Color(0.8, 0.8, 0.0));
+    auto material_center = make_shared<Lambertian>(Color(0.1, 0.2, 0.5));
+    auto material_left = make_shared<Dielectric>(1.5);
+    auto material_right = make_shared<Metal>(Color(0.8, 0.6, 0.2), 0.0);
+
+    //world.add(make_shared<Sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
+    world.add(make_shared<Sphere>(Point3(0.0, -100.5, -1.0), 100.0, make_shared<Lambertian>(checker)));
+    world.add(make_shared<Sphere>(Point3(0.0, 0.0, -1.0), 0.5, material_center));
+    world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), 0.5, material_left));
+    world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), -0.45, material_left));
+    world.add(make_shared<Sphere>(Point3(1.0, 0.0, -1.0), 0.5, material_right));
+
+    return world;
+}
+//motionScale scales how far the diffuse spheres move during the shutter interval, motionBvh puts them in a
+//MotionBvhNode instead of a BvhNode of swept boxes
+HittableList rt_one_weekend_scene(double motionScale = 1., bool motionBvh = false) {
+    HittableList world;
+
+    auto ground_material = make_shared<Lambertian>(COLOR_GREY);
+
+    HittableList smallSpheres;
+    for (int a = -11; a < 11; a++) 
+    {
+        for (int b = -11; b < 11; b++) 
+        {
+            auto choose_mat = random_double();
+            Point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+
+            if ((center - Point3(4, 0.2, 0)).length() > 0.9) 
+            {
+                shared_ptr<Material> sphere_material;
+
+                if (choose_mat < 0.8) 
+                {
+                    // diffuse
+                    auto albedo = Color::random() * Color::random();
+                    sphere_material = make_shared<Lambertian>(albedo);
+
+                    auto center2 = center + Vec3(0, random_double(0, .5 * motionScale), 0);
+                    smallSpheres.add(make_shared<MovingSphere>(0.0, 1.0,
+                        center, center2,  0.2, sphere_material));
+                }
+                else if (choose_mat < 0.95) 
+                {
+                    // metal
+                    auto albedo = Color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = make_shared<Metal>(albedo, fuzz);
+                    smallSpheres.add(make_shared<Sphere>(center, 0.2, sphere_material));
+                }
+                else 
+                {
+                    // glass
+                    sphere_material = make_shared<Dielectric>(1.5);
+                    smallSpheres.add(make_shared<Sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+
+    HittableList largeSpheres;
+
+    auto material1 = make_shared<Dielectric>(1.5);
+    auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
+    auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+
+    largeSpheres.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+    largeSpheres.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+    largeSpheres.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+
+    if (motionBvh)
+        world.add(make_shared<MotionBvhNode>(smallSpheres, 0, 1));
+    else
+        world.add(make_shared<BvhNode>(smallSpheres, 0, 1));
+    world.add(make_shared<BvhNode>(largeSpheres, 0, 1));
+    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
+    return world;
+}
+HittableList earth_scene()
+{
+    shared_ptr<Texture> earthTexture = make_shared<ImageTexture>(RT_TEXTURE_DIR "/earthmap.jpg");
+    shared_ptr<Material> earthMaterial = make_shared<Lambertian>(earthTexture);
+    
+    HittableList world;
+    world.add(make_shared<Sphere>(Point3(), 2, earthMaterial));
+    return world;
+}
+HittableList two_perlin_spheres()
+{
+    HittableList world;
+
+    auto marble = make_shared<NoiseTexture>(4, NoisePattern::Marble);
+    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(marble)));
+    world.add(make_shared<Sphere>(Point3(0, 2, 0), 2, make_shared<Lambertian>(marble)));
+    return world;
+}
+HittableList simple_light() 
+{
+    HittableList world;
+
+    auto checker = make_shared<CheckeredTexture>(Color(0.1, 0.1, 0.1), Color(0.9, 0.9, 0.9));
+    auto material_ground = make_shared<Lambertian>(Color(0.8, 0.8, 0.0));
+    world.add(make_shared<Sphere>(Point3(0.0, -100.5, -1.0), 100.0, make_shared<Lambertian>(checker)));
+
+    auto light_material = make_shared<Light>(COLOR_WHITE, 7);
+    auto lambertian_material = make_shared<Lambertian>(COLOR_WHITE);
+
+    world.add(make_shared<Sphere>(Point3(-1.0, 0.0, -1.0), 0.5, lambertian_material));
+    world.add(make_shared<Sphere>(Point3(0.0, 100.0, -1.0), 50, light_material));
+    world.add(make_shared<Sphere>(Point3(1.0, 0.0, -1.0), 0.5, lambertian_material));
+
+
+    world.add(make_shared<Box>(lambertian_material, Point3(-0.2, 0, -1.4), Point3(0.2, 0.4, -1)));
+    
+    return world;
+}
+HittableList cornell_box()
+{
+    HittableList world;
+
+    auto red_material = make_shared<Lambertian>(Color(.65, .05, .05));
+    auto green_material = make_shared<Lambertian>(Color(.12, .45, .15));
+    auto white_material = make_shared<Lambertian>(Color(.73, .73, .73));
+    auto light_material = make_shared<Light>(COLOR_WHITE, 15);
+
+    //add walls
+    world.add(make_shared<Rect_xz>(light_material, 213, 343, 227, 332, 554));
+    world.add(make_shared<Rect_yz>(red_material,   0, 555, 0, 555, 555));
+    world.add(make_shared<Rect_yz>(green_material, 0, 555, 0, 555, 0));
+    world.add(make_shared<Rect_xz>(white_material, 0, 555, 0, 555, 0));
+    world.add(make_shared<Rect_xz>(white_material, 0, 555, 0, 555, 555));
+    world.add(make_shared<Rect_xy>(white_material, 0, 555, 0, 555, 555));
+
+    //Add boxes
+    world.add(make_shared<Box>(white_material, Point3(130, 0, 65), Point3(295, 165, 230)));
+    world.add(make_shared<Box>(white_material, Point3(265, 0, 295), Point3(430, 330, 460)));
+
+    return world;
+}
+HittableList rt_next_week_scene()
+{
+    HittableList boxes1;
+    auto ground = make_shared<Lambertian>(Color(0.48, 0.83, 0.53));
+
+    const int boxes_per_side = 20;
+    for (int i = 0; i < boxes_per_side; i++) {
+        for (int j = 0; j < boxes_per_side; j++) {
+            auto w = 100.0;
+            auto x0 = -1000.0 + i * w;
+            auto z0 = -1000.0 + j * w;
+            auto y0 = 0.0;
+            auto x1 = x0 + w;
+            auto y1 = random_double(1, 101);
+            auto z1 = z0 + w;
+
+            boxes1.add(make_shared<Box>(ground, Point3(x0, y0, z0), Point3(x1, y1, z1)));
+        }
+    }
+
+    HittableList objects;
+
+    objects.add(make_shared<BvhNode>(boxes1, 0, 1));
+
+    auto light = make_shared<Light>(COLOR_WHITE, 7);
+    objects.add(make_shared<Rect_xz>(light, 123, 423, 147, 412, 554));
+
+    auto center1 = Point3(400, 400, 200);
+    auto center2 = center1 + Vec3(30, 0, 0);
+    auto moving_sphere_material = make_shared<Lambertian>(Color(0.7, 0.3, 0.1));
+    objects.add(make_shared<MovingSphere>( 0, 1, center1, center2, 50, moving_sphere_material));
+
+    objects.add(make_shared<Sphere>(Point3(260, 150, 45), 50, make_shared<Dielectric>(1.5)));
+    objects.add(make_shared<Sphere>(Point3(0, 150, 145), 50, make_shared<Metal>(Color(0.8, 0.8, 0.9), 1.0)));
+
+    auto boundary = make_shared<Sphere>(Point3(360, 150, 145), 70, make_shared<Dielectric>(1.5));
+    objects.add(boundary);
+    objects.add(make_shared<ConstantMedium>(boundary, 0.2, Color(0.2, 0.4, 0.9)));
+    boundary = make_shared<Sphere>(Point3(0, 0, 0), 5000, make_shared<Dielectric>(1.5));
+    objects.add(make_shared<ConstantMedium>(boundary, .0001, Color(1, 1, 1)));
+
+    auto emat = make_shared<Lambertian>(make_shared<ImageTexture>(RT_TEXTURE_DIR "/earthmap.jpg"));
+    objects.add(make_shared<Sphere>(Point3(400, 200, 400), 100, emat));
+    auto pertext = make_shared<NoiseTexture>(0.1);
+    objects.add(make_shared<Sphere>(Point3(220, 280, 300), 80, make_shared<Lambertian>(pertext)));
+
+    HittableList boxes2;
+    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
+    //int ns = 1000;
+    int ns = 50;
+    for (int j = 0; j < ns; j++) 
+    {
+        boxes2.add(make_shared<Sphere>(Point3::random(0, 165), 10, white));
+    }
+
+    objects.add(make_shared<Instance>(make_shared<BvhNode>(boxes2, 0.0, 1.0), Transform::translate(Vec3(-100, 270, 395)) * Transform::rotateY(15)));
+    return objects;
+}
+
+//world, background and camera of one of the scenes in the menu of main
+struct SceneDescription
+{
+    HittableList world;
+    Color background = Color(0, 0, 0);
+
+    Point3 cameraPosition = Point3(0, 0, 7);
+    Point3 cameraLookAt = Point3(0, 0, 0);
+    Vec3 cameraUp = Vec3(0, 1, 0);
+    double dist_to_focus = 10.0;
+    double aperture = 0.1;
+    double fieldOfView_deg = 20.;
+    double aspect_ratio = 1.0;// 3.0 / 2.0;
+
+    //emitter index of the world, null when it has no lights to sample
+    shared_ptr<LightSampler> lights;
+
+    Camera camera(double time0 = 0, double time1 = 0) const
+    {
+        return Camera(cameraPosition, cameraLookAt, cameraUp, fieldOfView_deg, aspect_ratio, dist_to_focus, aperture, time0, time1);
+    }
+};
+
+SceneDescription load_scene(int choice)
+{
+    SceneDescription scene;
+
+    switch (choice) 
+    {
+    case 1:
+        scene.world = rt_one_weekend_scene();
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.cameraPosition = Point3(13, 2, 3);
+        scene.cameraLookAt = Point3(0, 0, 0);
+        scene.fieldOfView_deg = 20.0;
+        scene.aperture = 0.1;
+        break;
+
+    case 2:
+        scene.world = initial_scene();
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.cameraPosition = Point3(0, 0, 7);
+        scene.cameraLookAt = Point3(0, 0, 0);
+        scene.fieldOfView_deg = 20.0;
+        scene.aperture = 0.1;
+        break;
+
+    case 3:
+        scene.world = simple_light();
+        scene.background = Color(0.0, 0.0, 0.0);    
+        scene.cameraLookAt = Point3(0, 0, 0);
+        scene.fieldOfView_deg = 20.0;
+        scene.aperture = 0.1;
+        break;
+
+    case 4:
+        scene.world = earth_scene();
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.cameraPosition = Point3(13, 2, 3);
+        scene.cameraLookAt = Point3(0, 0, 0);
+        scene.fieldOfView_deg = 20.0;
+        break;
+
+    case 5:
+        scene.world = cornell_box();
+        scene.background = Color(0.1, 0.1, 0.1); //to add some light 
+        scene.cameraPosition = Point3(278, 278, -800);
+        scene.cameraLookAt = Point3(278, 278, 0);
+        scene.fieldOfView_deg = 40.0;
+        break;
+    case 6:
+        scene.world = rt_next_week_scene();
+        scene.aspect_ratio = 1.0;
+        scene.cameraPosition = Point3(478, 278, -600);
+        scene.cameraLookAt = Point3(278, 278, 0);
+        scene.fieldOfView_deg = 40.0;
+        break;
+    case 7:
+        scene.world = two_perlin_spheres();
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.cameraPosition = Point3(13, 2, 3);
+        scene.cameraLookAt = Point3(0, 0, 0);
+        scene.fieldOfView_deg = 20.0;
+        scene.aperture = 0.0;
+        break;
+
+    default:
+        scene.background = Color(0.0, 0.0, 0.0);
+        break;
+    }
+
+    scene.lights = make_shared<LightSampler>(scene.world);
+    if (scene.lights->emitterCount() == 0)
+        scene.lights = nullptr;
+    return scene;
+}
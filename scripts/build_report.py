@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Builds the benchmark in several configurations, runs the benchmark suite with each and prints the speedup of
+every workload over the first configuration.
+
+    python3 scripts/build_report.py [--configs debug,release,...] [--suite-args "--max-prims 100000"] [-- extra cmake args]
+
+The pgo configuration builds an instrumented binary, trains it on the suite (the six scenes and the core kernels)
+and rebuilds with the recorded profiles.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# name -> cmake cache settings; debug is what a build without a build type used to give
+CONFIGS = {
+    "debug": ["-DCMAKE_BUILD_TYPE=Debug", "-DRT_LTO=OFF", "-DRT_ISA=generic"],
+    "release": ["-DCMAKE_BUILD_TYPE=Release", "-DRT_LTO=OFF", "-DRT_ISA=generic"],
+    "lto": ["-DCMAKE_BUILD_TYPE=Release", "-DRT_LTO=ON", "-DRT_ISA=generic"],
+    "dispatch": ["-DCMAKE_BUILD_TYPE=Release", "-DRT_LTO=ON", "-DRT_ISA=dispatch"],
+    "avx2": ["-DCMAKE_BUILD_TYPE=Release", "-DRT_LTO=ON", "-DRT_ISA=avx2"],
+    "native": ["-DCMAKE_BUILD_TYPE=Release", "-DRT_LTO=ON", "-DRT_ISA=native"],
+    "pgo": ["-DCMAKE_BUILD_TYPE=Release", "-DRT_LTO=ON", "-DRT_ISA=dispatch"],
+}
+
+
+def run(command, cwd=None):
+    print("+ " + " ".join(command), flush=True)
+    subprocess.run(command, cwd=cwd, check=True)
+
+
+def build(build_dir, settings, extra):
+    run(["cmake", "-S", ROOT, "-B", build_dir] + settings + extra)
+    run(["cmake", "--build", build_dir, "--target", "RaytracingBenchmark", "-j", str(os.cpu_count() or 1)])
+    return os.path.join(build_dir, "RaytracingBenchmark")
+
+
+def suite(binary, json_path, label, suite_args, cwd):
+    run([binary, "suite", "--json", json_path, "--label", label] + suite_args, cwd=cwd)
+    with open(json_path) as f:
+        return {r["name"]: r["ns_per_op"] for r in json.load(f)["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--configs", default="debug,release,lto,dispatch,native,pgo")
+    parser.add_argument("--suite-args", default="--max-prims 100000", help="options passed to the suite")
+    parser.add_argument("--build-root", default=os.path.join(ROOT, "_report_build"))
+    parser.add_argument("cmake_args", nargs="*", help="extra cmake arguments, after --")
+    args = parser.parse_args()
+
+    names = args.configs.split(",")
+    unknown = [n for n in names if n not in CONFIGS]
+    if unknown:
+        sys.exit("unknown configurations: " + ", ".join(unknown))
+    suite_args = args.suite_args.split()
+    os.makedirs(args.build_root, exist_ok=True)
+
+    results = {}
+    for name in names:
+        build_dir = os.path.join(args.build_root, name)
+        settings = CONFIGS[name]
+        if name == "pgo":
+            profiles = os.path.join(build_dir, "profiles")
+            shutil.rmtree(profiles, ignore_errors=True)
+            binary = build(build_dir, settings + ["-DRT_PGO=generate", "-DRT_PGO_DIR=" + profiles], args.cmake_args)
+            run([binary, "suite", "--repeats", "1"] + suite_args, cwd=build_dir)
+            profraw = [os.path.join(profiles, f) for f in os.listdir(profiles) if f.endswith(".profraw")]
+            if profraw:  # clang
+                run(["llvm-profdata", "merge", "-o", os.path.join(profiles, "default.profdata")] + profraw)
+            binary = build(build_dir, settings + ["-DRT_PGO=use", "-DRT_PGO_DIR=" + profiles], args.cmake_args)
+        else:
+            binary = build(build_dir, settings, args.cmake_args)
+        results[name] = suite(binary, os.path.join(build_dir, "suite.json"), name, suite_args, build_dir)
+
+    baseline = names[0]
+    workloads = list(results[baseline].keys())
+    print("\nns/op of %s and speedup of the other configurations over it" % baseline)
+    print("%-24s %12s" % ("workload", baseline) + "".join(" %10s" % n for n in names[1:]))
+    for workload in workloads:
+        base = results[baseline][workload]
+        row = "%-24s %12.2f" % (workload, base)
+        for name in names[1:]:
+            value = results[name].get(workload)
+            row += " %9.2fx" % (base / value) if value else " %10s" % "-"
+        print(row)
+
+
+if __name__ == "__main__":
+    main()
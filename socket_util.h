@@ -0,0 +1,122 @@
+#pragma once
+
+//Thin layer over POSIX sockets and Winsock for the preview server and the distributed renderer, localhost TCP only.
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX //windows.h, included by winsock2.h, would otherwise turn std::min and std::max into macros
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+const int sendFlags = 0;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+const int sendFlags = MSG_NOSIGNAL; //a closed peer must not kill the process with SIGPIPE
+#endif
+
+inline bool initSockets()
+{
+#ifdef _WIN32
+    WSADATA wsaData;
+    return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+    return true;
+#endif
+}
+
+//listening socket on 127.0.0.1:port, port 0 picks a free port which is written back
+inline socket_t listenLocal(int& port, int backlog = 16)
+{
+    socket_t listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET)
+        return INVALID_SOCKET;
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<unsigned short>(port));
+    socklen_t length = sizeof(address);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, backlog) != 0
+        || getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+    {
+        closesocket(listener);
+        return INVALID_SOCKET;
+    }
+    port = ntohs(address.sin_port);
+    return listener;
+}
+
+inline socket_t connectTo(const char* host, int port)
+{
+    socket_t s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<unsigned short>(port));
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1 || connect(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+
+    //small messages go out at once instead of waiting for more data
+    int noDelay = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    return s;
+}
+
+inline bool sendAll(socket_t s, const void* data, size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        int n = send(s, bytes, static_cast<int>(size), sendFlags);
+        if (n <= 0)
+            return false;
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+//recv on s fails after ms without data, so a peer stalling in the middle of a message can't block the reader forever
+inline bool setReceiveTimeout(socket_t s, double ms)
+{
+#ifdef _WIN32
+    DWORD timeout = static_cast<DWORD>(ms);
+#else
+    long long microseconds = static_cast<long long>(ms * 1000.);
+    timeval timeout = { static_cast<time_t>(microseconds / 1000000), static_cast<suseconds_t>(microseconds % 1000000) };
+#endif
+    return setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout)) == 0;
+}
+
+//false when the peer closed the connection (or the receive timeout passed) before size bytes arrived
+inline bool recvAll(socket_t s, void* data, size_t size)
+{
+    char* bytes = static_cast<char*>(data);
+    while (size > 0)
+    {
+        int n = recv(s, bytes, static_cast<int>(size), 0);
+        if (n <= 0)
+            return false;
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
@@ -17,6 +17,8 @@ class Sphere : public Hittable
 
         virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
         static void get_uv_coordinates(const Point3 &p, double& u, double& v);
+        //the intersection of hit, for spheres stored without a Sphere object (see paged_scene.h)
+        static bool hitSphere(const Point3& center, double radius, const Material* material, const Ray& r, double t_min, double t_max, HitRecord& rec);
 
         virtual bool boundingBox(double time0, double time1, aabb& output_box) const override;
 
@@ -24,10 +26,17 @@ class Sphere : public Hittable
         Point3 center;
         double radius;
         std::shared_ptr<Material> material;
+
+        friend class LightSampler;
 };
 
 
 bool Sphere::hit(const Ray& r, const double& t_min, const double& t_max, HitRecord& rec) const
+{
+    return hitSphere(center, radius, material.get(), r, t_min, t_max, rec);
+}
+
+bool Sphere::hitSphere(const Point3& center, double radius, const Material* material, const Ray& r, double t_min, double t_max, HitRecord& rec)
 {
     Vec3 oc = r.origin() - center;
     auto a = r.direction().length_squared();
@@ -77,8 +86,9 @@ void Sphere::get_uv_coordinates(const Point3& p, double& u, double& v)
 
 bool Sphere::boundingBox(double time0, double time1, aabb& output_box) const
 {
-    Point3 minimum = center - radius;
-    Point3 maximum = center + radius;;
+    //negative radius is used for hollow glass spheres
+    Point3 minimum = center - fabs(radius);
+    Point3 maximum = center + fabs(radius);
 
     output_box = aabb(minimum, maximum);
 
@@ -2,6 +2,9 @@
 
 #include "util.h"
 #include "vec3.h"
+#include "perlin.h"
+
+#include <algorithm>
 
 using std::shared_ptr;
 using std::make_shared;
@@ -10,6 +13,18 @@ class Texture
 {
     public:
     virtual Color colorValue(double u, double v, const Point3& p) const = 0;
+
+    //colors of count lookups at once, the points given as separate coordinate arrays. Procedural textures
+    //override it with SIMD loops, the default looks up one point after the other.
+    virtual void colorValues(size_t count, const double* u, const double* v, const double* x, const double* y, const double* z, Color* out) const
+    {
+        for (size_t i = 0; i < count; i++)
+            out[i] = colorValue(u[i], v[i], Point3(x[i], y[i], z[i]));
+    }
+
+    protected:
+        //batch overrides work through their lookups in chunks of this many points, with scratch arrays on the stack
+        static constexpr size_t batchChunk = 64;
 };
 
 class SolidColor : public Texture
@@ -28,6 +43,8 @@ class SolidColor : public Texture
             return color_value;
         }
 
+        Color color() const { return color_value; }
+
     private:
         Color color_value;
 };
@@ -45,26 +62,140 @@ class CheckeredTexture : public Texture
         {
             even = even_;
             odd = odd_;
+            auto solidEven = std::dynamic_pointer_cast<SolidColor>(even_);
+            auto solidOdd = std::dynamic_pointer_cast<SolidColor>(odd_);
+            solid = solidEven && solidOdd;
+            if (solid)
+            {
+                evenColor = solidEven->color();
+                oddColor = solidOdd->color();
+            }
         }
 
         CheckeredTexture(Color even_, Color odd_) 
         {
             even = make_shared<SolidColor>(even_);
             odd = make_shared<SolidColor>(odd_);
+            solid = true;
+            evenColor = even_;
+            oddColor = odd_;
         }
 
         virtual Color colorValue(double u, double v, const Point3& p) const override
         {
-            auto sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
-            if (sines < 0)
-                return odd->colorValue(u, v, p);
+            if (isOdd(p.x(), p.y(), p.z()))
+                return solid ? oddColor : odd->colorValue(u, v, p);
             else
-                return even->colorValue(u, v, p);
+                return solid ? evenColor : even->colorValue(u, v, p);
+        }
+
+        virtual void colorValues(size_t count, const double* u, const double* v, const double* x, const double* y, const double* z, Color* out) const override
+        {
+            for (size_t first = 0; first < count; first += batchChunk)
+            {
+                size_t chunk = std::min(batchChunk, count - first);
+                int odds[batchChunk];
+                #pragma omp simd
+                for (size_t i = 0; i < chunk; i++)
+                    odds[i] = isOdd(x[first + i], y[first + i], z[first + i]);
+
+                for (size_t i = 0; i < chunk; i++)
+                {
+                    size_t k = first + i;
+                    if (solid)
+                        out[k] = odds[i] ? oddColor : evenColor;
+                    else
+                        out[k] = odds[i] ? odd->colorValue(u[k], v[k], Point3(x[k], y[k], z[k])) : even->colorValue(u[k], v[k], Point3(x[k], y[k], z[k]));
+                }
+            }
         }
 
     private:
+        //sign of sin(10x)sin(10y)sin(10z) without the sines: sin(10x) is negative where floor(10x/pi) is odd,
+        //so the product is negative where the sum of the three floors is odd
+        static int isOdd(double x, double y, double z)
+        {
+            const double frequency = 10. / pi;
+            long long cells = static_cast<long long>(std::floor(x * frequency)) + static_cast<long long>(std::floor(y * frequency))
+                + static_cast<long long>(std::floor(z * frequency));
+            return static_cast<int>(cells & 1);
+        }
+
         shared_ptr<Texture> even;
         shared_ptr<Texture> odd;
+        bool solid; //both squares are solid colors, read inline
+        Color evenColor, oddColor;
+};
+
+enum class NoisePattern
+{
+    Noise,      //smooth noise mapped to [0,1]
+    Turbulence, //sum of octaves of noise
+    Marble      //sine stripes along z, phase shifted by turbulence
+};
+
+//Grey scale Perlin noise texture of Book 2, scale is the frequency of the pattern
+class NoiseTexture : public Texture
+{
+    public:
+        NoiseTexture(double scale_ = 1., NoisePattern pattern_ = NoisePattern::Marble) : scale(scale_), pattern(pattern_) {}
+
+        virtual Color colorValue(double u, double v, const Point3& p) const override
+        {
+            switch (pattern)
+            {
+            case NoisePattern::Noise:
+                return Color(1, 1, 1) * 0.5 * (1. + noise.noise(scale * p));
+            case NoisePattern::Turbulence:
+                return Color(1, 1, 1) * noise.turbulence(scale * p);
+            default:
+                return Color(1, 1, 1) * 0.5 * (1. + sin(scale * p.z() + 10. * noise.turbulence(p)));
+            }
+        }
+
+        virtual void colorValues(size_t count, const double* u, const double* v, const double* x, const double* y, const double* z, Color* out) const override
+        {
+            for (size_t first = 0; first < count; first += batchChunk)
+            {
+                size_t chunk = std::min(batchChunk, count - first);
+                double values[batchChunk];
+                if (pattern == NoisePattern::Marble)
+                {
+                    noise.turbulence(chunk, x + first, y + first, z + first, values);
+                    #pragma omp simd
+                    for (size_t i = 0; i < chunk; i++)
+                        values[i] = 0.5 * (1. + sin(scale * z[first + i] + 10. * values[i]));
+                }
+                else
+                {
+                    double sx[batchChunk], sy[batchChunk], sz[batchChunk];
+                    #pragma omp simd
+                    for (size_t i = 0; i < chunk; i++)
+                    {
+                        sx[i] = scale * x[first + i];
+                        sy[i] = scale * y[first + i];
+                        sz[i] = scale * z[first + i];
+                    }
+                    if (pattern == NoisePattern::Noise)
+                    {
+                        noise.noise(chunk, sx, sy, sz, values);
+                        #pragma omp simd
+                        for (size_t i = 0; i < chunk; i++)
+                            values[i] = 0.5 * (1. + values[i]);
+                    }
+                    else
+                        noise.turbulence(chunk, sx, sy, sz, values);
+                }
+
+                for (size_t i = 0; i < chunk; i++)
+                    out[first + i] = Color(values[i], values[i], values[i]);
+            }
+        }
+
+    private:
+        Perlin noise;
+        double scale;
+        NoisePattern pattern;
 };
 
 class ImageTexture : public Texture
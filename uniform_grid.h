@@ -0,0 +1,279 @@
+#pragma once
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "ray.h"
+#include "vec3.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using std::shared_ptr;
+using std::vector;
+
+//Uniform grid over the primitives, traversed cell by cell along the ray with a 3D-DDA (Amanatides & Woo). Every
+//cell lists the primitives whose box overlaps it. For nearly uniform scenes (the sphere lattice of Book 1, the
+//box ground of Book 2) it builds in linear time and can trace faster than a BVH.
+//Primitives far larger than the typical one (e.g. a ground sphere of radius 1000) would stretch the grid over
+//mostly empty space, and media sample a new distance on every test, so both are kept out of the cells and tested
+//by every ray instead.
+class UniformGrid : public Hittable
+{
+public:
+    //density is the number of cells per primitive, the resolution per axis follows from it and the bounds
+    UniformGrid(const HittableList& hittableList, double time_0, double time_1, double density = 4.);
+
+    virtual bool hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const override;
+    virtual bool boundingBox(double time0, double time1, aabb& output_box) const override;
+    virtual bool hitUsesRandom() const override { return usesRandom; }
+
+    const int* resolution() const { return cells; }
+    size_t cellCount() const { return static_cast<size_t>(cells[0]) * cells[1] * cells[2]; }
+    size_t referenceCount() const { return cellObjects.size(); }
+    size_t unbinnedCount() const { return unbinned.size(); }
+    aabb gridBounds() const { return aabb(Point3(gridMin[0], gridMin[1], gridMin[2]), Point3(gridMax[0], gridMax[1], gridMax[2])); }
+
+private:
+    //primitives whose box diagonal is this many times the median one aren't put in the cells
+    static constexpr double largeFactor = 16.;
+    static constexpr int maxResolution = 512;
+
+    size_t cellIndex(int x, int y, int z) const { return (static_cast<size_t>(z) * cells[1] + y) * cells[0] + x; }
+    int cellCoordinate(double p, int axis) const
+    {
+        int c = static_cast<int>((p - gridMin[axis]) * invCellSize[axis]);
+        return std::max(0, std::min(cells[axis] - 1, c));
+    }
+
+    vector<shared_ptr<Hittable>> objects;
+    vector<uint32_t> unbinned;    //indices of the primitives every ray tests
+    vector<uint32_t> cellStart;   //first entry of every cell in cellObjects, plus the end
+    vector<uint32_t> cellObjects; //primitive indices, cell after cell
+
+    int cells[3] = { 0, 0, 0 };
+    double gridMin[3] = { 0, 0, 0 }, gridMax[3] = { 0, 0, 0 };
+    double cellSize[3] = { 0, 0, 0 }, invCellSize[3] = { 0, 0, 0 };
+    aabb bBox;
+    bool usesRandom = false;
+};
+
+UniformGrid::UniformGrid(const HittableList& hittableList, double time_0, double time_1, double density) : objects(hittableList.list)
+{
+    size_t count = objects.size();
+    vector<aabb> boxes(count);
+    vector<char> bounded(count);
+    #pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(count); i++)
+        bounded[i] = objects[i]->boundingBox(time_0, time_1, boxes[i]);
+
+    vector<double> diagonals;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (bounded[i])
+            diagonals.push_back(boxes[i].extent().length());
+        usesRandom = usesRandom || objects[i]->hitUsesRandom();
+    }
+    double largeDiagonal = infinity;
+    if (!diagonals.empty())
+    {
+        std::nth_element(diagonals.begin(), diagonals.begin() + diagonals.size() / 2, diagonals.end());
+        largeDiagonal = largeFactor * diagonals[diagonals.size() / 2];
+    }
+
+    vector<uint32_t> binned;
+    aabb gridBox;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (bounded[i])
+            bBox.surround(boxes[i]);
+        bool large = !bounded[i] || (largeDiagonal > 0 && boxes[i].extent().length() > largeDiagonal);
+        if (large || objects[i]->hitUsesRandom())
+        {
+            unbinned.push_back(static_cast<uint32_t>(i));
+        }
+        else
+        {
+            binned.push_back(static_cast<uint32_t>(i));
+            gridBox.surround(boxes[i]);
+        }
+    }
+    if (binned.empty())
+        return;
+
+    //about density cells per primitive, with the cells as close to cubes as the bounds allow. Flat bounds get a
+    //sliver of thickness so the volume isn't 0.
+    Vec3 extent = gridBox.extent();
+    double maxExtent = std::max(extent.x(), std::max(extent.y(), extent.z()));
+    double minThickness = std::max(maxExtent * 1e-3, 1e-9);
+    double volume = 1;
+    for (int a = 0; a < 3; a++)
+    {
+        gridMin[a] = gridBox.minimum()[a];
+        gridMax[a] = std::max(gridBox.maximum()[a], gridMin[a] + minThickness);
+        volume *= gridMax[a] - gridMin[a];
+    }
+    double cellsPerUnit = std::cbrt(density * binned.size() / volume);
+    for (int a = 0; a < 3; a++)
+    {
+        cells[a] = std::max(1, std::min(maxResolution, static_cast<int>(std::round((gridMax[a] - gridMin[a]) * cellsPerUnit))));
+        cellSize[a] = (gridMax[a] - gridMin[a]) / cells[a];
+        invCellSize[a] = 1. / cellSize[a];
+    }
+
+    //cell ranges of the primitives, padded by a fraction of a cell against rounding at the cell walls
+    struct CellRange
+    {
+        int lo[3], hi[3];
+    };
+    vector<CellRange> ranges(binned.size());
+    #pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(binned.size()); i++)
+    {
+        const aabb& box = boxes[binned[i]];
+        for (int a = 0; a < 3; a++)
+        {
+            double pad = 1e-6 * cellSize[a];
+            ranges[i].lo[a] = cellCoordinate(box.minimum()[a] - pad, a);
+            ranges[i].hi[a] = cellCoordinate(box.maximum()[a] + pad, a);
+        }
+    }
+
+    //count the references of every cell, prefix sum to the start offsets, then fill. The fill order within a cell
+    //depends on the thread timing, sorting the cells keeps the order of the tests (and so ties) deterministic.
+    size_t totalCells = cellCount();
+    cellStart.assign(totalCells + 1, 0);
+    for (const CellRange& range : ranges)
+        for (int z = range.lo[2]; z <= range.hi[2]; z++)
+            for (int y = range.lo[1]; y <= range.hi[1]; y++)
+                for (int x = range.lo[0]; x <= range.hi[0]; x++)
+                    cellStart[cellIndex(x, y, z) + 1]++;
+    for (size_t c = 0; c < totalCells; c++)
+        cellStart[c + 1] += cellStart[c];
+
+    cellObjects.resize(cellStart[totalCells]);
+    vector<uint32_t> cursor(cellStart.begin(), cellStart.end() - 1);
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(ranges.size()); i++)
+    {
+        const CellRange& range = ranges[i];
+        for (int z = range.lo[2]; z <= range.hi[2]; z++)
+            for (int y = range.lo[1]; y <= range.hi[1]; y++)
+                for (int x = range.lo[0]; x <= range.hi[0]; x++)
+                {
+                    uint32_t slot;
+                    #pragma omp atomic capture
+                    slot = cursor[cellIndex(x, y, z)]++;
+                    cellObjects[slot] = binned[i];
+                }
+    }
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (std::ptrdiff_t c = 0; c < static_cast<std::ptrdiff_t>(totalCells); c++)
+        std::sort(cellObjects.begin() + cellStart[c], cellObjects.begin() + cellStart[c + 1]);
+}
+
+bool UniformGrid::hit(const Ray& r, const double& min_t, const double& max_t, HitRecord& hitrecord) const
+{
+    double closest = max_t;
+    bool hitAnything = false;
+    for (uint32_t index : unbinned)
+    {
+        if (objects[index]->hit(r, min_t, closest, hitrecord))
+        {
+            hitAnything = true;
+            closest = hitrecord.t;
+        }
+    }
+    if (cellStart.empty())
+        return hitAnything;
+
+    //clip the ray to the grid
+    double origin[3] = { r.origin().x(), r.origin().y(), r.origin().z() };
+    double direction[3] = { r.direction().x(), r.direction().y(), r.direction().z() };
+    double invDirection[3];
+    double t0 = min_t, t1 = closest;
+    for (int a = 0; a < 3; a++)
+    {
+        invDirection[a] = 1. / direction[a];
+        double near = (gridMin[a] - origin[a]) * invDirection[a];
+        double far = (gridMax[a] - origin[a]) * invDirection[a];
+        if (invDirection[a] < 0.)
+            std::swap(near, far);
+        t0 = near > t0 ? near : t0;
+        t1 = far < t1 ? far : t1;
+        if (t1 < t0)
+            return hitAnything;
+    }
+
+    //cell of the entry point, the ray parameter of the next wall on every axis and the step between walls
+    int cell[3], step[3], end[3];
+    double tNext[3], tDelta[3];
+    for (int a = 0; a < 3; a++)
+    {
+        cell[a] = cellCoordinate(origin[a] + t0 * direction[a], a);
+        if (direction[a] > 0)
+        {
+            step[a] = 1;
+            end[a] = cells[a];
+            tNext[a] = (gridMin[a] + (cell[a] + 1) * cellSize[a] - origin[a]) * invDirection[a];
+            tDelta[a] = cellSize[a] * invDirection[a];
+        }
+        else if (direction[a] < 0)
+        {
+            step[a] = -1;
+            end[a] = -1;
+            tNext[a] = (gridMin[a] + cell[a] * cellSize[a] - origin[a]) * invDirection[a];
+            tDelta[a] = -cellSize[a] * invDirection[a];
+        }
+        else
+        {
+            step[a] = 0;
+            end[a] = -1;
+            tNext[a] = infinity;
+            tDelta[a] = infinity;
+        }
+    }
+
+    //primitives spanning several cells are tested once, as long as they don't collide in the mailbox
+    const int mailboxSize = 8;
+    uint32_t mailbox[mailboxSize];
+    std::fill(mailbox, mailbox + mailboxSize, UINT32_MAX);
+
+    while (true)
+    {
+        size_t c = cellIndex(cell[0], cell[1], cell[2]);
+        for (uint32_t k = cellStart[c]; k < cellStart[c + 1]; k++)
+        {
+            uint32_t index = cellObjects[k];
+            if (mailbox[index % mailboxSize] == index)
+                continue;
+            mailbox[index % mailboxSize] = index;
+            if (objects[index]->hit(r, min_t, closest, hitrecord))
+            {
+                hitAnything = true;
+                closest = hitrecord.t;
+            }
+        }
+
+        //a hit before the exit of this cell can't be beaten by the primitives of the cells after it
+        int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+        if (closest <= tNext[axis] || tNext[axis] > t1)
+            break;
+        cell[axis] += step[axis];
+        if (cell[axis] == end[axis])
+            break;
+        tNext[axis] += tDelta[axis];
+    }
+    return hitAnything;
+}
+
+bool UniformGrid::boundingBox(double time0, double time1, aabb& output_box) const
+{
+    output_box = bBox;
+    return !objects.empty();
+}
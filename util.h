@@ -7,6 +7,8 @@
 #include "external/stb-image/stb_image.h"
 #include "external/stb-image/stb_image_write.h"
 #include <math.h>
+#include <atomic>
+#include <cstdint>
 #include <limits>
 #include <memory>
 #include <cstdlib>
@@ -14,6 +16,14 @@
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.14159265358979323846;
 
+//SIMD kernels marked RT_ISA_KERNEL are compiled for AVX-512, AVX2 and SSE4.2 besides the baseline, the best version
+//for the CPU is picked when the program loads (RT_ISA=dispatch in CMake, needs ifunc support: GCC or Clang on Linux)
+#if defined(RT_ISA_DISPATCH) && defined(__x86_64__) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+#define RT_ISA_KERNEL __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+#else
+#define RT_ISA_KERNEL
+#endif
+
 inline double clamp(double x, double minPoint, double maxPoint) {
     if (x < minPoint) return minPoint;
     if (x > maxPoint) return maxPoint;
@@ -30,9 +40,70 @@ inline double radiansToDegree(double radian)
     return 180. * radian / pi;
 }
 
+//adds to an atomic float or double, which has no fetch_add before C++20
+template <typename T>
+inline void atomicAdd(std::atomic<T>& target, T value)
+{
+    T current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+    {
+    }
+}
+
+//Per thread xoshiro256+ generator. random_double() used to call rand(), which is shared by all threads
+//of the render loop, serializes them and can't be seeded per pixel.
+struct RandomState
+{
+    uint64_t s[4];
+};
+
+inline uint64_t splitmix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+inline RandomState& random_state()
+{
+    //every thread starts from a different seed until it is seeded explicitly
+    static std::atomic<uint64_t> threadSeeds{ 0 };
+    static thread_local RandomState state = []()
+    {
+        uint64_t seed = threadSeeds.fetch_add(1);
+        RandomState initial;
+        for (auto& word : initial.s)
+            word = splitmix64(seed);
+        return initial;
+    }();
+    return state;
+}
+
+inline void seed_random(uint64_t seed)
+{
+    RandomState& state = random_state();
+    for (auto& word : state.s)
+        word = splitmix64(seed);
+}
+
+inline uint64_t random_uint64()
+{
+    uint64_t* s = random_state().s;
+    uint64_t result = s[0] + s[3];
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+}
+
 inline double random_double() {
     // Returns a random real in [0,1).
-    return rand() / (RAND_MAX + 1.0);
+    return (random_uint64() >> 11) * (1. / 9007199254740992.);
 }
 
 inline double random_double(double minPoint, double maxPoint) {
@@ -42,5 +113,5 @@ inline double random_double(double minPoint, double maxPoint) {
 
 inline int random_int(int min, int max)
 {
-    return rand() % (max + 1 - min) + min;
-}
\ No newline at end of file
+    return min + static_cast<int>(random_double() * (max + 1 - min));
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "util.h"
+#include <cassert>
 #include <cmath>
 #include <iostream>
 
@@ -163,6 +164,28 @@ Vec3 random_in_unit_disk()
         return p;
     }
 }
+//Shirley-Chiu concentric mapping of a point in [0,1)^2 to the unit disk, keeps the stratification of the input
+inline Vec3 concentric_sample_disk(double u1, double u2)
+{
+    double a = 2. * u1 - 1.;
+    double b = 2. * u2 - 1.;
+    if (a == 0. && b == 0.)
+        return Vec3(0, 0, 0);
+
+    double r, theta;
+    if (a * a > b * b)
+    {
+        r = a;
+        theta = (pi / 4.) * (b / a);
+    }
+    else
+    {
+        r = b;
+        theta = (pi / 2.) - (pi / 4.) * (a / b);
+    }
+    return Vec3(r * cos(theta), r * sin(theta), 0);
+}
+
 Vec3 random_in_unit_sphere()
 {
     /*pick a random point in a unit radius sphere. We’ll use what is usually the easiest algorithm:
@@ -190,6 +213,49 @@ Vec3 random_in_hemisphere(const Vec3& normal)
         return -in_unit_sphere;
 }
 
+//Closed form samplers: one pass, no rejection loop and no data dependent branches. Every call uses exactly two or
+//three random numbers, the rejection versions above throw away ~21% (disk) and ~48% (sphere) of their draws.
+enum class ScatterSampling
+{
+    Rejection,
+    Analytic
+};
+
+//used by the materials and the camera lens, set from the command line to compare images
+inline ScatterSampling scatterSampling = ScatterSampling::Analytic;
+
+inline Vec3 random_unit_vector_analytic()
+{
+    //uniform z and uniform angle around z is uniform on the sphere (Archimedes)
+    double z = 1. - 2. * random_double();
+    double r = std::sqrt(std::fmax(0., 1. - z * z));
+    double phi = 2. * pi * random_double();
+    return Vec3(r * cos(phi), r * sin(phi), z);
+}
+
+inline Vec3 random_in_unit_sphere_analytic()
+{
+    //volume grows with radius cubed
+    return std::cbrt(random_double()) * random_unit_vector_analytic();
+}
+
+inline Vec3 random_in_unit_disk_analytic()
+{
+    double r = std::sqrt(random_double());
+    double phi = 2. * pi * random_double();
+    return Vec3(r * cos(phi), r * sin(phi), 0);
+}
+
+//cosine weighted direction around +z, pdf = cos(theta) / pi
+inline Vec3 random_cosine_direction()
+{
+    double r1 = random_double();
+    double r2 = random_double();
+    double phi = 2. * pi * r1;
+    double sqrt_r2 = std::sqrt(r2);
+    return Vec3(cos(phi) * sqrt_r2, sin(phi) * sqrt_r2, std::sqrt(1. - r2));
+}
+
 Vec3 reflect(const Vec3& v, const Vec3& n) 
 {
     return v - 2 * dot(v, n) * n;